@@ -1,4 +1,20 @@
-import os, glob, platform
+import os, sys, glob, platform, shutil
+
+#optional release variants, any combination: python build_analyzer.py [lto] [pgo] [multiversion]
+#  lto           link-time optimization across all files
+#  pgo           profile-guided optimization (gcc): build an instrumented mbus_decode,
+#                train it on the simulator's standard workload (scenarios/ and corpus/),
+#                then build the plugin and tools with the profile
+#  multiversion  also compile the hot sample kernels for AVX2 and choose at run time
+#                (see MBUS_MULTIVERSION in tools/MBusRawSamples.cpp)
+variants = sys.argv[1:]
+for variant in variants:
+    if variant not in [ "lto", "pgo", "multiversion" ]:
+        print("Unknown variant " + variant + ", expected lto, pgo or multiversion")
+        sys.exit(1)
+if "pgo" in variants and platform.system().lower() == "darwin":
+    print("pgo uses gcc's profile format, which Apple's clang doesn't read")
+    sys.exit(1)
 
 #find out if we're running on mac or linux and set the dynamic library extension
 dylib_ext = ""
@@ -16,6 +32,7 @@ if not os.path.exists( "release" ):
 os.chdir( "release" )
 o_files = glob.glob( "*.o" )
 o_files.extend( glob.glob( "*" + dylib_ext ) )
+o_files.extend( glob.glob( "*.gcda" ) ) #plugin profiles from an earlier pgo build
 for o_file in o_files:
     os.remove( o_file )
 os.chdir( ".." )
@@ -40,10 +57,98 @@ os.chdir( ".." )
 #specify the search paths/dependencies/options for gcc
 include_paths = [ "./AnalyzerSDK/include" ]
 link_paths = [ "./AnalyzerSDK/lib" ]
-link_dependencies = [ "-lAnalyzer" ] #refers to libAnalyzer.dylib or libAnalyzer.so
+link_dependencies = [ "-lAnalyzer", "-lpthread" ] #refers to libAnalyzer.dylib or libAnalyzer.so
 
 debug_compile_flags = "-O0 -w -c -fpic -g"
 release_compile_flags = "-O3 -w -c -fpic"
+release_link_flags = ""
+
+if "lto" in variants:
+    release_compile_flags += " -flto"
+    release_link_flags += "-flto "
+if "multiversion" in variants:
+    release_compile_flags += " -DMBUS_MULTIVERSION"
+
+#headless tools: the decoder and simulator cores build without the SDK
+#(MBUS_HEADLESS). Each tools/mbus_*.cpp is a program, linked with the cores
+#and the shared tools/MBus*.cpp, into release/ and debug/, next to
+#libmbusdecoder
+headless_cpp_files = [ "source/MBusChannel.cpp", "source/MBusDecoder.cpp", "source/MBusSimulator.cpp", "source/MBusTransaction.cpp", "source/MBusTransactionStore.cpp", "source/MBusAddressIndex.cpp", "source/MBusStatistics.cpp", "source/MBusUtilization.cpp", "source/MBusStreamer.cpp", "source/MBusMessage.cpp", "source/MBusJsonWriter.cpp", "source/MBusPcapWriter.cpp", "source/MBusPropagation.cpp", "source/MBusEfficiency.cpp", "source/MBusSegmentFile.cpp", "source/MBusRingSet.cpp" ]
+
+os.chdir( "tools" )
+tool_files = glob.glob( "mbus_*.cpp" )
+for cpp_file in glob.glob( "MBus*.cpp" ):
+    headless_cpp_files.append( "tools/" + cpp_file )
+os.chdir( ".." )
+
+#-fpic so the same objects also make libmbusdecoder, the C interface
+headless_flags = "-std=c++11 -pthread -fpic -DMBUS_HEADLESS -I\"source\" -I\"tools\" "
+
+#compiles the headless cores and tools into <folder>/headless and links each tool into <folder>
+def build_headless( folder, compile_flags, link_flags ):
+    if not os.path.exists( folder + "/headless" ):
+        os.makedirs( folder + "/headless" )
+
+    object_files = ""
+    for cpp_file in headless_cpp_files:
+        object_file = folder + "/headless/" + os.path.basename( cpp_file ).replace( ".cpp", ".o" )
+        command = "g++ " + headless_flags + compile_flags + " -c -o\"" + object_file + "\" \"" + cpp_file + "\""
+        print(command)
+        os.system( command )
+        object_files += "\"" + object_file + "\" "
+
+    for tool_file in tool_files:
+        tool_name = tool_file.replace( ".cpp", "" )
+        object_file = folder + "/headless/" + tool_name + ".o"
+        command = "g++ " + headless_flags + compile_flags + " -c -o\"" + object_file + "\" \"tools/" + tool_file + "\""
+        print(command)
+        os.system( command )
+        command = "g++ -pthread " + link_flags + "-o\"" + folder + "/" + tool_name + "\" " + object_files + "\"" + object_file + "\""
+        print(command)
+        os.system( command )
+
+    #the C interface (tools/MBusCApi.h) as a shared library, for FFI callers
+    library_file = folder + "/libmbusdecoder" + dylib_ext
+    if dylib_ext == ".dylib":
+        command = "g++ -dynamiclib -pthread " + link_flags + "-o\"" + library_file + "\" " + object_files
+    else:
+        command = "g++ -shared -pthread " + link_flags + "-o\"" + library_file + "\" " + object_files
+    print(command)
+    os.system( command )
+
+#profile-guided: the profile is recorded against release/headless/*.o, so the
+#instrumented objects are built where the final ones will be and each .gcda
+#sits next to the object it describes. The plugin shares the decoder and
+#simulator cores, so their profiles are copied next to its objects too.
+if "pgo" in variants:
+    build_headless( "release", release_compile_flags.replace( " -c -fpic", "" ) + " -fprofile-generate", release_link_flags + "-fprofile-generate " )
+
+    for gcda_file in glob.glob( "release/headless/*.gcda" ):
+        os.remove( gcda_file )
+
+    #the standard workload: every scenario on a few ring sizes, then the corpus
+    training = []
+    for scenario in sorted( glob.glob( "scenarios/*.txt" ) ):
+        for node_count in [ "2", "3", "8" ]:
+            training.append( "simulate \"../../" + scenario + "\" -t 5 -n " + node_count )
+    training.append( "check ../../corpus/*.mbe" )
+    training.append( "fuzz -n 4 -i 2000 -f priority,multi-request,error,interject,glitch,stretch,drop-forward" )
+
+    os.chdir( "release/headless" ) #scenarios with an expect line write it to the working folder
+    for arguments in training:
+        command = "../mbus_decode " + arguments + " > " + os.devnull
+        print(command)
+        os.system( command )
+    os.chdir( "../.." )
+
+    for cpp_file in headless_cpp_files:
+        gcda_file = "release/headless/" + os.path.basename( cpp_file ).replace( ".cpp", ".gcda" )
+        if cpp_file.startswith( "source/" ) and os.path.exists( gcda_file ):
+            shutil.copy( gcda_file, "release/" + os.path.basename( gcda_file ) )
+
+    #the plugin's cores see the SDK's types rather than MBUS_HEADLESS's, so
+    #let gcc drop the profile of any function whose shape changed
+    release_compile_flags += " -fprofile-use -fprofile-correction -Wno-error=coverage-mismatch"
 
 #loop through all the cpp files, build up the gcc command line, and attempt to compile each cpp file
 for cpp_file in cpp_files:
@@ -99,10 +204,10 @@ for cpp_file in cpp_files:
 
 #the files to create (.so/.dylib files)
 if dylib_ext == ".dylib":
-    release_command = command + "-o release/lib" + analyzer_name + "Analyzer.dylib "
+    release_command = command + release_link_flags + "-o release/lib" + analyzer_name + "Analyzer.dylib "
     debug_command = command + "-o debug/lib" + analyzer_name + "Analyzer.dylib "
 else:
-    release_command = command + "-o\"release/lib" + analyzer_name + "Analyzer.so\" "
+    release_command = command + release_link_flags + "-o\"release/lib" + analyzer_name + "Analyzer.so\" "
     debug_command = command + "-o\"debug/lib" + analyzer_name + "Analyzer.so\" "
 
 #add all the object files to link
@@ -117,3 +222,8 @@ print(debug_command)
 os.system( debug_command )
 
         
+
+
+#headless tools, with the same release variant as the plugin
+build_headless( "release", release_compile_flags.replace( " -c -fpic", "" ), release_link_flags )
+build_headless( "debug", debug_compile_flags.replace( " -c -fpic", "" ), "" )
@@ -0,0 +1,120 @@
+#include "MBusAddressIndex.h"
+
+#include <cctype>
+#include <cstdlib>
+
+/*
+ * Every indexed transaction is posted twice, once under its prefix and once
+ * under its prefix's functional unit, so "everything to prefix X" and
+ * "everything to X.FU" are both a single list with no filtering. Short and
+ * full prefixes never collide as the address width is part of the key.
+ *
+ * Most lists stay short, so a list's first chunk grows as a vector would and
+ * only stops at MBUS_POSTING_CHUNK; after that each chunk is reserved whole.
+ */
+
+static void SplitAddress( U32 address, U8 address_bits, U32& prefix, U32& functional_unit )
+{
+	// Matches GenerateBubbleText's FrameTypeAddress
+	if (address_bits == 8)
+		prefix = (address >> 4) & 0xf;
+	else
+		prefix = (address >> 4) & 0xfffff;
+	functional_unit = address & 0xf;
+}
+
+bool ParseAddressFilter( const std::string& text, MBusAddressFilter& filter )
+{
+	std::string digits = text;
+	if ((digits.size() > 2) && (digits[0] == '0') && ((digits[1] == 'x') || (digits[1] == 'X')))
+		digits = digits.substr(2);
+
+	if ((digits.size() != 2) && (digits.size() != 8))
+		return false;
+
+	bool any_unit = digits[digits.size() - 1] == '*';
+	if (any_unit)
+		digits[digits.size() - 1] = '0';
+
+	for (size_t i=0; i < digits.size(); i++)
+		if (!isxdigit((unsigned char) digits[i]))
+			return false;
+
+	U32 address = (U32) strtoul(digits.c_str(), NULL, 16);
+	filter.mAddressBits = (digits.size() == 2) ? 8 : 32;
+
+	// 0xF? is the escape to a full address, and full addresses must use it
+	if ((filter.mAddressBits == 8) && ((address & 0xf0) == 0xf0))
+		return false;
+	if ((filter.mAddressBits == 32) && ((address & 0xf0000000) != 0xf0000000))
+		return false;
+
+	U32 functional_unit;
+	SplitAddress(address, filter.mAddressBits, filter.mPrefix, functional_unit);
+	filter.mFunctionalUnit = any_unit ? -1 : (int) functional_unit;
+	return true;
+}
+
+void MBusAddressIndex::PostingList::Add( U64 id )
+{
+	if (mChunks.empty() || (mChunks.back().size() == MBUS_POSTING_CHUNK)) {
+		mChunks.push_back( std::vector< U64 >() );
+		if (mChunks.size() > 1)
+			mChunks.back().reserve( MBUS_POSTING_CHUNK );
+	}
+	mChunks.back().push_back( id );
+}
+
+void MBusAddressIndex::PostingList::AppendTo( std::vector< U64 >& ids ) const
+{
+	for (size_t i=0; i < mChunks.size(); i++)
+		ids.insert( ids.end(), mChunks[i].begin(), mChunks[i].end() );
+}
+
+MBusAddressIndex::MBusAddressIndex()
+{
+}
+
+MBusAddressIndex::~MBusAddressIndex()
+{
+}
+
+void MBusAddressIndex::Add( U64 id, const MBusTransaction& transaction )
+{
+	if (transaction.mAddressBits == 0)
+		return;
+
+	U32 prefix, functional_unit;
+	SplitAddress(transaction.mAddress, transaction.mAddressBits, prefix, functional_unit);
+
+	std::lock_guard< std::mutex > lock( mMutex );
+	Postings& postings = mPrefixes[Key(transaction.mAddressBits, prefix)];
+	postings.mAll.Add(id);
+	postings.mFunctionalUnits[functional_unit].Add(id);
+}
+
+void MBusAddressIndex::Clear()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	mPrefixes.clear();
+}
+
+void MBusAddressIndex::Find( const MBusAddressFilter& filter, std::vector< U64 >& ids )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	std::map< U64, Postings >::const_iterator it = mPrefixes.find(Key(filter.mAddressBits, filter.mPrefix));
+	if (it == mPrefixes.end())
+		return;
+
+	const PostingList& postings = (filter.mFunctionalUnit < 0) ?
+		it->second.mAll : it->second.mFunctionalUnits[filter.mFunctionalUnit & 0xf];
+	postings.AppendTo(ids);
+}
+
+void MBusAddressIndex::GetPrefixes( U8 address_bits, std::vector< U32 >& prefixes )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	std::map< U64, Postings >::const_iterator it = mPrefixes.lower_bound(Key(address_bits, 0));
+	for ( ; (it != mPrefixes.end()) && ((it->first >> 32) == address_bits); ++it)
+		prefixes.push_back((U32) it->first);
+}
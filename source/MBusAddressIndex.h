@@ -0,0 +1,69 @@
+#ifndef MBUS_ADDRESS_INDEX
+#define MBUS_ADDRESS_INDEX
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Ids per posting list chunk once a list is that long, 32 KiB
+#define MBUS_POSTING_CHUNK 4096
+
+// Which addresses a query matches. Addresses split the way the bubbles show
+// them: a 4-bit (short) or 20-bit (full) prefix, then a 4-bit functional
+// unit. Bits 27:24 of a full address are reserved and not matched.
+struct MBusAddressFilter
+{
+	U8 mAddressBits;  // 8 or 32
+	U32 mPrefix;
+	int mFunctionalUnit; // -1 matches any
+};
+
+// Parses "17", "1*", "F00000B7", "F00000B*" (hex, optional 0x); '*' in place
+// of the last digit matches every functional unit of the prefix
+bool ParseAddressFilter( const std::string& text, MBusAddressFilter& filter );
+
+// Address to transaction id posting lists, filled as transactions commit.
+// Ids are those handed out by MBusTransactionStore, so lists stay sorted.
+class MBusAddressIndex
+{
+public:
+	MBusAddressIndex();
+	~MBusAddressIndex();
+
+	// Transactions interjected before their address finished are not indexed
+	void Add( U64 id, const MBusTransaction& transaction );
+	void Clear();
+
+	// Appends the ids of every matching transaction, in commit order
+	void Find( const MBusAddressFilter& filter, std::vector< U64 >& ids );
+
+	// Prefixes seen so far, for listing what the capture holds
+	void GetPrefixes( U8 address_bits, std::vector< U32 >& prefixes );
+
+protected:
+	// Ids in chunks, so a long list grows without being copied and adding
+	// allocates once per MBUS_POSTING_CHUNK ids
+	struct PostingList
+	{
+		void Add( U64 id );
+		void AppendTo( std::vector< U64 >& ids ) const;
+
+		std::vector< std::vector< U64 > > mChunks;
+	};
+	struct Postings
+	{
+		PostingList mAll;
+		PostingList mFunctionalUnits[16];
+	};
+
+	static U64 Key( U8 address_bits, U32 prefix ) { return ((U64)address_bits << 32) | prefix; }
+
+	std::mutex mMutex;
+	std::map< U64, Postings > mPrefixes;
+};
+
+#endif //MBUS_ADDRESS_INDEX
@@ -1,545 +1,220 @@
-#include "MBusAnalyzer.h"
-#include "MBusAnalyzerSettings.h"
-#include <AnalyzerChannelData.h>
-
-#include <exception>
-#include <iostream>
-#include <fstream>
-
-class InterjectedException : public std::exception {
-	virtual const char* what() const throw () {
-		return "Interjection Sequence Occurred";
-	}
-} interjectedException;
-
-MBusAnalyzer::MBusAnalyzer()
-:	Analyzer(),
-	mSettings( new MBusAnalyzerSettings() ),
-	mSimulationInitilized( false )
-{
-	requestBugWorkaround = false;
-	SetAnalyzerSettings( mSettings.get() );
-}
-
-MBusAnalyzer::~MBusAnalyzer()
-{
-	KillThread();
-}
-
-void MBusAnalyzer::WorkerThread()
-{
-	lyz_log_hack.open("MBus_LYZ_log_hack.txt");
-	lyz_log_hack << "LYZ: " << __LINE__ << ": Analyzer thread start" << std::endl;
-	lyz_log_hack.flush();
-
-	mResults.reset( new MBusAnalyzerResults( this, mSettings.get() ) );
-	SetAnalyzerResults( mResults.get() );
-	mResults->AddChannelBubblesWillAppearOn( mSettings->mMasterDATChannel );
-	for (int i=0; i < mSettings->mMemberCount; i++) {
-		mResults->AddChannelBubblesWillAppearOn( mSettings->mMemberDATChannels[i] );
-	}
-
-	mSampleRateHz = GetSampleRate();
-
-	mMasterCLK = GetAnalyzerChannelData( mSettings->mMasterCLKChannel );
-	mMasterDAT = GetAnalyzerChannelData( mSettings->mMasterDATChannel );
-	{
-		mMemberCLKs.resize( mSettings->mMemberCount );
-		mMemberDATs.resize( mSettings->mMemberCount );
-	}
-	for (int i=0; i < mSettings->mMemberCount; i++) {
-		mMemberCLKs.at(i) = GetAnalyzerChannelData( mSettings->mMemberCLKChannels[i] );
-		mMemberDATs.at(i) = GetAnalyzerChannelData( mSettings->mMemberDATChannels[i] );
-	}
-	// For convenience, we alias to a generic list of node w/ master at idx 0
-	{
-		mNodeCLKs.resize( mSettings->mMemberCount + 1 );
-		mNodeDATs.resize( mSettings->mMemberCount + 1 );
-	}
-	mNodeCLKs.at(0) = mMasterCLK;
-	mNodeDATs.at(0) = mMasterDAT;
-	for (int i=1; i < 1+mSettings->mMemberCount; i++) {
-		mNodeCLKs.at(i) = mMemberCLKs.at(i-1);
-		mNodeDATs.at(i) = mMemberDATs.at(i-1);
-	}
-
-	if (( mMasterCLK->GetBitState() == BIT_LOW ) || ( mMasterDAT->GetBitState() == BIT_LOW))
-		;//AnalyzerHelpers::Assert("Master node clock / data lines must be high at time 0. Analyzer does not support starting in the middle of a transaction");
-	for (int i=0; i < mSettings->mMemberCount; i++) {
-		if (( mMemberCLKs.at(i)->GetBitState() == BIT_LOW ) || (mMemberDATs.at(i)->GetBitState() == BIT_LOW))
-			;//AnalyzerHelpers::Assert("Member node clock / data lines must be high at time 0. Analyzer does not support starting in the middle of a transaction");
-	}
-
-	if (mMemberCLKs.size() == 0) {
-		mLastNodeCLK = mMasterCLK;
-		mLastNodeDAT = mMasterDAT;
-	} else {
-		mLastNodeCLK = mMemberCLKs.at(mMemberCLKs.size()-1);
-		mLastNodeDAT = mMemberDATs.at(mMemberDATs.size()-1);
-	}
-
-	while (true) {
-		try {
-			lyz_log_hack << "LYZ: " << __LINE__ << ": Start transaction loop" << std::endl;
-			lyz_log_hack.flush();
-			mEstClockFreq = 0;
-			Process_IdleToArbitration();
-			lyz_log_hack << "IdleToArbitration done" << std::endl;
-			Process_ArbitrationToPriorityArbitration();
-			lyz_log_hack << "ArbToPrioArb done" << std::endl;
-			Process_PriorityArbitrationToAddress();
-			lyz_log_hack << "PrioArbToAddr done" << std::endl;
-			Process_SkipReservedBit();
-			lyz_log_hack << "SkipReservedBit done" << std::endl;
-			Process_AddressToData();
-			lyz_log_hack << "AddrToData done" << std::endl;
-			Process_DataToInterjection();
-			lyz_log_hack << "DataToInt done" << std::endl;
-			Process_InterjectionToControl();
-			lyz_log_hack << "IntToControl done" << std::endl;
-			Process_ControlToIdle();
-			lyz_log_hack << "ControlToIdle done" << std::endl;
-		}
-		catch (InterjectedException) {
-			lyz_log_hack << "LYZ: " << __LINE__ << ": Uncaught Interjection in top loop" << std::endl;
-			lyz_log_hack.flush();
-			try {
-				Process_InterjectionToControl();
-				lyz_log_hack << "IntToControl from unhandled done" << std::endl;
-				Process_ControlToIdle();
-				lyz_log_hack << "ControlToIdle from unhandled done" << std::endl;
-			}
-			catch (InterjectedException) {
-				lyz_log_hack << "LYZ: " << __LINE__ << ": Uncuaght Interjection in interjection catch -- it's all screwed now." << std::endl;
-			}
-		}
-	}
-}
-
-void MBusAnalyzer::AdvanceAllTo(U64 sample) {
-	bool interjected = false;
-
-	for (size_t i=0; i<mNodeCLKs.size(); i++) {
-		mNodeCLKs.at(i)->AdvanceToAbsPosition(sample);
-		if (mNodeDATs.at(i)->AdvanceToAbsPosition(sample) > 3) {
-			// Note that the interjection was seen, but it's still important to advance all the channels,
-			// otherwise, the next AdvanceAll will "detect" an interjection on i+1'th node
-			interjected = true;
-		}
-	}
-
-	if (interjected) {
-		throw interjectedException;
-	}
-}
-
-#include <stdio.h>
-#include <signal.h>
-
-void MBusAnalyzer::Process_IdleToArbitration() {
-	Frame frame;
-	frame.mFlags = 0;
-	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
-
-	// Advance LastNodeCLK channel to end of t_long
-	mLastNodeCLK->AdvanceToNextEdge();
-
-	// VS2012 doesn't support non-constants for array length, annoying but w/e
-	{ // Put into a scope so we don't do anything foolish
-	bool *requested = new bool[ mNodeDATs.size() ];
-	for (size_t i=0; i < mNodeDATs.size(); i++) requested[i] = false;
-
-	U64  *DOUT_Fall = new U64[ mNodeDATs.size() ];
-
-	// First find the sample number when each node's DOUT falls
-	for (size_t i=0; i < mNodeDATs.size(); i++) {
-		/* It is theoretically possible for DOUTs to never fall until
-		 * data transmission, so advancing to the next edge is unsafe.
-		 * Instead we peek to the end of t_long to see if the node is
-		 * participating.
-		 */
-		U64 SamplesTo_t_long = mLastNodeCLK->GetSampleNumber() - mNodeDATs[i]->GetSampleNumber();
-		if (mNodeDATs[i]->WouldAdvancingCauseTransition(SamplesTo_t_long)) {
-			// Node is participating
-			mNodeDATs[i]->AdvanceToNextEdge();
-			DOUT_Fall[i] = mNodeDATs[i]->GetSampleNumber();
-
-			// Handle master node here, if its DOUT ever fell it requested
-			if (i==0)
-				requested[0] = true;
-		} else {
-			// Node is not participating, set a fake fall value past any participants
-			DOUT_Fall[i] = mLastNodeCLK->GetSampleNumber()+1;
-		}
-	}
-	// Now go through each member node. If a node's DOUT falls _before_
-	// the previous node's DOUT fell then this node is requesting.
-	for (size_t i=1; i < mNodeDATs.size(); i++) {
-		if (DOUT_Fall[i] < DOUT_Fall[i-1]) // min i==1, i-1 ref is safe
-			requested[i] = true;
-	}
-
-	AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-	frame.mData1 = 0;
-	for (size_t i=0; i<mNodeDATs.size(); i++) {
-		frame.mData1 |= ((U64) (requested[i])) << (i + 32);
-	}
-	frame.mData2 = 1;
-	frame.mType = FrameTypeRequest;
-
-	// Cleanup after VS2012 fix
-	delete[] requested;
-	delete[] DOUT_Fall;
-	} // end VS2012 scope
-
-	if (requestBugWorkaround) {
-		frame.mFlags |= REQUEST_BUG_WORKAROUND;
-	} else {
-		requestBugWorkaround = true;
-	}
-
-	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
-	mResults->AddFrame(frame);
-	mResults->CommitResults();
-	ReportProgress( mLastNodeCLK->GetSampleNumber() );
-}
-
-void MBusAnalyzer::Process_ArbitrationToPriorityArbitration() {
-	Frame frame;
-	frame.mFlags = 0;
-	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
-
-	// Latch Arbitration
-	mLastNodeCLK->AdvanceToNextEdge();
-	AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-	int arbitrationWinner = -1;
-	if (mMasterDAT->GetBitState() == BIT_LOW)
-		arbitrationWinner = 0;
-	else {
-		for (size_t i=1; i<mNodeDATs.size(); i++) {
-			if (
-					(mNodeDATs.at((i-1)%mNodeDATs.size())->GetBitState() == BIT_HIGH) &&
-					(mNodeDATs.at(i)->GetBitState() == BIT_LOW)
-			   ) {
-				if (arbitrationWinner != -1)
-					frame.mFlags |= MULTIPLE_ARBITRATION_WINNER | DISPLAY_AS_ERROR_FLAG;
-				arbitrationWinner = i;
-			}
-		}
-	}
-	if (arbitrationWinner == -1) {
-		frame.mFlags |= NO_ARBITRATION_WINNER | DISPLAY_AS_WARNING_FLAG;
-	}
-
-	mTransmitter = arbitrationWinner;
-
-	frame.mData1 = 0;
-	for (size_t i=0; i<mNodeDATs.size(); i++) {
-		frame.mData1 |= ((U64) (arbitrationWinner == i)) << (i+32);
-	}
-	frame.mData2 = 1;
-	frame.mType = FrameTypeArbitration;
-
-	// Get to Prio Drive edge before ending this frame
-	mLastNodeCLK->AdvanceToNextEdge();
-	AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
-	mResults->AddFrame(frame);
-	mResults->CommitResults();
-	ReportProgress( mLastNodeCLK->GetSampleNumber() );
-
-	mEstClockFreq = frame.mEndingSampleInclusive - frame.mStartingSampleInclusive;
-}
-
-void MBusAnalyzer::Process_PriorityArbitrationToAddress() {
-	Frame frame;
-	frame.mFlags = 0;
-	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
-
-	// Latch Prio Drive
-	mLastNodeCLK->AdvanceToNextEdge();
-	AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-	if (mTransmitter == -1) {
-		// No arbitration winner => no prio
-		frame.mFlags |= NO_ARBITRATION_WINNER | DISPLAY_AS_WARNING_FLAG;
-	} else {
-		int prioArbitrationWinner = -1;
-		if (mNodeDATs.at(mTransmitter)->GetBitState() == BIT_LOW)
-			prioArbitrationWinner = mTransmitter;
-		else {
-			int start = (mTransmitter+1) % mNodeDATs.size();
-			for (size_t j=start; j<start+mNodeDATs.size()-1; j++) {
-				size_t k = j % mNodeDATs.size();
-				if (
-						(mNodeDATs.at((k-1)%mNodeDATs.size())->GetBitState() == BIT_LOW) &&
-						(mNodeDATs.at(k)->GetBitState() == BIT_HIGH)
-				   ) {
-					if (prioArbitrationWinner != -1)
-						frame.mFlags |= MULTIPLE_ARBITRATION_WINNER | DISPLAY_AS_ERROR_FLAG;
-					prioArbitrationWinner = k;
-				}
-			}
-		}
-		if (prioArbitrationWinner != -1)
-			mTransmitter = prioArbitrationWinner;
-
-		frame.mData1 = 0;
-		for (size_t i=0; i<mNodeDATs.size(); i++) {
-			frame.mData1 |= ((U64) (prioArbitrationWinner == i)) << (i+32);
-		}
-		frame.mData2 = 1;
-	}
-	frame.mType = FrameTypePriorityArbitration;
-
-	// Get to Drive Bit 0 edge before ending this frame
-	mLastNodeCLK->AdvanceToNextEdge();
-	AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
-	mResults->AddFrame(frame);
-	mResults->CommitResults();
-	ReportProgress( mLastNodeCLK->GetSampleNumber() );
-
-	mEstClockFreq = (mEstClockFreq + (frame.mEndingSampleInclusive - frame.mStartingSampleInclusive)) / 2;
-}
-
-void MBusAnalyzer::Process_SkipReservedBit() {
-	Frame frame;
-	frame.mFlags = 0;
-	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
-
-	// Skip a bit
-	mLastNodeCLK->AdvanceToNextEdge();
-	AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-	if (mLastNodeCLK->GetSampleOfNextEdge() > mLastNodeDAT->GetSampleOfNextEdge()) {
-		// An Interjection occurred
-		AdvanceAllTo( mLastNodeDAT->GetSampleOfNextEdge() - 1 );
-	} else {
-		// Normal operation (clk before data)
-		mLastNodeCLK->AdvanceToNextEdge();
-		AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-	}
-
-	frame.mType = FrameTypeReservedBit;
-	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
-	mResults->AddFrame(frame);
-	mResults->CommitResults();
-	ReportProgress( mLastNodeCLK->GetSampleNumber() );
-}
-
-void MBusAnalyzer::Process_AddressToData() {
-	Frame frame;
-	frame.mFlags = 0;
-	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
-
-	U32 address = 0;
-
-	for (int i=0; i < 8; i++) {
-		// Latch Drive Bit N (Address is MSB)
-		mLastNodeCLK->AdvanceToNextEdge();
-		AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-		address <<= 1;
-		address |= mLastNodeDAT->GetBitState() == BIT_HIGH;
-		// Advance to Drive Bit N+1
-		mLastNodeCLK->AdvanceToNextEdge();
-		AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-	}
-
-	if ((address & 0xf0) == 0xf0) {
-		// This is 32-bit addr
-		for (int i=0; i < 24; i++) {
-			// Latch Drive Bit N (Address is MSB)
-			mLastNodeCLK->AdvanceToNextEdge();
-			AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-			address <<= 1;
-			address |= mLastNodeDAT->GetBitState() == BIT_HIGH;
-			// Advance to Drive Bit N+1
-			mLastNodeCLK->AdvanceToNextEdge();
-			AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-		}
-	}
-
-	frame.mData1 = address;
-	frame.mType = FrameTypeAddress;
-
-	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
-	mResults->AddFrame(frame);
-	mResults->CommitResults();
-	ReportProgress( mLastNodeCLK->GetSampleNumber() );
-}
-
-void MBusAnalyzer::Process_DataToInterjection() {
-	bool interjected = false;
-	bool whole_byte = false;
-	do {
-		Frame frame;
-		frame.mFlags = 0;
-		frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
-
-		U8 data = 0;
-		whole_byte = false;
-
-		for (int i=0; i < 8; i++) {
-			// Latch Drive Bit N (Data is MSB, byte-granularity)
-			mLastNodeCLK->AdvanceToNextEdge();
-			try {
-				AdvanceAllTo(mLastNodeCLK->GetSampleNumber());
-			}
-			catch (InterjectedException) {
-				interjected = true;
-				break;
-			}
-			data <<= 1;
-			data |= mLastNodeDAT->GetBitState() == BIT_HIGH;
-
-			// Note the byte is complete here, if we're watching a downstream node, the interjection
-			// will trigger in the next advance (but not yet if we're watching an upstream node)
-			if (i == 7) {
-				whole_byte = true;
-			}
-
-			// Save current point in time in case next transition interjects
-			frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
-
-			// Advance to Drive Bit N+1
-			mLastNodeCLK->AdvanceToNextEdge();
-			try {
-				AdvanceAllTo(mLastNodeCLK->GetSampleNumber());
-			}
-			catch (InterjectedException) {
-				interjected = true;
-				break;
-			}
-		}
-
-		frame.mData1 = data;
-		frame.mType = FrameTypeData;
-		if (interjected) {
-			if (whole_byte) {
-				mResults->AddFrame(frame);
-				mResults->CommitResults();
-			}
-
-			frame.mStartingSampleInclusive = frame.mEndingSampleInclusive + 1;
-			frame.mType = FrameTypeInterjection;
-		}
-
-		frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
-		mResults->AddFrame(frame);
-		mResults->CommitResults();
-		ReportProgress( mLastNodeCLK->GetSampleNumber() );
-	} while (!interjected);
-}
-
-void MBusAnalyzer::Process_InterjectionToControl() {
-	// nop; this is currently subsumed by the DataToInterrupt; FIXME
-}
-
-void MBusAnalyzer::Process_ControlToIdle() {
-	// This currently picks up having processed the drive Begin Control CLK edge
-	//
-	// Silently consume period that should eventually be marked as part of interjection:
-	// Latch Begin Control:
-	mLastNodeCLK->AdvanceToNextEdge();
-	AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-	// Drive Ctrl Bit 0
-	mLastNodeCLK->AdvanceToNextEdge();
-	AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-	// Control Bit 0
-	{
-		Frame frame;
-		frame.mFlags = 0;
-		frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
-
-		// Latch Ctrl Bit 0
-		mLastNodeCLK->AdvanceToNextEdge();
-		AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-		frame.mData1 = mLastNodeDAT->GetBitState() == BIT_HIGH;
-		frame.mType = FrameTypeControlBit0;
-
-		// Extend this bubble up to Drive Ctrl Bit 1
-		mLastNodeCLK->AdvanceToNextEdge();
-		AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-		frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
-		mResults->AddFrame(frame);
-		mResults->CommitResults();
-		ReportProgress( mLastNodeCLK->GetSampleNumber() );
-	}
-
-	// Control Bit 1
-	{
-		Frame frame;
-		frame.mFlags = 0;
-		frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
-
-		// Latch Ctrl Bit 1
-		mLastNodeCLK->AdvanceToNextEdge();
-		AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-		frame.mData1 = mLastNodeDAT->GetBitState() == BIT_HIGH;
-		frame.mType = FrameTypeControlBit1;
-
-		// Extend this bubble up to Drive Begin Idle
-		mLastNodeCLK->AdvanceToNextEdge();
-		AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-
-		frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
-		mResults->AddFrame(frame);
-		mResults->CommitResults();
-		ReportProgress( mLastNodeCLK->GetSampleNumber() );
-	}
-
-	// Silently consume Latch Begin Idle (good enough until we have real Idle solution)
-	mLastNodeCLK->AdvanceToNextEdge();
-	AdvanceAllTo( mLastNodeCLK->GetSampleNumber() );
-}
-
-bool MBusAnalyzer::NeedsRerun()
-{
-	return false;
-}
-
-U32 MBusAnalyzer::GenerateSimulationData( U64 minimum_sample_index, U32 device_sample_rate, SimulationChannelDescriptor** simulation_channels )
-{
-	if( mSimulationInitilized == false )
-	{
-		mSimulationDataGenerator.Initialize( GetSimulationSampleRate(), mSettings.get() );
-		mSimulationInitilized = true;
-	}
-
-	return mSimulationDataGenerator.GenerateSimulationData( minimum_sample_index, device_sample_rate, simulation_channels );
-}
-
-U32 MBusAnalyzer::GetMinimumSampleRateHz()
-{
-	// "Rule of Thumb" is bit rate * 4; current MBus @ 400 kHz
-	return 400e3 * 4;
-}
-
-const char* MBusAnalyzer::GetAnalyzerName() const
-{
-	return "MBus (v0.4.1)";
-}
-
-const char* GetAnalyzerName()
-{
-	return "MBus (v0.4.1)";
-}
-
-Analyzer* CreateAnalyzer()
-{
-	return new MBusAnalyzer();
-}
-
-void DestroyAnalyzer( Analyzer* analyzer )
-{
-	delete analyzer;
-}
+#include "MBusAnalyzer.h"
+#include "MBusAnalyzerSettings.h"
+#include <AnalyzerChannelData.h>
+
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+
+#ifdef WIN32
+#define snprintf _snprintf
+#endif
+
+// Hands one ring's decoder output to Logic, its frames tagged with the ring
+// (see RING_FLAGS_SHIFT). In compact mode the ring set has already made the
+// data bytes of a message a single FrameTypeDataBlock bubble backed by the
+// ring's transaction store rather than one Frame each.
+class MBusResultsSink : public MBusDecoderSink
+{
+public:
+	MBusResultsSink( MBusAnalyzer* analyzer, MBusAnalyzerResults* results, int ring, MBusTransactionStreamer* streamer )
+	:	mAnalyzer( analyzer ),
+		mResults( results ),
+		mRing( ring ),
+		mStreamer( streamer )
+	{
+	}
+
+	virtual void AddFrame( const MBusFrame& mbus_frame ) {
+		Frame frame;
+		frame.mStartingSampleInclusive = mbus_frame.mStartingSampleInclusive;
+		frame.mEndingSampleInclusive = mbus_frame.mEndingSampleInclusive;
+		frame.mData1 = mbus_frame.mData1;
+		frame.mData2 = mbus_frame.mData2;
+		// The store hands out ids as it appends, and this block's message is
+		// appended next. A message the decoder drops leaves its block with
+		// the next one's id, which GenerateBubbleText checks for.
+		if (mbus_frame.mType == FrameTypeDataBlock)
+			frame.mData1 = mResults->GetTransactionStore(mRing)->GetCount();
+		frame.mType = mbus_frame.mType;
+		frame.mFlags = mbus_frame.mFlags | (mRing << RING_FLAGS_SHIFT);
+		mResults->AddFrame(frame);
+	}
+
+	virtual void CommitResults() {
+		mResults->CommitResults();
+	}
+
+	virtual void CommitTransaction( const MBusTransaction& transaction ) {
+		mResults->AddTransaction(mRing, transaction);
+		if (mStreamer)
+			mStreamer->Push(transaction);
+	}
+
+	virtual void ReportProgress( U64 sample_number ) {
+		mAnalyzer->ReportProgress(sample_number);
+	}
+
+private:
+	MBusAnalyzer* mAnalyzer;
+	MBusAnalyzerResults* mResults;
+	int mRing;
+	MBusTransactionStreamer* mStreamer; // NULL unless this is the export ring
+};
+
+MBusAnalyzer::MBusAnalyzer()
+:	Analyzer(),
+	mSettings( new MBusAnalyzerSettings() ),
+	mSimulationInitilized( false )
+{
+	SetAnalyzerSettings( mSettings.get() );
+}
+
+MBusAnalyzer::~MBusAnalyzer()
+{
+	KillThread();
+	mStreamer.Stop();
+}
+
+void MBusAnalyzer::WorkerThread()
+{
+	lyz_log_hack.open("MBus_LYZ_log_hack.txt");
+	lyz_log_hack << "LYZ: " << __LINE__ << ": Analyzer thread start" << std::endl;
+	lyz_log_hack.flush();
+
+	mResults.reset( new MBusAnalyzerResults( this, mSettings.get() ) );
+	SetAnalyzerResults( mResults.get() );
+	mResults->AddChannelBubblesWillAppearOn( mSettings->mMasterDATChannel );
+	for (int i=0; i < mSettings->mMemberCount; i++) {
+		mResults->AddChannelBubblesWillAppearOn( mSettings->mMemberDATChannels[i] );
+	}
+	for (int r=1; r < mSettings->mRingCount; r++) {
+		for (int i=0; i < 1+mSettings->mMemberCount; i++)
+			mResults->AddChannelBubblesWillAppearOn( mSettings->mRingDATChannels[r-1][i] );
+	}
+
+	mSampleRateHz = GetSampleRate();
+	for (int r=0; r < mSettings->mRingCount; r++) {
+		mResults->GetUtilizationTimeline(r)->Initialize( (U64)mSampleRateHz * mSettings->mUtilizationBinUs / 1000000 );
+		mResults->GetPropagationProfile(r)->Initialize( mSettings->mMemberCount + 1 );
+
+		// Rings after the first keep their store next to the first's
+		std::string store_file = mSettings->mStoreFile;
+		if (r && !store_file.empty()) {
+			char suffix[16];
+			snprintf(suffix, sizeof(suffix), ".ring%d", r);
+			store_file += suffix;
+		}
+		if (!store_file.empty() && !mResults->GetTransactionStore(r)->Open( store_file ))
+			lyz_log_hack << "LYZ: " << __LINE__ << ": Could not open " << store_file << ", keeping transactions in memory" << std::endl;
+	}
+
+	mMasterCLK = GetAnalyzerChannelData( mSettings->mMasterCLKChannel );
+	mMasterDAT = GetAnalyzerChannelData( mSettings->mMasterDATChannel );
+	{
+		mMemberCLKs.resize( mSettings->mMemberCount );
+		mMemberDATs.resize( mSettings->mMemberCount );
+	}
+	for (int i=0; i < mSettings->mMemberCount; i++) {
+		mMemberCLKs.at(i) = GetAnalyzerChannelData( mSettings->mMemberCLKChannels[i] );
+		mMemberDATs.at(i) = GetAnalyzerChannelData( mSettings->mMemberDATChannels[i] );
+	}
+	// For convenience, we alias to a generic list of node w/ master at idx 0,
+	// then the same for each further ring
+	int ring_nodes = mSettings->mMemberCount + 1;
+	{
+		mNodeCLKs.resize( ring_nodes * mSettings->mRingCount );
+		mNodeDATs.resize( ring_nodes * mSettings->mRingCount );
+	}
+	mNodeCLKs.at(0).mData = mMasterCLK;
+	mNodeDATs.at(0).mData = mMasterDAT;
+	for (int i=1; i < 1+mSettings->mMemberCount; i++) {
+		mNodeCLKs.at(i).mData = mMemberCLKs.at(i-1);
+		mNodeDATs.at(i).mData = mMemberDATs.at(i-1);
+	}
+	for (int r=1; r < mSettings->mRingCount; r++) {
+		for (int i=0; i < ring_nodes; i++) {
+			mNodeCLKs.at(r * ring_nodes + i).mData = GetAnalyzerChannelData( mSettings->mRingCLKChannels[r-1][i] );
+			mNodeDATs.at(r * ring_nodes + i).mData = GetAnalyzerChannelData( mSettings->mRingDATChannels[r-1][i] );
+		}
+	}
+
+	if (( mMasterCLK->GetBitState() == BIT_LOW ) || ( mMasterDAT->GetBitState() == BIT_LOW))
+		;//AnalyzerHelpers::Assert("Master node clock / data lines must be high at time 0. Analyzer does not support starting in the middle of a transaction");
+	for (int i=0; i < mSettings->mMemberCount; i++) {
+		if (( mMemberCLKs.at(i)->GetBitState() == BIT_LOW ) || (mMemberDATs.at(i)->GetBitState() == BIT_LOW))
+			;//AnalyzerHelpers::Assert("Member node clock / data lines must be high at time 0. Analyzer does not support starting in the middle of a transaction");
+	}
+
+	// Pushing never blocks; the streamer's own thread deals with the consumer
+	if (mSettings->mStreamPath.empty())
+		mStreamer.Stop();
+	else
+		mStreamer.Start( mSettings->mStreamPath );
+
+	std::vector< MBusResultsSink > sinks;
+	for (int r=0; r < mSettings->mRingCount; r++)
+		sinks.push_back( MBusResultsSink( this, mResults.get(), r, (r == (int)mSettings->mExportRing) ? &mStreamer : NULL ) );
+
+	// One pass decodes every ring, see MBusRingSet
+	mRings.Clear();
+	mRings.SetCompactData( mSettings->mCompactStorage );
+	for (int r=0; r < mSettings->mRingCount; r++) {
+		std::vector< MBusChannel * > node_clks;
+		std::vector< MBusChannel * > node_dats;
+		for (int i=0; i < ring_nodes; i++) {
+			node_clks.push_back( &mNodeCLKs.at(r * ring_nodes + i) );
+			node_dats.push_back( &mNodeDATs.at(r * ring_nodes + i) );
+		}
+		mRings.AddRing( node_clks, node_dats, &sinks[r], &lyz_log_hack );
+		// Peeking at every node's CLK on every edge costs about a quarter of the decode
+		if (mSettings->mProfilePropagation)
+			mRings.GetDecoder(r).SetPropagationProfile( mResults->GetPropagationProfile(r) );
+	}
+
+	while (true) {
+		mRings.DecodeWindow();
+	}
+}
+
+bool MBusAnalyzer::NeedsRerun()
+{
+	return false;
+}
+
+U32 MBusAnalyzer::GenerateSimulationData( U64 minimum_sample_index, U32 device_sample_rate, SimulationChannelDescriptor** simulation_channels )
+{
+	if( mSimulationInitilized == false )
+	{
+		mSimulationDataGenerator.Initialize( GetSimulationSampleRate(), mSettings.get() );
+		mSimulationInitilized = true;
+	}
+
+	return mSimulationDataGenerator.GenerateSimulationData( minimum_sample_index, device_sample_rate, simulation_channels );
+}
+
+U32 MBusAnalyzer::GetMinimumSampleRateHz()
+{
+	// "Rule of Thumb" is bit rate * 4; current MBus @ 400 kHz
+	return 400e3 * 4;
+}
+
+const char* MBusAnalyzer::GetAnalyzerName() const
+{
+	return "MBus (v0.4.1)";
+}
+
+const char* GetAnalyzerName()
+{
+	return "MBus (v0.4.1)";
+}
+
+Analyzer* CreateAnalyzer()
+{
+	return new MBusAnalyzer();
+}
+
+void DestroyAnalyzer( Analyzer* analyzer )
+{
+	delete analyzer;
+}
@@ -1,328 +1,540 @@
-#include "MBusAnalyzerResults.h"
-#include <AnalyzerHelpers.h>
-#include "MBusAnalyzer.h"
-#include "MBusAnalyzerSettings.h"
-#include <iostream>
-#include <fstream>
-#include <iomanip>
-
-MBusAnalyzerResults::MBusAnalyzerResults( MBusAnalyzer* analyzer, MBusAnalyzerSettings* settings )
-:	AnalyzerResults(),
-	mSettings( settings ),
-	mAnalyzer( analyzer )
-{
-}
-
-MBusAnalyzerResults::~MBusAnalyzerResults()
-{
-}
-
-int MBusAnalyzerResults::ChannelToIndex(Channel& channel) {
-	if (channel == mSettings->mMasterDATChannel)
-		return 0;
-	for (int i=0; i<mSettings->mMemberCount; i++)
-		if (channel == mSettings->mMemberDATChannels[i])
-			return i+1;
-	AnalyzerHelpers::Assert("Internal Error: Could not find channel index");
-}
-
-void MBusAnalyzerResults::GenerateBubbleText( U64 frame_index, Channel& channel, DisplayBase display_base )
-{
-	ClearResultStrings();
-	Frame frame = GetFrame( frame_index );
-
-	U32 data = (frame.mData1 & (1ULL << (ChannelToIndex( channel ) + 32))) ? frame.mData2 : frame.mData1;
-
-	static bool singleton = false;
-	static std::ofstream outfile;
-	if (!singleton) {
-		outfile.open("MBus_AnalyzerResults.out", std::ios::out | std::ios::trunc);
-		singleton = true;
-	}
-
-	switch( frame.mType ) {
-		case FrameTypeRequest:
-			if (frame.mFlags & REQUEST_BUG_WORKAROUND) {
-				AddResultString("...");
-				AddResultString("Request Phase");
-			} else {
-				if (data) {
-					AddResultString("R");
-					AddResultString("Req");
-					AddResultString("Requested");
-				} else {
-					AddResultString("!R");
-					AddResultString("!Req");
-					AddResultString("Did not Request");
-				}
-			}
-			break;
-		case FrameTypeArbitration:
-			if (frame.mFlags & NO_ARBITRATION_WINNER) {
-				AddResultString("~A");
-				AddResultString("No Arb");
-				AddResultString("No Arbitration Winner");
-			} else if (data) {
-				AddResultString("A");
-				AddResultString("Arb");
-				AddResultString("Won Arbitration");
-			} else {
-				AddResultString("!A");
-				AddResultString("!Arb");
-				AddResultString("Lost Arbitration");
-				AddResultString("Lost Arbitration (Or Did Not Participate)");
-			}
-			break;
-		case FrameTypePriorityArbitration:
-			if (frame.mFlags & NO_ARBITRATION_WINNER) {
-				AddResultString("~P");
-				AddResultString("No Prio");
-				AddResultString("No Priority Arbitration Winner");
-			} else if (data) {
-				AddResultString("P");
-				AddResultString("Pri");
-				AddResultString("Won Priority");
-				AddResultString("Won Priority Arbitration");
-			} else {
-				AddResultString("!P");
-				AddResultString("!Pri");
-				AddResultString("Lost Priority");
-				AddResultString("Lost Priority Arbitration");
-				AddResultString("Lost Priority (Or Did Not Participate)");
-				AddResultString("Lost Priority Arbitration (Or Did Not Participate)");
-			}
-			break;
-		case FrameTypeReservedBit:
-			AddResultString("V");
-			AddResultString("Rsvd");
-			AddResultString("Reserved");
-			break;
-		case FrameTypeAddress:
-			{
-				char number_str[64];
-				int addr_len = ((data & 0xf0000000) == 0xf0000000) ? 32 : 8;
-				AnalyzerHelpers::GetNumberString(data, display_base, addr_len, number_str, 64);
-
-				AddResultString(number_str);
-
-				char prefix_str[64];
-				char fu_str[64];
-				if (addr_len == 8)
-					AnalyzerHelpers::GetNumberString((data >> 4) & 0xf, display_base, 4, prefix_str, 64);
-				else
-					AnalyzerHelpers::GetNumberString((data >> 4) & 0xfffff, display_base, 20, prefix_str, 64);
-				AnalyzerHelpers::GetNumberString(data & 0xf, display_base, 4, fu_str, 64);
-
-				AddResultString(prefix_str, " + ", fu_str);
-				AddResultString("Prefix: ", prefix_str, " F.U. Addr: ", fu_str);
-
-				outfile << "Prefix " << prefix_str << " FU_Addr " << fu_str << std::endl;
-			}
-			break;
-		case FrameTypeData:
-			{
-				char number_str[64];
-				AnalyzerHelpers::GetNumberString(data, display_base, 8, number_str, 64);
-
-				AddResultString(number_str);
-				AddResultString("Data: ", number_str);
-
-				outfile << "Data " << number_str << std::endl;
-			}
-			break;
-		case FrameTypeInterjection:
-			AddResultString("I");
-			AddResultString("Inj");
-			AddResultString("Interjection");
-			break;
-		case FrameTypeControlBit0:
-			mCB0 = data;
-			if (data) {
-				AddResultString("EoM");
-				AddResultString("End of Message");
-				AddResultString("Control Bit 0: End of Message");
-			} else {
-				AddResultString("Err");
-				AddResultString("Control Bit 0: General Error");
-			}
-			break;
-		case FrameTypeControlBit1:
-			if (mCB0) {
-				if (data) {
-					AddResultString("!K");
-					AddResultString("Nak");
-					AddResultString("Control Bit 1: Nak");
-				} else {
-					AddResultString("K");
-					AddResultString("Ack");
-					AddResultString("Control Bit 1: Ack");
-				}
-			} else {
-				if (data) {
-					AddResultString("TX,RX Err");
-					AddResultString("TX or RX Node Error");
-					AddResultString("Control Bit 1: TX or RX Node Error");
-				} else {
-					AddResultString("Int");
-					AddResultString("Interrupted");
-					AddResultString("Control Bit 1: Interrupted");
-				}
-			}
-			break;
-		default:
-			;//AnalyzerHelpers::Assert("Internal Error: Unknown frame type in GenerateBubbleText?");
-	}
-}
-
-void MBusAnalyzerResults::GenerateCSVFile( const char* file, DisplayBase display_base )
-{
-	std::ofstream file_stream( file, std::ios::out );
-
-	U64 trigger_sample = mAnalyzer->GetTriggerSample();
-	U32 sample_rate = mAnalyzer->GetSampleRate();
-
-	file_stream << "Time [s], Addr [in hex], Data [in hex]" << std::endl;
-
-	// Handle picking up in the middle of a transaction by ignoring everything until the first address
-	bool any_frame = false;
-	bool new_frame = true;
-	U64 num_frames = GetNumFrames();
-	U32 i = 0;
-	for( ; i < num_frames; i++ )
-	{
-		Frame frame = GetFrame( i );
-		U32 data = frame.mData1;
-
-		if (!any_frame) {
-			if (frame.mType == FrameTypeAddress) {
-				any_frame = true;
-			} else {
-				continue;
-			}
-		}
-
-		switch (frame.mType) {
-			case FrameTypeAddress:
-				{
-				new_frame = true;
-
-				char time_str[128];
-				AnalyzerHelpers::GetTimeString( frame.mStartingSampleInclusive, trigger_sample, sample_rate, time_str, 128 );
-				file_stream << time_str << ", ";
-
-				char number_str[64];
-				int addr_len = ((data & 0xf0000000) == 0xf0000000) ? 32 : 8;
-				AnalyzerHelpers::GetNumberString(data, display_base, addr_len, number_str, 64);
-				file_stream << number_str << ", ";
-				break;
-				}
-
-			case FrameTypeData:
-				{
-				if (new_frame) {
-					new_frame = false;
-					file_stream << "0x";
-				}
-
-				file_stream << std::hex << std::setw(2) << std::setfill('0') << data;
-				break;
-				}
-
-			case FrameTypeInterjection:
-				file_stream << std::endl;
-		};
-
-		if( UpdateExportProgressAndCheckForCancel( i, num_frames ) == true )
-		{
-			file_stream.close();
-			return;
-		}
-	}
-
-	UpdateExportProgressAndCheckForCancel( i, num_frames );
-	file_stream.close();
-}
-
-void MBusAnalyzerResults::GenerateOutFile(const char* file, DisplayBase display_base)
-{
-	std::ofstream file_stream(file, std::ios::out);
-
-	// Handle picking up in the middle of a transaction by ignoring everything until the first address
-	bool any_frame = false;
-	bool new_frame = true;
-	U64 num_frames = GetNumFrames();
-	U32 i = 0;
-	for ( ; i < num_frames; i++)
-	{
-		Frame frame = GetFrame(i);
-		U32 data = frame.mData1;
-
-		if (!any_frame) {
-			if (frame.mType == FrameTypeAddress) {
-				any_frame = true;
-			}
-			else {
-				continue;
-			}
-		}
-
-		switch (frame.mType) {
-		case FrameTypeAddress:
-		{
-			new_frame = true;
-
-			file_stream << "Address " << std::hex << data << std::endl;
-			break;
-		}
-
-		case FrameTypeData:
-		{
-			file_stream << "Data " << std::hex << (U32)data << std::endl;
-			break;
-		}
-		};
-
-		if (UpdateExportProgressAndCheckForCancel(i, num_frames) == true)
-		{
-			file_stream.close();
-			return;
-		}
-	}
-
-	UpdateExportProgressAndCheckForCancel( i, num_frames );
-	file_stream.close();
-}
-
-void MBusAnalyzerResults::GenerateExportFile(const char* file, DisplayBase display_base, U32 export_type_user_id)
-{
-	// With apologies to the world for using hard-coded #'s here, see MBusAnalzyerSettings::HACK_FILE_TYPE
-	if (export_type_user_id == 0) {
-		GenerateCSVFile(file, display_base);
-	}
-	else if (export_type_user_id == 1) {
-		GenerateOutFile(file, display_base);
-	}
-}
-
-
-void MBusAnalyzerResults::GenerateFrameTabularText( U64 frame_index, DisplayBase display_base )
-{
-	Frame frame = GetFrame( frame_index );
-	ClearResultStrings();
-
-	char number_str[128];
-	AnalyzerHelpers::GetNumberString( frame.mData1, display_base, 8, number_str, 128 );
-	AddResultString( number_str );
-}
-
-void MBusAnalyzerResults::GeneratePacketTabularText( U64 packet_id, DisplayBase display_base )
-{
-	ClearResultStrings();
-	AddResultString( "not supported" );
-}
-
-void MBusAnalyzerResults::GenerateTransactionTabularText( U64 transaction_id, DisplayBase display_base )
-{
-	ClearResultStrings();
-	AddResultString( "not supported" );
-}
+#include "MBusAnalyzerResults.h"
+#include <AnalyzerHelpers.h>
+#include "MBusAnalyzer.h"
+#include "MBusAnalyzerSettings.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdio>
+#include <string>
+
+#ifdef WIN32
+#define snprintf _snprintf
+#endif
+
+MBusAnalyzerResults::MBusAnalyzerResults( MBusAnalyzer* analyzer, MBusAnalyzerSettings* settings )
+:	AnalyzerResults(),
+	mSettings( settings ),
+	mAnalyzer( analyzer )
+{
+}
+
+MBusAnalyzerResults::~MBusAnalyzerResults()
+{
+}
+
+void MBusAnalyzerResults::AddTransaction( int ring, const MBusTransaction& transaction )
+{
+	MBusRingResults& results = mRings[ring];
+	U64 id = results.mTransactionStore.Append( transaction );
+	results.mAddressIndex.Add( id, transaction );
+	results.mStatistics.Add( transaction );
+	results.mEfficiency.Add( transaction );
+	results.mUtilization.Add( transaction );
+}
+
+int MBusAnalyzerResults::ChannelToIndex(int ring, Channel& channel) {
+	if (ring == 0) {
+		if (channel == mSettings->mMasterDATChannel)
+			return 0;
+		for (int i=0; i<mSettings->mMemberCount; i++)
+			if (channel == mSettings->mMemberDATChannels[i])
+				return i+1;
+	} else {
+		for (int i=0; i < 1+mSettings->mMemberCount; i++)
+			if (channel == mSettings->mRingDATChannels[ring-1][i])
+				return i;
+	}
+	return -1;
+}
+
+void MBusAnalyzerResults::GenerateBubbleText( U64 frame_index, Channel& channel, DisplayBase display_base )
+{
+	ClearResultStrings();
+	Frame frame = GetFrame( frame_index );
+
+	// Every ring's frames come by every ring's channels; only draw a frame on its own
+	int ring = (frame.mFlags & RING_FLAGS_MASK) >> RING_FLAGS_SHIFT;
+	int node = ChannelToIndex( ring, channel );
+	if (node < 0)
+		return;
+	MBusRingResults& results = mRings[ring];
+
+	U32 data = (frame.mData1 & (1ULL << (node + 32))) ? frame.mData2 : frame.mData1;
+
+	static bool singleton = false;
+	static std::ofstream outfile;
+	if (!singleton) {
+		outfile.open("MBus_AnalyzerResults.out", std::ios::out | std::ios::trunc);
+		singleton = true;
+	}
+
+	switch( frame.mType ) {
+		case FrameTypeRequest:
+			if (frame.mFlags & REQUEST_BUG_WORKAROUND) {
+				AddResultString("...");
+				AddResultString("Request Phase");
+			} else {
+				if (data) {
+					AddResultString("R");
+					AddResultString("Req");
+					AddResultString("Requested");
+				} else {
+					AddResultString("!R");
+					AddResultString("!Req");
+					AddResultString("Did not Request");
+				}
+			}
+			break;
+		case FrameTypeArbitration:
+			if (frame.mFlags & NO_ARBITRATION_WINNER) {
+				AddResultString("~A");
+				AddResultString("No Arb");
+				AddResultString("No Arbitration Winner");
+			} else if (data) {
+				AddResultString("A");
+				AddResultString("Arb");
+				AddResultString("Won Arbitration");
+			} else {
+				AddResultString("!A");
+				AddResultString("!Arb");
+				AddResultString("Lost Arbitration");
+				AddResultString("Lost Arbitration (Or Did Not Participate)");
+			}
+			break;
+		case FrameTypePriorityArbitration:
+			if (frame.mFlags & NO_ARBITRATION_WINNER) {
+				AddResultString("~P");
+				AddResultString("No Prio");
+				AddResultString("No Priority Arbitration Winner");
+			} else if (data) {
+				AddResultString("P");
+				AddResultString("Pri");
+				AddResultString("Won Priority");
+				AddResultString("Won Priority Arbitration");
+			} else {
+				AddResultString("!P");
+				AddResultString("!Pri");
+				AddResultString("Lost Priority");
+				AddResultString("Lost Priority Arbitration");
+				AddResultString("Lost Priority (Or Did Not Participate)");
+				AddResultString("Lost Priority Arbitration (Or Did Not Participate)");
+			}
+			break;
+		case FrameTypeReservedBit:
+			AddResultString("V");
+			AddResultString("Rsvd");
+			AddResultString("Reserved");
+			break;
+		case FrameTypeAddress:
+			{
+				char number_str[64];
+				int addr_len = ((data & 0xf0000000) == 0xf0000000) ? 32 : 8;
+				AnalyzerHelpers::GetNumberString(data, display_base, addr_len, number_str, 64);
+
+				AddResultString(number_str);
+
+				char prefix_str[64];
+				char fu_str[64];
+				if (addr_len == 8)
+					AnalyzerHelpers::GetNumberString((data >> 4) & 0xf, display_base, 4, prefix_str, 64);
+				else
+					AnalyzerHelpers::GetNumberString((data >> 4) & 0xfffff, display_base, 20, prefix_str, 64);
+				AnalyzerHelpers::GetNumberString(data & 0xf, display_base, 4, fu_str, 64);
+
+				AddResultString(prefix_str, " + ", fu_str);
+				AddResultString("Prefix: ", prefix_str, " F.U. Addr: ", fu_str);
+
+				outfile << "Prefix " << prefix_str << " FU_Addr " << fu_str << std::endl;
+			}
+			break;
+		case FrameTypeData:
+			{
+				char number_str[64];
+				AnalyzerHelpers::GetNumberString(data, display_base, 8, number_str, 64);
+
+				AddResultString(number_str);
+				AddResultString("Data: ", number_str);
+
+				outfile << "Data " << number_str << std::endl;
+			}
+			break;
+		case FrameTypeDataBlock:
+			{
+				// mData1 is the transaction id, mData2 the number of bytes. A
+				// message that never committed has no record of its own.
+				U8 bytes[8];
+				U32 num_bytes = 0;
+				MBusTransactionRecord record;
+				if (results.mTransactionStore.GetRecord(frame.mData1, record) &&
+					(record.mStartingSampleInclusive <= (U64)frame.mStartingSampleInclusive) &&
+					((U64)frame.mEndingSampleInclusive <= record.mEndingSampleInclusive))
+					num_bytes = results.mTransactionStore.GetData(frame.mData1, bytes, sizeof(bytes));
+
+				char count_str[32];
+				snprintf(count_str, sizeof(count_str), "%u B", (U32)frame.mData2);
+				AddResultString(count_str);
+
+				std::string text;
+				for (U32 i=0; i < num_bytes; i++) {
+					char number_str[64];
+					AnalyzerHelpers::GetNumberString(bytes[i], display_base, 8, number_str, 64);
+					if (i)
+						text += " ";
+					text += number_str;
+				}
+				if (frame.mData2 > num_bytes)
+					text += " ...";
+				AddResultString(text.c_str());
+
+				snprintf(count_str, sizeof(count_str), " (%u bytes)", (U32)frame.mData2);
+				AddResultString("Data: ", text.c_str(), count_str);
+			}
+			break;
+		case FrameTypeInterjection:
+			AddResultString("I");
+			AddResultString("Inj");
+			AddResultString("Interjection");
+			break;
+		case FrameTypeControlBit0:
+			results.mCB0 = data;
+			if (data) {
+				AddResultString("EoM");
+				AddResultString("End of Message");
+				AddResultString("Control Bit 0: End of Message");
+			} else {
+				AddResultString("Err");
+				AddResultString("Control Bit 0: General Error");
+			}
+			break;
+		case FrameTypeControlBit1:
+			if (results.mCB0) {
+				if (data) {
+					AddResultString("!K");
+					AddResultString("Nak");
+					AddResultString("Control Bit 1: Nak");
+				} else {
+					AddResultString("K");
+					AddResultString("Ack");
+					AddResultString("Control Bit 1: Ack");
+				}
+			} else {
+				if (data) {
+					AddResultString("TX,RX Err");
+					AddResultString("TX or RX Node Error");
+					AddResultString("Control Bit 1: TX or RX Node Error");
+				} else {
+					AddResultString("Int");
+					AddResultString("Interrupted");
+					AddResultString("Control Bit 1: Interrupted");
+				}
+			}
+			break;
+		default:
+			;//AnalyzerHelpers::Assert("Internal Error: Unknown frame type in GenerateBubbleText?");
+	}
+}
+
+void MBusAnalyzerResults::GetExportTransactions( std::vector< U64 >& ids )
+{
+	// The filter was checked in SetSettingsFromInterfaces; empty exports everything
+	MBusAddressFilter filter;
+	if (ParseAddressFilter( mSettings->mExportFilter, filter )) {
+		ExportRing().mAddressIndex.Find( filter, ids );
+	} else {
+		U64 num_transactions = ExportRing().mTransactionStore.GetCount();
+		ids.resize( num_transactions );
+		for (U64 i=0; i < num_transactions; i++)
+			ids[i] = i;
+	}
+}
+
+void MBusAnalyzerResults::GenerateCSVFile( const char* file, DisplayBase display_base )
+{
+	std::ofstream file_stream( file, std::ios::out );
+
+	U64 trigger_sample = mAnalyzer->GetTriggerSample();
+	U32 sample_rate = mAnalyzer->GetSampleRate();
+
+	file_stream << "Time [s], Addr [in hex], Data [in hex]" << std::endl;
+
+	// Transactions interjected before their address finished have nothing to print
+	std::vector< U64 > ids;
+	GetExportTransactions( ids );
+
+	MBusTransaction transaction;
+	U64 num_transactions = ids.size();
+	U64 i = 0;
+	for( ; i < num_transactions; i++ )
+	{
+		ExportRing().mTransactionStore.GetTransaction( ids[i], transaction );
+
+		if (transaction.mAddressBits != 0) {
+			char time_str[128];
+			AnalyzerHelpers::GetTimeString( transaction.mAddressSample, trigger_sample, sample_rate, time_str, 128 );
+			file_stream << time_str << ", ";
+
+			char number_str[64];
+			AnalyzerHelpers::GetNumberString(transaction.mAddress, display_base, transaction.mAddressBits, number_str, 64);
+			file_stream << number_str << ", ";
+
+			if (!transaction.mData.empty())
+				file_stream << "0x";
+			for (size_t j=0; j < transaction.mData.size(); j++)
+				file_stream << std::hex << std::setw(2) << std::setfill('0') << (U32)transaction.mData[j];
+
+			file_stream << std::endl;
+		}
+
+		if( UpdateExportProgressAndCheckForCancel( i, num_transactions ) == true )
+		{
+			file_stream.close();
+			return;
+		}
+	}
+
+	UpdateExportProgressAndCheckForCancel( i, num_transactions );
+	file_stream.close();
+}
+
+void MBusAnalyzerResults::GenerateOutFile(const char* file, DisplayBase display_base)
+{
+	std::ofstream file_stream(file, std::ios::out);
+
+	std::vector< U64 > ids;
+	GetExportTransactions(ids);
+
+	MBusTransaction transaction;
+	U64 num_transactions = ids.size();
+	U64 i = 0;
+	for ( ; i < num_transactions; i++)
+	{
+		ExportRing().mTransactionStore.GetTransaction(ids[i], transaction);
+
+		if (transaction.mAddressBits != 0) {
+			file_stream << "Address " << std::hex << transaction.mAddress << std::endl;
+			for (size_t j=0; j < transaction.mData.size(); j++)
+				file_stream << "Data " << std::hex << (U32)transaction.mData[j] << std::endl;
+		}
+
+		if (UpdateExportProgressAndCheckForCancel(i, num_transactions) == true)
+		{
+			file_stream.close();
+			return;
+		}
+	}
+
+	UpdateExportProgressAndCheckForCancel( i, num_transactions );
+	file_stream.close();
+}
+
+void MBusAnalyzerResults::GenerateSummaryFile(const char* file)
+{
+	// Aggregated as transactions committed, nothing left to walk
+	std::ofstream file_stream(file, std::ios::out);
+	WriteStatisticsSummary(file_stream, ExportRing().mStatistics, mAnalyzer->GetSampleRate());
+	UpdateExportProgressAndCheckForCancel(1, 1);
+	file_stream.close();
+}
+
+void MBusAnalyzerResults::GenerateUtilizationFile(const char* file)
+{
+	std::ofstream file_stream(file, std::ios::out);
+	WriteUtilizationTimeline(file_stream, ExportRing().mUtilization, mAnalyzer->GetSampleRate());
+	UpdateExportProgressAndCheckForCancel(1, 1);
+	file_stream.close();
+}
+
+void MBusAnalyzerResults::GenerateMessagesFile(const char* file)
+{
+	std::ofstream file_stream(file, std::ios::out);
+	WriteMessagesHeader(file_stream);
+
+	U32 sample_rate = mAnalyzer->GetSampleRate();
+	std::vector< U64 > ids;
+	GetExportTransactions(ids);
+
+	MBusTransaction transaction;
+	std::vector< MBusMessage > messages;
+	std::vector< char > line;
+	U64 num_transactions = ids.size();
+	U64 i = 0;
+	for ( ; i < num_transactions; i++)
+	{
+		ExportRing().mTransactionStore.GetTransaction(ids[i], transaction);
+
+		messages.clear();
+		DecodeMessages(transaction, messages);
+		for (size_t j=0; j < messages.size(); j++) {
+			line.clear();
+			FormatMessageLine(line, messages[j], sample_rate);
+			line.push_back('\n');
+			file_stream.write(&line[0], line.size());
+		}
+
+		if (UpdateExportProgressAndCheckForCancel(i, num_transactions) == true)
+		{
+			file_stream.close();
+			return;
+		}
+	}
+
+	UpdateExportProgressAndCheckForCancel( i, num_transactions );
+	file_stream.close();
+}
+
+void MBusAnalyzerResults::GenerateJsonFile(const char* file)
+{
+	MBusJsonWriter writer;
+	if (!writer.Open(file))
+		return;
+	writer.SetTiming(mAnalyzer->GetSampleRate(), mAnalyzer->GetTriggerSample());
+
+	// Unlike the csv, wakeups and early interjections are kept, with a null address
+	std::vector< U64 > ids;
+	GetExportTransactions(ids);
+
+	MBusTransaction transaction;
+	U64 num_transactions = ids.size();
+	U64 i = 0;
+	for ( ; i < num_transactions; i++)
+	{
+		ExportRing().mTransactionStore.GetTransaction(ids[i], transaction);
+		writer.Write(transaction);
+
+		if (UpdateExportProgressAndCheckForCancel(i, num_transactions) == true)
+		{
+			writer.Close();
+			return;
+		}
+	}
+
+	UpdateExportProgressAndCheckForCancel( i, num_transactions );
+	writer.Close();
+}
+
+void MBusAnalyzerResults::GeneratePcapFile(const char* file)
+{
+	MBusPcapWriter writer;
+	if (!writer.Open(file, mAnalyzer->GetSampleRate()))
+		return;
+
+	std::vector< U64 > ids;
+	GetExportTransactions(ids);
+
+	MBusTransaction transaction;
+	U64 num_transactions = ids.size();
+	U64 i = 0;
+	for ( ; i < num_transactions; i++)
+	{
+		ExportRing().mTransactionStore.GetTransaction(ids[i], transaction);
+		writer.Write(transaction);
+
+		if (UpdateExportProgressAndCheckForCancel(i, num_transactions) == true)
+		{
+			writer.Close();
+			return;
+		}
+	}
+
+	UpdateExportProgressAndCheckForCancel( i, num_transactions );
+	writer.Close();
+}
+
+void MBusAnalyzerResults::GeneratePropagationFile(const char* file)
+{
+	std::ofstream file_stream(file, std::ios::out);
+	if (!mSettings->mProfilePropagation)
+		file_stream << "# Nothing measured: turn on \"Profile Ring Propagation\" and decode again\n";
+	WritePropagationProfile(file_stream, ExportRing().mPropagation, mAnalyzer->GetSampleRate());
+	UpdateExportProgressAndCheckForCancel(1, 1);
+	file_stream.close();
+}
+
+void MBusAnalyzerResults::GenerateEfficiencyFile(const char* file)
+{
+	// The totals were kept as transactions committed; only the per
+	// transaction rows walk the store, with the clock measured over them all
+	std::ofstream file_stream(file, std::ios::out);
+	U32 sample_rate = mAnalyzer->GetSampleRate();
+	WriteEfficiencySummary(file_stream, ExportRing().mEfficiency, sample_rate);
+	file_stream << std::endl;
+	WriteEfficiencyHeader(file_stream);
+
+	double samples_per_cycle = ExportRing().mEfficiency.GetSamplesPerCycle();
+	std::vector< U64 > ids;
+	GetExportTransactions(ids);
+
+	MBusTransaction transaction;
+	U64 num_transactions = ids.size();
+	U64 i = 0;
+	for ( ; i < num_transactions; i++)
+	{
+		ExportRing().mTransactionStore.GetTransaction(ids[i], transaction);
+		WriteEfficiencyLine(file_stream, transaction, samples_per_cycle, sample_rate);
+
+		if (UpdateExportProgressAndCheckForCancel(i, num_transactions) == true)
+		{
+			file_stream.close();
+			return;
+		}
+	}
+
+	UpdateExportProgressAndCheckForCancel( i, num_transactions );
+	file_stream.close();
+}
+
+void MBusAnalyzerResults::GenerateExportFile(const char* file, DisplayBase display_base, U32 export_type_user_id)
+{
+	// With apologies to the world for using hard-coded #'s here, see MBusAnalzyerSettings::HACK_FILE_TYPE
+	if (export_type_user_id == 0) {
+		GenerateCSVFile(file, display_base);
+	}
+	else if (export_type_user_id == 1) {
+		GenerateOutFile(file, display_base);
+	}
+	else if (export_type_user_id == 2) {
+		GenerateSummaryFile(file);
+	}
+	else if (export_type_user_id == 3) {
+		GenerateUtilizationFile(file);
+	}
+	else if (export_type_user_id == 4) {
+		GenerateMessagesFile(file);
+	}
+	else if (export_type_user_id == 5) {
+		GenerateJsonFile(file);
+	}
+	else if (export_type_user_id == 6) {
+		GeneratePcapFile(file);
+	}
+	else if (export_type_user_id == 7) {
+		GeneratePropagationFile(file);
+	}
+	else if (export_type_user_id == 8) {
+		GenerateEfficiencyFile(file);
+	}
+}
+
+
+void MBusAnalyzerResults::GenerateFrameTabularText( U64 frame_index, DisplayBase display_base )
+{
+	Frame frame = GetFrame( frame_index );
+	ClearResultStrings();
+
+	char number_str[128];
+	AnalyzerHelpers::GetNumberString( frame.mData1, display_base, 8, number_str, 128 );
+	AddResultString( number_str );
+}
+
+void MBusAnalyzerResults::GeneratePacketTabularText( U64 packet_id, DisplayBase display_base )
+{
+	ClearResultStrings();
+	AddResultString( "not supported" );
+}
+
+void MBusAnalyzerResults::GenerateTransactionTabularText( U64 transaction_id, DisplayBase display_base )
+{
+	ClearResultStrings();
+	AddResultString( "not supported" );
+}
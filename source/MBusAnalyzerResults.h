@@ -1,52 +1,80 @@
-#ifndef MBUS_ANALYZER_RESULTS
-#define MBUS_ANALYZER_RESULTS
-
-#include <AnalyzerResults.h>
-
-enum MBusFrameType {
-	FrameTypeRequest,
-	FrameTypeArbitration,
-	FrameTypePriorityArbitration,
-	FrameTypeReservedBit,
-	FrameTypeAddress,
-	FrameTypeData,
-	FrameTypeInterjection,
-	FrameTypeControlBit0,
-	FrameTypeControlBit1,
-};
-
-#define MULTIPLE_ARBITRATION_WINNER (1 << 0)
-#define NO_ARBITRATION_WINNER		(1 << 1)
-#define REQUEST_BUG_WORKAROUND      (1 << 2)
-
-class MBusAnalyzer;
-class MBusAnalyzerSettings;
-
-class MBusAnalyzerResults : public AnalyzerResults
-{
-public:
-	MBusAnalyzerResults( MBusAnalyzer* analyzer, MBusAnalyzerSettings* settings );
-	virtual ~MBusAnalyzerResults();
-
-	virtual void GenerateBubbleText( U64 frame_index, Channel& channel, DisplayBase display_base );
-	virtual void GenerateExportFile( const char* file, DisplayBase display_base, U32 export_type_user_id );
-
-	virtual void GenerateFrameTabularText(U64 frame_index, DisplayBase display_base );
-	virtual void GeneratePacketTabularText( U64 packet_id, DisplayBase display_base );
-	virtual void GenerateTransactionTabularText( U64 transaction_id, DisplayBase display_base );
-
-protected: //functions
-
-protected:  //vars
-	MBusAnalyzerSettings* mSettings;
-	MBusAnalyzer* mAnalyzer;
-
-private:
-	int ChannelToIndex(Channel& channel);
-	bool mCB0;
-
-	void GenerateCSVFile(const char* file, DisplayBase display_base);
-	void GenerateOutFile(const char* file, DisplayBase display_base);
-};
-
-#endif //MBUS_ANALYZER_RESULTS
+#ifndef MBUS_ANALYZER_RESULTS
+#define MBUS_ANALYZER_RESULTS
+
+#include <AnalyzerResults.h>
+#include "MBusTransaction.h"
+#include "MBusTransactionStore.h"
+#include "MBusAddressIndex.h"
+#include "MBusStatistics.h"
+#include "MBusEfficiency.h"
+#include "MBusUtilization.h"
+#include "MBusPropagation.h"
+#include "MBusMessage.h"
+#include "MBusJsonWriter.h"
+#include "MBusPcapWriter.h"
+#include "MBusAnalyzerSettings.h"
+
+class MBusAnalyzer;
+
+// A frame's ring, with more than one decoded: bits 3-4 of mFlags, between
+// the decoder's own flags and the SDK's display flags
+#define RING_FLAGS_SHIFT 3
+#define RING_FLAGS_MASK (3 << RING_FLAGS_SHIFT)
+
+// Everything the results keep for one ring
+struct MBusRingResults
+{
+	MBusTransactionStore mTransactionStore;
+	MBusAddressIndex mAddressIndex;
+	MBusStatistics mStatistics;
+	MBusEfficiency mEfficiency;
+	MBusUtilizationTimeline mUtilization;
+	MBusPropagationProfile mPropagation;
+	bool mCB0; // the last control bit 0 drawn, for control bit 1's bubble
+};
+
+class MBusAnalyzerResults : public AnalyzerResults
+{
+public:
+	MBusAnalyzerResults( MBusAnalyzer* analyzer, MBusAnalyzerSettings* settings );
+	virtual ~MBusAnalyzerResults();
+
+	virtual void GenerateBubbleText( U64 frame_index, Channel& channel, DisplayBase display_base );
+	virtual void GenerateExportFile( const char* file, DisplayBase display_base, U32 export_type_user_id );
+
+	virtual void GenerateFrameTabularText(U64 frame_index, DisplayBase display_base );
+	virtual void GeneratePacketTabularText( U64 packet_id, DisplayBase display_base );
+	virtual void GenerateTransactionTabularText( U64 transaction_id, DisplayBase display_base );
+
+	// Every transaction ring decoded; exports and FrameTypeDataBlock bubbles read from here
+	MBusTransactionStore* GetTransactionStore( int ring ) { return &mRings[ring].mTransactionStore; }
+	void AddTransaction( int ring, const MBusTransaction& transaction );
+	MBusUtilizationTimeline* GetUtilizationTimeline( int ring ) { return &mRings[ring].mUtilization; }
+	MBusPropagationProfile* GetPropagationProfile( int ring ) { return &mRings[ring].mPropagation; }
+
+protected: //functions
+
+protected:  //vars
+	MBusAnalyzerSettings* mSettings;
+	MBusAnalyzer* mAnalyzer;
+	MBusRingResults mRings[MAX_MBUS_RINGS];
+
+private:
+	// The channel's node in ring, -1 if it is not one of ring's
+	int ChannelToIndex(int ring, Channel& channel);
+	// The ring the exports write
+	MBusRingResults& ExportRing() { return mRings[mSettings->mExportRing]; }
+
+	void GetExportTransactions(std::vector< U64 >& ids);
+	void GenerateCSVFile(const char* file, DisplayBase display_base);
+	void GenerateOutFile(const char* file, DisplayBase display_base);
+	void GenerateSummaryFile(const char* file);
+	void GenerateUtilizationFile(const char* file);
+	void GenerateMessagesFile(const char* file);
+	void GenerateJsonFile(const char* file);
+	void GeneratePcapFile(const char* file);
+	void GeneratePropagationFile(const char* file);
+	void GenerateEfficiencyFile(const char* file);
+};
+
+#endif //MBUS_ANALYZER_RESULTS
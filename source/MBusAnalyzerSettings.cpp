@@ -1,220 +1,483 @@
-#include "MBusAnalyzerSettings.h"
-#include <AnalyzerHelpers.h>
-
-#include <cassert>
-#include <cstdio>
-
-#ifdef WIN32
-#define snprintf _snprintf
-#endif
-
-MBusAnalyzerSettings::MBusAnalyzerSettings()
-:	mMasterCLKChannel( UNDEFINED_CHANNEL ),
-	mMasterDATChannel( UNDEFINED_CHANNEL ),
-	mMemberCount( 0 )
-{
-	log_hack.open("MBusAnalyzerLogHack.txt");
-	log_hack << "LOG HACK BEGIN\n\n";
-	log_hack.flush();
-
-	mMasterCLKChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
-	mMasterCLKChannelInterface->SetTitleAndTooltip( "Master CLK", "Connect to CLK_OUT of Mediator" );
-	mMasterCLKChannelInterface->SetChannel( mMasterCLKChannel );
-	mMasterCLKChannelInterface->SetSelectionOfNoneIsAllowed(false);
-
-	mMasterDATChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
-	mMasterDATChannelInterface->SetTitleAndTooltip( "Master DAT", "Connect to DAT_OUT of Mediator" );
-	mMasterDATChannelInterface->SetChannel( mMasterDATChannel );
-	mMasterDATChannelInterface->SetSelectionOfNoneIsAllowed(false);
-
-	AddInterface( mMasterCLKChannelInterface.get() );
-	AddInterface( mMasterDATChannelInterface.get() );
-
-	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
-		char title[32];
-
-#ifdef FUCK_THIS
-		static_assert(MAX_MBUS_MEMBERS == 1, "Fuck this");
-		mMemberActive[i] = true;
-		mMemberActiveInterface[i].reset( new AnalyzerSettingInterfaceBool() );
-		snprintf(title, 32, "Member %d Enabled", i);
-		mMemberActiveInterface[i]->SetTitleAndTooltip( title, "Enable / Disable this Member Node");
-		mMemberActiveInterface[i]->SetValue(mMemberActive[i]);
-#else
-		mMemberActive[i] = false;
-		mMemberActiveInterface[i].reset( new AnalyzerSettingInterfaceBool() );
-		snprintf(title, 32, "Member %d Enabled", i);
-		mMemberActiveInterface[i]->SetTitleAndTooltip( title, "Enable / Disable this Member Node");
-		mMemberActiveInterface[i]->SetValue(mMemberActive[i]);
-#endif
-
-		mMemberCLKChannels[i] = UNDEFINED_CHANNEL;
-		mMemberCLKChannelsInterface[i].reset( new AnalyzerSettingInterfaceChannel() );
-		snprintf(title, 32, "Member %d CLK\n", i);
-		mMemberCLKChannelsInterface[i]->SetTitleAndTooltip( title, "Connect to CLK_OUT of Member Node");
-		mMemberCLKChannelsInterface[i]->SetChannel(mMemberCLKChannels[i]);
-		mMemberCLKChannelsInterface[i]->SetSelectionOfNoneIsAllowed(true);
-
-		mMemberDATChannels[i] = UNDEFINED_CHANNEL;
-		mMemberDATChannelsInterface[i].reset( new AnalyzerSettingInterfaceChannel() );
-		snprintf(title, 32, "Member %d DAT\n", i);
-		mMemberDATChannelsInterface[i]->SetTitleAndTooltip( title, "Connect to DAT_OUT of Member Node");
-		mMemberDATChannelsInterface[i]->SetChannel(mMemberDATChannels[i]);
-		mMemberDATChannelsInterface[i]->SetSelectionOfNoneIsAllowed(true);
-
-		AddInterface( mMemberActiveInterface[i].get() );
-		AddInterface( mMemberCLKChannelsInterface[i].get() );
-		AddInterface( mMemberDATChannelsInterface[i].get() );
-	}
-
-	// With apologies to the world for using hard-coded #'s here, see MBusAnalyzerResults::HACK_FILE_TYPE
-	AddExportOption( 0, "Export as text/csv file" );
-	AddExportExtension( 0, "text", "txt" );
-	AddExportExtension( 0, "csv", "csv" );
-
-	AddExportOption(1, "Export as .out format");
-	AddExportExtension(1, "Custom format created by the old MBus_analyzer.out hack", "out");
-}
-
-MBusAnalyzerSettings::~MBusAnalyzerSettings()
-{
-}
-
-bool MBusAnalyzerSettings::SetSettingsFromInterfaces()
-{
-	static_assert(MAX_MBUS_NODES == (MAX_MBUS_MEMBERS + 1), "Bad MAX_MBUS #defines");
-
-	int     MemberCount;
-	bool    NodeActive[MAX_MBUS_NODES];
-	Channel _NodeChannels[MAX_MBUS_NODES * 2]; // Need uniform array for overlap API
-	Channel* NodeCLKChannels = _NodeChannels;
-	Channel* NodeDATChannels = _NodeChannels + MAX_MBUS_NODES;
-
-	NodeActive[0] = true;
-	NodeCLKChannels[0] = mMasterCLKChannelInterface->GetChannel();
-	NodeDATChannels[0] = mMasterDATChannelInterface->GetChannel();
-
-	if (NodeCLKChannels[0] == UNDEFINED_CHANNEL) {
-		SetErrorText("Master CLK Channel is required");
-		return false;
-	} else if (NodeDATChannels[0] == UNDEFINED_CHANNEL) {
-		SetErrorText("Master DAT Channel is required");
-		return false;
-	}
-
-	bool found_inactive = false;
-	MemberCount = 0;
-	for (int i=1; i < MAX_MBUS_NODES; i++) {
-		NodeActive[i] = mMemberActiveInterface[i-1]->GetValue();
-		NodeCLKChannels[i] = mMemberCLKChannelsInterface[i-1]->GetChannel();
-		NodeDATChannels[i] = mMemberDATChannelsInterface[i-1]->GetChannel();
-
-		if (NodeActive[i] && found_inactive) {
-			SetErrorText("All active members must be sequential (no gaps; weakness of my analyzer, sorry)");
-			return false;
-		} else if (NodeActive[i]) {
-			MemberCount++;
-		} else {
-			found_inactive = true;
-		}
-
-		if (NodeActive[i] && (NodeCLKChannels[i] == UNDEFINED_CHANNEL)) {
-			SetErrorText("Active member nodes must all have CLK defined.");
-			return false;
-		}
-		if (NodeActive[i] && (NodeDATChannels[i] == UNDEFINED_CHANNEL)) {
-			SetErrorText("Active member nodes must all have DAT defined");
-			return false;
-		}
-	}
-
-	if (AnalyzerHelpers::DoChannelsOverlap(_NodeChannels, MAX_MBUS_NODES * 2)) {
-		SetErrorText("All active channels must be unique");
-		return false;
-	}
-
-	ClearChannels();
-
-	mMemberCount = MemberCount;
-	mMasterCLKChannel = NodeCLKChannels[0];
-	mMasterDATChannel = NodeDATChannels[0];
-
-	AddChannel( mMasterCLKChannel, "MBus Master CLK", true);
-	AddChannel( mMasterDATChannel, "MBus Master DAT", true);
-
-	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
-		mMemberActive[i] = NodeActive[i+1];
-		mMemberCLKChannels[i] = NodeCLKChannels[i+1];
-		mMemberDATChannels[i] = NodeDATChannels[i+1];
-
-		if (mMemberActive[i] != true) {
-			log_hack << "SET: Member at index " << i << " is inactive." << std::endl;
-			break;
-		}
-
-		AddChannel( mMemberCLKChannels[i], "MBus Member CLK", mMemberActive[i] );
-		AddChannel( mMemberDATChannels[i], "MBus Member DAT", mMemberActive[i] );
-	}
-
-	return true;
-}
-
-void MBusAnalyzerSettings::UpdateInterfacesFromSettings()
-{
-	mMasterCLKChannelInterface->SetChannel( mMasterCLKChannel );
-	mMasterDATChannelInterface->SetChannel( mMasterDATChannel );
-
-	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
-		mMemberActiveInterface[i]->SetValue( mMemberActive[i] );
-		mMemberCLKChannelsInterface[i]->SetChannel( mMemberCLKChannels[i] );
-		mMemberDATChannelsInterface[i]->SetChannel( mMemberDATChannels[i] );
-	}
-}
-
-void MBusAnalyzerSettings::LoadSettings( const char* settings )
-{
-	SimpleArchive text_archive;
-	text_archive.SetString( settings );
-
-	text_archive >> mMasterCLKChannel;
-	text_archive >> mMasterDATChannel;
-	text_archive >> mMemberCount;
-	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
-		text_archive >> mMemberActive[i];
-		text_archive >> mMemberCLKChannels[i];
-		text_archive >> mMemberDATChannels[i];
-	}
-
-	ClearChannels();
-	AddChannel( mMasterCLKChannel, "MBus Master CLK", true );
-	AddChannel( mMasterDATChannel, "MBus Master DAT", true );
-	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
-#ifdef FUCK_THIS
-		if (mMemberActive[i] != true) {
-			log_hack << "SET: " << __LINE__ << ": Unexpected inactive member " << i << std::endl;
-			AnalyzerHelpers::Assert("How the fuck did this happen?");
-		}
-#endif
-		AddChannel( mMemberCLKChannels[i], "MBus Member CLK", mMemberActive[i] );
-		AddChannel( mMemberDATChannels[i], "MBus Member DAT", mMemberActive[i] );
-	}
-
-	UpdateInterfacesFromSettings();
-}
-
-const char* MBusAnalyzerSettings::SaveSettings()
-{
-	SimpleArchive text_archive;
-
-	text_archive << mMasterCLKChannel;
-	text_archive << mMasterDATChannel;
-	text_archive << mMemberCount;
-
-	for (int i=0; i<mMemberCount; i++) {
-		text_archive << mMemberActive[i];
-		text_archive << mMemberCLKChannels[i];
-		text_archive << mMemberDATChannels[i];
-	}
-
-	return SetReturnString( text_archive.GetString() );
-}
+#include "MBusAnalyzerSettings.h"
+#include "MBusAddressIndex.h"
+#include <AnalyzerHelpers.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+#ifdef WIN32
+#define snprintf _snprintf
+#endif
+
+MBusAnalyzerSettings::MBusAnalyzerSettings()
+:	mMasterCLKChannel( UNDEFINED_CHANNEL ),
+	mMasterDATChannel( UNDEFINED_CHANNEL ),
+	mMemberCount( 0 ),
+	mRingCount( 1 ),
+	mExportRing( 0 ),
+	mCompactStorage( false ),
+	mUtilizationBinUs( 10000 ),
+	mProfilePropagation( false )
+{
+	log_hack.open("MBusAnalyzerLogHack.txt");
+	log_hack << "LOG HACK BEGIN\n\n";
+	log_hack.flush();
+
+	mMasterCLKChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
+	mMasterCLKChannelInterface->SetTitleAndTooltip( "Master CLK", "Connect to CLK_OUT of Mediator" );
+	mMasterCLKChannelInterface->SetChannel( mMasterCLKChannel );
+	mMasterCLKChannelInterface->SetSelectionOfNoneIsAllowed(false);
+
+	mMasterDATChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
+	mMasterDATChannelInterface->SetTitleAndTooltip( "Master DAT", "Connect to DAT_OUT of Mediator" );
+	mMasterDATChannelInterface->SetChannel( mMasterDATChannel );
+	mMasterDATChannelInterface->SetSelectionOfNoneIsAllowed(false);
+
+	AddInterface( mMasterCLKChannelInterface.get() );
+	AddInterface( mMasterDATChannelInterface.get() );
+
+	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
+		char title[32];
+
+#ifdef FUCK_THIS
+		static_assert(MAX_MBUS_MEMBERS == 1, "Fuck this");
+		mMemberActive[i] = true;
+		mMemberActiveInterface[i].reset( new AnalyzerSettingInterfaceBool() );
+		snprintf(title, 32, "Member %d Enabled", i);
+		mMemberActiveInterface[i]->SetTitleAndTooltip( title, "Enable / Disable this Member Node");
+		mMemberActiveInterface[i]->SetValue(mMemberActive[i]);
+#else
+		mMemberActive[i] = false;
+		mMemberActiveInterface[i].reset( new AnalyzerSettingInterfaceBool() );
+		snprintf(title, 32, "Member %d Enabled", i);
+		mMemberActiveInterface[i]->SetTitleAndTooltip( title, "Enable / Disable this Member Node");
+		mMemberActiveInterface[i]->SetValue(mMemberActive[i]);
+#endif
+
+		mMemberCLKChannels[i] = UNDEFINED_CHANNEL;
+		mMemberCLKChannelsInterface[i].reset( new AnalyzerSettingInterfaceChannel() );
+		snprintf(title, 32, "Member %d CLK\n", i);
+		mMemberCLKChannelsInterface[i]->SetTitleAndTooltip( title, "Connect to CLK_OUT of Member Node");
+		mMemberCLKChannelsInterface[i]->SetChannel(mMemberCLKChannels[i]);
+		mMemberCLKChannelsInterface[i]->SetSelectionOfNoneIsAllowed(true);
+
+		mMemberDATChannels[i] = UNDEFINED_CHANNEL;
+		mMemberDATChannelsInterface[i].reset( new AnalyzerSettingInterfaceChannel() );
+		snprintf(title, 32, "Member %d DAT\n", i);
+		mMemberDATChannelsInterface[i]->SetTitleAndTooltip( title, "Connect to DAT_OUT of Member Node");
+		mMemberDATChannelsInterface[i]->SetChannel(mMemberDATChannels[i]);
+		mMemberDATChannelsInterface[i]->SetSelectionOfNoneIsAllowed(true);
+
+		AddInterface( mMemberActiveInterface[i].get() );
+		AddInterface( mMemberCLKChannelsInterface[i].get() );
+		AddInterface( mMemberDATChannelsInterface[i].get() );
+	}
+
+	for (int r=0; r < MAX_MBUS_RINGS - 1; r++) {
+		for (int i=0; i < MAX_MBUS_NODES; i++) {
+			char title[32];
+
+			mRingCLKChannels[r][i] = UNDEFINED_CHANNEL;
+			mRingCLKChannelsInterface[r][i].reset( new AnalyzerSettingInterfaceChannel() );
+			if (i == 0)
+				snprintf(title, 32, "Ring %d Master CLK", r+1);
+			else
+				snprintf(title, 32, "Ring %d Member %d CLK", r+1, i-1);
+			mRingCLKChannelsInterface[r][i]->SetTitleAndTooltip( title, "Connect to CLK_OUT of this node of another ring on the same probe; leave the ring's Master CLK unset to not decode it" );
+			mRingCLKChannelsInterface[r][i]->SetChannel(mRingCLKChannels[r][i]);
+			mRingCLKChannelsInterface[r][i]->SetSelectionOfNoneIsAllowed(true);
+
+			mRingDATChannels[r][i] = UNDEFINED_CHANNEL;
+			mRingDATChannelsInterface[r][i].reset( new AnalyzerSettingInterfaceChannel() );
+			if (i == 0)
+				snprintf(title, 32, "Ring %d Master DAT", r+1);
+			else
+				snprintf(title, 32, "Ring %d Member %d DAT", r+1, i-1);
+			mRingDATChannelsInterface[r][i]->SetTitleAndTooltip( title, "Connect to DAT_OUT of this node of another ring on the same probe" );
+			mRingDATChannelsInterface[r][i]->SetChannel(mRingDATChannels[r][i]);
+			mRingDATChannelsInterface[r][i]->SetSelectionOfNoneIsAllowed(true);
+
+			AddInterface( mRingCLKChannelsInterface[r][i].get() );
+			AddInterface( mRingDATChannelsInterface[r][i].get() );
+		}
+	}
+
+	mScenarioFileInterface.reset( new AnalyzerSettingInterfaceText() );
+	mScenarioFileInterface->SetTitleAndTooltip( "Simulation Scenario", "Optional traffic scenario file for the simulator (empty uses the built-in script)" );
+	mScenarioFileInterface->SetTextType( AnalyzerSettingInterfaceText::FilePath );
+	mScenarioFileInterface->SetText( mScenarioFile.c_str() );
+
+	AddInterface( mScenarioFileInterface.get() );
+
+	mCompactStorageInterface.reset( new AnalyzerSettingInterfaceBool() );
+	mCompactStorageInterface->SetTitleAndTooltip( "Compact Data Storage", "Show the payload as one bubble per message instead of one frame per byte; uses far less memory on long captures" );
+	mCompactStorageInterface->SetValue( mCompactStorage );
+
+	AddInterface( mCompactStorageInterface.get() );
+
+	mExportFilterInterface.reset( new AnalyzerSettingInterfaceText() );
+	mExportFilterInterface->SetTitleAndTooltip( "Export Address Filter", "Only export messages to this address, e.g. 17, 1* (any F.U. of prefix 1) or F00000B*; empty exports everything" );
+	mExportFilterInterface->SetText( mExportFilter.c_str() );
+
+	AddInterface( mExportFilterInterface.get() );
+
+	mUtilizationBinInterface.reset( new AnalyzerSettingInterfaceInteger() );
+	mUtilizationBinInterface->SetTitleAndTooltip( "Utilization Bin [us]", "Finest resolution of the bus utilization timeline export; coarser levels are 4x, 16x, ... this" );
+	mUtilizationBinInterface->SetMin( 1 );
+	mUtilizationBinInterface->SetMax( 60000000 );
+	mUtilizationBinInterface->SetInteger( mUtilizationBinUs );
+
+	AddInterface( mUtilizationBinInterface.get() );
+
+	mStreamPathInterface.reset( new AnalyzerSettingInterfaceText() );
+	mStreamPathInterface->SetTitleAndTooltip( "Live Stream Socket", "Optional Unix socket (or \\\\.\\pipe\\name on Windows) that receives each transaction as it is decoded" );
+	mStreamPathInterface->SetText( mStreamPath.c_str() );
+
+	AddInterface( mStreamPathInterface.get() );
+
+	mStoreFileInterface.reset( new AnalyzerSettingInterfaceText() );
+	mStoreFileInterface->SetTitleAndTooltip( "Transaction Store File", "Optional file to keep decoded transactions in instead of memory, for captures too long to hold; emptied on every run. Pair with Compact Data Storage" );
+	mStoreFileInterface->SetText( mStoreFile.c_str() );
+
+	AddInterface( mStoreFileInterface.get() );
+
+	mExportRingInterface.reset( new AnalyzerSettingInterfaceInteger() );
+	mExportRingInterface->SetTitleAndTooltip( "Export Ring", "Ring whose transactions the exports and live stream carry, 0 for the first (Master/Member channels above)" );
+	mExportRingInterface->SetMin( 0 );
+	mExportRingInterface->SetMax( MAX_MBUS_RINGS - 1 );
+	mExportRingInterface->SetInteger( mExportRing );
+
+	AddInterface( mExportRingInterface.get() );
+
+	mProfilePropagationInterface.reset( new AnalyzerSettingInterfaceBool() );
+	mProfilePropagationInterface->SetTitleAndTooltip( "Profile Ring Propagation", "Measure how long each CLK edge takes from node to node, for the propagation export; slows decoding by about a quarter" );
+	mProfilePropagationInterface->SetValue( mProfilePropagation );
+
+	AddInterface( mProfilePropagationInterface.get() );
+
+	// With apologies to the world for using hard-coded #'s here, see MBusAnalyzerResults::HACK_FILE_TYPE
+	AddExportOption( 0, "Export as text/csv file" );
+	AddExportExtension( 0, "text", "txt" );
+	AddExportExtension( 0, "csv", "csv" );
+
+	AddExportOption(1, "Export as .out format");
+	AddExportExtension(1, "Custom format created by the old MBus_analyzer.out hack", "out");
+
+	AddExportOption(2, "Export traffic summary per address and sender");
+	AddExportExtension(2, "csv", "csv");
+
+	AddExportOption(3, "Export bus utilization timeline");
+	AddExportExtension(3, "csv", "csv");
+
+	AddExportOption(4, "Export decoded messages (register, memory, broadcast)");
+	AddExportExtension(4, "csv", "csv");
+
+	AddExportOption(5, "Export transactions as JSON Lines");
+	AddExportExtension(5, "jsonl", "jsonl");
+
+	AddExportOption(6, "Export transactions as pcap (LINKTYPE_USER0)");
+	AddExportExtension(6, "pcap", "pcap");
+
+	AddExportOption(7, "Export ring propagation delays per hop");
+	AddExportExtension(7, "csv", "csv");
+
+	AddExportOption(8, "Export protocol efficiency (cycles per phase, goodput)");
+	AddExportExtension(8, "csv", "csv");
+}
+
+MBusAnalyzerSettings::~MBusAnalyzerSettings()
+{
+}
+
+bool MBusAnalyzerSettings::SetSettingsFromInterfaces()
+{
+	static_assert(MAX_MBUS_NODES == (MAX_MBUS_MEMBERS + 1), "Bad MAX_MBUS #defines");
+
+	int     MemberCount;
+	bool    NodeActive[MAX_MBUS_NODES];
+	Channel _NodeChannels[MAX_MBUS_NODES * 2]; // Need uniform array for overlap API
+	Channel* NodeCLKChannels = _NodeChannels;
+	Channel* NodeDATChannels = _NodeChannels + MAX_MBUS_NODES;
+
+	NodeActive[0] = true;
+	NodeCLKChannels[0] = mMasterCLKChannelInterface->GetChannel();
+	NodeDATChannels[0] = mMasterDATChannelInterface->GetChannel();
+
+	if (NodeCLKChannels[0] == UNDEFINED_CHANNEL) {
+		SetErrorText("Master CLK Channel is required");
+		return false;
+	} else if (NodeDATChannels[0] == UNDEFINED_CHANNEL) {
+		SetErrorText("Master DAT Channel is required");
+		return false;
+	}
+
+	bool found_inactive = false;
+	MemberCount = 0;
+	for (int i=1; i < MAX_MBUS_NODES; i++) {
+		NodeActive[i] = mMemberActiveInterface[i-1]->GetValue();
+		NodeCLKChannels[i] = mMemberCLKChannelsInterface[i-1]->GetChannel();
+		NodeDATChannels[i] = mMemberDATChannelsInterface[i-1]->GetChannel();
+
+		if (NodeActive[i] && found_inactive) {
+			SetErrorText("All active members must be sequential (no gaps; weakness of my analyzer, sorry)");
+			return false;
+		} else if (NodeActive[i]) {
+			MemberCount++;
+		} else {
+			found_inactive = true;
+		}
+
+		if (NodeActive[i] && (NodeCLKChannels[i] == UNDEFINED_CHANNEL)) {
+			SetErrorText("Active member nodes must all have CLK defined.");
+			return false;
+		}
+		if (NodeActive[i] && (NodeDATChannels[i] == UNDEFINED_CHANNEL)) {
+			SetErrorText("Active member nodes must all have DAT defined");
+			return false;
+		}
+	}
+
+	// Further rings are in use from ring 1 up to the last with a master CLK,
+	// each needing every node the first ring has
+	int RingCount = 1;
+	Channel RingCLKChannels[MAX_MBUS_RINGS - 1][MAX_MBUS_NODES];
+	Channel RingDATChannels[MAX_MBUS_RINGS - 1][MAX_MBUS_NODES];
+	std::vector< Channel > ActiveChannels( _NodeChannels, _NodeChannels + MAX_MBUS_NODES * 2 );
+	for (int r=0; r < MAX_MBUS_RINGS - 1; r++) {
+		for (int i=0; i < MAX_MBUS_NODES; i++) {
+			RingCLKChannels[r][i] = mRingCLKChannelsInterface[r][i]->GetChannel();
+			RingDATChannels[r][i] = mRingDATChannelsInterface[r][i]->GetChannel();
+		}
+		if (RingCLKChannels[r][0] == UNDEFINED_CHANNEL)
+			continue;
+
+		if (RingCount != r + 1) {
+			SetErrorText("Rings in use must be sequential (no gaps)");
+			return false;
+		}
+		for (int i=0; i < 1 + MemberCount; i++) {
+			if ((RingCLKChannels[r][i] == UNDEFINED_CHANNEL) || (RingDATChannels[r][i] == UNDEFINED_CHANNEL)) {
+				SetErrorText("Every ring in use needs CLK and DAT for its master and as many members as the first ring");
+				return false;
+			}
+			ActiveChannels.push_back(RingCLKChannels[r][i]);
+			ActiveChannels.push_back(RingDATChannels[r][i]);
+		}
+		RingCount++;
+	}
+
+	if (AnalyzerHelpers::DoChannelsOverlap(&ActiveChannels[0], (U32)ActiveChannels.size())) {
+		SetErrorText("All active channels must be unique");
+		return false;
+	}
+
+	U32 ExportRing = mExportRingInterface->GetInteger();
+	if (ExportRing >= (U32)RingCount) {
+		SetErrorText("Export Ring must be a ring in use (0 is the first)");
+		return false;
+	}
+
+	std::string ExportFilter = mExportFilterInterface->GetText();
+	MBusAddressFilter filter;
+	if (!ExportFilter.empty() && !ParseAddressFilter(ExportFilter, filter)) {
+		SetErrorText("Export filter must be a short (17, 1*) or full (F00000B7, F00000B*) hex address");
+		return false;
+	}
+
+	ClearChannels();
+
+	mMemberCount = MemberCount;
+	mRingCount = RingCount;
+	for (int r=0; r < MAX_MBUS_RINGS - 1; r++) {
+		for (int i=0; i < MAX_MBUS_NODES; i++) {
+			mRingCLKChannels[r][i] = RingCLKChannels[r][i];
+			mRingDATChannels[r][i] = RingDATChannels[r][i];
+		}
+	}
+	mExportRing = ExportRing;
+	mScenarioFile = mScenarioFileInterface->GetText();
+	mCompactStorage = mCompactStorageInterface->GetValue();
+	mExportFilter = ExportFilter;
+	mUtilizationBinUs = mUtilizationBinInterface->GetInteger();
+	mStreamPath = mStreamPathInterface->GetText();
+	mStoreFile = mStoreFileInterface->GetText();
+	mProfilePropagation = mProfilePropagationInterface->GetValue();
+	mMasterCLKChannel = NodeCLKChannels[0];
+	mMasterDATChannel = NodeDATChannels[0];
+
+	AddChannel( mMasterCLKChannel, "MBus Master CLK", true);
+	AddChannel( mMasterDATChannel, "MBus Master DAT", true);
+
+	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
+		mMemberActive[i] = NodeActive[i+1];
+		mMemberCLKChannels[i] = NodeCLKChannels[i+1];
+		mMemberDATChannels[i] = NodeDATChannels[i+1];
+
+		if (mMemberActive[i] != true) {
+			log_hack << "SET: Member at index " << i << " is inactive." << std::endl;
+			break;
+		}
+
+		AddChannel( mMemberCLKChannels[i], "MBus Member CLK", mMemberActive[i] );
+		AddChannel( mMemberDATChannels[i], "MBus Member DAT", mMemberActive[i] );
+	}
+	AddRingChannels();
+
+	return true;
+}
+
+void MBusAnalyzerSettings::AddRingChannels()
+{
+	for (int r=0; r < mRingCount - 1; r++) {
+		AddChannel( mRingCLKChannels[r][0], "MBus Master CLK", true );
+		AddChannel( mRingDATChannels[r][0], "MBus Master DAT", true );
+		for (int i=1; i < 1 + mMemberCount; i++) {
+			AddChannel( mRingCLKChannels[r][i], "MBus Member CLK", true );
+			AddChannel( mRingDATChannels[r][i], "MBus Member DAT", true );
+		}
+	}
+}
+
+void MBusAnalyzerSettings::UpdateInterfacesFromSettings()
+{
+	mMasterCLKChannelInterface->SetChannel( mMasterCLKChannel );
+	mMasterDATChannelInterface->SetChannel( mMasterDATChannel );
+
+	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
+		mMemberActiveInterface[i]->SetValue( mMemberActive[i] );
+		mMemberCLKChannelsInterface[i]->SetChannel( mMemberCLKChannels[i] );
+		mMemberDATChannelsInterface[i]->SetChannel( mMemberDATChannels[i] );
+	}
+	for (int r=0; r < MAX_MBUS_RINGS - 1; r++) {
+		for (int i=0; i < MAX_MBUS_NODES; i++) {
+			mRingCLKChannelsInterface[r][i]->SetChannel( mRingCLKChannels[r][i] );
+			mRingDATChannelsInterface[r][i]->SetChannel( mRingDATChannels[r][i] );
+		}
+	}
+	mExportRingInterface->SetInteger( mExportRing );
+
+	mScenarioFileInterface->SetText( mScenarioFile.c_str() );
+	mCompactStorageInterface->SetValue( mCompactStorage );
+	mExportFilterInterface->SetText( mExportFilter.c_str() );
+	mUtilizationBinInterface->SetInteger( mUtilizationBinUs );
+	mStreamPathInterface->SetText( mStreamPath.c_str() );
+	mStoreFileInterface->SetText( mStoreFile.c_str() );
+	mProfilePropagationInterface->SetValue( mProfilePropagation );
+}
+
+void MBusAnalyzerSettings::LoadSettings( const char* settings )
+{
+	SimpleArchive text_archive;
+	text_archive.SetString( settings );
+
+	text_archive >> mMasterCLKChannel;
+	text_archive >> mMasterDATChannel;
+	text_archive >> mMemberCount;
+	mMemberCount = std::max( 0, std::min( mMemberCount, MAX_MBUS_MEMBERS ) );
+	// Only the members in use are saved, and everything after them follows
+	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
+		if (i < mMemberCount) {
+			text_archive >> mMemberActive[i];
+			text_archive >> mMemberCLKChannels[i];
+			text_archive >> mMemberDATChannels[i];
+		} else {
+			mMemberActive[i] = false;
+			mMemberCLKChannels[i] = UNDEFINED_CHANNEL;
+			mMemberDATChannels[i] = UNDEFINED_CHANNEL;
+		}
+	}
+
+	// Settings saved before scenario support simply end here
+	const char* scenario_file;
+	if (text_archive >> &scenario_file)
+		mScenarioFile = scenario_file;
+	else
+		mScenarioFile.clear();
+	if (!(text_archive >> mCompactStorage))
+		mCompactStorage = false;
+	const char* export_filter;
+	if (text_archive >> &export_filter)
+		mExportFilter = export_filter;
+	else
+		mExportFilter.clear();
+	if (!(text_archive >> mUtilizationBinUs))
+		mUtilizationBinUs = 10000;
+	const char* stream_path;
+	if (text_archive >> &stream_path)
+		mStreamPath = stream_path;
+	else
+		mStreamPath.clear();
+	const char* store_file;
+	if (text_archive >> &store_file)
+		mStoreFile = store_file;
+	else
+		mStoreFile.clear();
+	if (!(text_archive >> mRingCount))
+		mRingCount = 1;
+	if (!(text_archive >> mExportRing))
+		mExportRing = 0;
+	for (int r=0; r < MAX_MBUS_RINGS - 1; r++) {
+		for (int i=0; i < MAX_MBUS_NODES; i++) {
+			mRingCLKChannels[r][i] = UNDEFINED_CHANNEL;
+			mRingDATChannels[r][i] = UNDEFINED_CHANNEL;
+			if ((r < mRingCount - 1) && (i < 1 + mMemberCount)) {
+				text_archive >> mRingCLKChannels[r][i];
+				text_archive >> mRingDATChannels[r][i];
+			}
+		}
+	}
+	if (!(text_archive >> mProfilePropagation))
+		mProfilePropagation = false;
+
+	ClearChannels();
+	AddChannel( mMasterCLKChannel, "MBus Master CLK", true );
+	AddChannel( mMasterDATChannel, "MBus Master DAT", true );
+	for (int i=0; i < MAX_MBUS_MEMBERS; i++) {
+#ifdef FUCK_THIS
+		if (mMemberActive[i] != true) {
+			log_hack << "SET: " << __LINE__ << ": Unexpected inactive member " << i << std::endl;
+			AnalyzerHelpers::Assert("How the fuck did this happen?");
+		}
+#endif
+		AddChannel( mMemberCLKChannels[i], "MBus Member CLK", mMemberActive[i] );
+		AddChannel( mMemberDATChannels[i], "MBus Member DAT", mMemberActive[i] );
+	}
+	AddRingChannels();
+
+	UpdateInterfacesFromSettings();
+}
+
+const char* MBusAnalyzerSettings::SaveSettings()
+{
+	SimpleArchive text_archive;
+
+	text_archive << mMasterCLKChannel;
+	text_archive << mMasterDATChannel;
+	text_archive << mMemberCount;
+
+	for (int i=0; i<mMemberCount; i++) {
+		text_archive << mMemberActive[i];
+		text_archive << mMemberCLKChannels[i];
+		text_archive << mMemberDATChannels[i];
+	}
+
+	text_archive << mScenarioFile.c_str();
+	text_archive << mCompactStorage;
+	text_archive << mExportFilter.c_str();
+	text_archive << mUtilizationBinUs;
+	text_archive << mStreamPath.c_str();
+	text_archive << mStoreFile.c_str();
+	text_archive << mRingCount;
+	text_archive << mExportRing;
+	for (int r=0; r < mRingCount - 1; r++) {
+		for (int i=0; i < 1 + mMemberCount; i++) {
+			text_archive << mRingCLKChannels[r][i];
+			text_archive << mRingDATChannels[r][i];
+		}
+	}
+	text_archive << mProfilePropagation;
+
+	return SetReturnString( text_archive.GetString() );
+}
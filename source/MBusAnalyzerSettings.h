@@ -1,58 +1,108 @@
-#ifndef MBUS_ANALYZER_SETTINGS
-#define MBUS_ANALYZER_SETTINGS
-
-#include <fstream>
-
-#include <AnalyzerSettings.h>
-#include <AnalyzerTypes.h>
-
-/*
-#define MAX_MBUS_NODES 16	// MBus design limits rings to 16 nodes
-#define MAX_MBUS_MEMBERS 15
- *
- * Take these down to a smaller number as Saleae's config window isn't as
- * dynamic / flexible as would be required to draw all of these well
- */
-#define FUCK_THIS
-
-#ifdef FUCK_THIS
-#define MAX_MBUS_NODES 2
-#define MAX_MBUS_MEMBERS (MAX_MBUS_NODES - 1)
-#else
-#define MAX_MBUS_NODES 5
-#define MAX_MBUS_MEMBERS (MAX_MBUS_NODES - 1)
-#endif
-
-class MBusAnalyzerSettings : public AnalyzerSettings
-{
-public:
-	MBusAnalyzerSettings();
-	virtual ~MBusAnalyzerSettings();
-
-	virtual bool SetSettingsFromInterfaces();
-	void UpdateInterfacesFromSettings();
-	virtual void LoadSettings( const char* settings );
-	virtual const char* SaveSettings();
-
-	
-	Channel mMasterCLKChannel;
-	Channel mMasterDATChannel;
-
-	int mMemberCount;
-	bool mMemberActive[MAX_MBUS_MEMBERS];
-	Channel mMemberCLKChannels[MAX_MBUS_MEMBERS];
-	Channel mMemberDATChannels[MAX_MBUS_MEMBERS];
-
-	std::ofstream log_hack;
-
-protected:
-	std::auto_ptr< AnalyzerSettingInterfaceChannel >   mMasterCLKChannelInterface;
-	std::auto_ptr< AnalyzerSettingInterfaceChannel >   mMasterDATChannelInterface;
-
-	std::auto_ptr< AnalyzerSettingInterfaceInteger >   mMemberCountInterface;
-	std::unique_ptr< AnalyzerSettingInterfaceBool >    mMemberActiveInterface[MAX_MBUS_MEMBERS];
-	std::unique_ptr< AnalyzerSettingInterfaceChannel > mMemberCLKChannelsInterface[MAX_MBUS_MEMBERS];
-	std::unique_ptr< AnalyzerSettingInterfaceChannel > mMemberDATChannelsInterface[MAX_MBUS_MEMBERS];
-};
-
-#endif //MBUS_ANALYZER_SETTINGS
+#ifndef MBUS_ANALYZER_SETTINGS
+#define MBUS_ANALYZER_SETTINGS
+
+#include <fstream>
+#include <string>
+
+#include <AnalyzerSettings.h>
+#include <AnalyzerTypes.h>
+
+/*
+#define MAX_MBUS_NODES 16	// MBus design limits rings to 16 nodes
+#define MAX_MBUS_MEMBERS 15
+ *
+ * Take these down to a smaller number as Saleae's config window isn't as
+ * dynamic / flexible as would be required to draw all of these well
+ */
+#define FUCK_THIS
+
+#ifdef FUCK_THIS
+#define MAX_MBUS_NODES 2
+#define MAX_MBUS_MEMBERS (MAX_MBUS_NODES - 1)
+#else
+#define MAX_MBUS_NODES 5
+#define MAX_MBUS_MEMBERS (MAX_MBUS_NODES - 1)
+#endif
+
+// Independent rings one analyzer decodes together, see MBusRingSet
+#define MAX_MBUS_RINGS 3
+
+class MBusAnalyzerSettings : public AnalyzerSettings
+{
+public:
+	MBusAnalyzerSettings();
+	virtual ~MBusAnalyzerSettings();
+
+	virtual bool SetSettingsFromInterfaces();
+	void UpdateInterfacesFromSettings();
+	virtual void LoadSettings( const char* settings );
+	virtual const char* SaveSettings();
+
+	
+	Channel mMasterCLKChannel;
+	Channel mMasterDATChannel;
+
+	int mMemberCount;
+	bool mMemberActive[MAX_MBUS_MEMBERS];
+	Channel mMemberCLKChannels[MAX_MBUS_MEMBERS];
+	Channel mMemberDATChannels[MAX_MBUS_MEMBERS];
+
+	// Rings after the first, each a master and as many members as the first
+	// has (node 0 the master); ring r's channels are at [r-1]. Only the
+	// first mRingCount rings, the first included, are in use.
+	int mRingCount;
+	Channel mRingCLKChannels[MAX_MBUS_RINGS - 1][MAX_MBUS_NODES];
+	Channel mRingDATChannels[MAX_MBUS_RINGS - 1][MAX_MBUS_NODES];
+
+	// Ring the exports and live stream carry, 0 for the first
+	U32 mExportRing;
+
+	// Optional traffic scenario for the simulator, empty => built-in script
+	std::string mScenarioFile;
+
+	// One record per transaction instead of one frame per data byte, see MBusTransactionStore
+	bool mCompactStorage;
+
+	// Exports only carry messages to this address, see ParseAddressFilter; empty => all
+	std::string mExportFilter;
+
+	// Width of the finest bus utilization bin, see MBusUtilizationTimeline
+	U32 mUtilizationBinUs;
+
+	// Unix socket (or Windows named pipe) to stream transactions to; empty => off
+	std::string mStreamPath;
+
+	// File to keep the transaction store in, see MBusSegmentFile; empty => memory
+	std::string mStoreFile;
+
+	// Measure per-hop CLK delays for the propagation export, see MBusPropagationProfile
+	bool mProfilePropagation;
+
+	std::ofstream log_hack;
+
+protected:
+	std::auto_ptr< AnalyzerSettingInterfaceChannel >   mMasterCLKChannelInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceChannel >   mMasterDATChannelInterface;
+
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >   mMemberCountInterface;
+	std::unique_ptr< AnalyzerSettingInterfaceBool >    mMemberActiveInterface[MAX_MBUS_MEMBERS];
+	std::unique_ptr< AnalyzerSettingInterfaceChannel > mMemberCLKChannelsInterface[MAX_MBUS_MEMBERS];
+	std::unique_ptr< AnalyzerSettingInterfaceChannel > mMemberDATChannelsInterface[MAX_MBUS_MEMBERS];
+	std::unique_ptr< AnalyzerSettingInterfaceChannel > mRingCLKChannelsInterface[MAX_MBUS_RINGS - 1][MAX_MBUS_NODES];
+	std::unique_ptr< AnalyzerSettingInterfaceChannel > mRingDATChannelsInterface[MAX_MBUS_RINGS - 1][MAX_MBUS_NODES];
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >   mExportRingInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceBool >      mProfilePropagationInterface;
+
+	std::auto_ptr< AnalyzerSettingInterfaceText >      mScenarioFileInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceBool >      mCompactStorageInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >      mExportFilterInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >   mUtilizationBinInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >      mStreamPathInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceText >      mStoreFileInterface;
+
+private:
+	// Registers the channels of the rings after the first
+	void AddRingChannels();
+};
+
+#endif //MBUS_ANALYZER_SETTINGS
@@ -0,0 +1,77 @@
+#include "MBusChannel.h"
+
+MBusEdgeChannel::MBusEdgeChannel()
+:	mBitState( BIT_HIGH ),
+	mEdges( NULL ),
+	mNumEdges( 0 ),
+	mNextEdge( 0 ),
+	mSampleNumber( 0 ),
+	mLastSample( 0 )
+{
+}
+
+MBusEdgeChannel::~MBusEdgeChannel()
+{
+}
+
+void MBusEdgeChannel::SetEdges( BitState initial_bit_state, const U64* edges, size_t num_edges, U64 last_sample )
+{
+	mBitState = initial_bit_state;
+	mEdges = edges;
+	mNumEdges = num_edges;
+	mNextEdge = 0;
+	mSampleNumber = 0;
+	mLastSample = last_sample;
+}
+
+U64 MBusEdgeChannel::GetSampleNumber()
+{
+	return mSampleNumber;
+}
+
+BitState MBusEdgeChannel::GetBitState()
+{
+	return mBitState;
+}
+
+U32 MBusEdgeChannel::AdvanceToAbsPosition( U64 sample_number )
+{
+	if (sample_number > mLastSample)
+		throw MBusEndOfData();
+	if (sample_number < mSampleNumber)
+		return 0;
+
+	U32 transitions = 0;
+	while ((mNextEdge < mNumEdges) && (mEdges[mNextEdge] <= sample_number)) {
+		mNextEdge++;
+		transitions++;
+	}
+	if (transitions & 1)
+		mBitState = (mBitState == BIT_LOW) ? BIT_HIGH : BIT_LOW;
+
+	mSampleNumber = sample_number;
+	return transitions;
+}
+
+void MBusEdgeChannel::AdvanceToNextEdge()
+{
+	if (mNextEdge >= mNumEdges)
+		throw MBusEndOfData();
+
+	mSampleNumber = mEdges[mNextEdge++];
+	mBitState = (mBitState == BIT_LOW) ? BIT_HIGH : BIT_LOW;
+}
+
+U64 MBusEdgeChannel::GetSampleOfNextEdge()
+{
+	// The SDK would block for an edge that may never come; "never" is the
+	// closest headless answer and sorts after every real edge
+	if (mNextEdge >= mNumEdges)
+		return ~0ULL;
+	return mEdges[mNextEdge];
+}
+
+bool MBusEdgeChannel::WouldAdvancingCauseTransition( U32 num_samples )
+{
+	return (mNextEdge < mNumEdges) && (mEdges[mNextEdge] <= mSampleNumber + num_samples);
+}
@@ -0,0 +1,58 @@
+#ifndef MBUS_CHANNEL
+#define MBUS_CHANNEL
+
+#include "MBusTypes.h"
+
+#include <exception>
+#include <cstddef>
+
+// Thrown by headless channels once the capture has been consumed. Inside
+// Logic the SDK blocks for more data instead, so this never fires there.
+class MBusEndOfData : public std::exception {
+public:
+	virtual const char* what() const throw () {
+		return "End of capture data";
+	}
+};
+
+// The subset of AnalyzerChannelData the decoder walks channels with
+class MBusChannel
+{
+public:
+	virtual ~MBusChannel() {}
+
+	virtual U64 GetSampleNumber() = 0;
+	virtual BitState GetBitState() = 0;
+	virtual U32 AdvanceToAbsPosition( U64 sample_number ) = 0;
+	virtual void AdvanceToNextEdge() = 0;
+	virtual U64 GetSampleOfNextEdge() = 0;
+	virtual bool WouldAdvancingCauseTransition( U32 num_samples ) = 0;
+};
+
+// A channel over a caller-owned, sorted array of edge sample numbers. Like
+// the SDK, an edge's sample number is the first sample of the new state.
+class MBusEdgeChannel : public MBusChannel
+{
+public:
+	MBusEdgeChannel();
+	virtual ~MBusEdgeChannel();
+
+	void SetEdges( BitState initial_bit_state, const U64* edges, size_t num_edges, U64 last_sample );
+
+	virtual U64 GetSampleNumber();
+	virtual BitState GetBitState();
+	virtual U32 AdvanceToAbsPosition( U64 sample_number );
+	virtual void AdvanceToNextEdge();
+	virtual U64 GetSampleOfNextEdge();
+	virtual bool WouldAdvancingCauseTransition( U32 num_samples );
+
+protected:
+	BitState mBitState;
+	const U64* mEdges;
+	size_t mNumEdges;
+	size_t mNextEdge;
+	U64 mSampleNumber;
+	U64 mLastSample;
+};
+
+#endif //MBUS_CHANNEL
@@ -0,0 +1,765 @@
+#include "MBusDecoder.h"
+
+/*
+ * The state machine is a template on the number of nodes in the ring. With
+ * N fixed, every per-node loop has a constant trip count the compiler
+ * unrolls, the channel pointers sit in fixed arrays indexed without checks,
+ * and the ring's modulo arithmetic folds away. N = 0 is the generic version,
+ * which reads the count at run time; MBusDecoder::Initialize picks one once
+ * per decode.
+ */
+template< int N >
+class MBusRingDecoder : public MBusDecoderCore
+{
+public:
+	MBusRingDecoder( const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, MBusDecoderSink* sink, std::ostream* log );
+
+	virtual void DecodeTransaction();
+	virtual void GetCheckpoint( MBusDecoderCheckpoint& checkpoint );
+	virtual bool Resume( const MBusDecoderCheckpoint& checkpoint );
+	virtual void SetCheckpointInterval( U32 transactions ) { mCheckpointInterval = transactions; mUntilCheckpoint = transactions; }
+	virtual void SetPropagationProfile( MBusPropagationProfile* profile ) { mPropagation = profile; mPropagationBatch.Clear( NodeCount() ); }
+
+private: // analysis helpers:
+	int NodeCount() const { return N ? N : mNodeCount; }
+
+	bool Process_IdleToArbitration();
+	bool Process_ArbitrationToPriorityArbitration();
+	bool Process_PriorityArbitrationToAddress();
+	bool Process_SkipReservedBit();
+	bool Process_AddressToData();
+	bool Process_DataToInterjection();
+	bool Process_InterjectionToControl();
+	bool Process_ControlToIdle();
+
+	// False if a node interjected on the way (every channel still advances)
+	bool AdvanceAllTo(U64 sample);
+	// The same, when mLastNodeCLK just moved to an edge at sample: also adds
+	// where each node saw it to mPropagationBatch
+	bool ProfileAndAdvanceAllTo(U64 sample);
+
+	// Splits the transaction's bus time into mTransaction.mPhaseSamples
+	void TallyPhases();
+
+	MBusDecoderSink* mSink;
+	std::ostream* mLog;
+
+	MBusChannel* mMasterDAT;
+	MBusChannel* mLastNodeCLK;
+	MBusChannel* mLastNodeDAT;
+
+	MBusChannel* mNodeCLKs[N ? N : MBUS_DECODER_MAX_NODES];
+	MBusChannel* mNodeDATs[N ? N : MBUS_DECODER_MAX_NODES];
+	int mNodeCount;
+
+	// Process_IdleToArbitration's per-node scratch
+	bool mRequested[N ? N : MBUS_DECODER_MAX_NODES];
+	U64 mDOUTFall[N ? N : MBUS_DECODER_MAX_NODES];
+
+	int mEstClockFreq;
+	int mTransmitter;
+	bool requestBugWorkaround;
+
+	// Phase boundaries TallyPhases needs beyond the transaction's own
+	U64 mRequestSample; // first DOUT fall
+	U64 mAddressEndingSample; // last sample of the address's final bit
+	U64 mControlSample; // Drive Begin Control
+
+	U64 mTransactions; // committed so far
+	U32 mCheckpointInterval;
+	U32 mUntilCheckpoint;
+
+	MBusPropagationProfile* mPropagation;
+	MBusPropagationTable mPropagationBatch; // this transaction's edges
+
+	MBusTransaction mTransaction;
+};
+
+template< int N >
+MBusRingDecoder< N >::MBusRingDecoder( const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, MBusDecoderSink* sink, std::ostream* log )
+:	mSink( sink ),
+	mLog( log ),
+	mNodeCount( (int)node_clks.size() ),
+	mEstClockFreq( 0 ),
+	mTransmitter( -1 ),
+	requestBugWorkaround( false ),
+	mRequestSample( 0 ),
+	mAddressEndingSample( 0 ),
+	mControlSample( 0 ),
+	mTransactions( 0 ),
+	mCheckpointInterval( 0 ),
+	mUntilCheckpoint( 0 ),
+	mPropagation( NULL )
+{
+	for (int i=0; i < mNodeCount; i++) {
+		mNodeCLKs[i] = node_clks[i];
+		mNodeDATs[i] = node_dats[i];
+	}
+
+	mMasterDAT = mNodeDATs[0];
+	mLastNodeCLK = mNodeCLKs[mNodeCount-1];
+	mLastNodeDAT = mNodeDATs[mNodeCount-1];
+
+	ClearTransaction(mTransaction);
+	// Room for long messages up front, so decoding rarely has to grow them
+	mTransaction.mData.reserve(1024);
+	mTransaction.mDataSamples.reserve(1024);
+}
+
+template< int N >
+static MBusDecoderCore* CreateRingDecoder( int node_count, const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, MBusDecoderSink* sink, std::ostream* log )
+{
+	if (node_count == N)
+		return new MBusRingDecoder< N >( node_clks, node_dats, sink, log );
+	return CreateRingDecoder< N - 1 >( node_count, node_clks, node_dats, sink, log );
+}
+
+template<>
+MBusDecoderCore* CreateRingDecoder< 0 >( int, const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, MBusDecoderSink* sink, std::ostream* log )
+{
+	return new MBusRingDecoder< 0 >( node_clks, node_dats, sink, log );
+}
+
+MBusDecoder::MBusDecoder()
+:	mCore( NULL ),
+	mSpecializedNodeCount( 0 )
+{
+}
+
+MBusDecoder::~MBusDecoder()
+{
+	delete mCore;
+}
+
+void MBusDecoder::Initialize( const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, MBusDecoderSink* sink, std::ostream* log, bool specialize )
+{
+	if (node_clks.empty() || (node_clks.size() != node_dats.size()) || (node_clks.size() > MBUS_DECODER_MAX_NODES))
+		MBusAssert("MBusDecoder needs 1 to 16 nodes, each with CLK and DAT");
+
+	int node_count = (int)node_clks.size();
+	delete mCore;
+	mCore = CreateRingDecoder< MBUS_DECODER_MAX_NODES >( specialize ? node_count : 0, node_clks, node_dats, sink, log );
+	mSpecializedNodeCount = specialize ? node_count : 0;
+}
+
+template< int N >
+void MBusRingDecoder< N >::DecodeTransaction()
+{
+	// Each phase returns false when a node interjects part way through,
+	// which skips straight to control. This used to be an exception, but
+	// every transaction ends in an interjection and throwing allocates.
+	if (mLog) *mLog << "LYZ: " << __LINE__ << ": Start transaction loop" << std::endl;
+	mEstClockFreq = 0;
+	bool completed = false;
+	do {
+		if (!Process_IdleToArbitration()) break;
+		if (mLog) *mLog << "IdleToArbitration done" << std::endl;
+		if (!Process_ArbitrationToPriorityArbitration()) break;
+		if (mLog) *mLog << "ArbToPrioArb done" << std::endl;
+		if (!Process_PriorityArbitrationToAddress()) break;
+		if (mLog) *mLog << "PrioArbToAddr done" << std::endl;
+		if (!Process_SkipReservedBit()) break;
+		if (mLog) *mLog << "SkipReservedBit done" << std::endl;
+		if (!Process_AddressToData()) break;
+		if (mLog) *mLog << "AddrToData done" << std::endl;
+		if (!Process_DataToInterjection()) break;
+		if (mLog) *mLog << "DataToInt done" << std::endl;
+		if (!Process_InterjectionToControl()) break;
+		if (mLog) *mLog << "IntToControl done" << std::endl;
+		if (!Process_ControlToIdle()) break;
+		if (mLog) *mLog << "ControlToIdle done" << std::endl;
+		completed = true;
+	} while (false);
+
+	if (!completed) {
+		if (mLog) *mLog << "LYZ: " << __LINE__ << ": Uncaught Interjection in top loop" << std::endl;
+		bool recovered = false;
+		if (Process_InterjectionToControl()) {
+			if (mLog) *mLog << "IntToControl from unhandled done" << std::endl;
+			if (Process_ControlToIdle()) {
+				if (mLog) *mLog << "ControlToIdle from unhandled done" << std::endl;
+				recovered = true;
+			}
+		}
+		if (!recovered && mLog)
+			*mLog << "LYZ: " << __LINE__ << ": Uncuaght Interjection in interjection catch -- it's all screwed now." << std::endl;
+		completed = recovered;
+	}
+
+	if (mPropagation)
+		mPropagation->Add(mPropagationBatch);
+
+	// Only a transaction that ended in idle leaves every channel lined up
+	if (completed && mCheckpointInterval && (--mUntilCheckpoint == 0)) {
+		mUntilCheckpoint = mCheckpointInterval;
+		MBusDecoderCheckpoint checkpoint;
+		GetCheckpoint(checkpoint);
+		mSink->CommitCheckpoint(checkpoint);
+	}
+}
+
+template< int N >
+void MBusRingDecoder< N >::GetCheckpoint( MBusDecoderCheckpoint& checkpoint )
+{
+	checkpoint.mSample = mLastNodeCLK->GetSampleNumber();
+	checkpoint.mTransactions = mTransactions;
+	checkpoint.mCLKStates = 0;
+	checkpoint.mDATStates = 0;
+	for (int i=0; i < NodeCount(); i++) {
+		if (mNodeCLKs[i]->GetBitState() == BIT_HIGH)
+			checkpoint.mCLKStates |= 1u << i;
+		if (mNodeDATs[i]->GetBitState() == BIT_HIGH)
+			checkpoint.mDATStates |= 1u << i;
+	}
+	checkpoint.mEstClockFreq = mEstClockFreq;
+	checkpoint.mTransmitter = mTransmitter;
+	checkpoint.mRequestBugWorkaround = requestBugWorkaround;
+	checkpoint.mReserved = 0;
+}
+
+template< int N >
+bool MBusRingDecoder< N >::Resume( const MBusDecoderCheckpoint& checkpoint )
+{
+	U32 clk_states = 0, dat_states = 0;
+	for (int i=0; i < NodeCount(); i++) {
+		mNodeCLKs[i]->AdvanceToAbsPosition(checkpoint.mSample);
+		mNodeDATs[i]->AdvanceToAbsPosition(checkpoint.mSample);
+		if (mNodeCLKs[i]->GetBitState() == BIT_HIGH)
+			clk_states |= 1u << i;
+		if (mNodeDATs[i]->GetBitState() == BIT_HIGH)
+			dat_states |= 1u << i;
+	}
+
+	mTransactions = checkpoint.mTransactions;
+	mEstClockFreq = checkpoint.mEstClockFreq;
+	mTransmitter = checkpoint.mTransmitter;
+	requestBugWorkaround = checkpoint.mRequestBugWorkaround != 0;
+	mUntilCheckpoint = mCheckpointInterval;
+
+	return (clk_states == checkpoint.mCLKStates) && (dat_states == checkpoint.mDATStates);
+}
+
+template< int N >
+bool MBusRingDecoder< N >::AdvanceAllTo(U64 sample) {
+	if (mPropagation && (mLastNodeCLK->GetSampleNumber() == sample))
+		return ProfileAndAdvanceAllTo(sample);
+
+	bool interjected = false;
+
+	for (int i=0; i<NodeCount(); i++) {
+		mNodeCLKs[i]->AdvanceToAbsPosition(sample);
+		if (mNodeDATs[i]->AdvanceToAbsPosition(sample) > 3) {
+			// Note that the interjection was seen, but it's still important to advance all the channels,
+			// otherwise, the next AdvanceAll will "detect" an interjection on i+1'th node
+			interjected = true;
+		}
+	}
+
+	return !interjected;
+}
+
+template< int N >
+bool MBusRingDecoder< N >::ProfileAndAdvanceAllTo(U64 sample) {
+	bool interjected = false;
+
+	// A node whose CLK moves exactly once on the way saw this edge then.
+	// Anything else is not a delay: an interjector blocks CLK, so the nodes
+	// before it see pulses that go no further. Only peek at an edge known to
+	// be there; an SDK channel waits for more data otherwise.
+	U64 edges[N ? N : MBUS_DECODER_MAX_NODES];
+	for (int i=0; i<NodeCount()-1; i++) {
+		MBusChannel* clk = mNodeCLKs[i];
+		U64 samples = sample - clk->GetSampleNumber();
+		U64 edge = 0;
+		if ((samples - 1 < 0xFFFFFFFFULL) && clk->WouldAdvancingCauseTransition((U32)samples))
+			edge = clk->GetSampleOfNextEdge();
+		if (clk->AdvanceToAbsPosition(sample) != 1)
+			edge = 0;
+		edges[i] = edge;
+		if (mNodeDATs[i]->AdvanceToAbsPosition(sample) > 3)
+			interjected = true;
+	}
+	edges[NodeCount()-1] = sample;
+	if (mLastNodeDAT->AdvanceToAbsPosition(sample) > 3)
+		interjected = true;
+
+	mPropagationBatch.AddEdge(mLastNodeCLK->GetBitState() == BIT_HIGH, edges);
+	return !interjected;
+}
+
+// b - a, or 0 if a recovered transaction left them out of order
+static U64 Span(U64 a, U64 b) {
+	return (b > a) ? b - a : 0;
+}
+
+template< int N >
+void MBusRingDecoder< N >::TallyPhases() {
+	// Each phase runs from where the one before it stopped; those a
+	// transaction never got to are left at 0
+	U64* phases = mTransaction.mPhaseSamples;
+	U64 cursor = mTransaction.mStartingSampleInclusive;
+	phases[PhaseIdle] = Span(cursor, mRequestSample);
+	cursor += phases[PhaseIdle];
+	U64 next = mTransaction.mAddressSample ? mTransaction.mAddressSample : mControlSample;
+	phases[PhaseArbitration] = Span(cursor, next);
+	cursor += phases[PhaseArbitration];
+	if (mTransaction.mAddressBits) {
+		phases[PhaseAddress] = Span(cursor, mAddressEndingSample + 1);
+		cursor += phases[PhaseAddress];
+	}
+	if (!mTransaction.mData.empty()) {
+		phases[PhaseData] = Span(cursor, mTransaction.mDataEndingSample + 1);
+		cursor += phases[PhaseData];
+	}
+	phases[PhaseInterjection] = Span(cursor, mControlSample);
+	cursor += phases[PhaseInterjection];
+	phases[PhaseControl] = Span(cursor, mTransaction.mEndingSampleInclusive + 1);
+}
+
+template< int N >
+bool MBusRingDecoder< N >::Process_IdleToArbitration() {
+	MBusFrame frame;
+	frame.mFlags = 0;
+	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
+
+	ClearTransaction(mTransaction);
+	mTransaction.mStartingSampleInclusive = frame.mStartingSampleInclusive;
+
+	// Advance LastNodeCLK channel to end of t_long
+	mLastNodeCLK->AdvanceToNextEdge();
+
+	// Scratch lives in the decoder, so no transaction allocates
+	bool* requested = mRequested;
+	for (int i=0; i < NodeCount(); i++) requested[i] = false;
+
+	U64* DOUT_Fall = mDOUTFall;
+
+	// First find the sample number when each node's DOUT falls
+	for (int i=0; i < NodeCount(); i++) {
+		/* It is theoretically possible for DOUTs to never fall until
+		 * data transmission, so advancing to the next edge is unsafe.
+		 * Instead we peek to the end of t_long to see if the node is
+		 * participating.
+		 */
+		U64 SamplesTo_t_long = mLastNodeCLK->GetSampleNumber() - mNodeDATs[i]->GetSampleNumber();
+		if (mNodeDATs[i]->WouldAdvancingCauseTransition(SamplesTo_t_long)) {
+			// Node is participating
+			mNodeDATs[i]->AdvanceToNextEdge();
+			DOUT_Fall[i] = mNodeDATs[i]->GetSampleNumber();
+
+			// Handle master node here, if its DOUT ever fell it requested
+			if (i==0)
+				requested[0] = true;
+		} else {
+			// Node is not participating, set a fake fall value past any participants
+			DOUT_Fall[i] = mLastNodeCLK->GetSampleNumber()+1;
+		}
+	}
+	// Now go through each member node. If a node's DOUT falls _before_
+	// the previous node's DOUT fell then this node is requesting.
+	mRequestSample = DOUT_Fall[0];
+	for (int i=1; i < NodeCount(); i++) {
+		if (DOUT_Fall[i] < DOUT_Fall[i-1]) // min i==1, i-1 ref is safe
+			requested[i] = true;
+		if (DOUT_Fall[i] < mRequestSample)
+			mRequestSample = DOUT_Fall[i];
+	}
+
+	if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+		return false;
+
+	frame.mData1 = 0;
+	for (int i=0; i<NodeCount(); i++) {
+		frame.mData1 |= ((U64) (requested[i])) << (i + 32);
+		mTransaction.mRequesters |= ((U32) (requested[i])) << i;
+	}
+	frame.mData2 = 1;
+	frame.mType = FrameTypeRequest;
+
+	if (requestBugWorkaround) {
+		frame.mFlags |= REQUEST_BUG_WORKAROUND;
+	} else {
+		requestBugWorkaround = true;
+	}
+
+	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
+	mSink->AddFrame(frame);
+	mSink->CommitResults();
+	mSink->ReportProgress( mLastNodeCLK->GetSampleNumber() );
+
+	return true;
+}
+
+template< int N >
+bool MBusRingDecoder< N >::Process_ArbitrationToPriorityArbitration() {
+	MBusFrame frame;
+	frame.mFlags = 0;
+	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
+
+	// Latch Arbitration
+	mLastNodeCLK->AdvanceToNextEdge();
+	if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+		return false;
+
+	int arbitrationWinner = -1;
+	if (mMasterDAT->GetBitState() == BIT_LOW)
+		arbitrationWinner = 0;
+	else {
+		for (int i=1; i<NodeCount(); i++) {
+			if (
+					(mNodeDATs[(i-1)%NodeCount()]->GetBitState() == BIT_HIGH) &&
+					(mNodeDATs[i]->GetBitState() == BIT_LOW)
+			   ) {
+				if (arbitrationWinner != -1)
+					frame.mFlags |= MULTIPLE_ARBITRATION_WINNER | DISPLAY_AS_ERROR_FLAG;
+				arbitrationWinner = i;
+			}
+		}
+	}
+	if (arbitrationWinner == -1) {
+		frame.mFlags |= NO_ARBITRATION_WINNER | DISPLAY_AS_WARNING_FLAG;
+	}
+
+	mTransmitter = arbitrationWinner;
+	mTransaction.mArbitrationWinner = arbitrationWinner;
+	mTransaction.mTransmitter = arbitrationWinner;
+	mTransaction.mFlags |= frame.mFlags;
+
+	frame.mData1 = 0;
+	for (int i=0; i<NodeCount(); i++) {
+		frame.mData1 |= ((U64) (arbitrationWinner == i)) << (i+32);
+	}
+	frame.mData2 = 1;
+	frame.mType = FrameTypeArbitration;
+
+	// Get to Prio Drive edge before ending this frame
+	mLastNodeCLK->AdvanceToNextEdge();
+	if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+		return false;
+
+	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
+	mSink->AddFrame(frame);
+	mSink->CommitResults();
+	mSink->ReportProgress( mLastNodeCLK->GetSampleNumber() );
+
+	mEstClockFreq = frame.mEndingSampleInclusive - frame.mStartingSampleInclusive;
+
+	return true;
+}
+
+template< int N >
+bool MBusRingDecoder< N >::Process_PriorityArbitrationToAddress() {
+	MBusFrame frame;
+	frame.mFlags = 0;
+	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
+
+	// Latch Prio Drive
+	mLastNodeCLK->AdvanceToNextEdge();
+	if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+		return false;
+
+	if (mTransmitter == -1) {
+		// No arbitration winner => no prio
+		frame.mFlags |= NO_ARBITRATION_WINNER | DISPLAY_AS_WARNING_FLAG;
+	} else {
+		int prioArbitrationWinner = -1;
+		if (mNodeDATs[mTransmitter]->GetBitState() == BIT_LOW)
+			prioArbitrationWinner = mTransmitter;
+		else {
+			int start = (mTransmitter+1) % NodeCount();
+			for (int j=start; j<start+NodeCount()-1; j++) {
+				int k = j % NodeCount();
+				if (
+						(mNodeDATs[(k+NodeCount()-1)%NodeCount()]->GetBitState() == BIT_LOW) &&
+						(mNodeDATs[k]->GetBitState() == BIT_HIGH)
+				   ) {
+					if (prioArbitrationWinner != -1)
+						frame.mFlags |= MULTIPLE_ARBITRATION_WINNER | DISPLAY_AS_ERROR_FLAG;
+					prioArbitrationWinner = k;
+				}
+			}
+		}
+		if (prioArbitrationWinner != -1)
+			mTransmitter = prioArbitrationWinner;
+		mTransaction.mPriorityWinner = prioArbitrationWinner;
+		mTransaction.mTransmitter = mTransmitter;
+
+		frame.mData1 = 0;
+		for (int i=0; i<NodeCount(); i++) {
+			frame.mData1 |= ((U64) (prioArbitrationWinner == i)) << (i+32);
+		}
+		frame.mData2 = 1;
+	}
+	frame.mType = FrameTypePriorityArbitration;
+	mTransaction.mFlags |= frame.mFlags;
+
+	// Get to Drive Bit 0 edge before ending this frame
+	mLastNodeCLK->AdvanceToNextEdge();
+	if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+		return false;
+
+	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
+	mSink->AddFrame(frame);
+	mSink->CommitResults();
+	mSink->ReportProgress( mLastNodeCLK->GetSampleNumber() );
+
+	mEstClockFreq = (mEstClockFreq + (frame.mEndingSampleInclusive - frame.mStartingSampleInclusive)) / 2;
+
+	return true;
+}
+
+template< int N >
+bool MBusRingDecoder< N >::Process_SkipReservedBit() {
+	MBusFrame frame;
+	frame.mFlags = 0;
+	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
+
+	// Skip a bit
+	mLastNodeCLK->AdvanceToNextEdge();
+	if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+		return false;
+
+	if (mLastNodeCLK->GetSampleOfNextEdge() > mLastNodeDAT->GetSampleOfNextEdge()) {
+		// An Interjection occurred
+		if (!AdvanceAllTo( mLastNodeDAT->GetSampleOfNextEdge() - 1 ))
+			return false;
+	} else {
+		// Normal operation (clk before data)
+		mLastNodeCLK->AdvanceToNextEdge();
+		if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+			return false;
+	}
+
+	frame.mData1 = 0;
+	frame.mData2 = 0;
+	frame.mType = FrameTypeReservedBit;
+	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
+	mSink->AddFrame(frame);
+	mSink->CommitResults();
+	mSink->ReportProgress( mLastNodeCLK->GetSampleNumber() );
+
+	return true;
+}
+
+template< int N >
+bool MBusRingDecoder< N >::Process_AddressToData() {
+	MBusFrame frame;
+	frame.mFlags = 0;
+	frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
+	mTransaction.mAddressSample = frame.mStartingSampleInclusive;
+
+	U32 address = 0;
+
+	for (int i=0; i < 8; i++) {
+		// Latch Drive Bit N (Address is MSB)
+		mLastNodeCLK->AdvanceToNextEdge();
+		if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+			return false;
+		address <<= 1;
+		address |= mLastNodeDAT->GetBitState() == BIT_HIGH;
+		// A message with no data interjects right after the last address
+		// bit, so the address must be kept before advancing past it
+		if ((i == 7) && ((address & 0xf0) != 0xf0)) {
+			mTransaction.mAddress = address;
+			mTransaction.mAddressBits = 8;
+		}
+		// Advance to Drive Bit N+1
+		mLastNodeCLK->AdvanceToNextEdge();
+		mAddressEndingSample = mLastNodeCLK->GetSampleNumber();
+		if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+			return false;
+	}
+
+	if ((address & 0xf0) == 0xf0) {
+		// This is 32-bit addr
+		for (int i=0; i < 24; i++) {
+			// Latch Drive Bit N (Address is MSB)
+			mLastNodeCLK->AdvanceToNextEdge();
+			if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+				return false;
+			address <<= 1;
+			address |= mLastNodeDAT->GetBitState() == BIT_HIGH;
+			if (i == 23) {
+				mTransaction.mAddress = address;
+				mTransaction.mAddressBits = 32;
+			}
+			// Advance to Drive Bit N+1
+			mLastNodeCLK->AdvanceToNextEdge();
+			mAddressEndingSample = mLastNodeCLK->GetSampleNumber();
+			if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+				return false;
+		}
+	}
+
+	frame.mData1 = address;
+	frame.mData2 = 0;
+	frame.mType = FrameTypeAddress;
+
+	mTransaction.mAddress = address;
+	mTransaction.mAddressBits = ((address & 0xf0000000) == 0xf0000000) ? 32 : 8;
+
+	frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
+	mSink->AddFrame(frame);
+	mSink->CommitResults();
+	mSink->ReportProgress( mLastNodeCLK->GetSampleNumber() );
+
+	return true;
+}
+
+template< int N >
+bool MBusRingDecoder< N >::Process_DataToInterjection() {
+	bool interjected = false;
+	bool whole_byte = false;
+	do {
+		MBusFrame frame;
+		frame.mFlags = 0;
+		frame.mData2 = 0;
+		frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
+
+		U8 data = 0;
+		whole_byte = false;
+
+		for (int i=0; i < 8; i++) {
+			// Latch Drive Bit N (Data is MSB, byte-granularity)
+			mLastNodeCLK->AdvanceToNextEdge();
+			if (!AdvanceAllTo(mLastNodeCLK->GetSampleNumber())) {
+				interjected = true;
+				break;
+			}
+			data <<= 1;
+			data |= mLastNodeDAT->GetBitState() == BIT_HIGH;
+
+			// Note the byte is complete here, if we're watching a downstream node, the interjection
+			// will trigger in the next advance (but not yet if we're watching an upstream node)
+			if (i == 7) {
+				whole_byte = true;
+			}
+
+			// Save current point in time in case next transition interjects
+			frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
+
+			// Advance to Drive Bit N+1
+			mLastNodeCLK->AdvanceToNextEdge();
+			if (!AdvanceAllTo(mLastNodeCLK->GetSampleNumber())) {
+				interjected = true;
+				break;
+			}
+		}
+
+		frame.mData1 = data;
+		frame.mType = FrameTypeData;
+		if (interjected) {
+			if (whole_byte) {
+				mSink->AddFrame(frame);
+				mSink->CommitResults();
+				mTransaction.mData.push_back(data);
+				mTransaction.mDataSamples.push_back(frame.mStartingSampleInclusive);
+				mTransaction.mDataEndingSample = frame.mEndingSampleInclusive;
+			}
+
+			frame.mStartingSampleInclusive = frame.mEndingSampleInclusive + 1;
+			frame.mType = FrameTypeInterjection;
+		} else {
+			mTransaction.mData.push_back(data);
+			mTransaction.mDataSamples.push_back(frame.mStartingSampleInclusive);
+			mTransaction.mDataEndingSample = mLastNodeCLK->GetSampleNumber();
+		}
+
+		frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
+		mSink->AddFrame(frame);
+		mSink->CommitResults();
+		mSink->ReportProgress( mLastNodeCLK->GetSampleNumber() );
+	} while (!interjected);
+
+	return true;
+}
+
+template< int N >
+bool MBusRingDecoder< N >::Process_InterjectionToControl() {
+	// nop; this is currently subsumed by the DataToInterrupt; FIXME
+	return true;
+}
+
+template< int N >
+bool MBusRingDecoder< N >::Process_ControlToIdle() {
+	// This currently picks up having processed the drive Begin Control CLK edge
+	//
+	mControlSample = mLastNodeCLK->GetSampleNumber();
+
+	// Silently consume period that should eventually be marked as part of interjection:
+	// Latch Begin Control:
+	mLastNodeCLK->AdvanceToNextEdge();
+	if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+		return false;
+	// Drive Ctrl Bit 0
+	mLastNodeCLK->AdvanceToNextEdge();
+	if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+		return false;
+
+	// Control Bit 0
+	{
+		MBusFrame frame;
+		frame.mFlags = 0;
+		frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
+
+		// Latch Ctrl Bit 0
+		mLastNodeCLK->AdvanceToNextEdge();
+		if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+			return false;
+
+		frame.mData1 = mLastNodeDAT->GetBitState() == BIT_HIGH;
+		frame.mData2 = 0;
+		frame.mType = FrameTypeControlBit0;
+		mTransaction.mCB0 = frame.mData1 != 0;
+
+		// Extend this bubble up to Drive Ctrl Bit 1
+		mLastNodeCLK->AdvanceToNextEdge();
+		if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+			return false;
+
+		frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
+		mSink->AddFrame(frame);
+		mSink->CommitResults();
+		mSink->ReportProgress( mLastNodeCLK->GetSampleNumber() );
+	}
+
+	// Control Bit 1
+	{
+		MBusFrame frame;
+		frame.mFlags = 0;
+		frame.mStartingSampleInclusive = mLastNodeCLK->GetSampleNumber()+1;
+
+		// Latch Ctrl Bit 1
+		mLastNodeCLK->AdvanceToNextEdge();
+		if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+			return false;
+
+		frame.mData1 = mLastNodeDAT->GetBitState() == BIT_HIGH;
+		frame.mData2 = 0;
+		frame.mType = FrameTypeControlBit1;
+		mTransaction.mCB1 = frame.mData1 != 0;
+
+		// Extend this bubble up to Drive Begin Idle
+		mLastNodeCLK->AdvanceToNextEdge();
+		if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+			return false;
+
+		frame.mEndingSampleInclusive = mLastNodeCLK->GetSampleNumber();
+		mSink->AddFrame(frame);
+		mSink->CommitResults();
+		mSink->ReportProgress( mLastNodeCLK->GetSampleNumber() );
+
+		mTransaction.mEndingSampleInclusive = frame.mEndingSampleInclusive;
+	}
+
+	// Silently consume Latch Begin Idle (good enough until we have real Idle solution)
+	mLastNodeCLK->AdvanceToNextEdge();
+	if (!AdvanceAllTo( mLastNodeCLK->GetSampleNumber() ))
+		return false;
+
+	TallyPhases();
+	mSink->CommitTransaction(mTransaction);
+	mTransactions++;
+
+	return true;
+}
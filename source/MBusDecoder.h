@@ -0,0 +1,100 @@
+#ifndef MBUS_DECODER
+#define MBUS_DECODER
+
+#include "MBusTypes.h"
+#include "MBusChannel.h"
+#include "MBusTransaction.h"
+#include "MBusPropagation.h"
+
+#include <ostream>
+#include <vector>
+
+// Everything the decoder carries from one transaction to the next. Between
+// transactions every channel sits on the same sample, so that and the
+// scalars below are enough to pick decoding up again from here.
+struct MBusDecoderCheckpoint
+{
+	U64 mSample;        // every CLK and DAT channel is here
+	U64 mTransactions;  // committed before this point
+	U32 mCLKStates;     // bit i is node i's CLK, 1 = high
+	U32 mDATStates;
+	S32 mEstClockFreq;
+	S32 mTransmitter;
+	U32 mRequestBugWorkaround;
+	U32 mReserved;
+};
+
+// Where the decoder delivers its results; MBusAnalyzer forwards to the SDK,
+// the headless tools keep them for themselves
+class MBusDecoderSink
+{
+public:
+	virtual ~MBusDecoderSink() {}
+
+	virtual void AddFrame( const MBusFrame& frame ) = 0;
+	virtual void CommitResults() = 0;
+	virtual void CommitTransaction( const MBusTransaction& transaction ) = 0;
+	virtual void ReportProgress( U64 sample_number ) = 0;
+	// Every checkpoint interval transactions (see MBusDecoder::SetCheckpointInterval)
+	virtual void CommitCheckpoint( const MBusDecoderCheckpoint& ) {}
+};
+
+// MBus rings have at most 16 nodes
+#define MBUS_DECODER_MAX_NODES 16
+
+// The state machine itself, built for one ring size (see MBusDecoder.cpp)
+class MBusDecoderCore
+{
+public:
+	virtual ~MBusDecoderCore() {}
+	virtual void DecodeTransaction() = 0;
+	virtual void GetCheckpoint( MBusDecoderCheckpoint& checkpoint ) = 0;
+	virtual bool Resume( const MBusDecoderCheckpoint& checkpoint ) = 0;
+	virtual void SetCheckpointInterval( U32 transactions ) = 0;
+	virtual void SetPropagationProfile( MBusPropagationProfile* profile ) = 0;
+};
+
+// The MBus state machine, independent of where the samples come from
+class MBusDecoder
+{
+public:
+	MBusDecoder();
+	~MBusDecoder();
+
+	// Node 0 is the mediator, followed by the members in ring order. Picks
+	// the state machine compiled for exactly this many nodes, whose per-node
+	// loops unroll; specialize = false keeps the any-size one (for timing).
+	void Initialize( const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, MBusDecoderSink* sink, std::ostream* log = NULL, bool specialize = true );
+
+	// Decodes one transaction, from idle through control. Throws
+	// MBusEndOfData when a headless channel runs out of samples.
+	void DecodeTransaction() { mCore->DecodeTransaction(); }
+
+	// Hands the sink a checkpoint after every transactions transactions that
+	// decode cleanly; 0 (the default) takes none
+	void SetCheckpointInterval( U32 transactions ) { mCore->SetCheckpointInterval( transactions ); }
+	// The state right now; only meaningful between DecodeTransaction calls
+	void GetCheckpoint( MBusDecoderCheckpoint& checkpoint ) { mCore->GetCheckpoint( checkpoint ); }
+	// Moves every channel forward to the checkpoint and takes up its state,
+	// so the transactions that follow decode exactly as they did the first
+	// time. The channels must not be past it yet. False if their lines are
+	// not in the state the checkpoint recorded (not the same capture).
+	bool Resume( const MBusDecoderCheckpoint& checkpoint ) { return mCore->Resume( checkpoint ); }
+
+	// Measures every CLK edge's per-hop delays into profile, handed over
+	// after each transaction (a transaction the capture cuts off is not
+	// counted); NULL (the default) measures nothing
+	void SetPropagationProfile( MBusPropagationProfile* profile ) { mCore->SetPropagationProfile( profile ); }
+
+	// The ring size the running state machine was compiled for, 0 if generic
+	int GetSpecializedNodeCount() const { return mSpecializedNodeCount; }
+
+private:
+	MBusDecoder( const MBusDecoder& );
+	MBusDecoder& operator=( const MBusDecoder& );
+
+	MBusDecoderCore* mCore;
+	int mSpecializedNodeCount;
+};
+
+#endif //MBUS_DECODER
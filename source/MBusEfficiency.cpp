@@ -0,0 +1,174 @@
+#include "MBusEfficiency.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef WIN32
+#define snprintf _snprintf
+#endif
+
+/*
+ * The decoder splits each transaction's samples into phases as it goes (see
+ * MBusTransaction::mPhaseSamples), so all that is left here is adding them
+ * up per class of message; cycles, goodput and rates are only worked out
+ * when written.
+ */
+
+static const char* ClassNames[NUM_ADDRESS_CLASSES] = {
+	"Short address",
+	"Full address",
+	"No address",
+};
+
+static MBusAddressClass ClassOf( const MBusTransaction& transaction )
+{
+	if (transaction.mAddressBits == 8)
+		return AddressShort;
+	if (transaction.mAddressBits == 32)
+		return AddressFull;
+	return AddressNone;
+}
+
+static void Sum( MBusEfficiencyCounters& total, const MBusEfficiencyCounters& counters )
+{
+	total.mMessages += counters.mMessages;
+	total.mAddressBits += counters.mAddressBits;
+	total.mPayloadBits += counters.mPayloadBits;
+	for (int i=0; i < NUM_MBUS_PHASES; i++)
+		total.mPhaseSamples[i] += counters.mPhaseSamples[i];
+}
+
+static double SamplesPerCycle( const MBusEfficiencyCounters& counters )
+{
+	U64 bits = counters.mAddressBits + counters.mPayloadBits;
+	if (bits == 0)
+		return 0.0;
+	return (double)(counters.mPhaseSamples[PhaseAddress] + counters.mPhaseSamples[PhaseData]) / bits;
+}
+
+MBusEfficiency::MBusEfficiency()
+{
+	memset( mCounters, 0, sizeof(mCounters) );
+}
+
+MBusEfficiency::~MBusEfficiency()
+{
+}
+
+void MBusEfficiency::Add( const MBusTransaction& transaction )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	MBusEfficiencyCounters& counters = mCounters[ClassOf( transaction )];
+	counters.mMessages++;
+	counters.mAddressBits += transaction.mAddressBits;
+	counters.mPayloadBits += 8 * transaction.mData.size();
+	for (int i=0; i < NUM_MBUS_PHASES; i++)
+		counters.mPhaseSamples[i] += transaction.mPhaseSamples[i];
+}
+
+void MBusEfficiency::Clear()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	memset( mCounters, 0, sizeof(mCounters) );
+}
+
+MBusEfficiencyCounters MBusEfficiency::GetCounters( MBusAddressClass address_class )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	return mCounters[address_class];
+}
+
+MBusEfficiencyCounters MBusEfficiency::GetTotals()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	MBusEfficiencyCounters total;
+	memset( &total, 0, sizeof(total) );
+	for (int i=0; i < NUM_ADDRESS_CLASSES; i++)
+		Sum( total, mCounters[i] );
+	return total;
+}
+
+double MBusEfficiency::GetSamplesPerCycle()
+{
+	return SamplesPerCycle( GetTotals() );
+}
+
+static void WriteCounters( std::ostream& out, const char* name, const MBusEfficiencyCounters& counters, double samples_per_cycle, U32 sample_rate )
+{
+	char line[128];
+	snprintf( line, sizeof(line), "%s, %llu", name, (unsigned long long)counters.mMessages );
+	out << line;
+
+	// Cycles per message by phase, then per message in all
+	double per_message = counters.mMessages ? samples_per_cycle * counters.mMessages : 0.0;
+	for (int i=PhaseArbitration; i < NUM_MBUS_PHASES; i++) {
+		snprintf( line, sizeof(line), ", %.1f", per_message ? counters.mPhaseSamples[i] / per_message : 0.0 );
+		out << line;
+	}
+	U64 busy = BusySamples( counters.mPhaseSamples );
+	snprintf( line, sizeof(line), ", %.1f", per_message ? busy / per_message : 0.0 );
+	out << line;
+
+	double cycles = samples_per_cycle ? busy / samples_per_cycle : 0.0;
+	double seconds = sample_rate ? (double)busy / sample_rate : 0.0;
+	snprintf( line, sizeof(line), ", %llu, %.2f, %.0f",
+		(unsigned long long)counters.mPayloadBits,
+		cycles ? 100.0 * counters.mPayloadBits / cycles : 0.0,
+		seconds ? counters.mPayloadBits / seconds : 0.0 );
+	out << line << "\n";
+}
+
+void WriteEfficiencySummary( std::ostream& out, MBusEfficiency& efficiency, U32 sample_rate )
+{
+	double samples_per_cycle = efficiency.GetSamplesPerCycle();
+	char line[128];
+	snprintf( line, sizeof(line), "Measured Clock [Hz], %.0f\n",
+		(samples_per_cycle && sample_rate) ? sample_rate / samples_per_cycle : 0.0 );
+	out << line;
+
+	out << "Messages, Count";
+	for (int i=PhaseArbitration; i < NUM_MBUS_PHASES; i++)
+		out << ", " << MBusPhaseNames[i] << " [cycles/msg]";
+	out << ", Total [cycles/msg], Payload [bits], Goodput [%], Effective Rate [bit/s]\n";
+
+	for (int i=0; i < NUM_ADDRESS_CLASSES; i++)
+		WriteCounters( out, ClassNames[i], efficiency.GetCounters( (MBusAddressClass)i ), samples_per_cycle, sample_rate );
+	WriteCounters( out, "All", efficiency.GetTotals(), samples_per_cycle, sample_rate );
+}
+
+void WriteEfficiencyHeader( std::ostream& out )
+{
+	out << "Time [s], Transmitter, Addr [in hex], Bytes";
+	for (int i=PhaseArbitration; i < NUM_MBUS_PHASES; i++)
+		out << ", " << MBusPhaseNames[i] << " [cycles]";
+	out << ", Total [cycles], Goodput [%], Effective Rate [bit/s]\n";
+}
+
+void WriteEfficiencyLine( std::ostream& out, const MBusTransaction& transaction, double samples_per_cycle, U32 sample_rate )
+{
+	char line[128];
+	snprintf( line, sizeof(line), "%.9f, %d, ",
+		sample_rate ? (double)transaction.mStartingSampleInclusive / sample_rate : 0.0, transaction.mTransmitter );
+	out << line;
+	if (transaction.mAddressBits)
+		snprintf( line, sizeof(line), (transaction.mAddressBits == 32) ? "0x%08X" : "0x%02X", transaction.mAddress );
+	else
+		line[0] = '\0';
+	out << line;
+	snprintf( line, sizeof(line), ", %u", (unsigned)transaction.mData.size() );
+	out << line;
+
+	for (int i=PhaseArbitration; i < NUM_MBUS_PHASES; i++) {
+		snprintf( line, sizeof(line), ", %.1f", samples_per_cycle ? transaction.mPhaseSamples[i] / samples_per_cycle : 0.0 );
+		out << line;
+	}
+
+	U64 busy = BusySamples( transaction.mPhaseSamples );
+	U64 payload_bits = 8 * transaction.mData.size();
+	double cycles = samples_per_cycle ? busy / samples_per_cycle : 0.0;
+	double seconds = sample_rate ? (double)busy / sample_rate : 0.0;
+	snprintf( line, sizeof(line), ", %.1f, %.2f, %.0f", cycles,
+		cycles ? 100.0 * payload_bits / cycles : 0.0,
+		seconds ? payload_bits / seconds : 0.0 );
+	out << line << "\n";
+}
@@ -0,0 +1,61 @@
+#ifndef MBUS_EFFICIENCY
+#define MBUS_EFFICIENCY
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+
+#include <mutex>
+#include <ostream>
+
+// Which messages a row of the efficiency summary covers
+enum MBusAddressClass {
+	AddressShort,  // 8-bit
+	AddressFull,   // 32-bit
+	AddressNone,   // wakeups and messages interjected before the address
+	NUM_ADDRESS_CLASSES
+};
+
+// Running totals of where bus time went, for one class of message
+struct MBusEfficiencyCounters
+{
+	U64 mMessages;
+	U64 mAddressBits;
+	U64 mPayloadBits;
+	U64 mPhaseSamples[NUM_MBUS_PHASES];
+};
+
+// Protocol overhead against payload, updated as each transaction commits.
+// Every address and data bit is one CLK cycle, so their samples over their
+// bits measure the bus clock, and that turns any phase's samples into
+// cycles. Goodput is payload bits over the cycles the bus was busy (request
+// through control; idle is not counted against a message).
+class MBusEfficiency
+{
+public:
+	MBusEfficiency();
+	~MBusEfficiency();
+
+	void Add( const MBusTransaction& transaction );
+	void Clear();
+
+	MBusEfficiencyCounters GetCounters( MBusAddressClass address_class );
+	MBusEfficiencyCounters GetTotals();
+	// Samples per CLK cycle measured over everything so far, 0 before any
+	// address or data bit
+	double GetSamplesPerCycle();
+
+protected:
+	std::mutex mMutex;
+	MBusEfficiencyCounters mCounters[NUM_ADDRESS_CLASSES];
+};
+
+// A row per class of message and one for all, as cycles per message by
+// phase, goodput and effective payload rate
+void WriteEfficiencySummary( std::ostream& out, MBusEfficiency& efficiency, U32 sample_rate );
+
+// The same breakdown for each transaction, with the clock measured over the
+// whole capture (MBusEfficiency::GetSamplesPerCycle)
+void WriteEfficiencyHeader( std::ostream& out );
+void WriteEfficiencyLine( std::ostream& out, const MBusTransaction& transaction, double samples_per_cycle, U32 sample_rate );
+
+#endif //MBUS_EFFICIENCY
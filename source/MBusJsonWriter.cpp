@@ -0,0 +1,206 @@
+#include "MBusJsonWriter.h"
+
+#include <cstring>
+
+/*
+ * Everything but the payload fits a line in well under MAX_FIXED bytes, so
+ * Write reserves that once, and then the payload in slices that fit the
+ * buffer. Numbers are converted with plain digit loops; snprintf costs more
+ * than the rest of the line put together.
+ */
+
+static const U32 MAX_FIXED = 512;
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static char* PutText( char* out, const char* text )
+{
+	size_t length = strlen( text );
+	memcpy( out, text, length );
+	return out + length;
+}
+
+static char* PutUnsigned( char* out, U64 value )
+{
+	char digits[20];
+	int count = 0;
+	do {
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+	while (count)
+		*out++ = digits[--count];
+	return out;
+}
+
+static char* PutSigned( char* out, S64 value )
+{
+	if (value < 0) {
+		*out++ = '-';
+		return PutUnsigned( out, 0 - (U64)value );
+	}
+	return PutUnsigned( out, (U64)value );
+}
+
+static char* PutHex( char* out, U32 value, int digits )
+{
+	for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+		*out++ = HEX_DIGITS[(value >> shift) & 0xf];
+	return out;
+}
+
+// Seconds with nanosecond digits, exact for any sample count
+static char* PutSeconds( char* out, S64 samples, U32 sample_rate )
+{
+	if (sample_rate == 0)
+		return PutText( out, "0" );
+
+	U64 magnitude = samples;
+	if (samples < 0) {
+		*out++ = '-';
+		magnitude = 0 - (U64)samples;
+	}
+	out = PutUnsigned( out, magnitude / sample_rate );
+	*out++ = '.';
+
+	U64 nanoseconds = (magnitude % sample_rate) * 1000000000ULL / sample_rate;
+	for (U64 scale = 100000000; scale; scale /= 10)
+		*out++ = (char)('0' + (nanoseconds / scale) % 10);
+	return out;
+}
+
+MBusJsonWriter::MBusJsonWriter( U32 buffer_size )
+:	mBuffer( NULL ),
+	mSize( buffer_size < 2 * MAX_FIXED ? 2 * MAX_FIXED : buffer_size ),
+	mUsed( 0 ),
+	mBytesWritten( 0 ),
+	mFile( NULL ),
+	mFailed( false ),
+	mSampleRate( 0 ),
+	mTriggerSample( 0 )
+{
+	mBuffer = new char[mSize];
+}
+
+MBusJsonWriter::~MBusJsonWriter()
+{
+	Close();
+	delete [] mBuffer;
+}
+
+bool MBusJsonWriter::Open( const char* path )
+{
+	Close();
+	mFile = fopen( path, "wb" );
+	mUsed = 0;
+	mBytesWritten = 0;
+	mFailed = mFile == NULL;
+	return !mFailed;
+}
+
+void MBusJsonWriter::SetTiming( U32 sample_rate, U64 trigger_sample )
+{
+	mSampleRate = sample_rate;
+	mTriggerSample = trigger_sample;
+}
+
+bool MBusJsonWriter::Close()
+{
+	if (mFile == NULL)
+		return !mFailed;
+
+	Flush();
+	if (fclose( mFile ) != 0)
+		mFailed = true;
+	mFile = NULL;
+	return !mFailed;
+}
+
+void MBusJsonWriter::Flush()
+{
+	if ((mUsed != 0) && (fwrite( mBuffer, 1, mUsed, mFile ) != mUsed))
+		mFailed = true;
+	mBytesWritten += mUsed;
+	mUsed = 0;
+}
+
+char* MBusJsonWriter::Reserve( U32 bytes )
+{
+	if (mUsed + bytes > mSize)
+		Flush();
+	return mBuffer + mUsed;
+}
+
+void MBusJsonWriter::Write( const MBusTransaction& transaction )
+{
+	if (mFile == NULL)
+		return;
+
+	char* out = Reserve( MAX_FIXED );
+	out = PutText( out, "{\"time\":" );
+	out = PutSeconds( out, (S64)(transaction.mStartingSampleInclusive - mTriggerSample), mSampleRate );
+	out = PutText( out, ",\"sample\":" );
+	out = PutUnsigned( out, transaction.mStartingSampleInclusive );
+	out = PutText( out, ",\"transmitter\":" );
+	out = PutSigned( out, transaction.mTransmitter );
+	out = PutText( out, ",\"requesters\":" );
+	out = PutUnsigned( out, transaction.mRequesters );
+	out = PutText( out, ",\"arbitration_winner\":" );
+	out = PutSigned( out, transaction.mArbitrationWinner );
+	out = PutText( out, ",\"priority_winner\":" );
+	out = PutSigned( out, transaction.mPriorityWinner );
+	if (transaction.mAddressBits == 0) {
+		out = PutText( out, ",\"address\":null,\"address_bits\":0" );
+	} else {
+		out = PutText( out, ",\"address\":\"" );
+		out = PutHex( out, transaction.mAddress, (transaction.mAddressBits == 32) ? 8 : 2 );
+		out = PutText( out, "\",\"address_bits\":" );
+		out = PutUnsigned( out, transaction.mAddressBits );
+	}
+	out = PutText( out, ",\"data\":\"" );
+	mUsed = (U32)(out - mBuffer);
+
+	// The payload has no upper bound, so it goes out in buffer-sized slices
+	const U8* data = transaction.mData.empty() ? NULL : &transaction.mData[0];
+	size_t remaining = transaction.mData.size();
+	while (remaining) {
+		U32 slice = (mSize - MAX_FIXED) / 2;
+		if (slice > remaining)
+			slice = (U32)remaining;
+		out = Reserve( 2 * slice + MAX_FIXED );
+		for (U32 i=0; i < slice; i++) {
+			*out++ = HEX_DIGITS[data[i] >> 4];
+			*out++ = HEX_DIGITS[data[i] & 0xf];
+		}
+		mUsed = (U32)(out - mBuffer);
+		data += slice;
+		remaining -= slice;
+	}
+
+	out = Reserve( MAX_FIXED );
+	out = PutText( out, transaction.mCB0 ? "\",\"cb0\":1" : "\",\"cb0\":0" );
+	out = PutText( out, transaction.mCB1 ? ",\"cb1\":1" : ",\"cb1\":0" );
+	if (!transaction.mCB0)
+		out = PutText( out, ",\"control\":\"error\"" );
+	else if (transaction.mCB1)
+		out = PutText( out, ",\"control\":\"nak\"" );
+	else
+		out = PutText( out, ",\"control\":\"ack\"" );
+
+	out = PutText( out, ",\"flags\":[" );
+	const char* separator = "";
+	if (transaction.mFlags & MULTIPLE_ARBITRATION_WINNER) {
+		out = PutText( out, "\"multiple_arbitration_winners\"" );
+		separator = ",";
+	}
+	if (transaction.mFlags & NO_ARBITRATION_WINNER) {
+		out = PutText( out, separator );
+		out = PutText( out, "\"no_arbitration_winner\"" );
+		separator = ",";
+	}
+	if (transaction.mFlags & REQUEST_BUG_WORKAROUND) {
+		out = PutText( out, separator );
+		out = PutText( out, "\"request_bug_workaround\"" );
+	}
+	out = PutText( out, "]}\n" );
+	mUsed = (U32)(out - mBuffer);
+}
@@ -0,0 +1,55 @@
+#ifndef MBUS_JSON_WRITER
+#define MBUS_JSON_WRITER
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+
+#include <cstdio>
+
+// Writes transactions as JSON Lines, one object per transaction:
+//
+//   {"time":0.000512300,"sample":5123,"transmitter":1,"requesters":3,
+//    "arbitration_winner":1,"priority_winner":-1,"address":"F00000B2",
+//    "address_bits":32,"data":"01234567","cb0":1,"cb1":0,"control":"ack",
+//    "flags":["multiple_arbitration_winners"]}
+//
+// address is null (and address_bits 0) if the transaction was interjected
+// before its address finished; control is ack, nak or error as in the
+// traffic summary. Lines are formatted by hand into one fixed buffer that
+// is written out when full, so a transaction costs no allocation, no
+// locale and no stream call.
+class MBusJsonWriter
+{
+public:
+	explicit MBusJsonWriter( U32 buffer_size = 1 << 20 );
+	~MBusJsonWriter();
+
+	bool Open( const char* path );
+	// time is (sample - trigger_sample) / sample_rate, like the csv export
+	void SetTiming( U32 sample_rate, U64 trigger_sample );
+	void Write( const MBusTransaction& transaction );
+	// False if anything failed to write
+	bool Close();
+
+	U64 GetBytesWritten() const { return mBytesWritten + mUsed; }
+
+private:
+	MBusJsonWriter( const MBusJsonWriter& );
+	MBusJsonWriter& operator=( const MBusJsonWriter& );
+
+	// Makes room for bytes more, writing out what is buffered if need be
+	char* Reserve( U32 bytes );
+	void Flush();
+
+	char* mBuffer;
+	U32 mSize;
+	U32 mUsed;
+	U64 mBytesWritten;
+	FILE* mFile;
+	bool mFailed;
+
+	U32 mSampleRate;
+	U64 mTriggerSample;
+};
+
+#endif //MBUS_JSON_WRITER
@@ -0,0 +1,228 @@
+#include "MBusMessage.h"
+
+#include <cstdio>
+
+#ifdef WIN32
+#define snprintf _snprintf
+#endif
+
+/*
+ * Dispatch is two constant tables indexed by functional unit, one for
+ * prefix 0 (broadcast channels) and one for every other prefix, so a
+ * transaction costs one table load and an indirect call; nothing is looked
+ * up by name or built per capture. Payloads are big-endian 32-bit words, as
+ * the M3 register and memory units send them.
+ */
+
+static_assert( sizeof(MBusMessage) == 40, "MBusMessage records are written to disk as they are" );
+
+const char* const MBusMessageTypeNames[NUM_MBUS_MESSAGE_TYPES] = {
+	"Unknown",
+	"Broadcast",
+	"Enumeration",
+	"Power",
+	"Register Write",
+	"Register Read",
+	"Memory Write",
+	"Memory Read",
+	"Memory Stream",
+};
+
+static U32 Word( const std::vector< U8 >& data, size_t offset )
+{
+	return ((U32)data[offset] << 24) | ((U32)data[offset+1] << 16) | ((U32)data[offset+2] << 8) | data[offset+3];
+}
+
+typedef void (*MBusMessageDecoder)( const MBusTransaction& transaction, MBusMessage& message, std::vector< MBusMessage >& messages );
+
+// Register writes and read requests: one message per word
+static void DecodeRegisterWords( const MBusTransaction& transaction, MBusMessage& message, std::vector< MBusMessage >& messages )
+{
+	const std::vector< U8 >& data = transaction.mData;
+	size_t offset = 0;
+	for ( ; offset + 4 <= data.size(); offset += 4) {
+		U32 word = Word(data, offset);
+		message.mAddress = word >> 24;
+		if (message.mType == MessageRegisterWrite) {
+			message.mValue = word & 0xffffff;
+		} else {
+			message.mValue = ((word >> 16) & 0xff) + 1; // registers to read
+			message.mReply = (word >> 8) & 0xff;
+			message.mDestination = word & 0xff;
+		}
+		message.mOffset = (U32)offset;
+		message.mLength = 4;
+		messages.push_back(message);
+	}
+
+	if ((offset < data.size()) || data.empty()) {
+		message.mAddress = 0;
+		message.mValue = 0;
+		message.mReply = 0;
+		message.mDestination = 0;
+		message.mOffset = (U32)offset;
+		message.mLength = (U32)(data.size() - offset);
+		message.mStatus |= MESSAGE_TRUNCATED;
+		messages.push_back(message);
+	}
+}
+
+static void DecodeMemoryWrite( const MBusTransaction& transaction, MBusMessage& message, std::vector< MBusMessage >& messages )
+{
+	const std::vector< U8 >& data = transaction.mData;
+	if (data.size() >= 4) {
+		message.mAddress = Word(data, 0);
+		message.mValue = (U32)((data.size() - 4) / 4);
+		message.mOffset = 4;
+		message.mLength = (U32)(data.size() - 4);
+	}
+	if ((data.size() < 8) || (data.size() % 4))
+		message.mStatus |= MESSAGE_TRUNCATED;
+	messages.push_back(message);
+}
+
+static void DecodeMemoryRead( const MBusTransaction& transaction, MBusMessage& message, std::vector< MBusMessage >& messages )
+{
+	const std::vector< U8 >& data = transaction.mData;
+	if (data.size() >= 8) {
+		U32 word = Word(data, 0);
+		message.mReply = word >> 24;
+		message.mValue = (word & 0xfffff) + 1; // words to read
+		message.mAddress = Word(data, 4);
+		if (data.size() >= 12)
+			message.mDestination = Word(data, 8);
+	}
+	message.mLength = (U32)data.size();
+	if ((data.size() < 8) || (data.size() % 4))
+		message.mStatus |= MESSAGE_TRUNCATED;
+	messages.push_back(message);
+}
+
+static void DecodeMemoryStream( const MBusTransaction& transaction, MBusMessage& message, std::vector< MBusMessage >& messages )
+{
+	message.mAddress = message.mUnit - 4; // stream channel
+	message.mValue = (U32)(transaction.mData.size() / 4);
+	message.mLength = (U32)transaction.mData.size();
+	if (transaction.mData.empty() || (transaction.mData.size() % 4))
+		message.mStatus |= MESSAGE_TRUNCATED;
+	messages.push_back(message);
+}
+
+// A command in the top nibble of the first word, its argument in the rest
+static void DecodeBroadcast( const MBusTransaction& transaction, MBusMessage& message, std::vector< MBusMessage >& messages )
+{
+	const std::vector< U8 >& data = transaction.mData;
+	if (data.size() >= 4) {
+		U32 word = Word(data, 0);
+		message.mAddress = word >> 28;
+		message.mValue = word & 0x0fffffff;
+	} else {
+		message.mStatus |= MESSAGE_TRUNCATED;
+	}
+	message.mLength = (U32)data.size();
+	messages.push_back(message);
+}
+
+static void DecodeOpaque( const MBusTransaction& transaction, MBusMessage& message, std::vector< MBusMessage >& messages )
+{
+	message.mLength = (U32)transaction.mData.size();
+	messages.push_back(message);
+}
+
+struct MBusMessageRule
+{
+	MBusMessageType mType;
+	MBusMessageDecoder mDecode;
+};
+
+static constexpr MBusMessageRule BROADCAST_RULES[16] = {
+	{ MessageEnumeration, DecodeBroadcast },
+	{ MessagePower, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+	{ MessageBroadcast, DecodeBroadcast },
+};
+
+static constexpr MBusMessageRule UNIT_RULES[16] = {
+	{ MessageRegisterWrite, DecodeRegisterWords },
+	{ MessageRegisterRead, DecodeRegisterWords },
+	{ MessageMemoryWrite, DecodeMemoryWrite },
+	{ MessageMemoryRead, DecodeMemoryRead },
+	{ MessageMemoryStream, DecodeMemoryStream },
+	{ MessageMemoryStream, DecodeMemoryStream },
+	{ MessageMemoryStream, DecodeMemoryStream },
+	{ MessageMemoryStream, DecodeMemoryStream },
+	{ MessageUnknown, DecodeOpaque },
+	{ MessageUnknown, DecodeOpaque },
+	{ MessageUnknown, DecodeOpaque },
+	{ MessageUnknown, DecodeOpaque },
+	{ MessageUnknown, DecodeOpaque },
+	{ MessageUnknown, DecodeOpaque },
+	{ MessageUnknown, DecodeOpaque },
+	{ MessageUnknown, DecodeOpaque },
+};
+
+static_assert( UNIT_RULES[3].mType == MessageMemoryRead, "functional unit 3 is memory read" );
+static_assert( BROADCAST_RULES[0].mType == MessageEnumeration, "channel 0 is enumeration" );
+
+void DecodeMessages( const MBusTransaction& transaction, std::vector< MBusMessage >& messages )
+{
+	if (transaction.mAddressBits == 0)
+		return;
+
+	MBusMessage message;
+	message.mSample = transaction.mStartingSampleInclusive;
+	// The prefix as MBusAddressIndex splits it: bits 23:4 of a full address
+	message.mTarget = (transaction.mAddressBits == 32) ? (transaction.mAddress >> 4) & 0xfffff : transaction.mAddress >> 4;
+	message.mAddress = 0;
+	message.mValue = 0;
+	message.mReply = 0;
+	message.mDestination = 0;
+	message.mOffset = 0;
+	message.mLength = 0;
+	message.mUnit = transaction.mAddress & 0xf;
+	message.mStatus = (transaction.mAddressBits == 32) ? MESSAGE_FULL_ADDRESS : 0;
+	if (!transaction.mCB0)
+		message.mStatus |= MESSAGE_ERROR;
+	else if (transaction.mCB1)
+		message.mStatus |= MESSAGE_NAKED;
+	message.mTransmitter = (S8)transaction.mTransmitter;
+
+	const MBusMessageRule& rule = (message.mTarget == 0) ? BROADCAST_RULES[message.mUnit] : UNIT_RULES[message.mUnit];
+	message.mType = (U8)rule.mType;
+	rule.mDecode(transaction, message, messages);
+}
+
+void WriteMessagesHeader( std::ostream& out )
+{
+	out << "Time [s], Type, Target, Unit, Address, Value, Reply, Destination, Status\n";
+}
+
+void FormatMessageLine( std::vector< char >& out, const MBusMessage& message, U32 sample_rate )
+{
+	const char* status = "Ack";
+	if (message.mStatus & MESSAGE_ERROR)
+		status = "Error";
+	else if (message.mStatus & MESSAGE_NAKED)
+		status = "Nak";
+
+	char line[256];
+	int length = snprintf(line, sizeof(line), "%.9f, %s, %0*X, %X, 0x%08X, 0x%X, %02X, 0x%X, %s%s",
+		sample_rate ? (double) message.mSample / sample_rate : 0.0,
+		MBusMessageTypeNames[message.mType],
+		(message.mStatus & MESSAGE_FULL_ADDRESS) ? 5 : 1, message.mTarget,
+		message.mUnit, message.mAddress, message.mValue, message.mReply, message.mDestination,
+		status, (message.mStatus & MESSAGE_TRUNCATED) ? " Truncated" : "");
+	out.insert(out.end(), line, line + length);
+}
@@ -0,0 +1,60 @@
+#ifndef MBUS_MESSAGE
+#define MBUS_MESSAGE
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+
+#include <ostream>
+#include <vector>
+
+// The message layer above address and data. Which one a transaction carries
+// is fixed by its address: prefix 0 is a broadcast and the functional unit is
+// the channel, anything else is a unit of a node.
+enum MBusMessageType {
+	MessageUnknown,        // reserved functional unit
+	MessageBroadcast,      // channels 2-15
+	MessageEnumeration,    // channel 0: query, response, enumerate, invalidate
+	MessagePower,          // channel 1
+	MessageRegisterWrite,  // unit 0: one message per <register, 24-bit value> word
+	MessageRegisterRead,   // unit 1: one message per read request word
+	MessageMemoryWrite,    // unit 2: <address> then data words
+	MessageMemoryRead,     // unit 3: <reply, length> <source> [<destination>]
+	MessageMemoryStream,   // units 4-7: data words for stream channel 0-3
+	NUM_MBUS_MESSAGE_TYPES
+};
+extern const char* const MBusMessageTypeNames[NUM_MBUS_MESSAGE_TYPES];
+
+// Status bits
+#define MESSAGE_NAKED     (1 << 0) // CB0 high, CB1 high
+#define MESSAGE_ERROR     (1 << 1) // CB0 low
+#define MESSAGE_TRUNCATED (1 << 2) // payload too short, or not whole words
+#define MESSAGE_FULL_ADDRESS (1 << 3) // sent to a 32-bit address
+
+// One typed message, 40 bytes. Payload bytes are not copied; mOffset and
+// mLength say which of the transaction's bytes the message covers.
+struct MBusMessage
+{
+	U64 mSample;      // first sample of the transaction
+	U32 mTarget;      // short (4-bit) or full (20-bit) prefix it was sent to
+	U32 mAddress;     // register, memory address, stream channel or broadcast command
+	U32 mValue;       // register value, word count, or broadcast argument
+	U32 mReply;       // reads: the short address the reply goes to
+	U32 mDestination; // reads: the register or memory address the reply writes
+	U32 mOffset;
+	U32 mLength;
+	U8 mType;
+	U8 mUnit;         // functional unit, or broadcast channel
+	U8 mStatus;
+	S8 mTransmitter;  // as the transaction's, -1 for the mediator's wakeup
+};
+
+// Appends the messages a committed transaction carries (none if it was
+// interjected before its address finished)
+void DecodeMessages( const MBusTransaction& transaction, std::vector< MBusMessage >& messages );
+
+// Time [s], Type, Target, Unit, Address, Value, Reply, Destination, Status
+void WriteMessagesHeader( std::ostream& out );
+// One csv line, without a newline, appended to out
+void FormatMessageLine( std::vector< char >& out, const MBusMessage& message, U32 sample_rate );
+
+#endif //MBUS_MESSAGE
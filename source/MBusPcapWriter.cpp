@@ -0,0 +1,126 @@
+#include "MBusPcapWriter.h"
+
+#include <cstring>
+
+/*
+ * Each packet goes out as two fwrites, its headers then its payload, into a
+ * large stdio buffer, so the file is written in one pass and in big blocks
+ * whatever the traffic looks like.
+ */
+
+static const size_t BUFFER_SIZE = 1 << 20;
+
+struct PcapFileHeader
+{
+	U32 mMagic;
+	U16 mVersionMajor;
+	U16 mVersionMinor;
+	S32 mThisZone;
+	U32 mSigFigs;
+	U32 mSnapLen;
+	U32 mLinkType;
+};
+
+struct PcapRecord
+{
+	U32 mSeconds;
+	U32 mNanoseconds;
+	U32 mIncludedLength;
+	U32 mOriginalLength;
+	MBusPcapHeader mMBus;
+};
+
+static_assert( sizeof(MBusPcapHeader) == 16, "MBusPcapHeader is written as it is" );
+static_assert( sizeof(PcapRecord) == 32, "PcapRecord is written as it is" );
+
+MBusPcapWriter::MBusPcapWriter()
+:	mFile( NULL ),
+	mBuffer( new char[BUFFER_SIZE] ),
+	mFailed( false ),
+	mSampleRate( 0 ),
+	mBytesWritten( 0 )
+{
+}
+
+MBusPcapWriter::~MBusPcapWriter()
+{
+	Close();
+	delete [] mBuffer;
+}
+
+bool MBusPcapWriter::Open( const char* path, U32 sample_rate )
+{
+	Close();
+	mSampleRate = sample_rate;
+	mBytesWritten = 0;
+	mFile = fopen( path, "wb" );
+	mFailed = mFile == NULL;
+	if (mFailed)
+		return false;
+	setvbuf( mFile, mBuffer, _IOFBF, BUFFER_SIZE );
+
+	PcapFileHeader header;
+	header.mMagic = 0xa1b23c4d; // nanosecond timestamps
+	header.mVersionMajor = 2;
+	header.mVersionMinor = 4;
+	header.mThisZone = 0;
+	header.mSigFigs = 0;
+	header.mSnapLen = MBUS_PCAP_SNAPLEN;
+	header.mLinkType = MBUS_PCAP_LINKTYPE;
+	if (fwrite( &header, sizeof(header), 1, mFile ) != 1)
+		mFailed = true;
+	mBytesWritten += sizeof(header);
+	return !mFailed;
+}
+
+bool MBusPcapWriter::Close()
+{
+	if (mFile == NULL)
+		return !mFailed;
+
+	if (fclose( mFile ) != 0)
+		mFailed = true;
+	mFile = NULL;
+	return !mFailed;
+}
+
+void MBusPcapWriter::Write( const MBusTransaction& transaction )
+{
+	if (mFile == NULL)
+		return;
+
+	PcapRecord record;
+	U64 sample = transaction.mStartingSampleInclusive;
+	if (mSampleRate) {
+		record.mSeconds = (U32)(sample / mSampleRate);
+		record.mNanoseconds = (U32)((sample % mSampleRate) * 1000000000ULL / mSampleRate);
+	} else {
+		record.mSeconds = 0;
+		record.mNanoseconds = 0;
+	}
+
+	U32 length = (U32)transaction.mData.size();
+	U32 included = length;
+	if (included > MBUS_PCAP_SNAPLEN - sizeof(MBusPcapHeader))
+		included = MBUS_PCAP_SNAPLEN - sizeof(MBusPcapHeader);
+	record.mIncludedLength = sizeof(MBusPcapHeader) + included;
+	record.mOriginalLength = sizeof(MBusPcapHeader) + length;
+
+	MBusPcapHeader& mbus = record.mMBus;
+	mbus.mVersion = 1;
+	mbus.mAddressBits = transaction.mAddressBits;
+	mbus.mControl = (transaction.mCB0 ? MBUS_PCAP_CB0 : 0) | (transaction.mCB1 ? MBUS_PCAP_CB1 : 0);
+	mbus.mFlags = transaction.mFlags;
+	mbus.mTransmitter = (S8)transaction.mTransmitter;
+	mbus.mArbitrationWinner = (S8)transaction.mArbitrationWinner;
+	mbus.mPriorityWinner = (S8)transaction.mPriorityWinner;
+	mbus.mReserved = 0;
+	mbus.mAddress = transaction.mAddressBits ? transaction.mAddress : 0;
+	mbus.mRequesters = transaction.mRequesters;
+
+	if (fwrite( &record, sizeof(record), 1, mFile ) != 1)
+		mFailed = true;
+	if (included && (fwrite( &transaction.mData[0], 1, included, mFile ) != included))
+		mFailed = true;
+	mBytesWritten += sizeof(record) + included;
+}
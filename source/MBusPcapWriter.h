@@ -0,0 +1,70 @@
+#ifndef MBUS_PCAP_WRITER
+#define MBUS_PCAP_WRITER
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+
+#include <cstdio>
+
+/* Transactions as pcap packets
+ *
+ * A nanosecond pcap file (magic a1b23c4d) with link type LINKTYPE_USER0,
+ * the one set aside for private protocols, so packet tools, filters and
+ * indexers can carry MBus traffic; a dissector only has to know the record
+ * below. Each packet is one transaction, timestamped from its first sample
+ * (time since the start of the capture):
+ *
+ *   MBusPcapHeader   16 bytes
+ *   payload          the data bytes, as sent
+ *
+ * Payloads longer than the snap length are cut short, with the packet's
+ * original length still the full one. Everything is little-endian.
+ */
+
+#define MBUS_PCAP_LINKTYPE 147 // LINKTYPE_USER0
+#define MBUS_PCAP_SNAPLEN 262144
+
+// MBusPcapHeader::mControl
+#define MBUS_PCAP_CB0 (1 << 0)
+#define MBUS_PCAP_CB1 (1 << 1)
+
+struct MBusPcapHeader
+{
+	U8 mVersion;       // 1
+	U8 mAddressBits;   // 8 or 32, 0 if interjected before the address finished
+	U8 mControl;       // MBUS_PCAP_CB0 | MBUS_PCAP_CB1
+	U8 mFlags;         // the transaction's decode flags
+	S8 mTransmitter;   // -1 for the mediator's wakeup
+	S8 mArbitrationWinner;
+	S8 mPriorityWinner;
+	U8 mReserved;
+	U32 mAddress;
+	U32 mRequesters;   // one bit per node, mediator is bit 0
+};
+
+class MBusPcapWriter
+{
+public:
+	MBusPcapWriter();
+	~MBusPcapWriter();
+
+	// Writes the file header; timestamps are sample / sample_rate
+	bool Open( const char* path, U32 sample_rate );
+	void Write( const MBusTransaction& transaction );
+	// False if anything failed to write
+	bool Close();
+
+	U64 GetBytesWritten() const { return mBytesWritten; }
+
+private:
+	MBusPcapWriter( const MBusPcapWriter& );
+	MBusPcapWriter& operator=( const MBusPcapWriter& );
+
+	FILE* mFile;
+	char* mBuffer;
+	bool mFailed;
+	U32 mSampleRate;
+	U64 mBytesWritten;
+};
+
+#endif //MBUS_PCAP_WRITER
@@ -0,0 +1,192 @@
+#include "MBusPropagation.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef WIN32
+#define snprintf _snprintf
+#endif
+
+/*
+ * A hop's delay is a handful of samples at any sensible sample rate, so one
+ * bin per sample up to MBUS_PROPAGATION_BINS covers it exactly, and the
+ * whole profile is a fixed 16 x 2 table that never grows. An edge costs a
+ * bin increment and an add per hop; counts and extremes are only worked
+ * out when a batch moves, once per transaction.
+ */
+
+static const char* DirectionName( bool rising )
+{
+	return rising ? "rising" : "falling";
+}
+
+static void ClearHistogram( MBusDelayHistogram& histogram )
+{
+	memset( &histogram, 0, sizeof(histogram) );
+	histogram.mMin = ~0ULL;
+}
+
+void MBusPropagationTable::Clear( int node_count )
+{
+	if (node_count > MBUS_PROPAGATION_MAX_HOPS + 1)
+		node_count = MBUS_PROPAGATION_MAX_HOPS + 1;
+	mHops = (node_count > 1) ? node_count - 1 : 0;
+	for (int hop=0; hop <= MBUS_PROPAGATION_MAX_HOPS; hop++) {
+		ClearHistogram( mHistograms[hop][0] );
+		ClearHistogram( mHistograms[hop][1] );
+	}
+}
+
+void MBusPropagationTable::Add( MBusDelayHistogram& histogram, U64 delay )
+{
+	// Per edge only the bin and the total; the rest is worked out from the
+	// bins when the batch moves, except the extremes of the last one
+	histogram.mTotal += delay;
+	if (delay < MBUS_PROPAGATION_BINS - 1) {
+		histogram.mBins[delay]++;
+	} else {
+		histogram.mBins[MBUS_PROPAGATION_BINS - 1]++;
+		if (delay < histogram.mMin)
+			histogram.mMin = delay;
+		if (delay > histogram.mMax)
+			histogram.mMax = delay;
+	}
+}
+
+void MBusPropagationTable::AddEdge( bool rising, const U64* edges )
+{
+	bool whole_chain = true;
+	for (int hop=0; hop < mHops; hop++) {
+		U64 from = edges[hop];
+		U64 to = edges[hop + 1];
+		if ((from == 0) || (to < from)) {
+			whole_chain = false;
+			continue;
+		}
+		Add( mHistograms[hop][rising], to - from );
+	}
+	if (whole_chain && mHops)
+		Add( mHistograms[MBUS_PROPAGATION_MAX_HOPS][rising], edges[mHops] - edges[0] );
+}
+
+void MBusPropagationTable::MoveTo( MBusPropagationTable& total )
+{
+	for (int hop=0; hop <= MBUS_PROPAGATION_MAX_HOPS; hop++) {
+		if ((hop >= mHops) && (hop < MBUS_PROPAGATION_MAX_HOPS))
+			continue;
+		for (int rising=0; rising < 2; rising++) {
+			MBusDelayHistogram& from = mHistograms[hop][rising];
+			MBusDelayHistogram& to = total.mHistograms[hop][rising];
+			for (U64 bin=0; bin < MBUS_PROPAGATION_BINS - 1; bin++) {
+				U64 edges = from.mBins[bin];
+				if (edges == 0)
+					continue;
+				to.mBins[bin] += edges;
+				to.mEdges += edges;
+				if (bin < to.mMin)
+					to.mMin = bin;
+				if (bin > to.mMax)
+					to.mMax = bin;
+				from.mBins[bin] = 0;
+			}
+			U64 longest = from.mBins[MBUS_PROPAGATION_BINS - 1];
+			if (longest) {
+				to.mBins[MBUS_PROPAGATION_BINS - 1] += longest;
+				to.mEdges += longest;
+				if (from.mMin < to.mMin)
+					to.mMin = from.mMin;
+				if (from.mMax > to.mMax)
+					to.mMax = from.mMax;
+				from.mBins[MBUS_PROPAGATION_BINS - 1] = 0;
+			}
+			to.mTotal += from.mTotal;
+			from.mTotal = 0;
+			from.mMin = ~0ULL;
+			from.mMax = 0;
+		}
+	}
+}
+
+const MBusDelayHistogram& MBusPropagationTable::GetHistogram( int hop, bool rising ) const
+{
+	if (hop >= mHops)
+		hop = MBUS_PROPAGATION_MAX_HOPS;
+	return mHistograms[hop][rising];
+}
+
+MBusPropagationProfile::MBusPropagationProfile()
+{
+	Initialize( 0 );
+}
+
+MBusPropagationProfile::~MBusPropagationProfile()
+{
+}
+
+void MBusPropagationProfile::Initialize( int node_count )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	mTotal.Clear( node_count );
+}
+
+void MBusPropagationProfile::Add( MBusPropagationTable& batch )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	batch.MoveTo( mTotal );
+}
+
+void MBusPropagationProfile::GetTable( MBusPropagationTable& table )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	table = mTotal;
+}
+
+void WritePropagationProfile( std::ostream& out, MBusPropagationProfile& profile, U32 sample_rate )
+{
+	// A copy, so the decoder is not held up while this is written
+	MBusPropagationTable table;
+	profile.GetTable( table );
+
+	double ns_per_sample = sample_rate ? 1e9 / sample_rate : 0.0;
+	int hops = table.GetHopCount();
+	char name[32];
+	char line[256];
+
+	out << "Hop, Direction, Edges, Min [ns], Mean [ns], Max [ns]\n";
+	for (int hop=0; hop <= hops; hop++) {
+		if (hop < hops)
+			snprintf( name, sizeof(name), "%d-%d", hop, hop + 1 );
+		else
+			snprintf( name, sizeof(name), "0-%d", hops );
+		for (int rising=1; rising >= 0; rising--) {
+			const MBusDelayHistogram& histogram = table.GetHistogram( hop, rising != 0 );
+			if (histogram.mEdges == 0) {
+				snprintf( line, sizeof(line), "%s, %s, 0, , , ", name, DirectionName( rising != 0 ) );
+			} else {
+				snprintf( line, sizeof(line), "%s, %s, %llu, %.1f, %.1f, %.1f", name, DirectionName( rising != 0 ),
+					(unsigned long long) histogram.mEdges, histogram.mMin * ns_per_sample,
+					(double) histogram.mTotal / histogram.mEdges * ns_per_sample, histogram.mMax * ns_per_sample );
+			}
+			out << line << "\n";
+		}
+	}
+
+	out << "\nHop, Direction, Delay [samples], Delay [ns], Edges\n";
+	for (int hop=0; hop <= hops; hop++) {
+		if (hop < hops)
+			snprintf( name, sizeof(name), "%d-%d", hop, hop + 1 );
+		else
+			snprintf( name, sizeof(name), "0-%d", hops );
+		for (int rising=1; rising >= 0; rising--) {
+			const MBusDelayHistogram& histogram = table.GetHistogram( hop, rising != 0 );
+			for (int bin=0; bin < MBUS_PROPAGATION_BINS; bin++) {
+				if (histogram.mBins[bin] == 0)
+					continue;
+				snprintf( line, sizeof(line), "%s, %s, %s%d, %.1f, %llu", name, DirectionName( rising != 0 ),
+					(bin == MBUS_PROPAGATION_BINS - 1) ? ">=" : "", bin, bin * ns_per_sample,
+					(unsigned long long) histogram.mBins[bin] );
+				out << line << "\n";
+			}
+		}
+	}
+}
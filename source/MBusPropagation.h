@@ -0,0 +1,81 @@
+#ifndef MBUS_PROPAGATION
+#define MBUS_PROPAGATION
+
+#include "MBusTypes.h"
+
+#include <mutex>
+#include <ostream>
+
+// MBus rings have at most 16 nodes (MBUS_DECODER_MAX_NODES)
+#define MBUS_PROPAGATION_MAX_HOPS 15
+// Delays of this many samples or more share the last bin
+#define MBUS_PROPAGATION_BINS 64
+
+// Streaming delay distribution for one hop and one edge direction, in
+// samples. A table still filling (a decoder's batch) only keeps the bins,
+// the total and the extremes of the last bin; mEdges, mMin and mMax cover
+// everything once it has moved to the profile.
+struct MBusDelayHistogram
+{
+	U64 mEdges;
+	U64 mTotal; // for the mean
+	U64 mMin;
+	U64 mMax;
+	U64 mBins[MBUS_PROPAGATION_BINS];
+};
+
+// How long each CLK edge takes to get from one node to the next. The
+// mediator drives CLK and every member forwards it, so an edge reaches node
+// 0, 1, ... in ring order; for every edge the decoder latches it is handed
+// the sample each node's CLK last moved on, and hop i is the delay from node
+// i to node i+1. The sum of the hops (0 to the last node) is kept as well,
+// since that is what bounds the ring clock. Memory and work per edge are
+// fixed, and nothing here locks: see MBusPropagationProfile.
+class MBusPropagationTable
+{
+public:
+	void Clear( int node_count );
+
+	// edges[i] is the sample node i's CLK moved on, 0 if it didn't in the
+	// same direction (e.g. a glitch); hops with a missing or out of order
+	// end are skipped
+	void AddEdge( bool rising, const U64* edges );
+	// Adds everything here to total and clears this
+	void MoveTo( MBusPropagationTable& total );
+
+	int GetHopCount() const { return mHops; }
+	// hop == GetHopCount() is the whole chain
+	const MBusDelayHistogram& GetHistogram( int hop, bool rising ) const;
+
+protected:
+	static void Add( MBusDelayHistogram& histogram, U64 delay );
+
+	int mHops;
+	// [hop][rising], with the whole chain after the last hop
+	MBusDelayHistogram mHistograms[MBUS_PROPAGATION_MAX_HOPS + 1][2];
+};
+
+// The table the analyzer exports while it decodes. The decoder adds edges
+// to a table of its own and hands them over here once per transaction, so
+// the lock is taken per transaction rather than per edge.
+class MBusPropagationProfile
+{
+public:
+	MBusPropagationProfile();
+	~MBusPropagationProfile();
+
+	void Initialize( int node_count );
+
+	void Add( MBusPropagationTable& batch );
+	void GetTable( MBusPropagationTable& table );
+
+protected:
+	std::mutex mMutex;
+	MBusPropagationTable mTotal;
+};
+
+// A summary row per hop and direction (edges, min, mean and max in ns),
+// then every non-empty bin
+void WritePropagationProfile( std::ostream& out, MBusPropagationProfile& profile, U32 sample_rate );
+
+#endif //MBUS_PROPAGATION
@@ -0,0 +1,265 @@
+#include "MBusRingSet.h"
+
+#include <algorithm>
+
+/*
+ * A transaction begins when the last node's CLK first moves (see
+ * Process_IdleToArbitration), so a ring is due a turn while that edge lies
+ * inside the window. The check only peeks, which the SDK answers as soon as
+ * the window's samples are in, so a quiet ring never holds up a busy one.
+ * The one exception is a ring idle for more than 2^32 samples, longer than a
+ * peek reaches: that waits for the ring's next edge.
+ *
+ * Frames wait per ring until every ring has had its turn, then go out
+ * earliest first. A transaction that runs past the window keeps its later
+ * frames back for the next round, when everything decoded then starts after
+ * them. Anything a ring hands over between frames (its commits, checkpoints)
+ * goes out right behind the frame before it, which keeps the order the
+ * results sink relies on: a data block frame is followed by its commit.
+ */
+
+void MBusRingSet::Ring::AddFrame( const MBusFrame& frame )
+{
+	if (mCompact) {
+		if (frame.mType == FrameTypeData) {
+			if (mDataBytes == 0)
+				mDataStart = frame.mStartingSampleInclusive;
+			mDataEnd = frame.mEndingSampleInclusive;
+			mDataBytes++;
+			return;
+		}
+		if (mDataBytes) {
+			// The sink fills in the id its store gives the message
+			MBusFrame block;
+			block.mStartingSampleInclusive = mDataStart;
+			block.mEndingSampleInclusive = mDataEnd;
+			block.mData1 = 0;
+			block.mData2 = mDataBytes;
+			block.mType = FrameTypeDataBlock;
+			block.mFlags = 0;
+			Hand( block );
+			mDataBytes = 0;
+		}
+	}
+	Hand( frame );
+}
+
+void MBusRingSet::Ring::Hand( const MBusFrame& frame )
+{
+	if (mBuffered)
+		mFrames.push_back( frame );
+	else
+		mSink->AddFrame( frame );
+}
+
+void MBusRingSet::Ring::CommitResults()
+{
+	if (!mBuffered) {
+		mSink->CommitResults();
+		return;
+	}
+	mCommits.push_back( Commit() );
+	mCommits.back().mKind = CommitKindResults;
+	mCommits.back().mFrames = mFrames.size();
+}
+
+void MBusRingSet::Ring::CommitTransaction( const MBusTransaction& transaction )
+{
+	if (!mBuffered) {
+		mSink->CommitTransaction( transaction );
+		return;
+	}
+	if (mTransactionCount == mTransactions.size())
+		mTransactions.push_back( transaction );
+	else
+		mTransactions[mTransactionCount] = transaction;
+	mTransactionCount++;
+	mCommits.push_back( Commit() );
+	mCommits.back().mKind = CommitKindTransaction;
+	mCommits.back().mFrames = mFrames.size();
+}
+
+void MBusRingSet::Ring::ReportProgress( U64 sample_number )
+{
+	// Held back rings are reported once per window by DecodeWindow
+	if (!mBuffered)
+		mSink->ReportProgress( sample_number );
+}
+
+void MBusRingSet::Ring::CommitCheckpoint( const MBusDecoderCheckpoint& checkpoint )
+{
+	if (!mBuffered) {
+		mSink->CommitCheckpoint( checkpoint );
+		return;
+	}
+	mCommits.push_back( Commit() );
+	mCommits.back().mKind = CommitKindCheckpoint;
+	mCommits.back().mFrames = mFrames.size();
+	mCommits.back().mCheckpoint = checkpoint;
+}
+
+void MBusRingSet::Ring::DeliverUntilFrame()
+{
+	while ((mNextCommit < mCommits.size()) && (mCommits[mNextCommit].mFrames <= mNextFrame)) {
+		Commit& commit = mCommits[mNextCommit++];
+		if (commit.mKind == CommitKindTransaction)
+			mSink->CommitTransaction( mTransactions[mNextTransaction++] );
+		else if (commit.mKind == CommitKindResults)
+			mSink->CommitResults();
+		else
+			mSink->CommitCheckpoint( commit.mCheckpoint );
+	}
+}
+
+void MBusRingSet::Ring::DropDelivered()
+{
+	// What is left is at most the one transaction still running past the
+	// window, so moving it down is cheap
+	mFrames.erase( mFrames.begin(), mFrames.begin() + mNextFrame );
+	mCommits.erase( mCommits.begin(), mCommits.begin() + mNextCommit );
+	for (size_t i=0; i < mCommits.size(); i++)
+		mCommits[i].mFrames -= mNextFrame;
+	// Delivered slots go to the back to be reused
+	std::rotate( mTransactions.begin(), mTransactions.begin() + mNextTransaction, mTransactions.begin() + mTransactionCount );
+	mTransactionCount -= mNextTransaction;
+	mNextFrame = 0;
+	mNextCommit = 0;
+	mNextTransaction = 0;
+}
+
+MBusRingSet::MBusRingSet()
+:	mWindow( MBUS_RING_SET_WINDOW ),
+	mCompact( false ),
+	mHorizon( 0 ),
+	mDelivered( 0 )
+{
+}
+
+MBusRingSet::~MBusRingSet()
+{
+	Clear();
+}
+
+void MBusRingSet::AddRing( const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, MBusDecoderSink* sink, std::ostream* log, bool specialize )
+{
+	Ring* ring = new Ring();
+	ring->mSink = sink;
+	ring->mLastNodeCLK = node_clks.back();
+	ring->mFinished = false;
+	ring->mCompact = mCompact;
+	ring->mDataBytes = 0;
+	ring->mNextFrame = 0;
+	ring->mNextCommit = 0;
+	ring->mNextTransaction = 0;
+	ring->mTransactionCount = 0;
+	ring->mDecoder.Initialize( node_clks, node_dats, ring, log, specialize );
+	mRings.push_back( ring );
+
+	for (size_t i=0; i < mRings.size(); i++)
+		mRings[i]->mBuffered = mRings.size() > 1;
+}
+
+void MBusRingSet::Clear()
+{
+	for (size_t i=0; i < mRings.size(); i++)
+		delete mRings[i];
+	mRings.clear();
+	mHorizon = 0;
+	mDelivered = 0;
+}
+
+void MBusRingSet::SetCompactData( bool compact )
+{
+	mCompact = compact;
+	for (size_t i=0; i < mRings.size(); i++)
+		mRings[i]->mCompact = compact;
+}
+
+bool MBusRingSet::IsReady( Ring& ring, U64 horizon )
+{
+	U64 position = ring.mLastNodeCLK->GetSampleNumber();
+	if (position >= horizon)
+		return false;
+	if (horizon - position > 0xffffffffULL)
+		return ring.mLastNodeCLK->GetSampleOfNextEdge() <= horizon;
+	return ring.mLastNodeCLK->WouldAdvancingCauseTransition( (U32)(horizon - position) );
+}
+
+void MBusRingSet::Deliver( U64 limit )
+{
+	while (true) {
+		// The ring with the earliest frame, and how far it can go before
+		// another ring's frames are due
+		Ring* next = NULL;
+		S64 next_start = 0;
+		S64 bound = (S64)limit;
+		for (size_t i=0; i < mRings.size(); i++) {
+			Ring* ring = mRings[i];
+			ring->DeliverUntilFrame();
+			if (ring->mNextFrame == ring->mFrames.size())
+				continue;
+			S64 start = ring->mFrames[ring->mNextFrame].mStartingSampleInclusive;
+			if ((next == NULL) || (start < next_start)) {
+				if (next != NULL)
+					bound = std::min( bound, next_start );
+				next = ring;
+				next_start = start;
+			} else {
+				bound = std::min( bound, start );
+			}
+		}
+		if ((next == NULL) || (next_start > (S64)limit))
+			break;
+
+		do {
+			MBusFrame& frame = next->mFrames[next->mNextFrame++];
+			if ((frame.mStartingSampleInclusive < mDelivered) && (mDelivered <= frame.mEndingSampleInclusive))
+				frame.mStartingSampleInclusive = mDelivered;
+			if (frame.mStartingSampleInclusive > mDelivered)
+				mDelivered = frame.mStartingSampleInclusive;
+			next->mSink->AddFrame( frame );
+			next->DeliverUntilFrame();
+		} while ((next->mNextFrame < next->mFrames.size()) && (next->mFrames[next->mNextFrame].mStartingSampleInclusive <= bound));
+	}
+
+	for (size_t i=0; i < mRings.size(); i++)
+		mRings[i]->DropDelivered();
+}
+
+void MBusRingSet::DecodeWindow()
+{
+	if (mRings.size() == 1) {
+		mRings[0]->mDecoder.DecodeTransaction();
+		return;
+	}
+
+	U64 horizon = mHorizon + mWindow;
+	bool running = false;
+	for (size_t i=0; i < mRings.size(); i++) {
+		Ring& ring = *mRings[i];
+		if (ring.mFinished)
+			continue;
+		try {
+			while (IsReady( ring, horizon ))
+				ring.mDecoder.DecodeTransaction();
+#ifdef MBUS_HEADLESS
+			// Headless channels end, where the SDK's wait for more data
+			if (ring.mLastNodeCLK->GetSampleOfNextEdge() == ~0ULL)
+				ring.mFinished = true;
+#endif
+		}
+		catch (const MBusEndOfData&) {
+			ring.mFinished = true;
+		}
+		running = running || !ring.mFinished;
+	}
+	mHorizon = horizon;
+
+	if (!running) {
+		Deliver( ~0ULL >> 1 );
+		throw MBusEndOfData();
+	}
+	Deliver( horizon );
+	for (size_t i=0; i < mRings.size(); i++)
+		mRings[i]->mSink->ReportProgress( horizon );
+}
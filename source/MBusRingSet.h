@@ -0,0 +1,121 @@
+#ifndef MBUS_RING_SET
+#define MBUS_RING_SET
+
+#include "MBusTypes.h"
+#include "MBusDecoder.h"
+
+#include <ostream>
+#include <vector>
+
+// Default MBusRingSet turn, ~6.5 ms at 10 MHz: a handful of transactions
+#define MBUS_RING_SET_WINDOW (1ULL << 16)
+
+// Several independent rings on one probe, decoded by one thread in one pass.
+// Each ring has its own state machine and its own sink. The set takes turns
+// a window of samples at a time, decoding every transaction that starts in
+// it on each ring, so all rings walk the shared channel data together rather
+// than one after another.
+//
+// Each sink sees what a decoder of its own would have handed it, in the same
+// order, with two exceptions. Frames from all rings are delivered in order
+// of their first sample, as Logic wants them, so a ring's request frame,
+// which starts where its previous transaction ended, is cut to start no
+// earlier than frames already delivered. And progress is reported once per
+// window, as the window's end, to every sink.
+//
+// With a single ring nothing is held back; the set is then just the decoder.
+class MBusRingSet
+{
+public:
+	MBusRingSet();
+	~MBusRingSet();
+
+	// Rings are numbered from 0 in the order added; channels as for
+	// MBusDecoder::Initialize
+	void AddRing( const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, MBusDecoderSink* sink, std::ostream* log = NULL, bool specialize = true );
+	void Clear();
+
+	int GetRingCount() const { return (int)mRings.size(); }
+	MBusDecoder& GetDecoder( int ring ) { return mRings[ring]->mDecoder; }
+
+	void SetWindow( U64 samples ) { mWindow = samples ? samples : 1; }
+
+	// Hand sinks one FrameTypeDataBlock frame per message in place of its
+	// data frames, as compact storage wants. That has to happen here, in
+	// each decoder's own order: a sink downstream would have let other
+	// rings' frames go out between the first data frame and the block.
+	// The block's mData1 is left 0 for the sink to fill in with the id its
+	// store will give the message, which is committed after the block.
+	void SetCompactData( bool compact );
+
+	// Decodes one window on every ring (one transaction with a single ring).
+	// Throws MBusEndOfData once every headless ring has run out, after
+	// delivering everything still held back.
+	void DecodeWindow();
+
+private:
+	MBusRingSet( const MBusRingSet& );
+	MBusRingSet& operator=( const MBusRingSet& );
+
+	// Stands between a ring's decoder and its sink, holding what the decoder
+	// hands over until the set delivers it. The buffers keep their size once
+	// grown, transactions' data buffers included, so holding back allocates
+	// nothing once the busiest window has been seen.
+	class Ring : public MBusDecoderSink
+	{
+	public:
+		enum CommitKind { CommitKindResults, CommitKindTransaction, CommitKindCheckpoint };
+		// Anything but a frame, and how many held back frames came before it
+		struct Commit
+		{
+			CommitKind mKind;
+			size_t mFrames;
+			MBusDecoderCheckpoint mCheckpoint;
+		};
+
+		virtual void AddFrame( const MBusFrame& frame );
+		virtual void CommitResults();
+		virtual void CommitTransaction( const MBusTransaction& transaction );
+		virtual void ReportProgress( U64 sample_number );
+		virtual void CommitCheckpoint( const MBusDecoderCheckpoint& checkpoint );
+
+		// Holds frame back, or passes it straight on with a single ring
+		void Hand( const MBusFrame& frame );
+		// Hands the sink everything up to the next frame
+		void DeliverUntilFrame();
+		// Drops what has been delivered
+		void DropDelivered();
+
+		MBusDecoder mDecoder;
+		MBusDecoderSink* mSink;
+		MBusChannel* mLastNodeCLK;
+		bool mBuffered;
+		bool mFinished;
+
+		bool mCompact;
+		U32 mDataBytes;
+		S64 mDataStart;
+		S64 mDataEnd;
+
+		std::vector< MBusFrame > mFrames;
+		size_t mNextFrame;
+		std::vector< Commit > mCommits;
+		size_t mNextCommit;
+		std::vector< MBusTransaction > mTransactions; // the first mTransactionCount are held back
+		size_t mNextTransaction;
+		size_t mTransactionCount;
+	};
+
+	// True if ring's next transaction starts (its last node's CLK moves) by horizon
+	bool IsReady( Ring& ring, U64 horizon );
+	// Delivers held back frames starting by limit, earliest first
+	void Deliver( U64 limit );
+
+	std::vector< Ring * > mRings;
+	U64 mWindow;
+	bool mCompact;
+	U64 mHorizon;
+	S64 mDelivered; // first sample of the last frame delivered
+};
+
+#endif //MBUS_RING_SET
@@ -0,0 +1,180 @@
+#include "MBusSegmentFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Segments are only ever added at the end of the file, and a window maps
+ * whole segments at a segment-aligned offset, so nothing already handed out
+ * ever moves. When every window is in use, the one used longest ago is
+ * unmapped; its dirty pages are the kernel's to write back, and once they
+ * have been they no longer count against the process.
+ */
+
+MBusSegmentFile::MBusSegmentFile()
+:
+#ifdef _WIN32
+	mFile( INVALID_HANDLE_VALUE ),
+#else
+	mFile( -1 ),
+#endif
+	mSegments( 0 ),
+	mUses( 0 )
+{
+	for (int i=0; i < MBUS_SEGMENT_WINDOWS; i++) {
+		mWindows[i].mCount = 0;
+		mWindows[i].mData = NULL;
+	}
+}
+
+MBusSegmentFile::~MBusSegmentFile()
+{
+	Close();
+}
+
+U64 MBusSegmentFile::GetMappedSize() const
+{
+	U64 size = 0;
+	for (int i=0; i < MBUS_SEGMENT_WINDOWS; i++)
+		size += (U64)mWindows[i].mCount * MBUS_SEGMENT_SIZE;
+	return size;
+}
+
+U8* MBusSegmentFile::Map( U32 segment, U32 count )
+{
+	if ((segment + count > mSegments) || (count == 0))
+		return NULL;
+
+	Window* oldest = &mWindows[0];
+	for (int i=0; i < MBUS_SEGMENT_WINDOWS; i++) {
+		Window& window = mWindows[i];
+		if ((window.mCount == count) && (window.mSegment == segment)) {
+			window.mLastUse = ++mUses;
+			return window.mData;
+		}
+		if ((window.mCount == 0) || ((oldest->mCount != 0) && (window.mLastUse < oldest->mLastUse)))
+			oldest = &window;
+	}
+	Unmap( *oldest );
+
+	U64 offset = (U64)segment * MBUS_SEGMENT_SIZE;
+	size_t length = (size_t)count * MBUS_SEGMENT_SIZE;
+#ifdef _WIN32
+	HANDLE mapping = CreateFileMappingA( (HANDLE) mFile, NULL, PAGE_READWRITE, 0, 0, NULL );
+	if (mapping == NULL)
+		return NULL;
+	void* data = MapViewOfFile( mapping, FILE_MAP_WRITE, (DWORD)(offset >> 32), (DWORD)offset, length );
+	// The view keeps the mapping alive
+	CloseHandle( mapping );
+	if (data == NULL)
+		return NULL;
+#else
+	void* data = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, (off_t)offset );
+	if (data == MAP_FAILED)
+		return NULL;
+#endif
+
+	oldest->mSegment = segment;
+	oldest->mCount = count;
+	oldest->mData = (U8*) data;
+	oldest->mLastUse = ++mUses;
+	return oldest->mData;
+}
+
+void MBusSegmentFile::Unmap( Window& window )
+{
+	if (window.mCount == 0)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile( window.mData );
+#else
+	munmap( window.mData, (size_t)window.mCount * MBUS_SEGMENT_SIZE );
+#endif
+	window.mCount = 0;
+	window.mData = NULL;
+}
+
+#ifdef _WIN32
+
+bool MBusSegmentFile::Open( const std::string& path )
+{
+	Close();
+	HANDLE file = CreateFileA( path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	mFile = file;
+	mPath = path;
+	return true;
+}
+
+void MBusSegmentFile::Close()
+{
+	for (int i=0; i < MBUS_SEGMENT_WINDOWS; i++)
+		Unmap( mWindows[i] );
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle( (HANDLE) mFile );
+	mFile = INVALID_HANDLE_VALUE;
+	mPath.clear();
+	mSegments = 0;
+}
+
+bool MBusSegmentFile::AddSegments( U32 count, U32& first )
+{
+	LARGE_INTEGER size;
+	size.QuadPart = (LONGLONG)(mSegments + count) * MBUS_SEGMENT_SIZE;
+	if (!SetFilePointerEx( (HANDLE) mFile, size, NULL, FILE_BEGIN ) || !SetEndOfFile( (HANDLE) mFile ))
+		return false;
+	first = mSegments;
+	mSegments += count;
+	return true;
+}
+
+#else
+
+bool MBusSegmentFile::Open( const std::string& path )
+{
+	Close();
+	int file = open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	if (file < 0)
+		return false;
+	mFile = file;
+	mPath = path;
+	return true;
+}
+
+void MBusSegmentFile::Close()
+{
+	for (int i=0; i < MBUS_SEGMENT_WINDOWS; i++)
+		Unmap( mWindows[i] );
+	if (mFile >= 0)
+		close( mFile );
+	mFile = -1;
+	mPath.clear();
+	mSegments = 0;
+}
+
+bool MBusSegmentFile::AddSegments( U32 count, U32& first )
+{
+	off_t offset = (off_t)mSegments * MBUS_SEGMENT_SIZE;
+	off_t length = (off_t)count * MBUS_SEGMENT_SIZE;
+#ifdef __linux__
+	// Reserve the blocks now; a full disk found by a store through the
+	// mapping would be a SIGBUS
+	if (posix_fallocate( mFile, offset, length ) != 0)
+		return false;
+#else
+	if (ftruncate( mFile, offset + length ) != 0)
+		return false;
+#endif
+	first = mSegments;
+	mSegments += count;
+	return true;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef MBUS_SEGMENT_FILE
+#define MBUS_SEGMENT_FILE
+
+#include "MBusTypes.h"
+
+#include <string>
+
+// 4 MiB, a multiple of every page size and of Windows' 64 KiB mapping
+// granularity
+#define MBUS_SEGMENT_SIZE (1U << 22)
+// Segments mapped at any one time; the rest of the file is only on disk
+#define MBUS_SEGMENT_WINDOWS 8
+
+// An append-only file handed out a segment at a time and mapped a segment
+// at a time, so a store can grow far beyond memory while only the segments
+// it is writing and the last few it read stay resident. Not thread-safe;
+// the owner locks.
+class MBusSegmentFile
+{
+public:
+	MBusSegmentFile();
+	~MBusSegmentFile();
+
+	// Creates the file, or empties it if it exists
+	bool Open( const std::string& path );
+	// Unmaps everything and closes; the file is left on disk
+	void Close();
+	bool IsOpen() const { return mPath.size() != 0; }
+
+	// Grows the file by count segments and returns the first one's number,
+	// false if the disk is full
+	bool AddSegments( U32 count, U32& first );
+
+	// The data of count segments from segment on, mapped read/write. Valid
+	// until the next call to Map, which may reuse its window; NULL if the
+	// mapping fails.
+	U8* Map( U32 segment, U32 count = 1 );
+
+	U32 GetSegmentCount() const { return mSegments; }
+	U64 GetSize() const { return (U64)mSegments * MBUS_SEGMENT_SIZE; }
+	// Bytes mapped right now
+	U64 GetMappedSize() const;
+
+private:
+	MBusSegmentFile( const MBusSegmentFile& );
+	MBusSegmentFile& operator=( const MBusSegmentFile& );
+
+	struct Window
+	{
+		U32 mSegment;
+		U32 mCount; // 0 if the window is free
+		U8* mData;
+		U64 mLastUse;
+	};
+
+	void Unmap( Window& window );
+
+	std::string mPath;
+#ifdef _WIN32
+	void* mFile;
+#else
+	int mFile;
+#endif
+	U32 mSegments;
+	U64 mUses;
+	Window mWindows[MBUS_SEGMENT_WINDOWS];
+};
+
+#endif //MBUS_SEGMENT_FILE
@@ -1,46 +1,35 @@
-#ifndef MBUS_SIMULATION_DATA_GENERATOR
-#define MBUS_SIMULATION_DATA_GENERATOR
-
-#include <SimulationChannelDescriptor.h>
-#include <AnalyzerHelpers.h> // For ClockGenerator
-#include <fstream>
-#include <string>
-#include <vector>
-class MBusAnalyzerSettings;
-
-class MBusSimulationDataGenerator
-{
-public:
-	MBusSimulationDataGenerator();
-	~MBusSimulationDataGenerator();
-
-	void Initialize( U32 simulation_sample_rate, MBusAnalyzerSettings* settings );
-	U32 GenerateSimulationData( U64 newest_sample_requested, U32 sample_rate, SimulationChannelDescriptor** simulation_channel );
-
-protected:
-	MBusAnalyzerSettings* mSettings;
-	U32 mSimulationSampleRateHz;
-
-protected:
-	SimulationChannelDescriptorGroup mMBusSimulationChannels;
-	std::vector< SimulationChannelDescriptor * > mNodeCLKSimulationDatas;
-	std::vector< SimulationChannelDescriptor * > mNodeDATSimulationDatas;
-
-	int mNodeCount;
-
-private:
-	void CreateMBusWakeup(int sender);
-	void CreateMBusTransaction(int sender, U32 address, U8 num_bytes, U8 data[], bool acked);
-	void CreateMBusArbitration(std::vector< bool > normal, std::vector< bool > priority);
-	void CreateMBusArbitration(std::vector< bool > normal, std::vector< bool > priority, std::vector< bool > wakeup);
-	void CreateMBusData(int sender, U32 address, U8 num_bytes, U8 data[]);
-	void CreateMBusBit(int sender, BitState bit);
-	void CreateMBusInterjection(int interjector);
-	void CreateMBusControl(int interjector, BitState cb0, int target, BitState cb1);
-	void PropogationDelay();
-
-	ClockGenerator mClockGenerator;
-
-	U64 minSampleNumber();
-};
-#endif //MBUS_SIMULATION_DATA_GENERATOR
+#ifndef MBUS_SIMULATION_DATA_GENERATOR
+#define MBUS_SIMULATION_DATA_GENERATOR
+
+#include <SimulationChannelDescriptor.h>
+#include <vector>
+
+#include "MBusSimulator.h"
+class MBusAnalyzerSettings;
+
+// Replays the SDK-free MBusSimulator's edges into Logic's simulation channels
+class MBusSimulationDataGenerator
+{
+public:
+	MBusSimulationDataGenerator();
+	~MBusSimulationDataGenerator();
+
+	void Initialize( U32 simulation_sample_rate, MBusAnalyzerSettings* settings );
+	U32 GenerateSimulationData( U64 newest_sample_requested, U32 sample_rate, SimulationChannelDescriptor** simulation_channel );
+
+protected:
+	MBusAnalyzerSettings* mSettings;
+	U32 mSimulationSampleRateHz;
+
+protected:
+	SimulationChannelDescriptorGroup mMBusSimulationChannels;
+	std::vector< SimulationChannelDescriptor * > mNodeCLKSimulationDatas;
+	std::vector< SimulationChannelDescriptor * > mNodeDATSimulationDatas;
+
+	int mNodeCount;
+	MBusSimulator mSimulator;
+
+private:
+	void ReplayEdges(MBusSimulatedChannel* simulated, SimulationChannelDescriptor* channel);
+};
+#endif //MBUS_SIMULATION_DATA_GENERATOR
@@ -0,0 +1,1100 @@
+#include "MBusSimulator.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm> // std::random_shuffle
+
+/* Scenario files
+ *
+ * Instead of the built-in script, the simulator can play a traffic scenario
+ * (the "Simulation Scenario" setting in Logic). The file is read lazily, one
+ * directive per line, only when more samples are requested; when the end is
+ * reached playback restarts from the top. Blank lines and '#' comments are
+ * ignored. Directives:
+ *
+ *   seed <n>                 Reseed the random generator
+ *   class <name> <weight> [key=value ...]
+ *                            Define (or redefine) a traffic class:
+ *       sender=<n>[,<n>...]      sending node(s), 0 is the mediator
+ *       addr=<a>[,<a>...]        destination address(es), 8- or 32-bit
+ *       len=<n>[-<m>]            payload bytes, uniform in [n, m]
+ *       ack=<ratio>              fraction of messages that are acked
+ *       prio=<ratio>             fraction sent with a priority request
+ *       gap=<n>[-<m>]            idle half-periods before each message
+ *   clear                    Forget all traffic classes
+ *   wakeup <ratio>           Chance of a wakeup sequence after a message
+ *   run <count>              Emit <count> messages, classes picked by weight
+ *   burst <name> <count>     Emit <count> messages from a single class
+ *   gap <n>                  Idle the bus for <n> half-periods
+ *   fault <kind> <ratio> [n] Inject a fault into this fraction of messages:
+ *       priority                 another node requests priority
+ *       multi-request            another node requests at the same time
+ *       error                    control bits signal a general error
+ *       interject                interjection partway through a byte
+ *       glitch                   one-sample DAT pulse while the bus idles
+ *       stretch                  random bits held for up to [n] extra
+ *                                half-periods (default 4)
+ *       drop-forward             a node stops forwarding DAT mid-message
+ *   expect <file>            Write the known answer for every following
+ *                            message, i.e. what the analyzer should decode
+ *                            on the last node, one line per message:
+ *                            <sample> <transmitter> <addr> <data> <cb0>
+ *                            <cb1> [faults]
+ *
+ * For example, 90% short sensor reads with a periodic imager dump:
+ *
+ *   class sensor 9 sender=1 addr=0x13,0x14 len=4-8 ack=0.9
+ *   class ping   1 sender=0 addr=0xF00000B2 len=4
+ *   class image  0 sender=1 addr=0x17 len=160 gap=2
+ *   run 500
+ *   burst image 160
+ */
+
+const char* MBusFaultNames[NUM_MBUS_FAULTS] = {
+	"priority",
+	"multi-request",
+	"error",
+	"interject",
+	"glitch",
+	"stretch",
+	"drop-forward",
+};
+
+MBusSimulatedChannel::MBusSimulatedChannel( const U64* sample_number, BitState initial_bit_state )
+:	mSampleNumber( sample_number ),
+	mBitState( initial_bit_state ),
+	mInitialBitState( initial_bit_state )
+{
+}
+
+void MBusSimulatedChannel::Transition()
+{
+	mBitState = (mBitState == BIT_LOW) ? BIT_HIGH : BIT_LOW;
+	mEdges.push_back( *mSampleNumber );
+}
+
+void MBusSimulatedChannel::TransitionIfNeeded( BitState bit_state )
+{
+	if (mBitState != bit_state)
+		Transition();
+}
+
+BitState MBusSimulatedChannel::GetCurrentBitState()
+{
+	return mBitState;
+}
+
+U64 MBusSimulatedChannel::GetCurrentSampleNumber()
+{
+	return *mSampleNumber;
+}
+
+void MBusSimulatedChannel::ClearEdges()
+{
+	mEdges.clear();
+	mInitialBitState = mBitState;
+}
+
+MBusSimulatedChannelGroup::MBusSimulatedChannelGroup()
+:	mSampleNumber( 0 )
+{
+}
+
+MBusSimulatedChannelGroup::~MBusSimulatedChannelGroup()
+{
+	for (size_t i=0; i < mChannels.size(); i++)
+		delete mChannels[i];
+}
+
+MBusSimulatedChannel* MBusSimulatedChannelGroup::Add( BitState initial_bit_state )
+{
+	mChannels.push_back( new MBusSimulatedChannel( &mSampleNumber, initial_bit_state ) );
+	return mChannels.back();
+}
+
+void MBusSimulatedChannelGroup::AdvanceAll( U32 num_samples_to_advance )
+{
+	mSampleNumber += num_samples_to_advance;
+}
+
+U64 MBusSimulatedChannelGroup::GetSampleNumber()
+{
+	return mSampleNumber;
+}
+
+MBusClockGenerator::MBusClockGenerator()
+:	mSamplesPerHalfPeriod( 1.0 ),
+	mRemainder( 0.0 )
+{
+}
+
+void MBusClockGenerator::Init( double target_frequency, U32 sample_rate_hz )
+{
+	mSamplesPerHalfPeriod = sample_rate_hz / (target_frequency * 2.0);
+	mRemainder = 0.0;
+}
+
+U32 MBusClockGenerator::AdvanceByHalfPeriod( double multiple )
+{
+	// Carry the fractional sample so the long-run rate stays exact
+	double samples = mSamplesPerHalfPeriod * multiple + mRemainder;
+	U32 whole_samples = (U32) samples;
+	mRemainder = samples - whole_samples;
+	return whole_samples;
+}
+
+MBusSimulator::MBusSimulator()
+:	mNullLog( NULL ),
+	mLog( &mNullLog ),
+	mNodeCount( 0 ),
+	mScenarioRunClass( -1 ),
+	mScenarioRunRemaining( 0 ),
+	mScenarioWakeupRatio( 0.0 ),
+	mScenarioProgress( false ),
+	mMaxClockStretch( 4 ),
+	mStretchClock( false ),
+	mDroppedForwardNode( -1 ),
+	mLatchedCB0( BIT_HIGH ),
+	mLatchedCB1( BIT_HIGH )
+{
+	for (int i=0; i < NUM_MBUS_FAULTS; i++)
+		mFaultRatio[i] = 0.0;
+	ClearTransaction(mExpectedTransaction);
+}
+
+MBusSimulator::~MBusSimulator()
+{
+}
+
+void MBusSimulator::Initialize( U32 simulation_sample_rate, int node_count, const std::string& scenario_file, std::ostream* log )
+{
+	mSimulationSampleRateHz = simulation_sample_rate;
+	mNodeCount = node_count;
+	mLog = (log != NULL) ? log : &mNullLog;
+
+	mClockGenerator.Init(400e3, mSimulationSampleRateHz);
+
+	{
+		mNodeCLKSimulationDatas.resize(mNodeCount);
+		mNodeDATSimulationDatas.resize(mNodeCount);
+	}
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i) = mMBusSimulationChannels.Add(BIT_HIGH);
+		mNodeDATSimulationDatas.at(i) = mMBusSimulationChannels.Add(BIT_HIGH);
+	}
+
+	if (!scenario_file.empty()) {
+		mScenario.open(scenario_file.c_str());
+		if (!mScenario.is_open())
+			*mLog << "SIM: Could not open scenario " << scenario_file << ", using built-in script" << std::endl;
+	}
+}
+
+void MBusSimulator::GenerateUntil( U64 sample_number )
+{
+	while( mMBusSimulationChannels.GetSampleNumber() < sample_number )
+	{
+		if (mScenario.is_open())
+			ScenarioStep();
+		else
+			CreateDefaultScript();
+	}
+}
+
+void MBusSimulator::CreateIdle( U32 half_periods )
+{
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(half_periods) );
+}
+
+U64 MBusSimulator::GetSampleNumber()
+{
+	return mMBusSimulationChannels.GetSampleNumber();
+}
+
+int MBusSimulator::GetNodeCount()
+{
+	return mNodeCount;
+}
+
+MBusSimulatedChannel* MBusSimulator::GetNodeCLK( int node )
+{
+	return mNodeCLKSimulationDatas.at(node);
+}
+
+MBusSimulatedChannel* MBusSimulator::GetNodeDAT( int node )
+{
+	return mNodeDATSimulationDatas.at(node);
+}
+
+const MBusTransaction& MBusSimulator::GetExpected()
+{
+	return mExpectedTransaction;
+}
+
+void MBusSimulator::CreateDefaultScript()
+{
+	U8 data[256];
+	data[0] = 0x01; data[1] = 0x23; data[2] = 0x45; data[3] = 0x67;
+	CreateMBusTransaction(0, 0xA1, 4, data, false);
+	CreateMBusTransaction(0, 0xA1, 4, data, false);
+	CreateMBusTransaction(0, 0xF00000B2, 4, data, false);
+	data[4] = 0x87; data[5] = 0x65; data[6] = 0x43; data[7] = 0x21;
+	CreateMBusTransaction(0, 0xC3, 8, data, true);
+	CreateMBusTransaction(0, 0xF00000D4, 8, data, true);
+	data[4] = 0x9A; data[5] = 0xBC;
+	CreateMBusTransaction(0, 0xE5, 6, data, false);
+
+	// Can't generate this sequence if we don't have any member nodes
+	if (mNodeCount > 1) {
+		*mLog << "\nSIM: Before CreateMBusWakeup" << std::endl;
+		CreateMBusWakeup(1);
+	} else {
+		*mLog << "\nSIM: Skipping CreateMBusWakeup because only one node" << std::endl;
+	}
+
+	// Imager messages: To address 0x17, 1 row / message
+	// 8 bits/column x 160 columns = 160 bytes / message
+	// There are 160 rows. Closes with a single 32-bit message
+	for (int i=0; i < 160; i++) {
+		for (int j=0; j < 160; j++)
+			data[j] = (j+i) % 255;
+		CreateMBusTransaction(0, 0x17, 160, data, false);
+	}
+	data[0] = 0xa5; data[1] = 0xa5; data[2] = 0xa5; data[3] = 0xa5;
+	CreateMBusTransaction(0, 0x17, 4, data, false);
+}
+
+void MBusSimulator::ScenarioStep()
+{
+	if (mScenarioRunRemaining > 0) {
+		mScenarioRunRemaining--;
+
+		if (mScenarioRunClass != -1) {
+			CreateScenarioTransaction(mScenarioClasses.at(mScenarioRunClass));
+			return;
+		}
+
+		U32 total_weight = 0;
+		for (size_t i=0; i < mScenarioClasses.size(); i++)
+			total_weight += mScenarioClasses[i].weight;
+		if (total_weight == 0) {
+			*mLog << "SIM: run with no weighted traffic classes, skipping" << std::endl;
+			mScenarioRunRemaining = 0;
+			return;
+		}
+
+		U32 pick = std::rand() % total_weight;
+		for (size_t i=0; i < mScenarioClasses.size(); i++) {
+			if (pick < mScenarioClasses[i].weight) {
+				CreateScenarioTransaction(mScenarioClasses[i]);
+				return;
+			}
+			pick -= mScenarioClasses[i].weight;
+		}
+		return;
+	}
+
+	std::string line;
+	if (!std::getline(mScenario, line)) {
+		// A full pass that generated nothing would spin forever
+		if (!mScenarioProgress) {
+			*mLog << "SIM: Scenario generates no bus activity, using built-in script" << std::endl;
+			mScenario.close();
+			return;
+		}
+		mScenarioProgress = false;
+		mScenarioClasses.clear();
+		mScenarioWakeupRatio = 0.0;
+		for (int i=0; i < NUM_MBUS_FAULTS; i++)
+			mFaultRatio[i] = 0.0;
+
+		mScenario.clear();
+		mScenario.seekg(0);
+		return;
+	}
+
+	ParseScenarioLine(line);
+}
+
+// Parses "<n>" or "<n>-<m>" into an inclusive range. Its width, max - min
+// + 1, is what values are drawn modulo, so it must fit in a U32 too.
+static bool ParseRange(const std::string& value, U32& min, U32& max)
+{
+	char* end;
+	unsigned long first = std::strtoul(value.c_str(), &end, 0);
+	if (end == value.c_str())
+		return false;
+	unsigned long last = first;
+	if (*end == '-')
+		last = std::strtoul(end + 1, &end, 0);
+	if ((*end != '\0') || (first > last) || (last > 0xffffffffUL) || (last - first >= 0xffffffffUL))
+		return false;
+	min = (U32) first;
+	max = (U32) last;
+	return true;
+}
+
+bool MBusSimulator::ParseTrafficClass(std::istringstream& args, MBusTrafficClass& traffic_class)
+{
+	traffic_class.min_len = traffic_class.max_len = 4;
+	traffic_class.ack_ratio = 0.0;
+	traffic_class.prio_ratio = 0.0;
+	traffic_class.min_gap = traffic_class.max_gap = 0;
+
+	if ((args >> traffic_class.name >> traffic_class.weight).fail())
+		return false;
+
+	std::string arg;
+	while (args >> arg) {
+		size_t eq = arg.find('=');
+		if (eq == std::string::npos)
+			return false;
+		std::string key = arg.substr(0, eq);
+		std::string value = arg.substr(eq + 1);
+
+		if ((key == "sender") || (key == "addr")) {
+			std::istringstream list(value);
+			std::string item;
+			while (std::getline(list, item, ',')) {
+				U32 number = std::strtoul(item.c_str(), NULL, 0);
+				if (key == "sender") {
+					if (number >= (U32) mNodeCount)
+						return false;
+					traffic_class.senders.push_back(number);
+				} else {
+					// Same constraint as CreateMBusData
+					if ((number > 0xff) && ((number & 0xf0000000) != 0xf0000000))
+						return false;
+					traffic_class.addresses.push_back(number);
+				}
+			}
+		} else if (key == "len") {
+			if (!ParseRange(value, traffic_class.min_len, traffic_class.max_len))
+				return false;
+		} else if (key == "gap") {
+			if (!ParseRange(value, traffic_class.min_gap, traffic_class.max_gap))
+				return false;
+		} else if (key == "ack") {
+			traffic_class.ack_ratio = std::atof(value.c_str());
+		} else if (key == "prio") {
+			traffic_class.prio_ratio = std::atof(value.c_str());
+		} else {
+			return false;
+		}
+	}
+
+	if (traffic_class.senders.empty())
+		traffic_class.senders.push_back(0);
+	if (traffic_class.addresses.empty())
+		return false;
+	return true;
+}
+
+void MBusSimulator::ParseScenarioLine(const std::string& line)
+{
+	std::istringstream args(line.substr(0, line.find('#')));
+	std::string directive;
+	if (!(args >> directive))
+		return;
+
+	bool ok = true;
+	if (directive == "seed") {
+		U32 seed;
+		ok = !(args >> seed).fail();
+		if (ok)
+			std::srand(seed);
+	} else if (directive == "class") {
+		MBusTrafficClass traffic_class;
+		ok = ParseTrafficClass(args, traffic_class);
+		if (ok) {
+			size_t i;
+			for (i=0; i < mScenarioClasses.size(); i++)
+				if (mScenarioClasses[i].name == traffic_class.name)
+					break;
+			if (i == mScenarioClasses.size())
+				mScenarioClasses.push_back(traffic_class);
+			else
+				mScenarioClasses[i] = traffic_class;
+		}
+	} else if (directive == "clear") {
+		mScenarioClasses.clear();
+	} else if (directive == "wakeup") {
+		ok = !(args >> mScenarioWakeupRatio).fail();
+	} else if (directive == "run") {
+		ok = !(args >> mScenarioRunRemaining).fail();
+		mScenarioRunClass = -1;
+	} else if (directive == "burst") {
+		std::string name;
+		U32 count;
+		ok = !(args >> name >> count).fail();
+		if (ok) {
+			ok = false;
+			for (size_t i=0; i < mScenarioClasses.size(); i++) {
+				if (mScenarioClasses[i].name == name) {
+					mScenarioRunClass = i;
+					mScenarioRunRemaining = count;
+					ok = true;
+				}
+			}
+		}
+	} else if (directive == "gap") {
+		U32 half_periods;
+		ok = !(args >> half_periods).fail();
+		if (ok && (half_periods > 0)) {
+			mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(half_periods) );
+			mScenarioProgress = true;
+		}
+	} else if (directive == "fault") {
+		std::string kind;
+		double ratio;
+		ok = !(args >> kind >> ratio).fail();
+		if (ok) {
+			int fault;
+			for (fault=0; fault < NUM_MBUS_FAULTS; fault++)
+				if (kind == MBusFaultNames[fault])
+					break;
+			ok = (fault != NUM_MBUS_FAULTS);
+			// stretch takes the most half-periods a bit is held, 4 if not given
+			U32 max_stretch = 4;
+			std::string value;
+			if (ok && (fault == FaultClockStretch) && (args >> value)) {
+				char* end;
+				unsigned long parsed = std::strtoul(value.c_str(), &end, 0);
+				ok = (end != value.c_str()) && (*end == '\0') && (parsed >= 1) && (parsed <= 0xffffffffUL);
+				max_stretch = (U32) parsed;
+			}
+			if (ok)
+				mFaultRatio[fault] = ratio;
+			if (ok && (fault == FaultClockStretch))
+				mMaxClockStretch = max_stretch;
+		}
+	} else if (directive == "expect") {
+		std::string file;
+		ok = !(args >> file).fail();
+		if (ok) {
+			// Known answers cover a single pass; reopening on rewind would truncate them
+			if (!mExpected.is_open())
+				mExpected.open(file.c_str(), std::ios::out | std::ios::trunc);
+			ok = mExpected.is_open();
+		}
+	} else {
+		ok = false;
+	}
+
+	if (!ok)
+		*mLog << "SIM: Ignoring bad scenario line: " << line << std::endl;
+}
+
+void MBusSimulator::CreateScenarioTransaction(const MBusTrafficClass& traffic_class)
+{
+	int sender = traffic_class.senders.at(std::rand() % traffic_class.senders.size());
+	U32 address = traffic_class.addresses.at(std::rand() % traffic_class.addresses.size());
+	U32 num_bytes = traffic_class.min_len + std::rand() % (traffic_class.max_len - traffic_class.min_len + 1);
+	U32 gap = traffic_class.min_gap + std::rand() % (traffic_class.max_gap - traffic_class.min_gap + 1);
+	bool acked = (std::rand() / (RAND_MAX + 1.0)) < traffic_class.ack_ratio;
+	bool priority = (std::rand() / (RAND_MAX + 1.0)) < traffic_class.prio_ratio;
+
+	mScenarioPayload.resize(num_bytes + 1);
+	for (U32 i=0; i < num_bytes; i++)
+		mScenarioPayload[i] = std::rand() & 0xff;
+
+	if (gap > 0)
+		mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(gap) );
+	CreateMBusTransaction(sender, address, num_bytes, &mScenarioPayload[0], acked, priority, RollFaults());
+
+	if ((mNodeCount > 1) && ((std::rand() / (RAND_MAX + 1.0)) < mScenarioWakeupRatio))
+		CreateMBusWakeup(1 + std::rand() % (mNodeCount - 1));
+
+	mScenarioProgress = true;
+}
+
+U32 MBusSimulator::RollFaults()
+{
+	U32 faults = 0;
+	for (int fault=0; fault < NUM_MBUS_FAULTS; fault++) {
+		if ((mFaultRatio[fault] > 0.0) && ((std::rand() / (RAND_MAX + 1.0)) < mFaultRatio[fault]))
+			faults |= 1 << fault;
+	}
+	return faults;
+}
+
+int MBusSimulator::PickOtherNode(int node)
+{
+	return (node + 1 + std::rand() % (mNodeCount - 1)) % mNodeCount;
+}
+
+void MBusSimulator::CreateGlitch()
+{
+	MBusSimulatedChannel* dat = mNodeDATSimulationDatas.at(std::rand() % mNodeCount);
+	dat->Transition();
+	mMBusSimulationChannels.AdvanceAll( 1 );
+	dat->Transition();
+}
+
+void MBusSimulator::RecordExpected(U64 start_sample, int transmitter, U32 faults)
+{
+	ClearTransaction(mExpectedTransaction);
+	mExpectedTransaction.mStartingSampleInclusive = start_sample;
+	mExpectedTransaction.mTransmitter = transmitter;
+
+	// Mirror the analyzer: 8-bit address, widened to 32 bits by a 0xF prefix,
+	// then whole bytes only; a partial byte before the interjection is dropped
+	U32 address = 0;
+	size_t address_bits = 8;
+	size_t bit = 0;
+	for (; (bit < 8) && (bit < mLatchedBits.size()); bit++)
+		address = (address << 1) | (mLatchedBits[bit] == BIT_HIGH);
+	if ((address & 0xf0) == 0xf0) {
+		address_bits = 32;
+		for (; (bit < 32) && (bit < mLatchedBits.size()); bit++)
+			address = (address << 1) | (mLatchedBits[bit] == BIT_HIGH);
+	}
+	if (bit == address_bits) {
+		mExpectedTransaction.mAddress = address;
+		mExpectedTransaction.mAddressBits = address_bits;
+	}
+
+	for (; bit + 8 <= mLatchedBits.size(); bit += 8) {
+		U8 byte = 0;
+		for (int i=0; i < 8; i++)
+			byte = (byte << 1) | (mLatchedBits[bit+i] == BIT_HIGH);
+		mExpectedTransaction.mData.push_back(byte);
+	}
+
+	mExpectedTransaction.mCB0 = (mLatchedCB0 == BIT_HIGH);
+	mExpectedTransaction.mCB1 = (mLatchedCB1 == BIT_HIGH);
+
+	if (!mExpected.is_open())
+		return;
+
+	WriteTransactionLine(mExpected, mExpectedTransaction);
+	const char* separator = " ";
+	for (int fault=0; fault < NUM_MBUS_FAULTS; fault++) {
+		if (faults & (1 << fault)) {
+			mExpected << separator << MBusFaultNames[fault];
+			separator = ",";
+		}
+	}
+	mExpected << std::endl;
+}
+
+void MBusSimulator::PropogationDelay() {
+	mMBusSimulationChannels.AdvanceAll( std::rand() % 3 + 1 );
+}
+
+void MBusSimulator::CreateMBusWakeup(int sender) {
+	for (int i=0; i < mNodeCount; i++) {
+		if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+			*mLog << "SIM: " << __LINE__ << ": CreateMBusTransaction must be entered with all lines high (Fail CLK)" << std::endl;
+			MBusAssert("CreateMBusTransaction must be entered with all lines high (Fail CLK)");
+		}
+		if (mNodeDATSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+			*mLog << "SIM: " << __LINE__ << ": CreateMBusTransaction must be entered with all lines high (Fail DAT)" << std::endl;
+			MBusAssert("CreateMBusTransaction must be entered with all lines high (Fail DAT)");
+		}
+	}
+
+	// Some space before we start
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(50) );
+	U64 start_sample = mMBusSimulationChannels.GetSampleNumber();
+
+	{
+		std::vector< bool > normal( mNodeCount, false );
+		std::vector< bool > priority( mNodeCount, false );
+		std::vector< bool > wakeup( mNodeCount, false );
+
+		wakeup.at(sender) = true;
+		CreateMBusArbitration(normal, priority, wakeup); // Through PrioLatch inclusive
+
+		for (int i=0; i<mNodeCount; i++) {
+			if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+				*mLog << "SIM: " << __LINE__ << ": CreateMBusArbitration did not exit with CLK's high?" << std::endl;
+				MBusAssert("CreateMBusArbitration did not exit with CLK's high?");
+			}
+		}
+	}
+
+	CreateMBusInterjection(0); // Through Interjection Asserted edge inclusive
+	for (int i=0; i<mNodeCount; i++) {
+		if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+			*mLog << "SIM: " << __LINE__ << ": CreateMBusInterjection did not exit with CLK's high?" << std::endl;
+			MBusAssert("CreateMBusInterjection did not exit with CLK's high?");
+		}
+	}
+	CreateMBusControl(0, BIT_LOW, 0, BIT_LOW); // Through Begin Idle latch inclusive
+	for (int i=0; i<mNodeCount; i++) {
+		if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+			*mLog << "SIM: " << __LINE__ << ": CreateMBusControl did not exit with CLK's high?" << std::endl;
+			MBusAssert("CreateMBusControl did not exit with CLK's high?");
+		}
+	}
+
+	// A wakeup never reaches the address, so there is nothing but control bits to expect
+	mLatchedBits.clear();
+	RecordExpected(start_sample, -1, 0);
+
+	// Some space after the end
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(20) );
+
+	// Sanity check: Make sure we left all the lines high
+	for (int i=0; i < mNodeCount; i++) {
+		if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+			*mLog << "SIM: " << __LINE__ << ": CreateMBusTransaction should exit with all lines high (Fail CLK)" << std::endl;
+			MBusAssert("CreateMBusTransaction should exit with all lines high (Fail CLK)");
+		}
+		if (mNodeDATSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+			*mLog << "SIM: " << __LINE__ << ": CreateMBusTransaction should exit with all lines high (Fail DAT)" << std::endl;
+			MBusAssert("CreateMBusTransaction should exit with all lines high (Fail DAT)");
+		}
+	}
+}
+
+void MBusSimulator::CreateMBusTransaction(int sender, U32 address, U32 num_bytes, U8 data[], bool acked, bool priority, U32 faults) {
+	*mLog << "SIM: " << __LINE__ << ": CreateMBusTransaction start" << std::endl;
+
+	for (int i=0; i < mNodeCount; i++) {
+		if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+			*mLog << "SIM: " << __LINE__ << ": CreateMBusTransaction must be entered with all lines high (Fail CLK)" << std::endl;
+			MBusAssert("CreateMBusTransaction must be entered with all lines high (Fail CLK)");
+		}
+		if (mNodeDATSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+			*mLog << "SIM: " << __LINE__ << ": CreateMBusTransaction must be entered with all lines high (Fail DAT)" << std::endl;
+			MBusAssert("CreateMBusTransaction must be entered with all lines high (Fail DAT)");
+		}
+	}
+
+	// Faults involving a second node need a ring
+	if (mNodeCount < 2)
+		faults &= ~((1 << FaultPriorityRequest) | (1 << FaultMultipleRequest) | (1 << FaultDroppedForward));
+	if (num_bytes == 0)
+		faults &= ~(1 << FaultMidByteInterjection);
+	U32 num_data_bits = num_bytes * 8;
+
+	// Some space before we start
+	if (faults & (1 << FaultGlitch)) {
+		mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(10) );
+		CreateGlitch();
+		mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(10) );
+	} else {
+		mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(20) );
+	}
+
+	U64 start_sample = mMBusSimulationChannels.GetSampleNumber();
+	int transmitter;
+	{
+		std::vector< bool > normal( mNodeCount, false );
+		std::vector< bool > priority_request( mNodeCount, false );
+
+		normal.at(sender) = true;
+		priority_request.at(sender) = priority;
+		if (faults & (1 << FaultMultipleRequest))
+			normal.at(PickOtherNode(sender)) = true;
+		if (faults & (1 << FaultPriorityRequest))
+			priority_request.at(PickOtherNode(sender)) = true;
+		transmitter = CreateMBusArbitration(normal, priority_request); // Through PrioLatch inclusive
+
+		for (int i=0; i<mNodeCount; i++) {
+			if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH) {
+				*mLog << "SIM: " << __LINE__ << ": CreateMBusArbitration did not exit with CLK's high?" << std::endl;
+				MBusAssert("CreateMBusArbitration did not exit with CLK's high?");
+			}
+		}
+	}
+	// Whoever actually won the bus sends the message
+	if (transmitter == -1)
+		transmitter = sender;
+
+	if (faults & (1 << FaultMidByteInterjection)) {
+		do {
+			num_data_bits = 1 + std::rand() % (num_bytes * 8 - 1);
+		} while ((num_data_bits % 8) == 0);
+	}
+	mStretchClock = (faults & (1 << FaultClockStretch)) != 0;
+	mDroppedForwardNode = (faults & (1 << FaultDroppedForward)) ? PickOtherNode(transmitter) : -1;
+	mLatchedBits.clear();
+
+	CreateMBusData(transmitter, address, num_bytes, data, num_data_bits); // Through last Data Bit latch inclusive
+	mStretchClock = false;
+	mDroppedForwardNode = -1;
+	for (int i=0; i<mNodeCount; i++)
+		if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH)
+			MBusAssert("CreateMBusData did not exit with CLK's high?");
+	CreateMBusInterjection(transmitter); // Through Interjection Asserted edge inclusive
+	for (int i=0; i<mNodeCount; i++)
+		if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH)
+			MBusAssert("CreateMBusInterjection did not exit with CLK's high?");
+	if (faults & (1 << FaultErrorControl))
+		CreateMBusControl(transmitter, BIT_LOW, address & 0xf, (std::rand() & 1) ? BIT_HIGH : BIT_LOW);
+	else
+		CreateMBusControl(transmitter, BIT_HIGH, address & 0xf, (acked) ? BIT_LOW : BIT_HIGH); // Through Begin Idle latch inclusive
+	for (int i=0; i<mNodeCount; i++)
+		if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH)
+			MBusAssert("CreateMBusControl did not exit with CLK's high?");
+
+	// Some space after the end
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(20) );
+
+	// Sanity check: Make sure we left all the lines high
+	for (int i=0; i < mNodeCount; i++) {
+		if (mNodeCLKSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH)
+			MBusAssert("CreateMBusTransaction should exit with all lines high (Fail CLK)");
+		if (mNodeDATSimulationDatas.at(i)->GetCurrentBitState() != BIT_HIGH)
+			MBusAssert("CreateMBusTransaction should exit with all lines high (Fail DAT)");
+	}
+
+	RecordExpected(start_sample, transmitter, faults);
+
+	*mLog << "SIM: " << __LINE__ << ": CreateMBusTransaction end" << std::endl;
+}
+
+int MBusSimulator::CreateMBusArbitration(std::vector< bool > normal, std::vector< bool > priority) {
+	std::vector< bool > wakeup( normal.size(), false );
+	return CreateMBusArbitration(normal, priority, wakeup);
+}
+
+int MBusSimulator::CreateMBusArbitration(std::vector< bool > normal, std::vector< bool > priority, std::vector< bool > wakeup) {
+	*mLog << "SIM: CreateMBusArbitration Begin" << std::endl;
+
+	std::vector< size_t > arb_order;
+	for (size_t i=0; i<normal.size(); i++) {
+		arb_order.push_back(i);
+	}
+	std::random_shuffle(arb_order.begin(), arb_order.end());
+
+	// Generate request signal(s)
+	*mLog << "SIM: gen request sigs" << std::endl;
+	for (size_t i=0; i<arb_order.size(); i++) {
+		if (normal.at(i) || wakeup.at(i))
+			mNodeDATSimulationDatas.at(i)->TransitionIfNeeded( BIT_LOW );
+		PropogationDelay();
+
+		// Propogate this node's request
+		for (unsigned j=i; j<i+mNodeCount; j++) {
+			int k = j % mNodeCount;
+			//  Ignore master node as it doesn't forward
+			if (k == 0)
+				continue;
+
+			if (mNodeDATSimulationDatas.at((k-1)%normal.size())->GetCurrentBitState() == BIT_LOW)
+				mNodeDATSimulationDatas.at(k)->TransitionIfNeeded( BIT_LOW );
+			PropogationDelay();
+		}
+	}
+
+	// "t_long"
+	*mLog << "SIM: t_long" << std::endl;
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(5) );
+
+	// Falling clock to start transaction
+	*mLog << "SIM: fall clock to start tx" << std::endl;
+	bool any_request = false;
+	for (size_t i=0; i<normal.size(); i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+
+		// Deassert wakeup requests; assumes master is node 0
+		if (normal.at(i) || any_request) {
+			any_request = true;
+		} else {
+			mNodeDATSimulationDatas.at(i)->TransitionIfNeeded (BIT_HIGH);
+		}
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Arbitration Edge
+	*mLog << "SIM: arb edge" << std::endl;
+	for (size_t i=0; i<normal.size(); i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Resolve arbitration winner internally
+	*mLog << "SIM: resolve arb winner" << std::endl;
+	int arbitrationWinner = -1;
+	if (mNodeDATSimulationDatas.at(0)->GetCurrentBitState() == BIT_LOW)
+		arbitrationWinner = 0;
+	else {
+		for (int j=1; j<mNodeCount; j++) {
+			if (
+					(mNodeDATSimulationDatas.at((j-1)%mNodeCount)->GetCurrentBitState() == BIT_HIGH) &&
+					(mNodeDATSimulationDatas.at(j)->GetCurrentBitState() == BIT_LOW)
+			   ) {
+				if (arbitrationWinner != -1)
+					MBusAssert("Multiple normal arbitration winners?");
+				arbitrationWinner = j;
+			}
+		}
+	}
+
+	// The timing here is too simple for now (all clocks then all datas),
+	// but generating anything more is prohibitively complex for gen 1
+	//
+	// Prio Drive Edge (CLK)
+	*mLog << "SIM: prio drive edge clk" << std::endl;
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	// Prio Drive Edge (DAT)
+	*mLog << "SIM: prio drive edge dat" << std::endl;
+	if (arbitrationWinner != -1) {
+		// Only deal with prio if someone won arb
+		for (int i=0; i<mNodeCount; i++) {
+			if (priority.at(i))
+				mNodeDATSimulationDatas.at(i)->TransitionIfNeeded( BIT_HIGH );
+			PropogationDelay();
+
+			// Propogate this node's request
+			for (int j=i; j<i+mNodeCount; j++) {
+				int k = j % mNodeCount;
+				// Ignore arbitration winner as it doesn't forward
+				if (k == arbitrationWinner)
+					continue;
+
+				if (mNodeDATSimulationDatas.at((k+mNodeCount-1)%mNodeCount)->GetCurrentBitState() == BIT_HIGH)
+					mNodeDATSimulationDatas.at(k)->TransitionIfNeeded( BIT_HIGH );
+				PropogationDelay();
+			}
+		}
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Prio Latch Edge
+	*mLog << "SIM: prio latch edge" << std::endl;
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Resolve priority arbitration winner internally; the transmitter is
+	// whoever holds the bus after this
+	int priorityArbitrationWinner = -1;
+	if (arbitrationWinner == -1)
+		;
+	else if (mNodeDATSimulationDatas.at(arbitrationWinner)->GetCurrentBitState() == BIT_LOW)
+		priorityArbitrationWinner = arbitrationWinner;
+	else {
+		for (int j=arbitrationWinner; j<arbitrationWinner+mNodeCount; j++) {
+			int k = j % mNodeCount;
+
+			if (
+					(mNodeDATSimulationDatas.at((k+mNodeCount-1)%mNodeCount)->GetCurrentBitState() == BIT_LOW) &&
+					(mNodeDATSimulationDatas.at(k)->GetCurrentBitState() == BIT_HIGH)
+			   ) {
+				if (priorityArbitrationWinner != -1)
+					MBusAssert("Multiple priority arbitration winners?");
+				priorityArbitrationWinner = k;
+			}
+		}
+		if (priorityArbitrationWinner == -1)
+			priorityArbitrationWinner = arbitrationWinner;
+	}
+
+	// Reserved Drive Edge (CLK)
+	*mLog << "SIM: rsv clk" << std::endl;
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	// Reserved Drive Edge (DAT)
+	*mLog << "SIM: rsv dat" << std::endl;
+	for (int i=0; i<mNodeCount; i++) {
+		;
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Reserved Latch Edge
+	*mLog << "SIM: rsv latch" << std::endl;
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	*mLog << "SIM: Gen Arb Done" << std::endl;
+
+	return priorityArbitrationWinner;
+}
+
+void MBusSimulator::CreateMBusBit(int sender, BitState bit) {
+	// Simplistic timing / prop still
+	//
+	// Drive Bit N (CLK)
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	// Drive Bit N (DAT)
+	for (int j=sender; j<sender+mNodeCount; j++) {
+		int k = j % mNodeCount;
+		// A node that dropped forwarding leaves itself and everything downstream stale
+		if (k == mDroppedForwardNode)
+			break;
+		mNodeDATSimulationDatas.at(k)->TransitionIfNeeded( bit );
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+	if (mStretchClock && ((std::rand() % 8) == 0))
+		mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1 + std::rand() % mMaxClockStretch) );
+
+	// Latch Bit N
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mLatchedBits.push_back(mNodeDATSimulationDatas.back()->GetCurrentBitState());
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+}
+
+void MBusSimulator::CreateMBusData(int sender, U32 address, U32 num_bytes, U8 data[], U32 num_data_bits) {
+	if (address > 0xff) {
+		if ((address & 0xf0000000) != 0xf0000000) {
+			*mLog << "SIM: " << __LINE__ << ": Big address but top bits not 0xf " << address << std::endl;
+			MBusAssert("If address is greater than 8 bits, the top 4 bits *must* be 0xf");
+		}
+		MBusBitExtractor addressBits(address, 32);
+		for (int i=0; i < 32; i++)
+			CreateMBusBit(sender, addressBits.GetNextBit());
+	} else {
+		MBusBitExtractor addressBits(address, 8);
+		for (int i=0; i < 8; i++)
+			CreateMBusBit(sender, addressBits.GetNextBit());
+	}
+
+	for (U32 b=0; (b < num_bytes) && (num_data_bits > 0); b++) {
+		MBusBitExtractor dataBits(data[b], 8);
+		for (int i=0; (i < 8) && (num_data_bits > 0); i++, num_data_bits--)
+			CreateMBusBit(sender, dataBits.GetNextBit());
+	}
+}
+
+void MBusSimulator::CreateMBusInterjection(int interjector) {
+	// Generate blocked CLK pulses
+	//
+	// Drive Req Int
+	for (int i=0; i<interjector; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Latch Req Int
+	for (int i=0; i<interjector; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Drive Beg Int
+	for (int i=0; i<interjector; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Latch Beg Int
+	for (int i=0; i<interjector; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	// Master Drives All Data High
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeDATSimulationDatas.at(i)->TransitionIfNeeded( BIT_HIGH );
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Generate Interjection Pulses
+	//
+	const int MBUS_NUM_INTERJECTION_PULSES = 3;
+	for (int p=0; p<MBUS_NUM_INTERJECTION_PULSES*2; p++) {
+		for (int i=0; i<mNodeCount; i++) {
+			mNodeDATSimulationDatas.at(i)->Transition();
+			PropogationDelay();
+		}
+		mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+	}
+}
+
+void MBusSimulator::CreateMBusControl(int interjector, BitState cb0, int target, BitState cb1) {
+	// "Drive" Begin Control
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// "Latch" Begin Control
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Drive CB0 (CLK)
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	// Drive CB0 (DAT)
+	for (int j=interjector; j < interjector + mNodeCount; j++) {
+		int k = j % mNodeCount;
+		mNodeDATSimulationDatas.at(k)->TransitionIfNeeded( cb0 );
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Latch CB0
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mLatchedCB0 = mNodeDATSimulationDatas.back()->GetCurrentBitState();
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Drive CB1 (CLK)
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	// Drive CB1 (DAT)
+	for (int j=target; j < target + mNodeCount; j++) {
+		int k = j % mNodeCount;
+		mNodeDATSimulationDatas.at(k)->TransitionIfNeeded( cb1 );
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// Latch CB1
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	mLatchedCB1 = mNodeDATSimulationDatas.back()->GetCurrentBitState();
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// "Drive" Begin Idle (CLK)
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	// "Drive" Begin Idle (DAT) [master returns data line to high]
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeDATSimulationDatas.at(i)->TransitionIfNeeded( BIT_HIGH );
+		PropogationDelay();
+	}
+	mMBusSimulationChannels.AdvanceAll( mClockGenerator.AdvanceByHalfPeriod(1) );
+
+	// "Latch" Begin Idle (CLK)
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeCLKSimulationDatas.at(i)->Transition();
+		PropogationDelay();
+	}
+	// "Latch" Begin Idle (DAT)
+	for (int i=0; i<mNodeCount; i++) {
+		mNodeDATSimulationDatas.at(i)->TransitionIfNeeded( BIT_HIGH );
+		PropogationDelay();
+	}
+}
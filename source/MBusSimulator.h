@@ -0,0 +1,189 @@
+#ifndef MBUS_SIMULATOR
+#define MBUS_SIMULATOR
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+
+#include <fstream>
+#include <sstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// One line of traffic mix from a scenario file, see MBusSimulator.cpp
+struct MBusTrafficClass
+{
+	std::string name;
+	U32 weight;
+	std::vector< int > senders;
+	std::vector< U32 > addresses;
+	U32 min_len, max_len;
+	double ack_ratio;
+	double prio_ratio;
+	U32 min_gap, max_gap;
+};
+
+// Faults the simulator can inject into a transaction, see "fault" directive
+enum MBusFault {
+	FaultPriorityRequest,     // another node raises a priority request
+	FaultMultipleRequest,     // another node requests alongside the sender
+	FaultErrorControl,        // CB0 low, i.e. NAK with a general error
+	FaultMidByteInterjection, // sender interjects partway through a byte
+	FaultGlitch,              // short pulse on a DAT line while idle
+	FaultClockStretch,        // some bits held low for extra half-periods
+	FaultDroppedForward,      // a node stops forwarding DAT mid-message
+	NUM_MBUS_FAULTS
+};
+// Scenario names for the faults above, e.g. "glitch"
+extern const char* MBusFaultNames[NUM_MBUS_FAULTS];
+
+// A simulated wire: records the sample of every transition so the owner can
+// replay them into a SimulationChannelDescriptor or feed them to the decoder
+class MBusSimulatedChannel
+{
+public:
+	MBusSimulatedChannel( const U64* sample_number, BitState initial_bit_state );
+
+	void Transition();
+	void TransitionIfNeeded( BitState bit_state );
+	BitState GetCurrentBitState();
+	U64 GetCurrentSampleNumber();
+
+	// Edges since the last ClearEdges(), and the state before the first one
+	const std::vector< U64 >& GetEdges() const { return mEdges; }
+	BitState GetInitialBitState() const { return mInitialBitState; }
+	void ClearEdges();
+
+protected:
+	const U64* mSampleNumber;
+	BitState mBitState;
+	BitState mInitialBitState;
+	std::vector< U64 > mEdges;
+};
+
+// All wires share one sample counter, like SimulationChannelDescriptorGroup
+class MBusSimulatedChannelGroup
+{
+public:
+	MBusSimulatedChannelGroup();
+	~MBusSimulatedChannelGroup();
+
+	MBusSimulatedChannel* Add( BitState initial_bit_state );
+	void AdvanceAll( U32 num_samples_to_advance );
+	U64 GetSampleNumber();
+
+protected:
+	U64 mSampleNumber;
+	std::vector< MBusSimulatedChannel* > mChannels;
+};
+
+// Stand-in for the SDK's ClockGenerator
+class MBusClockGenerator
+{
+public:
+	MBusClockGenerator();
+
+	void Init( double target_frequency, U32 sample_rate_hz );
+	U32 AdvanceByHalfPeriod( double multiple = 1.0 );
+
+protected:
+	double mSamplesPerHalfPeriod;
+	double mRemainder;
+};
+
+// Stand-in for the SDK's BitExtractor, MSB first
+class MBusBitExtractor
+{
+public:
+	MBusBitExtractor( U64 data, U32 num_bits ) : mData( data ), mMask( 1ULL << (num_bits - 1) ) {}
+
+	BitState GetNextBit()
+	{
+		BitState bit = (mData & mMask) ? BIT_HIGH : BIT_LOW;
+		mMask >>= 1;
+		return bit;
+	}
+
+protected:
+	U64 mData;
+	U64 mMask;
+};
+
+// Generates MBus traffic on a simulated ring with no dependence on the
+// AnalyzerSDK, so the same traffic can drive Logic or the headless tools
+class MBusSimulator
+{
+public:
+	MBusSimulator();
+	~MBusSimulator();
+
+	void Initialize( U32 simulation_sample_rate, int node_count, const std::string& scenario_file, std::ostream* log = NULL );
+	void GenerateUntil( U64 sample_number );
+	void CreateIdle( U32 half_periods );
+
+	U64 GetSampleNumber();
+	int GetNodeCount();
+	MBusSimulatedChannel* GetNodeCLK( int node );
+	MBusSimulatedChannel* GetNodeDAT( int node );
+
+	// Generate one message directly, bypassing the scenario
+	void CreateMBusTransaction(int sender, U32 address, U32 num_bytes, U8 data[], bool acked, bool priority = false, U32 faults = 0);
+	void CreateMBusWakeup(int sender);
+
+	// What the analyzer should decode at the last node for the most recent message
+	const MBusTransaction& GetExpected();
+
+protected:
+	std::ostream mNullLog;
+	std::ostream* mLog;
+
+	U32 mSimulationSampleRateHz;
+	int mNodeCount;
+
+	MBusSimulatedChannelGroup mMBusSimulationChannels;
+	std::vector< MBusSimulatedChannel * > mNodeCLKSimulationDatas;
+	std::vector< MBusSimulatedChannel * > mNodeDATSimulationDatas;
+
+	// Scenario playback state; the file is read one directive at a time
+	std::ifstream mScenario;
+	std::vector< MBusTrafficClass > mScenarioClasses;
+	int mScenarioRunClass; // -1 => weighted pick across all classes
+	U32 mScenarioRunRemaining;
+	double mScenarioWakeupRatio;
+	bool mScenarioProgress;
+	std::vector< U8 > mScenarioPayload;
+
+	// Fault injection, configured from the scenario
+	double mFaultRatio[NUM_MBUS_FAULTS];
+	U32 mMaxClockStretch;
+	bool mStretchClock;
+	int mDroppedForwardNode;
+
+	// Known answer: what the analyzer should decode at the last node
+	std::ofstream mExpected;
+	MBusTransaction mExpectedTransaction;
+	std::vector< BitState > mLatchedBits;
+	BitState mLatchedCB0, mLatchedCB1;
+
+private:
+	void CreateDefaultScript();
+	void ScenarioStep();
+	void ParseScenarioLine(const std::string& line);
+	bool ParseTrafficClass(std::istringstream& args, MBusTrafficClass& traffic_class);
+	void CreateScenarioTransaction(const MBusTrafficClass& traffic_class);
+	U32 RollFaults();
+	int PickOtherNode(int node);
+	void CreateGlitch();
+	void RecordExpected(U64 start_sample, int transmitter, U32 faults);
+
+	int CreateMBusArbitration(std::vector< bool > normal, std::vector< bool > priority);
+	int CreateMBusArbitration(std::vector< bool > normal, std::vector< bool > priority, std::vector< bool > wakeup);
+	void CreateMBusData(int sender, U32 address, U32 num_bytes, U8 data[], U32 num_data_bits);
+	void CreateMBusBit(int sender, BitState bit);
+	void CreateMBusInterjection(int interjector);
+	void CreateMBusControl(int interjector, BitState cb0, int target, BitState cb1);
+	void PropogationDelay();
+
+	MBusClockGenerator mClockGenerator;
+};
+#endif //MBUS_SIMULATOR
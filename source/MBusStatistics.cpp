@@ -0,0 +1,151 @@
+#include "MBusStatistics.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef WIN32
+#define snprintf _snprintf
+#endif
+
+static void Count( MBusTrafficCounters& counters, const MBusTransaction& transaction )
+{
+	counters.mMessages++;
+	counters.mPayloadBytes += transaction.mData.size();
+	if (!transaction.mCB0)
+		counters.mErrors++;
+	else if (transaction.mCB1)
+		counters.mNaks++;
+	else
+		counters.mAcks++;
+	// The transaction's span also takes in the idle time before it
+	counters.mBusSamples += BusySamples( transaction.mPhaseSamples );
+}
+
+MBusStatistics::MBusStatistics()
+{
+	memset( &mTotals, 0, sizeof(mTotals) );
+}
+
+MBusStatistics::~MBusStatistics()
+{
+}
+
+void MBusStatistics::Add( const MBusTransaction& transaction )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+
+	Count( mTotals, transaction );
+
+	if (transaction.mAddressBits != 0) {
+		U64 key = ((U64)transaction.mAddressBits << 32) | transaction.mAddress;
+		std::map< U64, MBusTrafficCounters >::iterator it = mAddresses.find( key );
+		if (it == mAddresses.end()) {
+			MBusTrafficCounters counters;
+			memset( &counters, 0, sizeof(counters) );
+			it = mAddresses.insert( std::make_pair( key, counters ) ).first;
+		}
+		Count( it->second, transaction );
+	}
+
+	// Wakeups have no transmitter, and nobody loses an arbitration nobody won
+	if (transaction.mTransmitter < 0)
+		return;
+
+	size_t nodes = transaction.mTransmitter + 1;
+	for (size_t node = nodes; node < 32; node++)
+		if (transaction.mRequesters & (1u << node))
+			nodes = node + 1;
+	if (mNodes.size() < nodes) {
+		MBusTrafficCounters counters;
+		memset( &counters, 0, sizeof(counters) );
+		mNodes.resize( nodes, counters );
+	}
+
+	Count( mNodes[transaction.mTransmitter], transaction );
+	for (size_t node = 0; node < nodes; node++) {
+		if ((transaction.mRequesters & (1u << node)) && ((int)node != transaction.mTransmitter)) {
+			mNodes[node].mArbitrationLosses++;
+			mTotals.mArbitrationLosses++;
+		}
+	}
+}
+
+void MBusStatistics::Clear()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	mAddresses.clear();
+	mNodes.clear();
+	memset( &mTotals, 0, sizeof(mTotals) );
+}
+
+void MBusStatistics::GetAddressCounters( std::vector< MBusAddressCounters >& counters )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	counters.clear();
+	for (std::map< U64, MBusTrafficCounters >::const_iterator it = mAddresses.begin(); it != mAddresses.end(); ++it) {
+		MBusAddressCounters address;
+		static_cast< MBusTrafficCounters& >( address ) = it->second;
+		address.mAddress = (U32)it->first;
+		address.mAddressBits = (U8)(it->first >> 32);
+		counters.push_back( address );
+	}
+}
+
+void MBusStatistics::GetNodeCounters( std::vector< MBusTrafficCounters >& counters )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	counters = mNodes;
+}
+
+MBusTrafficCounters MBusStatistics::GetTotals()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	return mTotals;
+}
+
+static void WriteCounters( std::ostream& out, const MBusTrafficCounters& counters, const MBusTrafficCounters& totals, U32 sample_rate, bool losses )
+{
+	char line[256];
+	snprintf( line, sizeof(line), "%llu, %llu, %llu, %llu, %llu, ",
+		(unsigned long long)counters.mMessages, (unsigned long long)counters.mPayloadBytes,
+		(unsigned long long)counters.mAcks, (unsigned long long)counters.mNaks, (unsigned long long)counters.mErrors );
+	out << line;
+	if (losses) {
+		snprintf( line, sizeof(line), "%llu, ", (unsigned long long)counters.mArbitrationLosses );
+		out << line;
+	}
+	snprintf( line, sizeof(line), "%.9f, %.2f",
+		sample_rate ? (double)counters.mBusSamples / sample_rate : 0.0,
+		totals.mBusSamples ? 100.0 * counters.mBusSamples / totals.mBusSamples : 0.0 );
+	out << line << std::endl;
+}
+
+void WriteStatisticsSummary( std::ostream& out, MBusStatistics& statistics, U32 sample_rate )
+{
+	std::vector< MBusAddressCounters > addresses;
+	std::vector< MBusTrafficCounters > nodes;
+	statistics.GetAddressCounters( addresses );
+	statistics.GetNodeCounters( nodes );
+	MBusTrafficCounters totals = statistics.GetTotals();
+
+	// Bus share is of the time the bus was busy, not of the whole capture
+	out << "Addr [in hex], Messages, Bytes, Acks, Naks, Errors, Bus Time [s], Bus Share [%]" << std::endl;
+	for (size_t i=0; i < addresses.size(); i++) {
+		char address[16];
+		snprintf( address, sizeof(address), (addresses[i].mAddressBits == 32) ? "0x%08X, " : "0x%02X, ", addresses[i].mAddress );
+		out << address;
+		WriteCounters( out, addresses[i], totals, sample_rate, false );
+	}
+	out << std::endl;
+
+	out << "Sender, Messages, Bytes, Acks, Naks, Errors, Arbitration Losses, Bus Time [s], Bus Share [%]" << std::endl;
+	for (size_t i=0; i < nodes.size(); i++) {
+		if (i == 0)
+			out << "Mediator, ";
+		else
+			out << "Member " << i - 1 << ", ";
+		WriteCounters( out, nodes[i], totals, sample_rate, true );
+	}
+	out << "All, ";
+	WriteCounters( out, totals, totals, sample_rate, true );
+}
@@ -0,0 +1,56 @@
+#ifndef MBUS_STATISTICS
+#define MBUS_STATISTICS
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Running totals for one address, one node or the whole bus
+struct MBusTrafficCounters
+{
+	U64 mMessages;
+	U64 mPayloadBytes;
+	U64 mAcks;      // CB0 high, CB1 low
+	U64 mNaks;      // CB0 high, CB1 high
+	U64 mErrors;    // CB0 low: general error, node error or interrupted
+	U64 mArbitrationLosses; // node tables only: requested, someone else sent
+	U64 mBusSamples; // request through the end of control (BusySamples)
+};
+
+struct MBusAddressCounters : MBusTrafficCounters
+{
+	U32 mAddress;
+	U8 mAddressBits;
+};
+
+// Per-address and per-sender aggregates, updated as each transaction commits
+// so the summary never needs another pass over the frames
+class MBusStatistics
+{
+public:
+	MBusStatistics();
+	~MBusStatistics();
+
+	void Add( const MBusTransaction& transaction );
+	void Clear();
+
+	// Snapshots; addresses in ascending order (short before full), nodes by index
+	void GetAddressCounters( std::vector< MBusAddressCounters >& counters );
+	void GetNodeCounters( std::vector< MBusTrafficCounters >& counters );
+	MBusTrafficCounters GetTotals();
+
+protected:
+	std::mutex mMutex;
+	std::map< U64, MBusTrafficCounters > mAddresses;
+	std::vector< MBusTrafficCounters > mNodes;
+	MBusTrafficCounters mTotals;
+};
+
+// Address and node tables as text/csv, bus time in seconds at sample_rate
+void WriteStatisticsSummary( std::ostream& out, MBusStatistics& statistics, U32 sample_rate );
+
+#endif //MBUS_STATISTICS
@@ -0,0 +1,269 @@
+#include "MBusStreamer.h"
+
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS uses SO_NOSIGPIPE instead
+#endif
+
+/*
+ * The queue positions only ever grow; the byte at position p lives at
+ * p & mMask. The producer publishes with a release store of mTail after
+ * copying, the consumer frees space with a release store of mHead after
+ * sending, and each acquires the other's index, so neither needs a lock.
+ */
+
+MBusStreamQueue::MBusStreamQueue( U32 capacity_log2 )
+:	mBuffer( (size_t)1 << capacity_log2 ),
+	mMask( ((U64)1 << capacity_log2) - 1 ),
+	mHead( 0 ),
+	mTail( 0 )
+{
+}
+
+bool MBusStreamQueue::Push( const char* data, U32 length )
+{
+	U64 tail = mTail.load( std::memory_order_relaxed );
+	U64 head = mHead.load( std::memory_order_acquire );
+	if (tail + length - head > mBuffer.size())
+		return false;
+
+	U64 offset = tail & mMask;
+	U64 first = mBuffer.size() - offset;
+	if (first > length)
+		first = length;
+	memcpy( &mBuffer[offset], data, first );
+	memcpy( &mBuffer[0], data + first, length - first );
+
+	mTail.store( tail + length, std::memory_order_release );
+	return true;
+}
+
+U32 MBusStreamQueue::Peek( const char*& data )
+{
+	U64 head = mHead.load( std::memory_order_relaxed );
+	U64 tail = mTail.load( std::memory_order_acquire );
+	U64 offset = head & mMask;
+	U64 length = tail - head;
+	if (length > mBuffer.size() - offset)
+		length = mBuffer.size() - offset;
+	data = &mBuffer[offset];
+	return (U32)length;
+}
+
+void MBusStreamQueue::Release( U32 length )
+{
+	mHead.store( mHead.load( std::memory_order_relaxed ) + length, std::memory_order_release );
+}
+
+static U64 CountLines( const char* data, U32 length )
+{
+	U64 lines = 0;
+	const char* end = data + length;
+	while ((data = (const char*) memchr( data, '\n', end - data )) != NULL) {
+		lines++;
+		data++;
+	}
+	return lines;
+}
+
+MBusTransactionStreamer::MBusTransactionStreamer()
+:	mQueue( NULL ),
+	mStop( false ),
+	mSent( 0 ),
+	mDropped( 0 ),
+	mDroppedReported( 0 ),
+#ifdef _WIN32
+	mPipe( INVALID_HANDLE_VALUE )
+#else
+	mSocket( -1 )
+#endif
+{
+}
+
+MBusTransactionStreamer::~MBusTransactionStreamer()
+{
+	Stop();
+}
+
+void MBusTransactionStreamer::Start( const std::string& path, U32 queue_log2 )
+{
+	Stop();
+
+	mPath = path;
+	mQueue = new MBusStreamQueue( queue_log2 );
+	mStop = false;
+	mSent = 0;
+	mDropped = 0;
+	mDroppedReported = 0;
+	mThread = std::thread( &MBusTransactionStreamer::WriterThread, this );
+}
+
+void MBusTransactionStreamer::Stop()
+{
+	if (!mThread.joinable())
+		return;
+
+	mStop = true;
+	mThread.join();
+	delete mQueue;
+	mQueue = NULL;
+}
+
+void MBusTransactionStreamer::Push( const MBusTransaction& transaction )
+{
+	if (mQueue == NULL)
+		return;
+
+	// mLine keeps its capacity, so after the first few messages this allocates nothing
+	mLine.clear();
+	FormatTransactionLine( mLine, transaction );
+	mLine.push_back( '\n' );
+
+	if (!mQueue->Push( &mLine[0], (U32)mLine.size() ))
+		mDropped.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void MBusTransactionStreamer::WriterThread()
+{
+	bool connected = false;
+	std::chrono::steady_clock::time_point next_attempt = std::chrono::steady_clock::now();
+
+	while (true) {
+		bool stopping = mStop.load();
+
+		if (!connected && (std::chrono::steady_clock::now() >= next_attempt)) {
+			connected = Connect();
+			next_attempt = std::chrono::steady_clock::now() + std::chrono::milliseconds( 250 );
+		}
+
+		// Until a consumer connects the queue simply fills, then drops
+		const char* data;
+		U32 length = connected ? mQueue->Peek( data ) : 0;
+		if (length == 0) {
+			U64 dropped = mDropped.load();
+			if (connected && (dropped != mDroppedReported)) {
+				char note[64];
+				int note_length = snprintf( note, sizeof(note), "# dropped %llu\n", (unsigned long long)(dropped - mDroppedReported) );
+				if (Send( note, note_length ))
+					mDroppedReported = dropped;
+			}
+			if (stopping)
+				break;
+			std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+			continue;
+		}
+
+		U64 lines = CountLines( data, length );
+		if (Send( data, length )) {
+			mSent.fetch_add( lines, std::memory_order_relaxed );
+		} else {
+			// The consumer went away mid-write; whatever it missed is lost
+			Disconnect();
+			connected = false;
+			mDropped.fetch_add( lines, std::memory_order_relaxed );
+		}
+		mQueue->Release( length );
+	}
+
+	// Stopped with nobody listening
+	const char* data;
+	U32 length;
+	while ((length = mQueue->Peek( data )) != 0) {
+		mDropped.fetch_add( CountLines( data, length ), std::memory_order_relaxed );
+		mQueue->Release( length );
+	}
+
+	if (connected)
+		Disconnect();
+}
+
+#ifdef _WIN32
+
+bool MBusTransactionStreamer::Connect()
+{
+	mPipe = CreateFileA( mPath.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL );
+	return mPipe != INVALID_HANDLE_VALUE;
+}
+
+void MBusTransactionStreamer::Disconnect()
+{
+	CloseHandle( (HANDLE) mPipe );
+	mPipe = INVALID_HANDLE_VALUE;
+}
+
+bool MBusTransactionStreamer::Send( const char* data, U32 length )
+{
+	while (length) {
+		DWORD written;
+		if (!WriteFile( (HANDLE) mPipe, data, length, &written, NULL ))
+			return false;
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+
+#else
+
+bool MBusTransactionStreamer::Connect()
+{
+	struct sockaddr_un address;
+	if (mPath.size() >= sizeof(address.sun_path))
+		return false;
+
+	mSocket = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if (mSocket < 0)
+		return false;
+
+	// A consumer that stops reading must not wedge Stop() forever
+	struct timeval timeout;
+	timeout.tv_sec = 1;
+	timeout.tv_usec = 0;
+	setsockopt( mSocket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout) );
+
+#ifdef SO_NOSIGPIPE
+	int on = 1;
+	setsockopt( mSocket, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on) );
+#endif
+
+	memset( &address, 0, sizeof(address) );
+	address.sun_family = AF_UNIX;
+	strcpy( address.sun_path, mPath.c_str() );
+	if (connect( mSocket, (struct sockaddr*) &address, sizeof(address) ) != 0) {
+		Disconnect();
+		return false;
+	}
+	return true;
+}
+
+void MBusTransactionStreamer::Disconnect()
+{
+	if (mSocket >= 0)
+		close( mSocket );
+	mSocket = -1;
+}
+
+bool MBusTransactionStreamer::Send( const char* data, U32 length )
+{
+	while (length) {
+		ssize_t written = send( mSocket, data, length, MSG_NOSIGNAL );
+		if (written <= 0)
+			return false;
+		data += written;
+		length -= (U32) written;
+	}
+	return true;
+}
+
+#endif
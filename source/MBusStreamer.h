@@ -0,0 +1,82 @@
+#ifndef MBUS_STREAMER
+#define MBUS_STREAMER
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bounded single-producer, single-consumer byte queue. Push either takes
+// the whole message or nothing; neither side ever waits for the other.
+class MBusStreamQueue
+{
+public:
+	explicit MBusStreamQueue( U32 capacity_log2 = 20 );
+
+	// Producer side
+	bool Push( const char* data, U32 length );
+
+	// Consumer side: the oldest unread bytes up to the end of the buffer
+	// (peek again after Release() for any that wrapped); Release() hands
+	// them back once written
+	U32 Peek( const char*& data );
+	void Release( U32 length );
+
+private:
+	std::vector< char > mBuffer;
+	U64 mMask;
+	// Written by one side each, so keep them off a shared cache line
+	std::atomic< U64 > mHead; // next byte to read
+	char mPad[64];
+	std::atomic< U64 > mTail; // next byte to write
+};
+
+// Pushes each committed transaction, one WriteTransactionLine per line, to
+// a local consumer: a Unix domain socket, or on Windows a named pipe
+// (\\.\pipe\name). The decoder thread only formats and queues; a writer
+// thread connects, reconnects and sends. The queue holds traffic while no
+// consumer is connected. When it is full the newest transaction is dropped
+// and counted, so a slow or absent consumer can never stall decoding, and the
+// consumer is told with a "# dropped <n>" line.
+class MBusTransactionStreamer
+{
+public:
+	MBusTransactionStreamer();
+	~MBusTransactionStreamer();
+
+	void Start( const std::string& path, U32 queue_log2 = 20 );
+	void Stop();
+	bool IsRunning() const { return mThread.joinable(); }
+
+	// Decoder thread only
+	void Push( const MBusTransaction& transaction );
+
+	U64 GetSent() const { return mSent.load(); }
+	U64 GetDropped() const { return mDropped.load(); }
+
+private:
+	void WriterThread();
+	bool Connect();
+	void Disconnect();
+	bool Send( const char* data, U32 length );
+
+	std::string mPath;
+	MBusStreamQueue* mQueue;
+	std::thread mThread;
+	std::atomic< bool > mStop;
+	std::atomic< U64 > mSent;
+	std::atomic< U64 > mDropped;
+	U64 mDroppedReported;
+	std::vector< char > mLine;
+
+#ifdef _WIN32
+	void* mPipe;
+#else
+	int mSocket;
+#endif
+};
+
+#endif //MBUS_STREAMER
@@ -0,0 +1,89 @@
+#include "MBusTransaction.h"
+
+#include <cstdio>
+
+const char* MBusPhaseNames[NUM_MBUS_PHASES] = {
+	"Idle",
+	"Arbitration",
+	"Address",
+	"Data",
+	"Interjection",
+	"Control",
+};
+
+void ClearTransaction(MBusTransaction& transaction)
+{
+	transaction.mStartingSampleInclusive = 0;
+	transaction.mEndingSampleInclusive = 0;
+	transaction.mRequesters = 0;
+	transaction.mArbitrationWinner = -1;
+	transaction.mPriorityWinner = -1;
+	transaction.mTransmitter = -1;
+	transaction.mAddress = 0;
+	transaction.mAddressBits = 0;
+	transaction.mAddressSample = 0;
+	transaction.mData.clear();
+	transaction.mDataSamples.clear();
+	transaction.mDataEndingSample = 0;
+	transaction.mCB0 = false;
+	transaction.mCB1 = false;
+	transaction.mFlags = 0;
+	for (int i=0; i < NUM_MBUS_PHASES; i++)
+		transaction.mPhaseSamples[i] = 0;
+}
+
+U64 BusySamples(const U64 phase_samples[NUM_MBUS_PHASES])
+{
+	U64 samples = 0;
+	for (int i=PhaseArbitration; i < NUM_MBUS_PHASES; i++)
+		samples += phase_samples[i];
+	return samples;
+}
+
+bool SameDecode(const MBusTransaction& a, const MBusTransaction& b)
+{
+	return (a.mTransmitter == b.mTransmitter) &&
+		(a.mAddressBits == b.mAddressBits) &&
+		((a.mAddressBits == 0) || (a.mAddress == b.mAddress)) &&
+		(a.mData == b.mData) &&
+		(a.mCB0 == b.mCB0) &&
+		(a.mCB1 == b.mCB1);
+}
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static void AppendHex(std::vector< char >& out, U32 value, int digits)
+{
+	for (int i = digits - 1; i >= 0; i--)
+		out.push_back(HEX_DIGITS[(value >> (4 * i)) & 0xf]);
+}
+
+void FormatTransactionLine(std::vector< char >& out, const MBusTransaction& transaction)
+{
+	char number[32];
+	int length = snprintf(number, sizeof(number), "%llu %d ", (unsigned long long) transaction.mStartingSampleInclusive, transaction.mTransmitter);
+	out.insert(out.end(), number, number + length);
+
+	if (transaction.mAddressBits == 0)
+		out.push_back('-');
+	else
+		AppendHex(out, transaction.mAddress, (transaction.mAddressBits == 32) ? 8 : 2);
+	out.push_back(' ');
+
+	if (transaction.mData.empty())
+		out.push_back('-');
+	for (size_t i=0; i < transaction.mData.size(); i++)
+		AppendHex(out, transaction.mData[i], 2);
+
+	out.push_back(' ');
+	out.push_back(transaction.mCB0 ? '1' : '0');
+	out.push_back(' ');
+	out.push_back(transaction.mCB1 ? '1' : '0');
+}
+
+void WriteTransactionLine(std::ostream& out, const MBusTransaction& transaction)
+{
+	std::vector< char > line;
+	FormatTransactionLine(line, transaction);
+	out.write(&line[0], line.size());
+}
@@ -0,0 +1,88 @@
+#ifndef MBUS_TRANSACTION
+#define MBUS_TRANSACTION
+
+#include "MBusTypes.h"
+
+#include <ostream>
+#include <vector>
+
+enum MBusFrameType {
+	FrameTypeRequest,
+	FrameTypeArbitration,
+	FrameTypePriorityArbitration,
+	FrameTypeReservedBit,
+	FrameTypeAddress,
+	FrameTypeData,
+	FrameTypeInterjection,
+	FrameTypeControlBit0,
+	FrameTypeControlBit1,
+	FrameTypeDataBlock, // compact storage: whole payload, mData1 is the transaction id
+};
+
+// What the bus is doing, coarser than the frame types
+enum MBusBusPhase {
+	PhaseIdle,
+	PhaseArbitration, // request, arbitration, priority and the reserved bit
+	PhaseAddress,
+	PhaseData,
+	PhaseInterjection,
+	PhaseControl,
+	NUM_MBUS_PHASES
+};
+extern const char* MBusPhaseNames[NUM_MBUS_PHASES];
+
+#define MULTIPLE_ARBITRATION_WINNER (1 << 0)
+#define NO_ARBITRATION_WINNER		(1 << 1)
+#define REQUEST_BUG_WORKAROUND      (1 << 2)
+
+// SDK-free twin of the SDK's Frame, field for field
+struct MBusFrame
+{
+	S64 mStartingSampleInclusive;
+	S64 mEndingSampleInclusive;
+	U64 mData1;
+	U64 mData2;
+	U8 mType;
+	U8 mFlags;
+};
+
+// Everything decoded between the request and the end of control
+struct MBusTransaction
+{
+	U64 mStartingSampleInclusive;
+	U64 mEndingSampleInclusive;
+	U32 mRequesters; // one bit per node, mediator is bit 0
+	int mArbitrationWinner; // -1 if nobody won (e.g. a wakeup)
+	int mPriorityWinner;
+	int mTransmitter;
+	U32 mAddress;
+	U8 mAddressBits; // 8 or 32, 0 if interjected before the address finished
+	U64 mAddressSample; // first sample of the address
+	std::vector< U8 > mData;
+	std::vector< U64 > mDataSamples; // first sample of each byte in mData
+	U64 mDataEndingSample; // last sample of the final byte, 0 if no data
+	bool mCB0;
+	bool mCB1;
+	U8 mFlags;
+	// Samples in each phase, summing to the whole transaction: idle since
+	// the one before, the first request through the reserved bit, address,
+	// whole data bytes, interjection (anything cut short included) through
+	// Drive Begin Control, and control through Begin Idle
+	U64 mPhaseSamples[NUM_MBUS_PHASES];
+};
+
+void ClearTransaction(MBusTransaction& transaction);
+
+// Samples the bus was busy, every phase but the idle one before the request
+U64 BusySamples(const U64 phase_samples[NUM_MBUS_PHASES]);
+
+// True if two transactions carry the same transmitter, address, data and control bits
+bool SameDecode(const MBusTransaction& a, const MBusTransaction& b);
+
+// One line per transaction, the same layout as the simulator's known answers:
+// <sample> <transmitter> <addr> <data> <cb0> <cb1> (no trailing newline)
+void WriteTransactionLine(std::ostream& out, const MBusTransaction& transaction);
+// The same line appended to out, for callers that must not touch a stream
+void FormatTransactionLine(std::vector< char >& out, const MBusTransaction& transaction);
+
+#endif //MBUS_TRANSACTION
@@ -0,0 +1,434 @@
+#include "MBusTransactionStore.h"
+
+#include <algorithm>
+#include <cstring>
+
+/*
+ * Storage layout
+ * ==============
+ *
+ * Every transaction gets one MBusTransactionRecord. Its payload is copied
+ * into the arena, a list of 64 KiB chunks that are never reallocated, and is
+ * immediately followed by the sample positions of the address and each byte,
+ * with the length of each phase (MBusPhase) after the address:
+ *
+ *   <payload bytes> <address - transaction start> <phase samples>...
+ *   <first byte - address> <byte N - byte N-1>...
+ *   <last sample of final byte - first sample of it>
+ *
+ * The address and first byte offsets and the phases are unsigned LEB128
+ * varints, a byte or two each. Bytes are
+ * evenly spaced unless the clock is stretched, so each later delta is stored
+ * as its difference from the one before, zigzag coded, and is nearly always
+ * a single zero or small byte. A 160-byte imager row costs a 48-byte record
+ * plus ~340 arena bytes, against ~165 frames of 40+ bytes each when every
+ * byte is its own Frame.
+ *
+ * A payload larger than a chunk gets a chunk of its own. Records and frames
+ * are kept in 64 KiB chunks too, so a long capture allocates once per
+ * thousand or so transactions and never copies what it already holds.
+ *
+ * On disk
+ * =======
+ *
+ * Opened on a file, the same records and arena bytes, and any frames, go to
+ * three streams of 4 MiB segments interleaved in one MBusSegmentFile.
+ * Records and frames are fixed size and never straddle a segment, so id N
+ * is segment N / per-segment at a fixed offset in it: one page to read. The
+ * arena fills a segment at a time, and mChunk becomes the segment number; a
+ * payload larger than a segment gets a run of its own. What stays in memory
+ * is the segment lists and the sparse time indexes, under 1% of what is
+ * stored, so a long capture costs disk rather than memory.
+ */
+
+static const U32 ARENA_CHUNK_SIZE = 1 << 16;
+static const U32 RECORDS_PER_CHUNK = ARENA_CHUNK_SIZE / sizeof(MBusTransactionRecord);
+static const U32 FRAMES_PER_CHUNK = ARENA_CHUNK_SIZE / sizeof(MBusFrame);
+static const U32 RECORDS_PER_SEGMENT = MBUS_SEGMENT_SIZE / sizeof(MBusTransactionRecord);
+static const U32 FRAMES_PER_SEGMENT = MBUS_SEGMENT_SIZE / sizeof(MBusFrame);
+
+static void PutVarint( std::vector< U8 >& out, U64 value )
+{
+	while (value >= 0x80) {
+		out.push_back( (U8)(value | 0x80) );
+		value >>= 7;
+	}
+	out.push_back( (U8)value );
+}
+
+static U64 ZigZag( S64 value )
+{
+	return ((U64)value << 1) ^ (U64)(value >> 63);
+}
+
+static S64 UnZigZag( U64 value )
+{
+	return (S64)(value >> 1) ^ -(S64)(value & 1);
+}
+
+static U64 GetVarint( const U8*& in )
+{
+	U64 value = 0;
+	int shift = 0;
+	while (*in & 0x80) {
+		value |= (U64)(*in++ & 0x7f) << shift;
+		shift += 7;
+	}
+	value |= (U64)(*in++) << shift;
+	return value;
+}
+
+static U32 SegmentsFor( U64 num_bytes )
+{
+	return (U32)((num_bytes + MBUS_SEGMENT_SIZE - 1) / MBUS_SEGMENT_SIZE);
+}
+
+// Appends item to a list of chunks of per_chunk, reserving each when it starts
+template< typename T >
+static void AddToChunks( std::vector< std::vector< T > >& chunks, U64 count, U32 per_chunk, const T& item )
+{
+	if (count % per_chunk == 0) {
+		chunks.push_back( std::vector< T >() );
+		chunks.back().reserve( per_chunk );
+	}
+	chunks.back().push_back( item );
+}
+
+// Last stride whose first entry starts at or before sample
+static U64 FindStride( const std::vector< U64 >& starts, U64 sample )
+{
+	U64 stride = std::upper_bound( starts.begin(), starts.end(), sample ) - starts.begin();
+	return stride ? stride - 1 : 0;
+}
+
+MBusTransactionStore::MBusTransactionStore()
+:	mCount( 0 ),
+	mFrameCount( 0 ),
+	mArenaSegment( 0 ),
+	mArenaUsed( MBUS_SEGMENT_SIZE )
+{
+}
+
+MBusTransactionStore::~MBusTransactionStore()
+{
+}
+
+bool MBusTransactionStore::Open( const std::string& path )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	mRecords.clear();
+	mChunks.clear();
+	mFrames.clear();
+	mRecordSegments.clear();
+	mFrameSegments.clear();
+	mStarts.clear();
+	mFrameStarts.clear();
+	mCount = 0;
+	mFrameCount = 0;
+	mArenaUsed = MBUS_SEGMENT_SIZE;
+	mPath = path;
+	return mFile.Open( path );
+}
+
+U8* MBusTransactionStore::AddSlot( std::vector< U32 >& segments, U64 count, U32 size )
+{
+	U32 per_segment = MBUS_SEGMENT_SIZE / size;
+	if (count % per_segment == 0) {
+		U32 segment;
+		if (!mFile.AddSegments( 1, segment ))
+			MBusAssert( "Out of disk space for the transaction store" );
+		segments.push_back( segment );
+	}
+	U8* data = mFile.Map( segments[count / per_segment] );
+	if (data == NULL)
+		MBusAssert( "Could not map the transaction store" );
+	return data + (count % per_segment) * size;
+}
+
+MBusTransactionRecord* MBusTransactionStore::RecordAt( U64 id )
+{
+	if (!mFile.IsOpen())
+		return &mRecords[id / RECORDS_PER_CHUNK][id % RECORDS_PER_CHUNK];
+	U8* data = mFile.Map( mRecordSegments[id / RECORDS_PER_SEGMENT] );
+	if (data == NULL)
+		MBusAssert( "Could not map the transaction store" );
+	return (MBusTransactionRecord*)data + id % RECORDS_PER_SEGMENT;
+}
+
+MBusFrame* MBusTransactionStore::FrameAt( U64 index )
+{
+	if (!mFile.IsOpen())
+		return &mFrames[index / FRAMES_PER_CHUNK][index % FRAMES_PER_CHUNK];
+	U8* data = mFile.Map( mFrameSegments[index / FRAMES_PER_SEGMENT] );
+	if (data == NULL)
+		MBusAssert( "Could not map the transaction store" );
+	return (MBusFrame*)data + index % FRAMES_PER_SEGMENT;
+}
+
+const U8* MBusTransactionStore::ArenaAt( const MBusTransactionRecord& record )
+{
+	if (!mFile.IsOpen())
+		return &mChunks[record.mChunk][record.mOffset];
+	U8* data = mFile.Map( record.mChunk, SegmentsFor( (U64)record.mOffset + record.mNumBytes + record.mSampleBytes ) );
+	if (data == NULL)
+		MBusAssert( "Could not map the transaction store" );
+	return data + record.mOffset;
+}
+
+U8* MBusTransactionStore::Allocate( U32 num_bytes, U32& chunk, U32& offset )
+{
+	if (mFile.IsOpen()) {
+		if (mArenaUsed + num_bytes > MBUS_SEGMENT_SIZE) {
+			U32 count = (num_bytes > MBUS_SEGMENT_SIZE) ? SegmentsFor( num_bytes ) : 1;
+			if (!mFile.AddSegments( count, mArenaSegment ))
+				MBusAssert( "Out of disk space for the transaction store" );
+			// A run of segments is this payload's alone
+			mArenaUsed = (count > 1) ? MBUS_SEGMENT_SIZE : num_bytes;
+			chunk = mArenaSegment;
+			offset = 0;
+			return mFile.Map( chunk, count );
+		}
+		chunk = mArenaSegment;
+		offset = mArenaUsed;
+		mArenaUsed += num_bytes;
+		U8* arena = mFile.Map( chunk );
+		return arena ? arena + offset : NULL;
+	}
+
+	// Chunks are reserved, not filled, so the tail of the newest one costs
+	// address space only, and nothing already stored ever moves
+	if (mChunks.empty() || (mChunks.back().size() + num_bytes > mChunks.back().capacity())) {
+		mChunks.push_back( std::vector< U8 >() );
+		mChunks.back().reserve( (num_bytes > ARENA_CHUNK_SIZE) ? num_bytes : ARENA_CHUNK_SIZE );
+	}
+
+	std::vector< U8 >& arena = mChunks.back();
+	chunk = (U32)(mChunks.size() - 1);
+	offset = (U32)arena.size();
+	arena.resize( arena.size() + num_bytes );
+	return &arena[offset];
+}
+
+U64 MBusTransactionStore::Append( const MBusTransaction& transaction )
+{
+	// Encode outside the lock, the UI only ever waits for the copy
+	std::vector< U8 >& samples = mSamples;
+	samples.clear();
+	size_t num_bytes = transaction.mData.size();
+	U64 last = transaction.mStartingSampleInclusive;
+	if (transaction.mAddressSample > last) {
+		PutVarint( samples, transaction.mAddressSample - last );
+		last = transaction.mAddressSample;
+	} else {
+		PutVarint( samples, 0 );
+	}
+	for (int i=0; i < NUM_MBUS_PHASES; i++)
+		PutVarint( samples, transaction.mPhaseSamples[i] );
+	if ((num_bytes > 0) && (transaction.mDataSamples.size() == num_bytes)) {
+		PutVarint( samples, transaction.mDataSamples[0] - last );
+		S64 spacing = 0;
+		for (size_t i=1; i < num_bytes; i++) {
+			S64 delta = transaction.mDataSamples[i] - transaction.mDataSamples[i-1];
+			PutVarint( samples, ZigZag( delta - spacing ) );
+			spacing = delta;
+		}
+		PutVarint( samples, transaction.mDataEndingSample - transaction.mDataSamples[num_bytes-1] );
+	}
+
+	MBusTransactionRecord record;
+	record.mStartingSampleInclusive = transaction.mStartingSampleInclusive;
+	record.mEndingSampleInclusive = transaction.mEndingSampleInclusive;
+	record.mRequesters = transaction.mRequesters;
+	record.mAddress = transaction.mAddress;
+	record.mNumBytes = (U32)num_bytes;
+	record.mSampleBytes = (U32)samples.size();
+	record.mArbitrationWinner = (S8)transaction.mArbitrationWinner;
+	record.mPriorityWinner = (S8)transaction.mPriorityWinner;
+	record.mTransmitter = (S8)transaction.mTransmitter;
+	record.mAddressBits = transaction.mAddressBits;
+	record.mFlags = transaction.mFlags;
+	record.mControl = (transaction.mCB0 ? 1 : 0) | (transaction.mCB1 ? 2 : 0);
+
+	std::lock_guard< std::mutex > lock( mMutex );
+
+	U8* arena = Allocate( record.mNumBytes + record.mSampleBytes, record.mChunk, record.mOffset );
+	if (arena == NULL)
+		MBusAssert( "Could not map the transaction store" );
+	if (record.mNumBytes)
+		memcpy( arena, &transaction.mData[0], record.mNumBytes );
+	if (record.mSampleBytes)
+		memcpy( arena + record.mNumBytes, &samples[0], record.mSampleBytes );
+
+	if (mCount % MBUS_STORE_INDEX_STRIDE == 0)
+		mStarts.push_back( record.mStartingSampleInclusive );
+	if (mFile.IsOpen())
+		memcpy( AddSlot( mRecordSegments, mCount, sizeof(record) ), &record, sizeof(record) );
+	else
+		AddToChunks( mRecords, mCount, RECORDS_PER_CHUNK, record );
+	return mCount++;
+}
+
+void MBusTransactionStore::Clear()
+{
+	if (mFile.IsOpen()) {
+		Open( mPath );
+		return;
+	}
+
+	std::lock_guard< std::mutex > lock( mMutex );
+	mRecords.clear();
+	mChunks.clear();
+	mFrames.clear();
+	mStarts.clear();
+	mFrameStarts.clear();
+	mCount = 0;
+	mFrameCount = 0;
+}
+
+U64 MBusTransactionStore::GetCount()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	return mCount;
+}
+
+bool MBusTransactionStore::GetRecord( U64 id, MBusTransactionRecord& record )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if (id >= mCount)
+		return false;
+	record = *RecordAt( id );
+	return true;
+}
+
+U64 MBusTransactionStore::FindTransaction( U64 sample )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	// Transactions follow one another, so ends are in order as well as starts
+	U64 id = FindStride( mStarts, sample ) * MBUS_STORE_INDEX_STRIDE;
+	U64 end = std::min( id + MBUS_STORE_INDEX_STRIDE, mCount );
+	for ( ; id < end; id++)
+		if (RecordAt( id )->mEndingSampleInclusive >= sample)
+			break;
+	return id;
+}
+
+U64 MBusTransactionStore::AppendFrame( const MBusFrame& frame )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if (mFrameCount % MBUS_STORE_INDEX_STRIDE == 0)
+		mFrameStarts.push_back( frame.mStartingSampleInclusive );
+	if (mFile.IsOpen())
+		memcpy( AddSlot( mFrameSegments, mFrameCount, sizeof(frame) ), &frame, sizeof(frame) );
+	else
+		AddToChunks( mFrames, mFrameCount, FRAMES_PER_CHUNK, frame );
+	return mFrameCount++;
+}
+
+U64 MBusTransactionStore::GetFrameCount()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	return mFrameCount;
+}
+
+bool MBusTransactionStore::GetFrame( U64 index, MBusFrame& frame )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if (index >= mFrameCount)
+		return false;
+	frame = *FrameAt( index );
+	return true;
+}
+
+U64 MBusTransactionStore::FindFrame( U64 sample )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	// A frame ends before the next one starts, bar the same bit seen on
+	// each node, which share their samples
+	U64 index = FindStride( mFrameStarts, sample ) * MBUS_STORE_INDEX_STRIDE;
+	U64 end = std::min( index + MBUS_STORE_INDEX_STRIDE, mFrameCount );
+	for ( ; index < end; index++)
+		if ((U64)FrameAt( index )->mEndingSampleInclusive >= sample)
+			break;
+	return index;
+}
+
+void MBusTransactionStore::Decode( const MBusTransactionRecord& record, MBusTransaction& transaction )
+{
+	ClearTransaction( transaction );
+	transaction.mStartingSampleInclusive = record.mStartingSampleInclusive;
+	transaction.mEndingSampleInclusive = record.mEndingSampleInclusive;
+	transaction.mRequesters = record.mRequesters;
+	transaction.mArbitrationWinner = record.mArbitrationWinner;
+	transaction.mPriorityWinner = record.mPriorityWinner;
+	transaction.mTransmitter = record.mTransmitter;
+	transaction.mAddress = record.mAddress;
+	transaction.mAddressBits = record.mAddressBits;
+	transaction.mCB0 = (record.mControl & 1) != 0;
+	transaction.mCB1 = (record.mControl & 2) != 0;
+	transaction.mFlags = record.mFlags;
+
+	const U8* arena = ArenaAt( record );
+	transaction.mData.assign( arena, arena + record.mNumBytes );
+
+	const U8* in = arena + record.mNumBytes;
+	const U8* end = in + record.mSampleBytes;
+	U64 sample = record.mStartingSampleInclusive + GetVarint( in );
+	transaction.mAddressSample = sample;
+	for (int i=0; i < NUM_MBUS_PHASES; i++)
+		transaction.mPhaseSamples[i] = GetVarint( in );
+	if (in == end)
+		return;
+
+	transaction.mDataSamples.resize( record.mNumBytes );
+	sample += GetVarint( in );
+	transaction.mDataSamples[0] = sample;
+	S64 spacing = 0;
+	for (U32 i=1; i < record.mNumBytes; i++) {
+		spacing += UnZigZag( GetVarint( in ) );
+		sample += spacing;
+		transaction.mDataSamples[i] = sample;
+	}
+	transaction.mDataEndingSample = sample + GetVarint( in );
+}
+
+bool MBusTransactionStore::GetTransaction( U64 id, MBusTransaction& transaction )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if (id >= mCount)
+		return false;
+	// A copy, as mapping the arena may unmap the record
+	MBusTransactionRecord record = *RecordAt( id );
+	Decode( record, transaction );
+	return true;
+}
+
+U32 MBusTransactionStore::GetData( U64 id, U8* data, U32 max_bytes )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if (id >= mCount)
+		return 0;
+
+	MBusTransactionRecord record = *RecordAt( id );
+	U32 num_bytes = (record.mNumBytes < max_bytes) ? record.mNumBytes : max_bytes;
+	if (num_bytes)
+		memcpy( data, ArenaAt( record ), num_bytes );
+	return num_bytes;
+}
+
+U64 MBusTransactionStore::GetMemoryUsage()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	U64 usage = (mStarts.size() + mFrameStarts.size()) * sizeof(U64);
+	usage += (mRecordSegments.size() + mFrameSegments.size()) * sizeof(U32);
+	if (!mFile.IsOpen())
+		usage += mCount * sizeof(MBusTransactionRecord) + mFrameCount * sizeof(MBusFrame);
+	for (size_t i=0; i < mChunks.size(); i++)
+		usage += mChunks[i].size();
+	return usage;
+}
+
+U64 MBusTransactionStore::GetFileSize()
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	return mFile.GetSize();
+}
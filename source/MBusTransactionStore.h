@@ -0,0 +1,125 @@
+#ifndef MBUS_TRANSACTION_STORE
+#define MBUS_TRANSACTION_STORE
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+#include "MBusSegmentFile.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Every this many transactions (and frames) the sparse time index keeps the
+// starting sample of one, so a lookup by time reads at most this many
+// records: 3 KiB of them, one or two pages
+#define MBUS_STORE_INDEX_STRIDE 64
+
+// Fixed-size summary of one transaction. The payload and the per-byte sample
+// positions live in the store's arena, see MBusTransactionStore.cpp
+struct MBusTransactionRecord
+{
+	U64 mStartingSampleInclusive;
+	U64 mEndingSampleInclusive;
+	U32 mRequesters;
+	U32 mAddress;
+	U32 mChunk;       // arena chunk holding this transaction's bytes
+	U32 mOffset;      // payload starts here, delta-coded samples follow it
+	U32 mNumBytes;
+	U32 mSampleBytes; // length of the delta-coded samples
+	S8 mArbitrationWinner;
+	S8 mPriorityWinner;
+	S8 mTransmitter;
+	U8 mAddressBits;
+	U8 mFlags;
+	U8 mControl;      // CB0 in bit 0, CB1 in bit 1
+};
+
+// Append-only transaction storage, one record per transaction instead of one
+// frame per byte. Safe to read from the UI while the worker thread appends;
+// only one thread may append. Memory grows a chunk at a time, so appending
+// allocates once per many transactions rather than once per few.
+// Held in memory unless opened on a file, in which case records, payloads
+// and frames go to an MBusSegmentFile and only the indexes stay in memory.
+class MBusTransactionStore
+{
+public:
+	MBusTransactionStore();
+	~MBusTransactionStore();
+
+	// Moves the store to a segment file at path (created or emptied), false
+	// if it can't be; the store is left empty either way
+	bool Open( const std::string& path );
+	bool IsOnDisk() const { return mFile.IsOpen(); }
+
+	// Returns the id of the new transaction, ids count up from 0
+	U64 Append( const MBusTransaction& transaction );
+	// Empties the store, and its file if it has one
+	void Clear();
+
+	U64 GetCount();
+	bool GetRecord( U64 id, MBusTransactionRecord& record );
+
+	// Id of the transaction in progress at sample, or else the first one
+	// after it; GetCount() if there is none
+	U64 FindTransaction( U64 sample );
+
+	// Frames, for callers that have nowhere else to keep them (the plugin's
+	// live in Logic). Appended in the order the decoder emits them; indexes
+	// count up from 0.
+	U64 AppendFrame( const MBusFrame& frame );
+	U64 GetFrameCount();
+	bool GetFrame( U64 index, MBusFrame& frame );
+	// Index of the first frame still in progress at sample or after it,
+	// GetFrameCount() if there is none
+	U64 FindFrame( U64 sample );
+
+	// Rebuilds the whole transaction, including mDataSamples
+	bool GetTransaction( U64 id, MBusTransaction& transaction );
+
+	// Copies up to max_bytes of payload, returns how many were copied
+	U32 GetData( U64 id, U8* data, U32 max_bytes );
+
+	// Bytes held in memory: records, arena and frames, or on disk just the
+	// indexes
+	U64 GetMemoryUsage();
+	// Bytes in the segment file, 0 in memory
+	U64 GetFileSize();
+
+protected:
+	U8* Allocate( U32 num_bytes, U32& chunk, U32& offset );
+	void Decode( const MBusTransactionRecord& record, MBusTransaction& transaction );
+
+	// Where things live, in memory or mapped from the file. The pointers are
+	// only good until the next call to any of these.
+	MBusTransactionRecord* RecordAt( U64 id );
+	MBusFrame* FrameAt( U64 index );
+	const U8* ArenaAt( const MBusTransactionRecord& record );
+	// The next free slot of a fixed-size record file stream
+	U8* AddSlot( std::vector< U32 >& segments, U64 count, U32 size );
+
+	std::mutex mMutex;
+	U64 mCount;
+	U64 mFrameCount;
+	// First samples for the time lookups, every MBUS_STORE_INDEX_STRIDE
+	std::vector< U64 > mStarts;
+	std::vector< U64 > mFrameStarts;
+
+	// In memory, records and frames in chunks reserved up front like the
+	// arena's, so nothing already stored moves
+	std::vector< std::vector< MBusTransactionRecord > > mRecords;
+	std::vector< std::vector< U8 > > mChunks;
+	std::vector< std::vector< MBusFrame > > mFrames;
+	// Append's encoding of the sample positions, kept for its capacity
+	std::vector< U8 > mSamples;
+
+	// On disk: which segments hold records and frames, in order, and the
+	// arena segment being filled (mChunk is a segment number)
+	std::string mPath;
+	MBusSegmentFile mFile;
+	std::vector< U32 > mRecordSegments;
+	std::vector< U32 > mFrameSegments;
+	U32 mArenaSegment;
+	U32 mArenaUsed;
+};
+
+#endif //MBUS_TRANSACTION_STORE
@@ -0,0 +1,45 @@
+#ifndef MBUS_TYPES
+#define MBUS_TYPES
+
+/*
+ * The decoder and simulator cores are shared by the Saleae plugin and the
+ * headless tools (built with MBUS_HEADLESS), which have no AnalyzerSDK to
+ * lean on. This provides the handful of SDK types the cores use.
+ */
+#ifdef MBUS_HEADLESS
+
+#include <cstdio>
+#include <cstdlib>
+
+typedef signed char S8;
+typedef short S16;
+typedef int S32;
+typedef long long int S64;
+typedef unsigned char U8;
+typedef unsigned short U16;
+typedef unsigned int U32;
+typedef unsigned long long int U64;
+
+enum BitState { BIT_LOW, BIT_HIGH };
+
+#define DISPLAY_AS_WARNING_FLAG ( 1 << 6 )
+#define DISPLAY_AS_ERROR_FLAG ( 1 << 7 )
+
+inline void MBusAssert(const char* message) {
+	std::fprintf(stderr, "MBus assertion failed: %s\n", message);
+	std::abort();
+}
+
+#else
+
+#include <AnalyzerTypes.h>
+#include <AnalyzerResults.h>
+#include <AnalyzerHelpers.h>
+
+inline void MBusAssert(const char* message) {
+	AnalyzerHelpers::Assert(message);
+}
+
+#endif //MBUS_HEADLESS
+
+#endif //MBUS_TYPES
@@ -0,0 +1,200 @@
+#include "MBusUtilization.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef WIN32
+#define snprintf _snprintf
+#endif
+
+/*
+ * Level 0 is filled exactly: the current bin counts samples per phase in
+ * U64s and is rounded to 16-bit shares only when it closes. Each level up
+ * averages four closed bins, so a bin costs 10 bytes at every level and the
+ * whole pyramid is 4/3 of level 0; a 10 hour capture in 10 ms bins is about
+ * 48 MB. The last bin of each level is still open; it is worked out from the
+ * bins below it when asked for, weighted by how much of it is covered.
+ */
+
+static const U32 LEVEL_FAN_IN = 4;
+
+MBusUtilizationTimeline::MBusUtilizationTimeline()
+{
+	Initialize( 1 );
+}
+
+MBusUtilizationTimeline::~MBusUtilizationTimeline()
+{
+}
+
+void MBusUtilizationTimeline::Initialize( U64 bin_samples )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	mBinSamples = bin_samples ? bin_samples : 1;
+	mCursor = 0;
+	mPhase = PhaseIdle;
+	memset( mCurrent, 0, sizeof(mCurrent) );
+	mLevels.clear();
+}
+
+void MBusUtilizationTimeline::Add( const MBusTransaction& transaction )
+{
+	// The phases run back to back from the transaction's first sample. A
+	// request frame starts right after the transaction before, so frames
+	// would count the whole gap as arbitration.
+	std::lock_guard< std::mutex > lock( mMutex );
+	U64 sample = transaction.mStartingSampleInclusive;
+	for (int i=0; i < NUM_MBUS_PHASES; i++) {
+		if (sample > mCursor)
+			Account( sample );
+		mPhase = (MBusBusPhase)i;
+		sample += transaction.mPhaseSamples[i];
+	}
+	if (sample > mCursor)
+		Account( sample );
+	mPhase = PhaseIdle;
+}
+
+void MBusUtilizationTimeline::Account( U64 end )
+{
+	while (mCursor < end) {
+		U64 bin_end = (mCursor / mBinSamples + 1) * mBinSamples;
+		U64 stop = (end < bin_end) ? end : bin_end;
+		if (mPhase != PhaseIdle)
+			mCurrent[mPhase - 1] += stop - mCursor;
+		mCursor = stop;
+
+		if (mCursor == bin_end) {
+			MBusUtilizationBin bin;
+			for (int i=0; i < NUM_MBUS_PHASES - 1; i++)
+				bin.mShare[i] = (U16)((mCurrent[i] * 65535 + mBinSamples / 2) / mBinSamples);
+			CommitBin( 0, bin );
+			memset( mCurrent, 0, sizeof(mCurrent) );
+		}
+	}
+}
+
+void MBusUtilizationTimeline::CommitBin( U32 level, const MBusUtilizationBin& bin )
+{
+	if (mLevels.size() <= level)
+		mLevels.resize( level + 1 );
+	std::vector< MBusUtilizationBin >& bins = mLevels[level];
+	bins.push_back( bin );
+	if (bins.size() % LEVEL_FAN_IN)
+		return;
+
+	MBusUtilizationBin parent;
+	for (int i=0; i < NUM_MBUS_PHASES - 1; i++) {
+		U32 sum = 0;
+		for (size_t j = bins.size() - LEVEL_FAN_IN; j < bins.size(); j++)
+			sum += bins[j].mShare[i];
+		parent.mShare[i] = (U16)((sum + LEVEL_FAN_IN / 2) / LEVEL_FAN_IN);
+	}
+	CommitBin( level + 1, parent );
+}
+
+U64 MBusUtilizationTimeline::GetBinSamples( U32 level )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	U64 samples = mBinSamples;
+	for (U32 i=0; i < level; i++)
+		samples *= LEVEL_FAN_IN;
+	return samples;
+}
+
+U64 MBusUtilizationTimeline::GetBinCount( U32 level )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	U64 bins = (mCursor + mBinSamples - 1) / mBinSamples;
+	for (U32 i=0; i < level; i++)
+		bins = (bins + LEVEL_FAN_IN - 1) / LEVEL_FAN_IN;
+	return bins;
+}
+
+U32 MBusUtilizationTimeline::GetLevelCount()
+{
+	U32 levels = 1;
+	while (GetBinCount( levels - 1 ) > 1)
+		levels++;
+	return levels;
+}
+
+bool MBusUtilizationTimeline::GetPartialBin( U32 level, U64 index, double share[NUM_MBUS_PHASES], U64& samples )
+{
+	for (int i=0; i < NUM_MBUS_PHASES; i++)
+		share[i] = 0;
+
+	if ((level < mLevels.size()) && (index < mLevels[level].size())) {
+		const MBusUtilizationBin& bin = mLevels[level][index];
+		for (int i=0; i < NUM_MBUS_PHASES - 1; i++)
+			share[i + 1] = bin.mShare[i] / 65535.0;
+		samples = mBinSamples;
+		for (U32 i=0; i < level; i++)
+			samples *= LEVEL_FAN_IN;
+	} else if (level == 0) {
+		// The bin still being filled
+		U64 start = index * mBinSamples;
+		if (mCursor <= start)
+			return false;
+		samples = mCursor - start;
+		for (int i=0; i < NUM_MBUS_PHASES - 1; i++)
+			share[i + 1] = (double) mCurrent[i] / samples;
+	} else {
+		samples = 0;
+		for (U32 child = 0; child < LEVEL_FAN_IN; child++) {
+			double child_share[NUM_MBUS_PHASES];
+			U64 child_samples;
+			if (!GetPartialBin( level - 1, index * LEVEL_FAN_IN + child, child_share, child_samples ))
+				break;
+			for (int i=1; i < NUM_MBUS_PHASES; i++)
+				share[i] += child_share[i] * child_samples;
+			samples += child_samples;
+		}
+		if (samples == 0)
+			return false;
+		for (int i=1; i < NUM_MBUS_PHASES; i++)
+			share[i] /= samples;
+	}
+
+	double busy = 0;
+	for (int i=1; i < NUM_MBUS_PHASES; i++)
+		busy += share[i];
+	share[PhaseIdle] = (busy < 1.0) ? 1.0 - busy : 0.0;
+	return true;
+}
+
+bool MBusUtilizationTimeline::GetBin( U32 level, U64 index, double share[NUM_MBUS_PHASES], U64& samples )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	return GetPartialBin( level, index, share, samples );
+}
+
+void WriteUtilizationTimeline( std::ostream& out, MBusUtilizationTimeline& timeline, U32 sample_rate, U64 max_bins )
+{
+	out << "Level, Start [s], Width [s]";
+	for (int i=0; i < NUM_MBUS_PHASES; i++)
+		out << ", " << MBusPhaseNames[i] << " [%]";
+	out << "\n";
+
+	U32 levels = timeline.GetLevelCount();
+	for (U32 level = levels; level-- > 0; ) {
+		U64 bins = timeline.GetBinCount( level );
+		if (max_bins && (bins > max_bins))
+			continue;
+
+		double width = sample_rate ? (double) timeline.GetBinSamples( level ) / sample_rate : 0.0;
+		for (U64 index = 0; index < bins; index++) {
+			double share[NUM_MBUS_PHASES];
+			U64 samples;
+			if (!timeline.GetBin( level, index, share, samples ))
+				break;
+
+			char line[256];
+			int length = snprintf( line, sizeof(line), "%u, %.6f, %.6f", level, width * index,
+				sample_rate ? (double) samples / sample_rate : 0.0 );
+			for (int i=0; i < NUM_MBUS_PHASES; i++)
+				length += snprintf( line + length, sizeof(line) - length, ", %.2f", 100.0 * share[i] );
+			out << line << "\n";
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef MBUS_UTILIZATION
+#define MBUS_UTILIZATION
+
+#include "MBusTypes.h"
+#include "MBusTransaction.h"
+
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// One bin at any level: the share of the bin each busy phase took, in
+// 1/65535ths. Idle is whatever is left.
+struct MBusUtilizationBin
+{
+	U16 mShare[NUM_MBUS_PHASES - 1];
+};
+
+// Fixed-width time bins of bus phase, built while decoding. Level 0 bins are
+// bin_samples wide, and every four bins of a level are averaged into one bin
+// of the next, so any zoom level of a long capture is already summarised.
+class MBusUtilizationTimeline
+{
+public:
+	MBusUtilizationTimeline();
+	~MBusUtilizationTimeline();
+
+	void Initialize( U64 bin_samples );
+
+	// Marks each of a decoded transaction's phases (mPhaseSamples), idle
+	// until its request included, and idle after control ends
+	void Add( const MBusTransaction& transaction );
+
+	U32 GetLevelCount();
+	U64 GetBinSamples( U32 level );
+	// Includes a final partly-filled bin on each level
+	U64 GetBinCount( U32 level );
+	// Share of each phase, idle included, summing to 1, and how many samples
+	// the bin covers so far
+	bool GetBin( U32 level, U64 index, double share[NUM_MBUS_PHASES], U64& samples );
+
+protected:
+	void Account( U64 end );
+	void CommitBin( U32 level, const MBusUtilizationBin& bin );
+	bool GetPartialBin( U32 level, U64 index, double share[NUM_MBUS_PHASES], U64& samples );
+
+	std::mutex mMutex;
+	U64 mBinSamples;
+	U64 mCursor; // samples before here are accounted for
+	MBusBusPhase mPhase;
+	U64 mCurrent[NUM_MBUS_PHASES - 1]; // busy samples of the level 0 bin being filled
+	std::vector< std::vector< MBusUtilizationBin > > mLevels;
+};
+
+// Every level, coarsest first: level, start and width in seconds, % per phase.
+// max_bins skips levels with more bins than that, 0 keeps them all.
+void WriteUtilizationTimeline( std::ostream& out, MBusUtilizationTimeline& timeline, U32 sample_rate, U64 max_bins = 0 );
+
+#endif //MBUS_UTILIZATION
@@ -0,0 +1,198 @@
+#include "MBusCApi.h"
+#include "MBusChannel.h"
+#include "MBusDecoder.h"
+#include "MBusTransaction.h"
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+/*
+ * Records are filled in as the decoder commits them, and each payload is
+ * appended to one shared buffer. That buffer can still move while it grows,
+ * so the data pointers are only set once the decode has finished. The buffers
+ * keep their capacity from one decode to the next. A tool that decodes
+ * capture after capture therefore stops allocating once it has seen its
+ * biggest capture.
+ *
+ * Nothing may escape through the C interface: the end of the capture ends
+ * the decode, and any other exception becomes MBUS_ERROR_INTERNAL.
+ */
+
+static_assert(MBUS_PHASE_COUNT == NUM_MBUS_PHASES, "mbus_transaction.phase_samples must match MBusBusPhase");
+static_assert(sizeof(uint64_t) == sizeof(U64), "mbus_wire edges are read as U64");
+
+struct mbus_decoder : public MBusDecoderSink
+{
+	mbus_decoder( U32 node_count );
+
+	virtual void AddFrame( const MBusFrame& ) {}
+	virtual void CommitResults() {}
+	virtual void CommitTransaction( const MBusTransaction& transaction );
+	virtual void ReportProgress( U64 ) {}
+
+	// Points every record at its payload
+	void Finish();
+
+	U32 mNodeCount;
+	std::vector< MBusEdgeChannel > mCLKs;
+	std::vector< MBusEdgeChannel > mDATs;
+	std::vector< MBusChannel * > mNodeCLKs;
+	std::vector< MBusChannel * > mNodeDATs;
+	MBusDecoder mDecoder;
+
+	std::vector< mbus_transaction > mTransactions;
+	std::vector< U8 > mData;
+	std::vector< U64 > mDataSamples;
+	size_t mNext; // for mbus_next_transaction
+	std::string mError;
+};
+
+mbus_decoder::mbus_decoder( U32 node_count )
+:	mNodeCount( node_count ),
+	mCLKs( node_count ),
+	mDATs( node_count ),
+	mNext( 0 )
+{
+	for (U32 i=0; i < node_count; i++) {
+		mNodeCLKs.push_back( &mCLKs[i] );
+		mNodeDATs.push_back( &mDATs[i] );
+	}
+}
+
+void mbus_decoder::CommitTransaction( const MBusTransaction& transaction )
+{
+	mbus_transaction record;
+	std::memset( &record, 0, sizeof(record) );
+	record.start_sample = transaction.mStartingSampleInclusive;
+	record.end_sample = transaction.mEndingSampleInclusive;
+	record.address_sample = transaction.mAddressSample;
+	record.data_end_sample = transaction.mDataEndingSample;
+	record.data_length = transaction.mData.size();
+	for (int i=0; i < NUM_MBUS_PHASES; i++)
+		record.phase_samples[i] = transaction.mPhaseSamples[i];
+	record.address = transaction.mAddress;
+	record.requesters = transaction.mRequesters;
+	record.arbitration_winner = transaction.mArbitrationWinner;
+	record.priority_winner = transaction.mPriorityWinner;
+	record.transmitter = transaction.mTransmitter;
+	record.address_bits = transaction.mAddressBits;
+	record.cb0 = transaction.mCB0;
+	record.cb1 = transaction.mCB1;
+	record.flags = transaction.mFlags;
+	mTransactions.push_back( record );
+
+	mData.insert( mData.end(), transaction.mData.begin(), transaction.mData.end() );
+	mDataSamples.insert( mDataSamples.end(), transaction.mDataSamples.begin(), transaction.mDataSamples.end() );
+}
+
+void mbus_decoder::Finish()
+{
+	size_t offset = 0;
+	for (size_t i=0; i < mTransactions.size(); i++) {
+		mbus_transaction& record = mTransactions[i];
+		if (record.data_length) {
+			record.data = &mData[offset];
+			record.data_samples = reinterpret_cast< const uint64_t* >( &mDataSamples[offset] );
+		}
+		offset += (size_t)record.data_length;
+	}
+}
+
+uint32_t mbus_capi_version( void )
+{
+	return MBUS_CAPI_VERSION;
+}
+
+mbus_decoder* mbus_decoder_create( uint32_t node_count )
+{
+	if ((node_count < 2) || (node_count > MBUS_DECODER_MAX_NODES))
+		return NULL;
+	try {
+		return new mbus_decoder( node_count );
+	}
+	catch (const std::exception&) {
+		return NULL;
+	}
+}
+
+void mbus_decoder_destroy( mbus_decoder* decoder )
+{
+	delete decoder;
+}
+
+int mbus_decode_edges( mbus_decoder* decoder, const mbus_wire* wires, uint32_t wire_count, uint64_t num_samples )
+{
+	if (decoder == NULL)
+		return MBUS_ERROR_ARGUMENT;
+	decoder->mTransactions.clear();
+	decoder->mData.clear();
+	decoder->mDataSamples.clear();
+	decoder->mNext = 0;
+	decoder->mError.clear();
+	if ((wires == NULL) || (wire_count != 2 * decoder->mNodeCount)) {
+		decoder->mError = "expected a CLK and a DAT wire per node";
+		return MBUS_ERROR_ARGUMENT;
+	}
+
+	// Edges are not checked for order: that would read every one of them
+	// again, a tenth of the decode. Out of order they decode to nonsense,
+	// but every channel stays inside its array and every transaction
+	// consumes an edge, so the decode still ends.
+	for (uint32_t wire=0; wire < wire_count; wire++) {
+		const mbus_wire& edges = wires[wire];
+		if ((edges.edges == NULL) && edges.edge_count) {
+			decoder->mError = "wire without an edge array";
+			return MBUS_ERROR_ARGUMENT;
+		}
+		if (edges.edge_count && (edges.edges[edges.edge_count - 1] >= num_samples)) {
+			char error[64];
+			std::snprintf( error, sizeof(error), "wire %u: edges past the capture", (unsigned)wire );
+			decoder->mError = error;
+			return MBUS_ERROR_EDGES;
+		}
+
+		MBusEdgeChannel& channel = (wire & 1) ? decoder->mDATs[wire / 2] : decoder->mCLKs[wire / 2];
+		channel.SetEdges( edges.initial_level ? BIT_HIGH : BIT_LOW,
+			edges.edge_count ? reinterpret_cast< const U64* >( edges.edges ) : NULL, (size_t)edges.edge_count, num_samples );
+	}
+
+	try {
+		decoder->mDecoder.Initialize( decoder->mNodeCLKs, decoder->mNodeDATs, decoder );
+		while (true)
+			decoder->mDecoder.DecodeTransaction();
+	}
+	catch (const MBusEndOfData&) {
+	}
+	catch (const std::exception& e) {
+		decoder->mError = e.what();
+		decoder->mTransactions.clear();
+		return MBUS_ERROR_INTERNAL;
+	}
+
+	decoder->Finish();
+	return MBUS_OK;
+}
+
+const mbus_transaction* mbus_next_transaction( mbus_decoder* decoder )
+{
+	if ((decoder == NULL) || (decoder->mNext >= decoder->mTransactions.size()))
+		return NULL;
+	return &decoder->mTransactions[decoder->mNext++];
+}
+
+const mbus_transaction* mbus_get_transactions( const mbus_decoder* decoder, uint64_t* count )
+{
+	if (count)
+		*count = decoder ? decoder->mTransactions.size() : 0;
+	if ((decoder == NULL) || decoder->mTransactions.empty())
+		return NULL;
+	return &decoder->mTransactions[0];
+}
+
+const char* mbus_decoder_error( const mbus_decoder* decoder )
+{
+	return decoder ? decoder->mError.c_str() : "";
+}
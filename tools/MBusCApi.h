@@ -0,0 +1,124 @@
+#ifndef MBUS_CAPI
+#define MBUS_CAPI
+
+/* C interface to the decoder core, for tools that load a shared library
+ * through an FFI (ctypes, cffi, Rust, Julia, ...) rather than link C++.
+ * build_analyzer.py builds it into libmbusdecoder.so (.dylib on macOS)
+ * next to the headless tools.
+ *
+ * The caller hands over a whole capture as edge arrays, one per wire, which
+ * are read in place and must stay put until the call returns. Everything
+ * given back points into the decoder, which keeps it until the next decode
+ * or until it is destroyed; nothing is copied on the way out.
+ *
+ *   mbus_decoder* decoder = mbus_decoder_create( 3 );
+ *   if (mbus_decode_edges( decoder, wires, 6, num_samples ) == MBUS_OK) {
+ *       const mbus_transaction* t;
+ *       while ((t = mbus_next_transaction( decoder )) != NULL)
+ *           ... t->address, t->data[0 .. t->data_length) ...
+ *   }
+ *   mbus_decoder_destroy( decoder );
+ *
+ * The layout of every struct here is fixed for a given
+ * MBUS_CAPI_VERSION; anything added later goes on the end.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define MBUS_CAPI_EXPORT __declspec(dllexport)
+#else
+#define MBUS_CAPI_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBUS_CAPI_VERSION 1
+
+/* Return codes */
+#define MBUS_OK              0
+#define MBUS_ERROR_ARGUMENT -1 /* NULL, or a wire count the ring doesn't have */
+#define MBUS_ERROR_EDGES    -2 /* a wire's last edge is at or past num_samples */
+#define MBUS_ERROR_INTERNAL -3 /* the decoder failed; see mbus_decoder_error */
+
+/* Decode flags, as in MBusTransaction.h */
+#define MBUS_FLAG_MULTIPLE_ARBITRATION_WINNER (1 << 0)
+#define MBUS_FLAG_NO_ARBITRATION_WINNER       (1 << 1)
+#define MBUS_FLAG_REQUEST_BUG_WORKAROUND      (1 << 2)
+
+/* Phases of phase_samples, as MBusBusPhase */
+#define MBUS_PHASE_IDLE         0
+#define MBUS_PHASE_ARBITRATION  1
+#define MBUS_PHASE_ADDRESS      2
+#define MBUS_PHASE_DATA         3
+#define MBUS_PHASE_INTERJECTION 4
+#define MBUS_PHASE_CONTROL      5
+#define MBUS_PHASE_COUNT        6
+
+typedef struct mbus_decoder mbus_decoder;
+
+/* One wire of the capture: the sample number of every transition, strictly
+ * increasing, each the first sample of the new level (as Logic counts).
+ * Order is the caller's to keep; it is not checked. */
+typedef struct mbus_wire
+{
+	const uint64_t* edges;
+	uint64_t edge_count;
+	uint32_t initial_level; /* 0 low, 1 high, at sample 0 */
+	uint32_t reserved;
+} mbus_wire;
+
+/* One decoded transaction, as MBusTransaction */
+typedef struct mbus_transaction
+{
+	uint64_t start_sample;
+	uint64_t end_sample;
+	uint64_t address_sample;   /* first sample of the address */
+	uint64_t data_end_sample;  /* last sample of the final byte, 0 if no data */
+	const uint8_t* data;       /* the payload, in the decoder's buffer */
+	const uint64_t* data_samples; /* first sample of each payload byte */
+	uint64_t data_length;
+	uint64_t phase_samples[MBUS_PHASE_COUNT];
+	uint32_t address;
+	uint32_t requesters;       /* one bit per node, mediator is bit 0 */
+	int32_t arbitration_winner; /* -1 if nobody won (e.g. a wakeup) */
+	int32_t priority_winner;
+	int32_t transmitter;
+	uint8_t address_bits;      /* 8 or 32, 0 if interjected before the address finished */
+	uint8_t cb0;
+	uint8_t cb1;
+	uint8_t flags;             /* MBUS_FLAG_* */
+} mbus_transaction;
+
+/* MBUS_CAPI_VERSION of the library, to check against the header used */
+MBUS_CAPI_EXPORT uint32_t mbus_capi_version( void );
+
+/* A decoder for a ring of node_count nodes (2 to 16, mediator included);
+ * NULL if out of range or out of memory */
+MBUS_CAPI_EXPORT mbus_decoder* mbus_decoder_create( uint32_t node_count );
+MBUS_CAPI_EXPORT void mbus_decoder_destroy( mbus_decoder* decoder );
+
+/* Decodes a whole capture of num_samples samples from idle at sample 0.
+ * wires holds 2 * node_count entries: mediator CLK, mediator DAT, then each
+ * member's CLK and DAT in ring order. The results of any earlier decode are
+ * dropped and their buffers reused. */
+MBUS_CAPI_EXPORT int mbus_decode_edges( mbus_decoder* decoder, const mbus_wire* wires, uint32_t wire_count, uint64_t num_samples );
+
+/* The decode's transactions one at a time, from the first; NULL once all
+ * have been read. Each decode starts over. */
+MBUS_CAPI_EXPORT const mbus_transaction* mbus_next_transaction( mbus_decoder* decoder );
+
+/* All of the decode's transactions at once, an array of *count */
+MBUS_CAPI_EXPORT const mbus_transaction* mbus_get_transactions( const mbus_decoder* decoder, uint64_t* count );
+
+/* What went wrong with the last decode, "" if nothing */
+MBUS_CAPI_EXPORT const char* mbus_decoder_error( const mbus_decoder* decoder );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_CAPI */
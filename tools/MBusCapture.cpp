@@ -0,0 +1,198 @@
+#include "MBusCapture.h"
+#include "MBusChannel.h"
+#include "MBusRingSet.h"
+#include "MBusSimulator.h"
+
+#include <iostream>
+
+bool StoringSink::OpenStore( const std::string& path )
+{
+	if (path.empty() || mStore.Open(path))
+		return true;
+	std::cerr << "Could not create store file " << path << std::endl;
+	return false;
+}
+
+void StoringSink::AddFrame( const MBusFrame& frame )
+{
+	mFrames++;
+	if (frame.mType == FrameTypeData)
+		mDataFrames++;
+	if (mStore.IsOnDisk())
+		mStore.AppendFrame( frame );
+}
+
+void StoringSink::CommitTransaction( const MBusTransaction& transaction )
+{
+	mIndex.Add( mStore.Append( transaction ), transaction );
+	mStatistics.Add( transaction );
+	mEfficiency.Add( transaction );
+	if (mTimeline)
+		mUtilization.Add( transaction );
+}
+
+// Decodes every ring of options.mRingNodes until the channels run out
+static void RunRings( const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, const DecodeOptions& options )
+{
+	MBusRingSet rings;
+	rings.SetCompactData(options.mCompact);
+	size_t first = 0;
+	for (size_t i=0; i < options.mRingNodes.size(); i++) {
+		size_t end = first + options.mRingNodes[i];
+		if (options.mRingSinks[i]) {
+			rings.AddRing(std::vector< MBusChannel * >(node_clks.begin() + first, node_clks.begin() + end),
+				std::vector< MBusChannel * >(node_dats.begin() + first, node_dats.begin() + end),
+				options.mRingSinks[i], NULL, options.mSpecialize);
+		}
+		first = end;
+	}
+	try {
+		while (true)
+			rings.DecodeWindow();
+	}
+	catch (const MBusEndOfData&) {
+	}
+}
+
+// Decodes until the channels run out (or the sink throws MBusEndOfData)
+static void RunDecoder( const std::vector< MBusChannel * >& node_clks, const std::vector< MBusChannel * >& node_dats, MBusDecoderSink& sink, const DecodeOptions& options )
+{
+	if (!options.mRingNodes.empty()) {
+		RunRings(node_clks, node_dats, options);
+		return;
+	}
+
+	MBusDecoder decoder;
+	decoder.Initialize(node_clks, node_dats, &sink, NULL, options.mSpecialize);
+	decoder.SetCheckpointInterval(options.mCheckpointInterval);
+	decoder.SetPropagationProfile(options.mPropagation);
+	try {
+		if (options.mResume && !decoder.Resume(*options.mResume)) {
+			std::cerr << "Checkpoint does not match the capture" << std::endl;
+			return;
+		}
+		while (true)
+			decoder.DecodeTransaction();
+	}
+	catch (const MBusEndOfData&) {
+	}
+}
+
+void DecodeTrace(const MBusTrace& trace, MBusDecoderSink& sink, const DecodeOptions& options)
+{
+	size_t node_count = trace.mNodeCLKs.size();
+	std::vector< MBusEdgeChannel > clks( node_count );
+	std::vector< MBusEdgeChannel > dats( node_count );
+	std::vector< MBusChannel * > node_clks( node_count );
+	std::vector< MBusChannel * > node_dats( node_count );
+
+	for (size_t i=0; i < node_count; i++) {
+		const MBusTraceChannel& clk = trace.mNodeCLKs[i];
+		const MBusTraceChannel& dat = trace.mNodeDATs[i];
+		clks[i].SetEdges(clk.mInitialBitState, clk.mEdges.empty() ? NULL : &clk.mEdges[0], clk.mEdges.size(), trace.mNumSamples);
+		dats[i].SetEdges(dat.mInitialBitState, dat.mEdges.empty() ? NULL : &dat.mEdges[0], dat.mEdges.size(), trace.mNumSamples);
+		node_clks[i] = &clks[i];
+		node_dats[i] = &dats[i];
+	}
+
+	RunDecoder(node_clks, node_dats, sink, options);
+}
+
+void DecodeEdgeFile(const MBusEdgeFile& file, MBusDecoderSink& sink, const DecodeOptions& options)
+{
+	U32 node_count = file.GetNodeCount();
+	std::vector< MBusEdgeFileReader > clks( node_count );
+	std::vector< MBusEdgeFileReader > dats( node_count );
+	std::vector< MBusChannel * > node_clks( node_count );
+	std::vector< MBusChannel * > node_dats( node_count );
+
+	for (U32 i=0; i < node_count; i++) {
+		clks[i].SetWire(file, 2 * i);
+		dats[i].SetWire(file, 2 * i + 1);
+		node_clks[i] = &clks[i];
+		node_dats[i] = &dats[i];
+	}
+
+	RunDecoder(node_clks, node_dats, sink, options);
+}
+
+bool IsEdgeFile(const std::string& path)
+{
+	return (path.size() > 4) && (path.compare(path.size() - 4, 4, ".mbe") == 0);
+}
+
+bool Capture::Open( const std::string& path )
+{
+	mIsEdgeFile = IsEdgeFile(path);
+	return mIsEdgeFile ? mEdgeFile.Open(path) : ReadTrace(path, mTrace);
+}
+
+void Capture::Decode( MBusDecoderSink& sink, const DecodeOptions& options )
+{
+	if (mIsEdgeFile)
+		DecodeEdgeFile(mEdgeFile, sink, options);
+	else
+		DecodeTrace(mTrace, sink, options);
+}
+
+U32 Capture::GetNodeCount()
+{
+	return mIsEdgeFile ? mEdgeFile.GetNodeCount() : (U32) mTrace.mNodeCLKs.size();
+}
+
+U64 Capture::GetNumSamples()
+{
+	return mIsEdgeFile ? mEdgeFile.GetNumSamples() : mTrace.mNumSamples;
+}
+
+U32 Capture::GetSampleRate()
+{
+	return mIsEdgeFile ? mEdgeFile.GetSampleRate() : mTrace.mSampleRate;
+}
+
+bool SaveCapture(const std::string& path, const MBusTrace& trace)
+{
+	return IsEdgeFile(path) ? WriteEdgeFile(path, trace) : WriteTrace(path, trace);
+}
+
+void SimulateTrace(const std::string& scenario, int node_count, double seconds, U32 sample_rate, MBusTrace& trace)
+{
+	MBusSimulator simulator;
+	simulator.Initialize(sample_rate, node_count, scenario);
+	simulator.CreateIdle(200);
+	simulator.GenerateUntil((U64) (seconds * sample_rate));
+	TraceFromSimulator(simulator, sample_rate, trace);
+}
+
+void WriteTransactions(std::ostream& out, const std::vector< MBusTransaction >& transactions)
+{
+	for (size_t i=0; i < transactions.size(); i++) {
+		WriteTransactionLine(out, transactions[i]);
+		out << "\n";
+	}
+}
+
+void WriteMessages(std::ostream& out, const std::vector< MBusMessage >& messages, U32 sample_rate)
+{
+	WriteMessagesHeader(out);
+	std::vector< char > line;
+	for (size_t i=0; i < messages.size(); i++) {
+		line.clear();
+		FormatMessageLine(line, messages[i], sample_rate);
+		line.push_back('\n');
+		out.write(&line[0], line.size());
+	}
+}
+
+void WriteMessages(std::ostream& out, const std::vector< MBusTransaction >& transactions, U32 sample_rate)
+{
+	std::vector< MBusMessage > messages;
+	for (size_t i=0; i < transactions.size(); i++)
+		DecodeMessages(transactions[i], messages);
+	WriteMessages(out, messages, sample_rate);
+}
+
+double Seconds(clock_t start)
+{
+	return (double) (std::clock() - start) / CLOCKS_PER_SEC;
+}
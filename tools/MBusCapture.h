@@ -0,0 +1,121 @@
+#ifndef MBUS_CAPTURE
+#define MBUS_CAPTURE
+
+#include "MBusTypes.h"
+#include "MBusDecoder.h"
+#include "MBusTransactionStore.h"
+#include "MBusAddressIndex.h"
+#include "MBusStatistics.h"
+#include "MBusEfficiency.h"
+#include "MBusUtilization.h"
+#include "MBusMessage.h"
+#include "MBusEdgeFile.h"
+#include "MBusTrace.h"
+
+#include <ctime>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class MBusPropagationProfile;
+
+/* What mbus_decode's modes have in common: opening a capture of either
+ * kind, running the decoder over it into a sink, and writing what it
+ * decoded in the layouts the corpus keeps.
+ */
+
+// Keeps whole transactions, drops the frames
+class CollectingSink : public MBusDecoderSink
+{
+public:
+	virtual void AddFrame( const MBusFrame& ) {}
+	virtual void CommitResults() {}
+	virtual void CommitTransaction( const MBusTransaction& transaction ) { mTransactions.push_back( transaction ); }
+	virtual void ReportProgress( U64 ) {}
+
+	std::vector< MBusTransaction > mTransactions;
+};
+
+// Counts frames the way Logic would hold them, and stores and indexes
+// transactions the way MBusAnalyzerResults does. With the store on disk
+// (-S) the frames are kept in it too, as nothing else here holds them.
+class StoringSink : public MBusDecoderSink
+{
+public:
+	StoringSink() : mFrames( 0 ), mDataFrames( 0 ), mTimeline( false ) {}
+
+	// Moves the store to path if there is one
+	bool OpenStore( const std::string& path );
+
+	virtual void AddFrame( const MBusFrame& frame );
+	virtual void CommitResults() {}
+	virtual void CommitTransaction( const MBusTransaction& transaction );
+	virtual void ReportProgress( U64 ) {}
+
+	U64 mFrames;
+	U64 mDataFrames;
+	MBusTransactionStore mStore;
+	MBusAddressIndex mIndex;
+	MBusStatistics mStatistics;
+	MBusEfficiency mEfficiency;
+	// Only fed once given a bin size, as one-sample bins outgrow everything else
+	bool mTimeline;
+	MBusUtilizationTimeline mUtilization;
+};
+
+// How to run a decode: which state machine, how often to checkpoint,
+// where to start (NULL for the beginning) and whether to profile the ring.
+// mRingNodes splits the capture's nodes into independent rings of that many
+// nodes each, decoded in one pass (see MBusRingSet) into mRingSinks in place
+// of the sink given with the options; a ring whose sink is NULL is left out.
+struct DecodeOptions
+{
+	explicit DecodeOptions( bool specialize = true ) : mSpecialize( specialize ), mCheckpointInterval( 0 ), mResume( NULL ), mPropagation( NULL ), mCompact( false ) {}
+
+	bool mSpecialize;
+	U32 mCheckpointInterval;
+	const MBusDecoderCheckpoint* mResume;
+	MBusPropagationProfile* mPropagation;
+	std::vector< U32 > mRingNodes;
+	std::vector< MBusDecoderSink * > mRingSinks;
+	bool mCompact; // data blocks in place of data frames, rings only
+};
+
+// Runs the decoder over a whole trace, or straight from a mapped edge file,
+// until the channels run out (or the sink throws MBusEndOfData)
+void DecodeTrace(const MBusTrace& trace, MBusDecoderSink& sink, const DecodeOptions& options = DecodeOptions());
+void DecodeEdgeFile(const MBusEdgeFile& file, MBusDecoderSink& sink, const DecodeOptions& options = DecodeOptions());
+
+// Captures ending in .mbe are edge files, anything else a text trace
+bool IsEdgeFile(const std::string& path);
+
+// A capture from either a text trace or an edge file
+struct Capture
+{
+	MBusTrace mTrace;
+	MBusEdgeFile mEdgeFile;
+	bool mIsEdgeFile;
+
+	bool Open( const std::string& path );
+	void Decode( MBusDecoderSink& sink, const DecodeOptions& options = DecodeOptions() );
+	U32 GetNodeCount();
+	U64 GetNumSamples();
+	U32 GetSampleRate();
+};
+
+bool SaveCapture(const std::string& path, const MBusTrace& trace);
+
+// Plays a scenario file (see MBusSimulator.h) for seconds into trace
+void SimulateTrace(const std::string& scenario, int node_count, double seconds, U32 sample_rate, MBusTrace& trace);
+
+// One line per transaction, as the corpus' .expected files hold them
+void WriteTransactions(std::ostream& out, const std::vector< MBusTransaction >& transactions);
+
+// The message export, header and all, as the corpus' .messages files hold it
+void WriteMessages(std::ostream& out, const std::vector< MBusMessage >& messages, U32 sample_rate);
+void WriteMessages(std::ostream& out, const std::vector< MBusTransaction >& transactions, U32 sample_rate);
+
+// Processor time since start
+double Seconds(clock_t start);
+
+#endif //MBUS_CAPTURE
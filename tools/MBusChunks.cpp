@@ -0,0 +1,165 @@
+#include "MBusChunks.h"
+
+#include <cstdio>
+#include <cstring>
+
+bool WriteChunkState( const std::string& path, const MBusChunkState& state )
+{
+	FILE* out = std::fopen(path.c_str(), "wb");
+	if (out == NULL)
+		return false;
+
+	MBusChunkStateHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.mMagic, MBUS_CHUNK_STATE_MAGIC, sizeof(header.mMagic));
+	header.mVersion = 1;
+	header.mSampleRate = state.mSampleRate;
+	header.mEnd = state.mEnd;
+	header.mNodeCount = state.mNodeCount;
+	header.mCheckpoint = state.mCheckpoint;
+	bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+
+	for (size_t wire=0; ok && (wire < state.mCarry.size()); wire++) {
+		U64 count = state.mCarry[wire].size();
+		ok = std::fwrite(&count, sizeof(count), 1, out) == 1;
+		if (ok && count)
+			ok = std::fwrite(&state.mCarry[wire][0], sizeof(U64), count, out) == count;
+	}
+
+	return (std::fclose(out) == 0) && ok;
+}
+
+bool ReadChunkState( const std::string& path, MBusChunkState& state )
+{
+	FILE* in = std::fopen(path.c_str(), "rb");
+	if (in == NULL)
+		return false;
+
+	MBusChunkStateHeader header;
+	bool ok = (std::fread(&header, sizeof(header), 1, in) == 1)
+		&& (std::memcmp(header.mMagic, MBUS_CHUNK_STATE_MAGIC, sizeof(header.mMagic)) == 0)
+		&& (header.mVersion == 1)
+		&& (header.mNodeCount <= MBUS_DECODER_MAX_NODES);
+
+	std::vector< std::vector< U64 > > carry( ok ? 2 * header.mNodeCount : 0 );
+	for (size_t wire=0; ok && (wire < carry.size()); wire++) {
+		U64 count;
+		ok = std::fread(&count, sizeof(count), 1, in) == 1;
+		if (!ok)
+			break;
+		carry[wire].resize(count);
+		if (count)
+			ok = std::fread(&carry[wire][0], sizeof(U64), count, in) == count;
+	}
+	std::fclose(in);
+	if (!ok)
+		return false;
+
+	state.mSampleRate = header.mSampleRate;
+	state.mEnd = header.mEnd;
+	state.mNodeCount = header.mNodeCount;
+	state.mCheckpoint = header.mCheckpoint;
+	state.mCarry.swap(carry);
+	return true;
+}
+
+// Passes everything on, remembering the last checkpoint
+class MBusChunkSink : public MBusDecoderSink
+{
+public:
+	MBusChunkSink( MBusDecoderSink& sink ) : mSink( sink ) {}
+
+	virtual void AddFrame( const MBusFrame& frame ) { mSink.AddFrame( frame ); }
+	virtual void CommitResults() { mSink.CommitResults(); }
+	virtual void CommitTransaction( const MBusTransaction& transaction ) { mSink.CommitTransaction( transaction ); }
+	virtual void ReportProgress( U64 sample_number ) { mSink.ReportProgress( sample_number ); }
+	virtual void CommitCheckpoint( const MBusDecoderCheckpoint& checkpoint ) { mLatest = checkpoint; }
+
+	MBusDecoderSink& mSink;
+	MBusDecoderCheckpoint mLatest;
+};
+
+bool DecodeChunk( const MBusEdgeFile& file, MBusChunkState& state, MBusDecoderSink& sink )
+{
+	U32 node_count = file.GetNodeCount();
+	U32 wires = 2 * node_count;
+	bool first = state.mNodeCount == 0;
+	if ((node_count < 1) || (node_count > MBUS_DECODER_MAX_NODES))
+		return false;
+	if (!first && ((state.mNodeCount != node_count) || (state.mSampleRate != file.GetSampleRate()) || (state.mCarry.size() != wires)))
+		return false;
+
+	std::vector< std::vector< U64 > > no_carry;
+	const std::vector< std::vector< U64 > >& carry = first ? no_carry : state.mCarry;
+	if (first)
+		no_carry.resize(wires);
+
+	// Each line must start the chunk where the last one left it: the
+	// checkpoint's state, toggled once per carried edge
+	std::vector< BitState > start_states( wires );
+	for (U32 wire=0; wire < wires; wire++) {
+		BitState chunk_state = file.GetChannel(wire).mInitialBitState ? BIT_HIGH : BIT_LOW;
+		if (first) {
+			start_states[wire] = chunk_state;
+			continue;
+		}
+		U32 states = (wire & 1) ? state.mCheckpoint.mDATStates : state.mCheckpoint.mCLKStates;
+		bool high = ((states >> (wire / 2)) & 1) != 0;
+		start_states[wire] = high ? BIT_HIGH : BIT_LOW;
+		if ((high != ((carry[wire].size() & 1) != 0)) != (chunk_state == BIT_HIGH))
+			return false;
+	}
+
+	U64 offset = first ? 0 : state.mEnd;
+	U64 start = first ? 0 : state.mCheckpoint.mSample;
+	std::vector< MBusEdgeFileReader > channels( wires );
+	std::vector< MBusChannel * > node_clks( node_count );
+	std::vector< MBusChannel * > node_dats( node_count );
+	for (U32 wire=0; wire < wires; wire++) {
+		channels[wire].SetWire(file, wire, offset, start, start_states[wire], carry[wire]);
+		if (wire & 1)
+			node_dats[wire / 2] = &channels[wire];
+		else
+			node_clks[wire / 2] = &channels[wire];
+	}
+
+	// A checkpoint after every transaction costs little next to decoding
+	// it, and means the carry never holds a transaction that finished
+	MBusChunkSink chunk_sink( sink );
+	MBusDecoder decoder;
+	decoder.Initialize(node_clks, node_dats, &chunk_sink);
+	decoder.SetCheckpointInterval(1);
+	if (first)
+		decoder.GetCheckpoint(chunk_sink.mLatest);
+	else if (decoder.Resume(state.mCheckpoint))
+		chunk_sink.mLatest = state.mCheckpoint;
+	else
+		return false;
+
+	try {
+		while (true)
+			decoder.DecodeTransaction();
+	}
+	catch (const MBusEndOfData&) {
+	}
+
+	// Whatever the chunk (and the carry before it) had after the last
+	// checkpoint goes to the next one
+	std::vector< std::vector< U64 > > next_carry( wires );
+	for (U32 wire=0; wire < wires; wire++) {
+		MBusEdgeFileReader channel;
+		channel.SetWire(file, wire, offset, start, start_states[wire], carry[wire]);
+		channel.AdvanceToAbsPosition(chunk_sink.mLatest.mSample);
+		while (channel.GetSampleOfNextEdge() != ~0ULL) {
+			channel.AdvanceToNextEdge();
+			next_carry[wire].push_back(channel.GetSampleNumber());
+		}
+	}
+
+	state.mSampleRate = file.GetSampleRate();
+	state.mEnd = offset + file.GetNumSamples();
+	state.mNodeCount = node_count;
+	state.mCheckpoint = chunk_sink.mLatest;
+	state.mCarry.swap(next_carry);
+	return true;
+}
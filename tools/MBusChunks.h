@@ -0,0 +1,70 @@
+#ifndef MBUS_CHUNKS
+#define MBUS_CHUNKS
+
+#include "MBusTypes.h"
+#include "MBusDecoder.h"
+#include "MBusEdgeFile.h"
+
+#include <string>
+#include <vector>
+
+/* Captures delivered as a sequence of edge files (chunks)
+ *
+ * A monitoring rig writes a long capture as rolling files of a few seconds
+ * each. Every chunk starts again at its own sample 0, and the next one picks
+ * up at the sample after the previous one ended. The decoder sees a single
+ * timeline: chunk k's sample 0 is the sum of the earlier chunks' lengths.
+ *
+ * A transaction still in flight when a chunk ends cannot be decoded from
+ * that chunk alone. So decoding a chunk leaves an MBusChunkState behind: the
+ * decoder checkpoint after the last transaction that finished, and every
+ * edge the chunk had after it. The next chunk is decoded from that
+ * checkpoint, over those edges followed by its own. Nothing before the
+ * checkpoint is decoded twice, and nothing after it is lost.
+ *
+ * The state can be kept in memory between chunks or saved to a file, so a
+ * chunk can be decoded as soon as the rig closes it:
+ *
+ *   MBusChunkStateHeader
+ *   per wire (clk0, dat0, clk1, dat1, ...):
+ *     U64 count
+ *     U64 edges[count]     absolute samples after the checkpoint
+ *
+ * Everything is little-endian.
+ */
+
+#define MBUS_CHUNK_STATE_MAGIC "MBUSCHK1"
+
+struct MBusChunkStateHeader
+{
+	char mMagic[8];
+	U32 mVersion;
+	U32 mSampleRate;
+	U64 mEnd;
+	U32 mNodeCount;
+	U32 mReserved;
+	MBusDecoderCheckpoint mCheckpoint;
+};
+
+// Where decoding stopped. mNodeCount == 0 means nothing has been decoded
+// yet, so the first chunk starts from idle at sample 0.
+struct MBusChunkState
+{
+	MBusChunkState() : mSampleRate( 0 ), mEnd( 0 ), mNodeCount( 0 ) {}
+
+	U32 mSampleRate;
+	U64 mEnd;       // the next chunk's sample 0
+	U32 mNodeCount;
+	MBusDecoderCheckpoint mCheckpoint;
+	std::vector< std::vector< U64 > > mCarry; // per wire, edges in (checkpoint, end)
+};
+
+bool WriteChunkState( const std::string& path, const MBusChunkState& state );
+bool ReadChunkState( const std::string& path, MBusChunkState& state );
+
+// Decodes the chunk that follows state, which must be from a ring of the
+// same size and sample rate, and leaves state describing where it stopped.
+// False (with state untouched) if the chunk doesn't fit.
+bool DecodeChunk( const MBusEdgeFile& file, MBusChunkState& state, MBusDecoderSink& sink );
+
+#endif //MBUS_CHUNKS
@@ -0,0 +1,316 @@
+#include "MBusEdgeFile.h"
+#include "MBusTrace.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static void PutVarint(std::vector< U8 >& out, U64 value)
+{
+	while (value >= 0x80) {
+		out.push_back((U8) (value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((U8) value);
+}
+
+// The varints that end in bytes[0, num_bytes), one per byte without the
+// continuation bit. A block whose last byte has it set ends none there.
+static U32 CountVarints(const U8* bytes, U32 num_bytes)
+{
+	if (bytes[num_bytes - 1] & 0x80)
+		return 0;
+	U32 count = 0;
+	for (U32 i=0; i < num_bytes; i++)
+		count += (bytes[i] & 0x80) ? 0 : 1;
+	return count;
+}
+
+static inline U64 GetVarint(const U8*& cursor)
+{
+	// Most deltas on a busy ring fit in a byte
+	if ((*cursor & 0x80) == 0)
+		return *cursor++;
+
+	U64 value = *cursor & 0x7f;
+	U32 shift = 7;
+	while (*cursor++ & 0x80) {
+		value |= (U64) (*cursor & 0x7f) << shift;
+		shift += 7;
+	}
+	return value;
+}
+
+bool WriteEdgeFile(const std::string& path, const MBusTrace& trace, U32 block_edges)
+{
+	FILE* out = std::fopen(path.c_str(), "wb");
+	if (out == NULL)
+		return false;
+
+	MBusEdgeFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.mMagic, MBUS_EDGE_FILE_MAGIC, sizeof(header.mMagic));
+	header.mVersion = 1;
+	header.mSampleRate = trace.mSampleRate;
+	header.mNumSamples = trace.mNumSamples;
+	header.mNodeCount = trace.mNodeCLKs.size();
+	header.mBlockEdges = block_edges;
+	std::fwrite(&header, sizeof(header), 1, out);
+
+	std::vector< MBusEdgeFileChannel > channels;
+	std::vector< MBusEdgeFileBlock > blocks;
+	std::vector< U8 > bytes;
+	U64 offset = sizeof(header);
+
+	for (U32 wire=0; wire < 2 * header.mNodeCount; wire++) {
+		const MBusTraceChannel& edges = (wire & 1) ? trace.mNodeDATs[wire / 2] : trace.mNodeCLKs[wire / 2];
+
+		MBusEdgeFileChannel channel;
+		channel.mInitialBitState = edges.mInitialBitState;
+		channel.mNumBlocks = 0;
+		channel.mNumEdges = edges.mEdges.size();
+		channel.mFirstBlock = blocks.size();
+
+		U64 previous = 0;
+		for (size_t first=0; first < edges.mEdges.size(); first += block_edges) {
+			MBusEdgeFileBlock block;
+			block.mBaseSample = previous;
+			block.mOffset = offset;
+			block.mNumEdges = 0;
+
+			bytes.clear();
+			for (size_t i=first; (i < edges.mEdges.size()) && (i < first + block_edges); i++) {
+				PutVarint(bytes, edges.mEdges[i] - previous);
+				previous = edges.mEdges[i];
+				block.mNumEdges++;
+			}
+			block.mNumBytes = bytes.size();
+			std::fwrite(&bytes[0], 1, bytes.size(), out);
+			offset += bytes.size();
+
+			blocks.push_back(block);
+			channel.mNumBlocks++;
+		}
+		channels.push_back(channel);
+	}
+
+	// Keep the index aligned so it can be read in place
+	static const U8 padding[8] = { 0 };
+	std::fwrite(padding, 1, (8 - offset % 8) % 8, out);
+	header.mIndexOffset = offset + (8 - offset % 8) % 8;
+
+	std::fwrite(&channels[0], sizeof(MBusEdgeFileChannel), channels.size(), out);
+	if (!blocks.empty())
+		std::fwrite(&blocks[0], sizeof(MBusEdgeFileBlock), blocks.size(), out);
+
+	std::fseek(out, 0, SEEK_SET);
+	std::fwrite(&header, sizeof(header), 1, out);
+
+	bool ok = !std::ferror(out);
+	return (std::fclose(out) == 0) && ok;
+}
+
+MBusEdgeFile::MBusEdgeFile()
+:	mData( NULL ),
+	mSize( 0 ),
+	mHeader( NULL ),
+	mChannels( NULL ),
+	mBlocks( NULL )
+{
+}
+
+MBusEdgeFile::~MBusEdgeFile()
+{
+	Close();
+}
+
+bool MBusEdgeFile::Open( const std::string& path )
+{
+	Close();
+
+	if (!mFile.Open(path) || (mFile.GetSize() < sizeof(MBusEdgeFileHeader)))
+		return false;
+	mData = mFile.GetData();
+	mSize = mFile.GetSize();
+
+	// Check everything the readers will trust before handing it out. Offsets
+	// and counts come from the file, so sizes are compared by subtracting
+	// from what is known to fit rather than by adding, which could wrap.
+	mHeader = (const MBusEdgeFileHeader*) mData;
+	U64 channels_size = 2ULL * mHeader->mNodeCount * sizeof(MBusEdgeFileChannel);
+	if ((std::memcmp(mHeader->mMagic, MBUS_EDGE_FILE_MAGIC, sizeof(mHeader->mMagic)) != 0) ||
+		(mHeader->mVersion != 1) || (mHeader->mNodeCount == 0) || (mHeader->mIndexOffset % 8) ||
+		(mHeader->mIndexOffset > mSize) || (channels_size > mSize - mHeader->mIndexOffset)) {
+		Close();
+		return false;
+	}
+	mChannels = (const MBusEdgeFileChannel*) (mData + mHeader->mIndexOffset);
+	mBlocks = (const MBusEdgeFileBlock*) (mData + mHeader->mIndexOffset + channels_size);
+
+	U64 num_blocks = (mSize - mHeader->mIndexOffset - channels_size) / sizeof(MBusEdgeFileBlock);
+	for (U32 wire=0; wire < 2 * mHeader->mNodeCount; wire++) {
+		const MBusEdgeFileChannel& channel = mChannels[wire];
+		if ((channel.mFirstBlock > num_blocks) || (channel.mNumBlocks > num_blocks - channel.mFirstBlock)) {
+			Close();
+			return false;
+		}
+		for (U32 i=0; i < channel.mNumBlocks; i++) {
+			const MBusEdgeFileBlock& block = mBlocks[channel.mFirstBlock + i];
+			if ((block.mNumEdges == 0) || (block.mNumBytes == 0) || (block.mOffset < sizeof(MBusEdgeFileHeader)) ||
+				(block.mOffset > mHeader->mIndexOffset) || (block.mNumBytes > mHeader->mIndexOffset - block.mOffset) ||
+				(CountVarints(mData + block.mOffset, block.mNumBytes) != block.mNumEdges)) {
+				Close();
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void MBusEdgeFile::Close()
+{
+	mFile.Close();
+	mData = NULL;
+	mSize = 0;
+	mHeader = NULL;
+	mChannels = NULL;
+	mBlocks = NULL;
+}
+
+MBusEdgeFileReader::MBusEdgeFileReader()
+:	mData( NULL ),
+	mBlocks( NULL ),
+	mNumBlocks( 0 ),
+	mBlock( 0 ),
+	mCursor( NULL ),
+	mRemaining( 0 ),
+	mHasNextEdge( false ),
+	mNextEdge( 0 ),
+	mBitState( BIT_HIGH ),
+	mSampleNumber( 0 ),
+	mLastSample( 0 ),
+	mSampleOffset( 0 )
+{
+}
+
+MBusEdgeFileReader::~MBusEdgeFileReader()
+{
+}
+
+void MBusEdgeFileReader::SetWire( const MBusEdgeFile& file, U32 wire )
+{
+	SetWire(file, wire, 0, 0, file.GetChannel(wire).mInitialBitState ? BIT_HIGH : BIT_LOW, std::vector< U64 >());
+}
+
+void MBusEdgeFileReader::SetWire( const MBusEdgeFile& file, U32 wire, U64 offset, U64 sample, BitState bit_state, const std::vector< U64 >& carry )
+{
+	mData = file.GetData();
+	mBlocks = file.GetBlocks(wire);
+	mNumBlocks = file.GetChannel(wire).mNumBlocks;
+	mBitState = bit_state;
+	mSampleNumber = sample;
+	mSampleOffset = offset;
+	mLastSample = offset + file.GetNumSamples();
+
+	mHasNextEdge = false;
+	if (carry.empty()) {
+		if (mNumBlocks > 0)
+			LoadBlock(0);
+		return;
+	}
+
+	// The carry is read as one more block, numbered so that the next is 0.
+	// Its last edge is before offset, block 0's base, so skipping works too.
+	mCarry.clear();
+	U64 previous = sample;
+	for (size_t i=0; i < carry.size(); i++) {
+		PutVarint(mCarry, carry[i] - previous);
+		previous = carry[i];
+	}
+	mBlock = ~0U;
+	mCursor = &mCarry[0];
+	mRemaining = (U32) carry.size() - 1;
+	mNextEdge = sample + GetVarint(mCursor);
+	mHasNextEdge = true;
+}
+
+void MBusEdgeFileReader::LoadBlock( U32 block )
+{
+	mBlock = block;
+	mCursor = mData + mBlocks[block].mOffset;
+	mRemaining = mBlocks[block].mNumEdges - 1;
+	mNextEdge = mBlocks[block].mBaseSample + mSampleOffset + GetVarint(mCursor);
+	mHasNextEdge = true;
+}
+
+void MBusEdgeFileReader::LoadNextEdge()
+{
+	if (mRemaining > 0) {
+		mNextEdge += GetVarint(mCursor);
+		mRemaining--;
+	}
+	else if (mBlock + 1 < mNumBlocks)
+		LoadBlock(mBlock + 1);
+	else
+		mHasNextEdge = false;
+}
+
+U64 MBusEdgeFileReader::GetSampleNumber()
+{
+	return mSampleNumber;
+}
+
+BitState MBusEdgeFileReader::GetBitState()
+{
+	return mBitState;
+}
+
+U32 MBusEdgeFileReader::AdvanceToAbsPosition( U64 sample_number )
+{
+	if (sample_number > mLastSample)
+		throw MBusEndOfData();
+	if (sample_number < mSampleNumber)
+		return 0;
+
+	U32 transitions = 0;
+
+	// The next block's base is this block's last edge; if that is still
+	// behind us, the rest of this block only matters for its parity
+	while (mHasNextEdge && (mBlock + 1 < mNumBlocks) && (mBlocks[mBlock + 1].mBaseSample + mSampleOffset <= sample_number)) {
+		transitions += 1 + mRemaining;
+		LoadBlock(mBlock + 1);
+	}
+
+	while (mHasNextEdge && (mNextEdge <= sample_number)) {
+		transitions++;
+		LoadNextEdge();
+	}
+	if (transitions & 1)
+		mBitState = (mBitState == BIT_LOW) ? BIT_HIGH : BIT_LOW;
+
+	mSampleNumber = sample_number;
+	return transitions;
+}
+
+void MBusEdgeFileReader::AdvanceToNextEdge()
+{
+	if (!mHasNextEdge)
+		throw MBusEndOfData();
+
+	mSampleNumber = mNextEdge;
+	mBitState = (mBitState == BIT_LOW) ? BIT_HIGH : BIT_LOW;
+	LoadNextEdge();
+}
+
+U64 MBusEdgeFileReader::GetSampleOfNextEdge()
+{
+	// Same convention as MBusEdgeChannel: no more edges sorts after everything
+	if (!mHasNextEdge)
+		return ~0ULL;
+	return mNextEdge;
+}
+
+bool MBusEdgeFileReader::WouldAdvancingCauseTransition( U32 num_samples )
+{
+	return mHasNextEdge && (mNextEdge <= mSampleNumber + num_samples);
+}
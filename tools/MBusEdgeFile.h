@@ -0,0 +1,135 @@
+#ifndef MBUS_EDGE_FILE
+#define MBUS_EDGE_FILE
+
+#include "MBusTypes.h"
+#include "MBusChannel.h"
+#include "MBusMappedFile.h"
+
+#include <string>
+#include <vector>
+
+struct MBusTrace;
+
+/* Compact edge captures (.mbe)
+ *
+ * Raw samples spend a byte or more per sample on lines that sit idle for
+ * thousands of samples at a time. An edge file keeps only the edges, as
+ * LEB128 varint deltas, which is usually one or two bytes per edge.
+ *
+ *   MBusEdgeFileHeader
+ *   block data             varint deltas, blocks back to back
+ *   (padding to 8 bytes)
+ *   MBusEdgeFileChannel    one per wire: clk0, dat0, clk1, dat1, ...
+ *   MBusEdgeFileBlock      every channel's blocks, in channel order
+ *
+ * Each block holds up to mBlockEdges edges. Its first delta is from the
+ * block's base sample, which is the previous edge or 0, so any block can be
+ * decoded on its own. The index is at the end so the writer can stream.
+ * Everything is little-endian and naturally aligned for reading in place.
+ */
+
+#define MBUS_EDGE_FILE_MAGIC "MBUSEDG1"
+
+struct MBusEdgeFileHeader
+{
+	char mMagic[8];
+	U32 mVersion;
+	U32 mSampleRate;
+	U64 mNumSamples;
+	U32 mNodeCount;
+	U32 mBlockEdges;
+	U64 mIndexOffset;
+};
+
+struct MBusEdgeFileChannel
+{
+	U32 mInitialBitState;
+	U32 mNumBlocks;
+	U64 mNumEdges;
+	U64 mFirstBlock;
+};
+
+struct MBusEdgeFileBlock
+{
+	U64 mBaseSample;
+	U64 mOffset;
+	U32 mNumEdges;
+	U32 mNumBytes;
+};
+
+bool WriteEdgeFile(const std::string& path, const MBusTrace& trace, U32 block_edges = 4096);
+
+// A read-only mapping of an edge file
+class MBusEdgeFile
+{
+public:
+	MBusEdgeFile();
+	~MBusEdgeFile();
+
+	bool Open( const std::string& path );
+	void Close();
+
+	U32 GetSampleRate() const { return mHeader->mSampleRate; }
+	U64 GetNumSamples() const { return mHeader->mNumSamples; }
+	U32 GetNodeCount() const { return mHeader->mNodeCount; }
+
+	// Wire 2*node is the node's CLK, 2*node+1 its DAT
+	const MBusEdgeFileChannel& GetChannel( U32 wire ) const { return mChannels[wire]; }
+	const MBusEdgeFileBlock* GetBlocks( U32 wire ) const { return mBlocks + mChannels[wire].mFirstBlock; }
+	const U8* GetData() const { return mData; }
+
+protected:
+	MBusMappedFile mFile;
+	const U8* mData;
+	size_t mSize;
+	const MBusEdgeFileHeader* mHeader;
+	const MBusEdgeFileChannel* mChannels;
+	const MBusEdgeFileBlock* mBlocks;
+};
+
+// Walks one wire of a mapped edge file, decoding varints in place. Whole
+// blocks are skipped through the index when advancing past them.
+class MBusEdgeFileReader : public MBusChannel
+{
+public:
+	MBusEdgeFileReader();
+	virtual ~MBusEdgeFileReader();
+
+	void SetWire( const MBusEdgeFile& file, U32 wire );
+	// Places the wire on a longer timeline, for a file that is one chunk of
+	// a capture (see MBusChunks.h): the file's sample 0 is offset, the reader
+	// starts at sample with the line in bit_state, and carry (absolute
+	// samples after sample, all before offset) comes ahead of the file's own
+	// edges. carry is copied.
+	void SetWire( const MBusEdgeFile& file, U32 wire, U64 offset, U64 sample, BitState bit_state, const std::vector< U64 >& carry );
+
+	virtual U64 GetSampleNumber();
+	virtual BitState GetBitState();
+	virtual U32 AdvanceToAbsPosition( U64 sample_number );
+	virtual void AdvanceToNextEdge();
+	virtual U64 GetSampleOfNextEdge();
+	virtual bool WouldAdvancingCauseTransition( U32 num_samples );
+
+protected:
+	void LoadBlock( U32 block );
+	void LoadNextEdge();
+
+	const U8* mData;
+	const MBusEdgeFileBlock* mBlocks;
+	U32 mNumBlocks;
+	U32 mBlock; // ~0 while still in the carry
+	const U8* mCursor;
+	U32 mRemaining; // edges in this block after mNextEdge
+
+	bool mHasNextEdge;
+	U64 mNextEdge; // valid while mHasNextEdge
+
+	BitState mBitState;
+	U64 mSampleNumber;
+	U64 mLastSample;
+
+	U64 mSampleOffset; // the file's sample 0
+	std::vector< U8 > mCarry; // varint deltas, a block ahead of block 0
+};
+
+#endif //MBUS_EDGE_FILE
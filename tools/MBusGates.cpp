@@ -0,0 +1,360 @@
+#include "MBusGates.h"
+#include "MBusCapture.h"
+#include "MBusSimulator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+int CheckCorpus(const std::vector< std::string >& paths, const std::string& baseline_path, double margin, bool update)
+{
+	std::vector< Capture > captures( paths.size() );
+	int failures = 0;
+
+	for (size_t i=0; i < paths.size(); i++) {
+		if (!captures[i].Open(paths[i])) {
+			std::cerr << "FAIL " << paths[i] << ": could not read capture" << std::endl;
+			failures++;
+			continue;
+		}
+
+		std::string expected_path = paths[i].substr(0, paths[i].rfind('.')) + ".expected";
+		std::ifstream expected_file(expected_path.c_str());
+		std::stringstream expected;
+		expected << expected_file.rdbuf();
+
+		CollectingSink sink;
+		captures[i].Decode(sink);
+		std::ostringstream decoded;
+		WriteTransactions(decoded, sink.mTransactions);
+
+		if (!expected_file.is_open() || (decoded.str() != expected.str())) {
+			std::cerr << "FAIL " << paths[i] << ": decode differs from " << expected_path << std::endl;
+			failures++;
+			continue;
+		}
+
+		// Captures with a .messages file must also decode to those messages
+		std::string messages_path = paths[i].substr(0, paths[i].rfind('.')) + ".messages";
+		std::ifstream messages_file(messages_path.c_str());
+		if (messages_file.is_open()) {
+			std::stringstream expected_messages;
+			expected_messages << messages_file.rdbuf();
+			std::ostringstream decoded_messages;
+			WriteMessages(decoded_messages, sink.mTransactions, captures[i].GetSampleRate());
+			if (decoded_messages.str() != expected_messages.str()) {
+				std::cerr << "FAIL " << paths[i] << ": messages differ from " << messages_path << std::endl;
+				failures++;
+				continue;
+			}
+		}
+		std::cerr << "ok   " << paths[i] << " (" << sink.mTransactions.size() << " transactions)" << std::endl;
+	}
+	if (failures)
+		return 1;
+
+	// Repeat each trace for a while so short traces still time reliably
+	double samples = 0.0, elapsed = 0.0;
+	for (size_t i=0; i < captures.size(); i++) {
+		clock_t start = std::clock();
+		do {
+			CollectingSink sink;
+			captures[i].Decode(sink);
+			samples += captures[i].GetNumSamples();
+		} while (Seconds(start) < 0.25);
+		elapsed += Seconds(start);
+	}
+	double rate = samples / elapsed;
+	std::cerr << "Throughput: " << rate / 1e6 << " Msamples/s" << std::endl;
+
+	if (baseline_path.empty())
+		return 0;
+
+	if (update) {
+		std::ofstream baseline(baseline_path.c_str(), std::ios::out | std::ios::trunc);
+		baseline << "# Decoder throughput for the corpus, samples/sec (mbus_decode check -u)\n" << (U64) rate << "\n";
+		std::cerr << "Updated " << baseline_path << std::endl;
+		return baseline.fail() ? 1 : 0;
+	}
+
+	std::ifstream baseline(baseline_path.c_str());
+	std::string line;
+	double baseline_rate = 0.0;
+	while (std::getline(baseline, line))
+		if (!line.empty() && (line[0] != '#'))
+			baseline_rate = std::atof(line.c_str());
+	if (baseline_rate <= 0.0) {
+		std::cerr << "No baseline in " << baseline_path << ", run with -u to record one" << std::endl;
+		return 1;
+	}
+
+	double change = rate / baseline_rate - 1.0;
+	std::cerr << "Baseline:   " << baseline_rate / 1e6 << " Msamples/s (" << (change >= 0 ? "+" : "") << change * 100 << "%)" << std::endl;
+	if (change < -margin) {
+		std::cerr << "FAIL throughput dropped more than " << margin * 100 << "%" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+struct FuzzCase
+{
+	int sender;
+	U32 address;
+	std::vector< U8 > data;
+	bool acked;
+	bool priority;
+	U32 faults;
+};
+
+static void RandomCase( FuzzCase& c, int node_count, U32 fault_mask )
+{
+	c.sender = std::rand() % node_count;
+	if (std::rand() % 4)
+		c.address = std::rand() % 0xf0;
+	else
+		c.address = 0xf0000000 | (std::rand() & 0x0fffffff);
+
+	U32 num_bytes = (std::rand() % 16) ? std::rand() % 33 : std::rand() % 256;
+	c.data.resize(num_bytes);
+	for (U32 i=0; i < num_bytes; i++)
+		c.data[i] = std::rand() & 0xff;
+
+	c.acked = std::rand() & 1;
+	c.priority = (std::rand() % 8) == 0;
+
+	c.faults = 0;
+	for (int fault=0; fault < NUM_MBUS_FAULTS; fault++)
+		if ((fault_mask & (1 << fault)) && (std::rand() % 4) == 0)
+			c.faults |= 1 << fault;
+}
+
+// Simulates one case from a known seed; returns true if the decoder agrees
+static bool RunCase( const FuzzCase& c, int node_count, U32 sample_rate, U32 seed, MBusTransaction* expected, std::vector< MBusTransaction >* decoded )
+{
+	std::srand(seed);
+	MBusSimulator simulator;
+	simulator.Initialize(sample_rate, node_count, "");
+	simulator.CreateIdle(200);
+
+	std::vector< U8 > data(c.data);
+	data.push_back(0);
+	simulator.CreateMBusTransaction(c.sender, c.address, c.data.size(), &data[0], c.acked, c.priority, c.faults);
+
+	MBusTrace trace;
+	TraceFromSimulator(simulator, sample_rate, trace);
+	CollectingSink sink;
+	DecodeTrace(trace, sink);
+
+	if (expected)
+		*expected = simulator.GetExpected();
+	if (decoded)
+		*decoded = sink.mTransactions;
+	return (sink.mTransactions.size() == 1) && SameDecode(sink.mTransactions[0], simulator.GetExpected());
+}
+
+// Greedy shrink: keep any simplification that still fails
+static void Minimize( FuzzCase& c, int node_count, U32 sample_rate, U32 seed )
+{
+	bool shrunk = true;
+	while (shrunk) {
+		shrunk = false;
+		std::vector< FuzzCase > candidates;
+
+		if (!c.data.empty()) {
+			FuzzCase half(c);
+			half.data.resize(c.data.size() / 2);
+			candidates.push_back(half);
+			FuzzCase shorter(c);
+			shorter.data.pop_back();
+			candidates.push_back(shorter);
+		}
+		for (size_t i=0; i < c.data.size(); i++) {
+			if (c.data[i] != 0) {
+				FuzzCase zeroed(c);
+				zeroed.data[i] = 0;
+				candidates.push_back(zeroed);
+				break;
+			}
+		}
+		if (c.address > 0xff) {
+			FuzzCase narrow(c);
+			narrow.address = 0x10;
+			candidates.push_back(narrow);
+		}
+		if (c.sender != 0) {
+			FuzzCase mediator(c);
+			mediator.sender = 0;
+			candidates.push_back(mediator);
+		}
+		if (c.acked || c.priority) {
+			FuzzCase plain(c);
+			plain.acked = plain.priority = false;
+			candidates.push_back(plain);
+		}
+		for (int fault=0; fault < NUM_MBUS_FAULTS; fault++) {
+			if (c.faults & (1 << fault)) {
+				FuzzCase fewer(c);
+				fewer.faults &= ~(1 << fault);
+				candidates.push_back(fewer);
+			}
+		}
+
+		for (size_t i=0; i < candidates.size(); i++) {
+			if (!RunCase(candidates[i], node_count, sample_rate, seed, NULL, NULL)) {
+				c = candidates[i];
+				shrunk = true;
+				break;
+			}
+		}
+	}
+}
+
+static void PrintCase( const FuzzCase& c )
+{
+	std::fprintf(stderr, "  sender %d addr %08X len %u acked %d priority %d faults", c.sender, c.address, (unsigned) c.data.size(), c.acked, c.priority);
+	if (c.faults == 0)
+		std::fprintf(stderr, " none");
+	for (int fault=0; fault < NUM_MBUS_FAULTS; fault++)
+		if (c.faults & (1 << fault))
+			std::fprintf(stderr, " %s", MBusFaultNames[fault]);
+	std::fprintf(stderr, "\n  data");
+	for (size_t i=0; i < c.data.size(); i++)
+		std::fprintf(stderr, " %02X", c.data[i]);
+	std::fprintf(stderr, "\n");
+}
+
+int FuzzDecoder(int node_count, U32 seed, U32 iterations, U32 fault_mask, U32 sample_rate)
+{
+	clock_t start = std::clock();
+	for (U32 i=0; i < iterations; i++) {
+		FuzzCase c;
+		std::srand(seed + i);
+		RandomCase(c, node_count, fault_mask);
+
+		if (RunCase(c, node_count, sample_rate, seed + i, NULL, NULL))
+			continue;
+
+		std::fprintf(stderr, "Mismatch at iteration %u (-s %u -i 1):\n", i, seed + i);
+		PrintCase(c);
+		Minimize(c, node_count, sample_rate, seed + i);
+		std::fprintf(stderr, "Minimized:\n");
+		PrintCase(c);
+
+		MBusTransaction expected;
+		std::vector< MBusTransaction > decoded;
+		RunCase(c, node_count, sample_rate, seed + i, &expected, &decoded);
+		std::cerr << "  expected ";
+		WriteTransactionLine(std::cerr, expected);
+		std::cerr << std::endl;
+		for (size_t j=0; j < decoded.size(); j++) {
+			std::cerr << "  decoded  ";
+			WriteTransactionLine(std::cerr, decoded[j]);
+			std::cerr << std::endl;
+		}
+		if (decoded.empty())
+			std::cerr << "  decoded  nothing" << std::endl;
+		return 1;
+	}
+
+	double elapsed = Seconds(start);
+	std::cerr << iterations << " iterations passed in " << elapsed << " s ("
+		<< (elapsed > 0 ? iterations / elapsed : 0) << " iterations/s)" << std::endl;
+	return 0;
+}
+
+bool ParseFaults(const std::string& list, U32& mask)
+{
+	std::istringstream names(list);
+	std::string name;
+	mask = 0;
+	while (std::getline(names, name, ',')) {
+		int fault;
+		for (fault=0; fault < NUM_MBUS_FAULTS; fault++)
+			if (name == MBusFaultNames[fault])
+				break;
+		if (fault == NUM_MBUS_FAULTS)
+			return false;
+		mask |= 1 << fault;
+	}
+	return true;
+}
+
+// Drops everything, so only the decoder's own allocations are left
+class NullSink : public MBusDecoderSink
+{
+public:
+	virtual void AddFrame( const MBusFrame& ) {}
+	virtual void CommitResults() {}
+	virtual void CommitTransaction( const MBusTransaction& ) {}
+	virtual void ReportProgress( U64 ) {}
+};
+
+// Passes everything on to sink, noting the allocation count after warmup
+// transactions and again after count more
+class AllocationSink : public MBusDecoderSink
+{
+public:
+	AllocationSink( MBusDecoderSink& sink, const std::atomic< U64 >& allocations, U64 warmup, U64 count )
+	:	mSink( sink ), mAllocations( allocations ), mWarmup( warmup ), mEnd( warmup + count ), mTransactions( 0 ), mStart( 0 ), mStop( 0 ) {}
+
+	virtual void AddFrame( const MBusFrame& frame ) { mSink.AddFrame( frame ); }
+	virtual void CommitResults() { mSink.CommitResults(); }
+	virtual void CommitTransaction( const MBusTransaction& transaction )
+	{
+		mSink.CommitTransaction( transaction );
+		mTransactions++;
+		if (mTransactions == mWarmup)
+			mStart = mAllocations.load();
+		if (mTransactions == mEnd)
+			mStop = mAllocations.load();
+	}
+	virtual void ReportProgress( U64 sample_number ) { mSink.ReportProgress( sample_number ); }
+
+	MBusDecoderSink& mSink;
+	const std::atomic< U64 >& mAllocations;
+	U64 mWarmup;
+	U64 mEnd;
+	U64 mTransactions;
+	U64 mStart;
+	U64 mStop;
+};
+
+// The store, index and timeline hold everything decoded, so they can't stop
+// allocating, but they grow a chunk at a time: about one allocation per 100
+// transactions on the scenarios here, still filling their first chunks.
+// Anything allocating per transaction again is 32 times over this.
+#define MAX_STORING_ALLOCATIONS_PER_TRANSACTION (1.0 / 32)
+
+int CountAllocations(const std::string& scenario, int node_count, double seconds, U32 sample_rate, U32 count, const std::atomic< U64 >& allocations)
+{
+	MBusTrace trace;
+	SimulateTrace(scenario, node_count, seconds, sample_rate, trace);
+
+	// The decoder alone must not allocate at all, and behind the analyzer's
+	// commit path (MBusAnalyzerResults::AddTransaction) only now and then
+	const U64 warmup = 100;
+	NullSink null_sink;
+	AllocationSink decoder(null_sink, allocations, warmup, count);
+	DecodeTrace(trace, decoder);
+	if (decoder.mTransactions < warmup + count) {
+		std::cerr << "Only " << decoder.mTransactions << " transactions; simulate longer (-t) for "
+			<< warmup << " + " << count << std::endl;
+		return 1;
+	}
+	U64 decoding_allocations = decoder.mStop - decoder.mStart;
+	std::cerr << decoding_allocations << " allocations in " << count << " transactions after " << warmup << " to warm up" << std::endl;
+
+	StoringSink storing_sink;
+	storing_sink.mUtilization.Initialize((U64) sample_rate / 100);
+	storing_sink.mTimeline = true;
+	AllocationSink storing(storing_sink, allocations, warmup, count);
+	DecodeTrace(trace, storing);
+	U64 storing_allocations = storing.mStop - storing.mStart;
+	U64 limit = (U64)(count * MAX_STORING_ALLOCATIONS_PER_TRANSACTION);
+	std::cerr << storing_allocations << " allocations storing them (at most " << limit << ")" << std::endl;
+
+	return (decoding_allocations || (storing_allocations > limit)) ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MBUS_GATES
+#define MBUS_GATES
+
+#include "MBusTypes.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/* The checks a decoder change has to pass (mbus_decode check, fuzz and
+ * allocs; see mbus_decode.cpp for their options). Each prints what it
+ * measured to stderr and returns the tool's exit code, 0 for a pass.
+ */
+
+// Decodes each capture against its .expected file, and its .messages file
+// if it has one, then times the whole corpus against the baseline
+// samples/sec in baseline_path, or records it there when update is set
+int CheckCorpus(const std::vector< std::string >& paths, const std::string& baseline_path, double margin, bool update);
+
+// Round-trips iterations random messages, each with some of the faults in
+// fault_mask (bits of MBusFault), through the simulator and decoder. The
+// first that decodes wrong is shrunk and printed with its seed.
+int FuzzDecoder(int node_count, U32 seed, U32 iterations, U32 fault_mask, U32 sample_rate);
+bool ParseFaults(const std::string& list, U32& mask);
+
+// Counts allocations over count transactions of a scenario once warmed up,
+// decoding alone and then behind the analyzer's commit path. allocations
+// is the caller's count of every operator new it makes.
+int CountAllocations(const std::string& scenario, int node_count, double seconds, U32 sample_rate, U32 count, const std::atomic< U64 >& allocations);
+
+#endif //MBUS_GATES
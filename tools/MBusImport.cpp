@@ -0,0 +1,539 @@
+#include "MBusImport.h"
+#include "MBusMappedFile.h"
+#include "MBusTrace.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Hands out one line at a time. Newlines are found a vector at a time and
+// kept as a bitmask, so a typical capture line costs a compare, a movemask
+// and a count-trailing-zeros rather than a byte loop.
+class LineScanner
+{
+public:
+	LineScanner( const U8* data, size_t size )
+	:	mData( data ), mSize( size ), mLineStart( 0 ), mChunk( 0 ), mMask( 0 )
+	{
+		LoadMask();
+	}
+
+	// Returns false at the end of the data; the line excludes the newline
+	bool NextLine( const U8*& line, const U8*& end )
+	{
+		while (mMask == 0) {
+			mChunk += kChunk;
+			if (mChunk >= mSize) {
+				if (mLineStart >= mSize)
+					return false;
+				// Last line without a trailing newline
+				line = mData + mLineStart;
+				end = mData + mSize;
+				mLineStart = mSize;
+				return true;
+			}
+			LoadMask();
+		}
+
+		size_t newline = mChunk + __builtin_ctzll(mMask);
+		mMask &= mMask - 1;
+		line = mData + mLineStart;
+		end = mData + newline;
+		if ((end > line) && (end[-1] == '\r'))
+			end--;
+		mLineStart = newline + 1;
+		return true;
+	}
+
+private:
+#if defined(__AVX2__)
+	static const size_t kChunk = 32;
+#else
+	static const size_t kChunk = 16;
+#endif
+
+	void LoadMask()
+	{
+		if (mChunk + kChunk > mSize) {
+			// Tail of the mapping: don't read past it
+			mMask = 0;
+			for (size_t i = mChunk; i < mSize; i++)
+				if (mData[i] == '\n')
+					mMask |= 1ULL << (i - mChunk);
+			return;
+		}
+#if defined(__AVX2__)
+		__m256i bytes = _mm256_loadu_si256((const __m256i*) (mData + mChunk));
+		mMask = (U32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+#elif defined(__SSE2__)
+		__m128i bytes = _mm_loadu_si128((const __m128i*) (mData + mChunk));
+		mMask = (U32) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+#else
+		mMask = 0;
+		for (size_t i = 0; i < kChunk; i++)
+			if (mData[mChunk + i] == '\n')
+				mMask |= 1ULL << i;
+#endif
+	}
+
+	const U8* mData;
+	size_t mSize;
+	size_t mLineStart;
+	size_t mChunk;
+	U64 mMask;
+};
+
+// One bit per byte that differs between a and b, for up to 16 bytes
+static inline U32 DiffMask(const U8* a, const U8* b, size_t length)
+{
+#if defined(__SSE2__)
+	if (length == 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*) a);
+		__m128i y = _mm_loadu_si128((const __m128i*) b);
+		return (U32) _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+	}
+#endif
+	U32 mask = 0;
+	for (size_t i=0; i < length; i++)
+		if (a[i] != b[i])
+			mask |= 1 << i;
+	return mask;
+}
+
+static inline bool IsSpace(U8 c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static std::string Trim(const U8* begin, const U8* end)
+{
+	while ((begin < end) && IsSpace(*begin))
+		begin++;
+	while ((end > begin) && IsSpace(end[-1]))
+		end--;
+	if ((end - begin >= 2) && (*begin == '"') && (end[-1] == '"')) {
+		begin++;
+		end--;
+	}
+	return std::string((const char*) begin, end - begin);
+}
+
+// If the 8 bytes at p are all digits, their value (SWAR: pairs, then
+// quads, then the whole word); otherwise ~0
+static inline U64 ParseEightDigits(const U8* p)
+{
+	U64 chunk;
+	std::memcpy(&chunk, p, sizeof(chunk));
+	U64 digits = chunk - 0x3030303030303030ULL;
+	if (((digits | (digits + 0x7676767676767676ULL)) & 0x8080808080808080ULL) != 0)
+		return ~0ULL;
+	digits = (digits * 10) + (digits >> 8);
+	digits = (((digits & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+		(((digits >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+	return digits;
+}
+
+// Parses an unsigned decimal, advancing p
+static inline U64 ParseUnsigned(const U8*& p, const U8* end)
+{
+	U64 value = 0;
+	while (end - p >= 8) {
+		U64 eight = ParseEightDigits(p);
+		if (eight == ~0ULL)
+			break;
+		value = value * 100000000 + eight;
+		p += 8;
+	}
+	while ((p < end) && ((U8) (*p - '0') < 10))
+		value = value * 10 + (*p++ - '0');
+	return value;
+}
+
+static const double kPowersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+	1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+};
+
+// Converts a time in seconds to the nearest sample. The integer and
+// fraction are parsed separately so a long capture keeps its resolution.
+static bool ParseSeconds(const U8*& p, const U8* end, U32 sample_rate, U64& sample)
+{
+	const U8* start = p;
+	U64 whole = ParseUnsigned(p, end);
+	double fraction = 0.0;
+
+	if ((p < end) && (*p == '.')) {
+		p++;
+		const U8* digits = p;
+		U64 value = ParseUnsigned(p, end);
+		size_t count = p - digits;
+		if (count >= sizeof(kPowersOfTen) / sizeof(kPowersOfTen[0]))
+			return false;
+		fraction = value / kPowersOfTen[count];
+	}
+
+	if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+		// Rare enough to not need a fast path
+		char* stop;
+		std::string text((const char*) start, end - start);
+		double seconds = std::strtod(text.c_str(), &stop);
+		p = start + (stop - text.c_str());
+		if (seconds < 0)
+			return false;
+		sample = (U64) std::floor(seconds * sample_rate + 0.5);
+		return true;
+	}
+
+	if (p == start)
+		return false;
+	sample = whole * sample_rate + (U64) std::floor(fraction * sample_rate + 0.5);
+	return true;
+}
+
+// Collects edges for the imported wires
+class EdgeCollector
+{
+public:
+	EdgeCollector( MBusTrace& trace, size_t num_wires )
+	:	mTrace( trace ), mState( num_wires, -1 )
+	{
+		trace.mNodeCLKs.assign(num_wires / 2, MBusTraceChannel());
+		trace.mNodeDATs.assign(num_wires / 2, MBusTraceChannel());
+		for (size_t i=0; i < num_wires / 2; i++)
+			trace.mNodeCLKs[i].mInitialBitState = trace.mNodeDATs[i].mInitialBitState = BIT_HIGH;
+	}
+
+	void Set( size_t wire, int value, U64 sample )
+	{
+		if (mState[wire] == value)
+			return;
+
+		MBusTraceChannel& channel = (wire & 1) ? mTrace.mNodeDATs[wire / 2] : mTrace.mNodeCLKs[wire / 2];
+		if ((mState[wire] == -1) || ((sample == 0) && channel.mEdges.empty())) {
+			// First value seen is the state the capture starts in
+			channel.mInitialBitState = value ? BIT_HIGH : BIT_LOW;
+		} else if (!channel.mEdges.empty() && (channel.mEdges.back() >= sample)) {
+			// Two changes rounded onto one sample cancel out
+			channel.mEdges.pop_back();
+		} else {
+			channel.mEdges.push_back(sample);
+		}
+		mState[wire] = value;
+	}
+
+private:
+	MBusTrace& mTrace;
+	std::vector< int > mState; // -1 until the first value
+};
+
+// Resolves each requested wire against the capture's signal names
+static bool MapWires(const std::vector< std::string >& wires, const std::vector< std::string >& signals, std::vector< int >& wire_of_signal, size_t& num_wires, std::string& error)
+{
+	std::vector< std::string > names(wires);
+	if (names.empty()) {
+		for (size_t i=0; i < signals.size(); i++)
+			names.push_back(signals[i]);
+	}
+	if ((names.size() < 2) || (names.size() % 2)) {
+		error = "need a CLK and a DAT for every node, i.e. an even number of wires";
+		return false;
+	}
+
+	wire_of_signal.assign(signals.size(), -1);
+	for (size_t wire=0; wire < names.size(); wire++) {
+		size_t signal;
+		for (signal=0; signal < signals.size(); signal++)
+			if (signals[signal] == names[wire])
+				break;
+		if (signal == signals.size()) {
+			char* end;
+			signal = std::strtoul(names[wire].c_str(), &end, 10);
+			if ((*end != '\0') || (end == names[wire].c_str()) || (signal >= signals.size())) {
+				error = "no signal named " + names[wire];
+				return false;
+			}
+		}
+		if (wire_of_signal[signal] != -1) {
+			error = "signal " + signals[signal] + " mapped twice";
+			return false;
+		}
+		wire_of_signal[signal] = wire;
+	}
+	num_wires = names.size();
+	return true;
+}
+
+bool ImportSaleaeCsv(const std::string& path, const std::vector< std::string >& wires, U32 sample_rate, MBusTrace& trace, std::string& error)
+{
+	MBusMappedFile file;
+	if (!file.Open(path)) {
+		error = "could not open " + path;
+		return false;
+	}
+
+	LineScanner lines(file.GetData(), file.GetSize());
+	const U8* line;
+	const U8* end;
+
+	// Header: time column, then one column per channel
+	if (!lines.NextLine(line, end)) {
+		error = "empty file";
+		return false;
+	}
+	std::vector< std::string > signals;
+	const U8* field = line;
+	bool first = true;
+	for (const U8* p = line; p <= end; p++) {
+		if ((p == end) || (*p == ',')) {
+			if (!first)
+				signals.push_back(Trim(field, p));
+			first = false;
+			field = p + 1;
+		}
+	}
+
+	std::vector< int > wire_of_signal;
+	size_t num_wires;
+	if (!MapWires(wires, signals, wire_of_signal, num_wires, error))
+		return false;
+
+	trace.mSampleRate = sample_rate;
+	trace.mNumSamples = 0;
+	EdgeCollector edges(trace, num_wires);
+
+	// Logic writes every row with the same layout, so once a row has been
+	// parsed field by field the next is XORed against it a vector at a
+	// time and only the digits that changed are looked at
+	std::vector< int > signal_at; // offset into the values -> signal, -1 between
+	const U8* previous = NULL;
+	size_t previous_length = 0;
+
+	U64 line_number = 1;
+	while (lines.NextLine(line, end)) {
+		line_number++;
+		const U8* p = line;
+		while ((p < end) && IsSpace(*p))
+			p++;
+		if (p == end)
+			continue;
+
+		U64 sample;
+		if (!ParseSeconds(p, end, sample_rate, sample)) {
+			error = "bad time on line " + std::to_string(line_number);
+			return false;
+		}
+
+		size_t length = end - p;
+		bool same_layout = (previous != NULL) && (length == previous_length);
+		for (size_t offset=0; same_layout && (offset < length); offset += 16) {
+			U32 changed = DiffMask(previous + offset, p + offset, std::min< size_t >(16, length - offset));
+			while (changed) {
+				size_t at = offset + __builtin_ctz(changed);
+				changed &= changed - 1;
+				int signal = signal_at[at];
+				if ((signal == -1) || ((U8) (p[at] - '0') > 1)) {
+					same_layout = false;
+					break;
+				}
+				if (wire_of_signal[signal] != -1)
+					edges.Set(wire_of_signal[signal], p[at] - '0', sample);
+			}
+		}
+
+		if (!same_layout) {
+			signal_at.assign(length, -1);
+			const U8* values = p;
+			for (size_t signal=0; signal < signals.size(); signal++) {
+				while ((p < end) && (IsSpace(*p) || (*p == ',')))
+					p++;
+				if ((p == end) || ((U8) (*p - '0') > 1)) {
+					error = "bad value on line " + std::to_string(line_number);
+					return false;
+				}
+				signal_at[p - values] = signal;
+				if (wire_of_signal[signal] != -1)
+					edges.Set(wire_of_signal[signal], *p - '0', sample);
+				p++;
+			}
+			p = values;
+		}
+
+		previous = p;
+		previous_length = length;
+		trace.mNumSamples = sample + 1;
+	}
+	return true;
+}
+
+// Seconds per tick for a VCD $timescale such as "1ns" or "10 us"
+static bool ParseTimescale(const std::string& text, double& seconds)
+{
+	const char* p = text.c_str();
+	char* unit;
+	double magnitude = std::strtod(p, &unit);
+	while (*unit == ' ')
+		unit++;
+
+	static const struct { const char* name; double seconds; } units[] = {
+		{ "s", 1 }, { "ms", 1e-3 }, { "us", 1e-6 }, { "ns", 1e-9 }, { "ps", 1e-12 }, { "fs", 1e-15 },
+	};
+	for (size_t i=0; i < sizeof(units) / sizeof(units[0]); i++) {
+		if (std::strncmp(unit, units[i].name, std::strlen(units[i].name)) == 0 &&
+			((unit[std::strlen(units[i].name)] == '\0') || (unit[std::strlen(units[i].name)] == ' '))) {
+			seconds = magnitude * units[i].seconds;
+			return magnitude > 0;
+		}
+	}
+	return false;
+}
+
+bool ImportVcd(const std::string& path, const std::vector< std::string >& wires, U32 sample_rate, MBusTrace& trace, std::string& error)
+{
+	MBusMappedFile file;
+	if (!file.Open(path)) {
+		error = "could not open " + path;
+		return false;
+	}
+
+	LineScanner lines(file.GetData(), file.GetSize());
+	const U8* line;
+	const U8* end;
+
+	// Header: collect $timescale and the single-bit $vars, as whitespace
+	// separated tokens up to $enddefinitions
+	std::vector< std::string > signals;
+	std::vector< std::string > ids;
+	std::vector< std::string > tokens;
+	double timescale = 1e-9;
+	bool definitions_done = false;
+
+	while (!definitions_done && lines.NextLine(line, end)) {
+		const U8* p = line;
+		while (p < end) {
+			while ((p < end) && IsSpace(*p))
+				p++;
+			const U8* token = p;
+			while ((p < end) && !IsSpace(*p))
+				p++;
+			if (p > token)
+				tokens.push_back(std::string((const char*) token, p - token));
+		}
+
+		// Statements end with $end, possibly lines later
+		while (true) {
+			size_t statement_end;
+			for (statement_end=0; statement_end < tokens.size(); statement_end++)
+				if (tokens[statement_end] == "$end")
+					break;
+			if (statement_end == tokens.size())
+				break;
+
+			if (!tokens.empty() && (tokens[0] == "$timescale")) {
+				std::string text;
+				for (size_t i=1; i < statement_end; i++)
+					text += tokens[i] + " ";
+				if (!ParseTimescale(text, timescale)) {
+					error = "unsupported $timescale " + text;
+					return false;
+				}
+			} else if (!tokens.empty() && (tokens[0] == "$var") && (statement_end >= 5) && (tokens[2] == "1")) {
+				ids.push_back(tokens[3]);
+				signals.push_back(tokens[4]);
+			} else if (!tokens.empty() && (tokens[0] == "$enddefinitions")) {
+				definitions_done = true;
+			}
+			tokens.erase(tokens.begin(), tokens.begin() + statement_end + 1);
+		}
+	}
+	if (!definitions_done) {
+		error = "no $enddefinitions";
+		return false;
+	}
+
+	std::vector< int > wire_of_signal;
+	size_t num_wires;
+	if (!MapWires(wires, signals, wire_of_signal, num_wires, error))
+		return false;
+
+	if (sample_rate == 0) {
+		if (1.0 / timescale > 4e9) {
+			error = "timescale too fine for one sample per tick, give a sample rate";
+			return false;
+		}
+		sample_rate = (U32) std::floor(1.0 / timescale + 0.5);
+	}
+	double samples_per_tick = timescale * sample_rate;
+
+	// Identifiers are nearly always a single printable character, so look
+	// those up directly and fall back to a map for the rest
+	int single_char_wire[128];
+	for (int i=0; i < 128; i++)
+		single_char_wire[i] = -1;
+	std::map< std::string, int > long_id_wire;
+	for (size_t signal=0; signal < signals.size(); signal++) {
+		if (wire_of_signal[signal] == -1)
+			continue;
+		if ((ids[signal].size() == 1) && ((U8) ids[signal][0] < 128))
+			single_char_wire[(U8) ids[signal][0]] = wire_of_signal[signal];
+		else
+			long_id_wire[ids[signal]] = wire_of_signal[signal];
+	}
+
+	trace.mSampleRate = sample_rate;
+	trace.mNumSamples = 0;
+	EdgeCollector edges(trace, num_wires);
+	U64 sample = 0;
+	bool in_comment = false;
+
+	while (lines.NextLine(line, end)) {
+		const U8* p = line;
+		while (p < end) {
+			while ((p < end) && IsSpace(*p))
+				p++;
+			if (p == end)
+				break;
+
+			const U8* token = p;
+			while ((p < end) && !IsSpace(*p))
+				p++;
+
+			if (in_comment) {
+				in_comment = (p - token != 4) || (std::memcmp(token, "$end", 4) != 0);
+			} else if ((p - token == 8) && (std::memcmp(token, "$comment", 8) == 0)) {
+				in_comment = true;
+			} else if (*token == '#') {
+				const U8* digits = token + 1;
+				U64 ticks = ParseUnsigned(digits, p);
+				sample = (U64) std::floor(ticks * samples_per_tick + 0.5);
+				if (sample + 1 > trace.mNumSamples)
+					trace.mNumSamples = sample + 1;
+			} else if ((*token == '0') || (*token == '1')) {
+				int wire = -1;
+				if (p - token == 2)
+					wire = ((U8) token[1] < 128) ? single_char_wire[(U8) token[1]] : -1;
+				else {
+					std::map< std::string, int >::const_iterator it = long_id_wire.find(std::string((const char*) token + 1, p - token - 1));
+					if (it != long_id_wire.end())
+						wire = it->second;
+				}
+				if (wire != -1)
+					edges.Set(wire, *token - '0', sample);
+			} else if ((*token == 'b') || (*token == 'r')) {
+				// Vector values are followed by their identifier; single-bit
+				// signals are all we import, so skip both
+				while ((p < end) && IsSpace(*p))
+					p++;
+				while ((p < end) && !IsSpace(*p))
+					p++;
+			}
+			// x/z values, $dumpvars and friends change nothing
+		}
+	}
+	return true;
+}
@@ -0,0 +1,25 @@
+#ifndef MBUS_IMPORT
+#define MBUS_IMPORT
+
+#include "MBusTypes.h"
+
+#include <string>
+#include <vector>
+
+struct MBusTrace;
+
+/* Importers for captures exported from Logic (CSV) or other tools (VCD).
+ *
+ * wires names the capture signal for each ring wire in MBusTrace order:
+ * mediator CLK, mediator DAT, then CLK and DAT of each member. A wire is
+ * matched by its CSV column header or VCD signal name, or given as the
+ * index of the signal (0 is the first signal after the time column). An
+ * empty list takes every signal in file order.
+ *
+ * CSV times are in seconds and are rounded to sample_rate. VCD times are in
+ * the file's timescale; sample_rate 0 uses one sample per tick.
+ */
+bool ImportSaleaeCsv(const std::string& path, const std::vector< std::string >& wires, U32 sample_rate, MBusTrace& trace, std::string& error);
+bool ImportVcd(const std::string& path, const std::vector< std::string >& wires, U32 sample_rate, MBusTrace& trace, std::string& error);
+
+#endif //MBUS_IMPORT
@@ -0,0 +1,52 @@
+#include "MBusMappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MBusMappedFile::MBusMappedFile()
+:	mData( NULL ),
+	mSize( 0 )
+{
+}
+
+MBusMappedFile::~MBusMappedFile()
+{
+	Close();
+}
+
+bool MBusMappedFile::Open( const std::string& path )
+{
+	Close();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	// Captures are read front to back exactly once
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	mData = (const U8*) data;
+	mSize = st.st_size;
+	return true;
+}
+
+void MBusMappedFile::Close()
+{
+	if (mData != NULL)
+		munmap((void*) mData, mSize);
+	mData = NULL;
+	mSize = 0;
+}
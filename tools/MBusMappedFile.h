@@ -0,0 +1,31 @@
+#ifndef MBUS_MAPPED_FILE
+#define MBUS_MAPPED_FILE
+
+#include "MBusTypes.h"
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only, for parsing captures in place
+class MBusMappedFile
+{
+public:
+	MBusMappedFile();
+	~MBusMappedFile();
+
+	bool Open( const std::string& path );
+	void Close();
+
+	const U8* GetData() const { return mData; }
+	size_t GetSize() const { return mSize; }
+
+protected:
+	const U8* mData;
+	size_t mSize;
+
+private:
+	MBusMappedFile( const MBusMappedFile& );
+	MBusMappedFile& operator=( const MBusMappedFile& );
+};
+
+#endif //MBUS_MAPPED_FILE
@@ -0,0 +1,226 @@
+#include "MBusRawSamples.h"
+#include "MBusMappedFile.h"
+#include "MBusTrace.h"
+
+#include <cstring>
+
+// With MBUS_MULTIVERSION (build_analyzer.py multiversion) an x86 build that
+// isn't already AVX2 also gets AVX2 copies of the vector kernels, picked at
+// run time, so one binary runs anywhere and still uses AVX2 where it can
+#if defined(__AVX2__)
+#define MBUS_AVX2_KERNELS
+#define MBUS_TARGET_AVX2
+#elif defined(MBUS_MULTIVERSION) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MBUS_AVX2_KERNELS
+#define MBUS_AVX2_AT_RUN_TIME
+#define MBUS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(MBUS_AVX2_KERNELS) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Edges for every selected probe channel, indexed by probe bit
+struct TransitionSink
+{
+	std::vector< U64 >* mEdges[16];
+};
+
+// Records the changes between the sample at index and the one before it
+static inline void AddTransitions(TransitionSink& sink, U32 changed, U64 index)
+{
+	while (changed) {
+		U32 bit = __builtin_ctz(changed);
+		changed &= changed - 1;
+		sink.mEdges[bit]->push_back(index);
+	}
+}
+
+template < typename SampleType >
+static void ScalarTransitions(const SampleType* samples, U64 begin, U64 end, SampleType mask, TransitionSink& sink)
+{
+	for (U64 i=begin; i < end; i++) {
+		SampleType changed = (samples[i] ^ samples[i - 1]) & mask;
+		if (changed)
+			AddTransitions(sink, changed, i);
+	}
+}
+
+// XOR each vector of samples with the same vector shifted back by one
+// sample, keep the selected channels, and turn "anything changed" into a
+// bitmask; quiet stretches of the bus then cost one compare per vector.
+// Each returns the first sample not yet examined.
+#if defined(MBUS_AVX2_KERNELS)
+MBUS_TARGET_AVX2 static U64 Avx2Transitions8(const U8* samples, U64 num_samples, U8 mask, TransitionSink& sink)
+{
+	U64 i = 1;
+	const __m256i select = _mm256_set1_epi8((char) mask);
+	const __m256i zero = _mm256_setzero_si256();
+	for (; i + 32 <= num_samples; i += 32) {
+		__m256i current = _mm256_loadu_si256((const __m256i*) (samples + i));
+		__m256i previous = _mm256_loadu_si256((const __m256i*) (samples + i - 1));
+		__m256i changed = _mm256_and_si256(_mm256_xor_si256(current, previous), select);
+		U32 quiet = (U32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(changed, zero));
+		U32 active = ~quiet;
+		while (active) {
+			U32 lane = __builtin_ctz(active);
+			active &= active - 1;
+			AddTransitions(sink, (samples[i + lane] ^ samples[i + lane - 1]) & mask, i + lane);
+		}
+	}
+	return i;
+}
+
+// As above for 16-bit samples; movemask gives two bits per sample, so only
+// the even ones are kept
+MBUS_TARGET_AVX2 static U64 Avx2Transitions16(const U16* samples, U64 num_samples, U16 mask, TransitionSink& sink)
+{
+	U64 i = 1;
+	const __m256i select = _mm256_set1_epi16((short) mask);
+	const __m256i zero = _mm256_setzero_si256();
+	for (; i + 16 <= num_samples; i += 16) {
+		__m256i current = _mm256_loadu_si256((const __m256i*) (samples + i));
+		__m256i previous = _mm256_loadu_si256((const __m256i*) (samples + i - 1));
+		__m256i changed = _mm256_and_si256(_mm256_xor_si256(current, previous), select);
+		U32 active = ~(U32) _mm256_movemask_epi8(_mm256_cmpeq_epi16(changed, zero)) & 0x55555555;
+		while (active) {
+			U32 lane = __builtin_ctz(active) / 2;
+			active &= active - 1;
+			AddTransitions(sink, (samples[i + lane] ^ samples[i + lane - 1]) & mask, i + lane);
+		}
+	}
+	return i;
+}
+#endif
+
+#if defined(__SSE2__)
+static U64 Sse2Transitions8(const U8* samples, U64 num_samples, U8 mask, TransitionSink& sink)
+{
+	U64 i = 1;
+	const __m128i select = _mm_set1_epi8((char) mask);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= num_samples; i += 16) {
+		__m128i current = _mm_loadu_si128((const __m128i*) (samples + i));
+		__m128i previous = _mm_loadu_si128((const __m128i*) (samples + i - 1));
+		__m128i changed = _mm_and_si128(_mm_xor_si128(current, previous), select);
+		U32 active = (U32) _mm_movemask_epi8(_mm_cmpeq_epi8(changed, zero)) ^ 0xffff;
+		while (active) {
+			U32 lane = __builtin_ctz(active);
+			active &= active - 1;
+			AddTransitions(sink, (samples[i + lane] ^ samples[i + lane - 1]) & mask, i + lane);
+		}
+	}
+	return i;
+}
+
+static U64 Sse2Transitions16(const U16* samples, U64 num_samples, U16 mask, TransitionSink& sink)
+{
+	U64 i = 1;
+	const __m128i select = _mm_set1_epi16((short) mask);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= num_samples; i += 8) {
+		__m128i current = _mm_loadu_si128((const __m128i*) (samples + i));
+		__m128i previous = _mm_loadu_si128((const __m128i*) (samples + i - 1));
+		__m128i changed = _mm_and_si128(_mm_xor_si128(current, previous), select);
+		U32 active = ((U32) _mm_movemask_epi8(_mm_cmpeq_epi16(changed, zero)) ^ 0xffff) & 0x5555;
+		while (active) {
+			U32 lane = __builtin_ctz(active) / 2;
+			active &= active - 1;
+			AddTransitions(sink, (samples[i + lane] ^ samples[i + lane - 1]) & mask, i + lane);
+		}
+	}
+	return i;
+}
+#endif
+
+static U64 VectorTransitions8(const U8* samples, U64 num_samples, U8 mask, TransitionSink& sink)
+{
+#if defined(MBUS_AVX2_AT_RUN_TIME)
+	if (__builtin_cpu_supports("avx2"))
+		return Avx2Transitions8(samples, num_samples, mask, sink);
+#elif defined(MBUS_AVX2_KERNELS)
+	return Avx2Transitions8(samples, num_samples, mask, sink);
+#endif
+#if defined(__SSE2__)
+	return Sse2Transitions8(samples, num_samples, mask, sink);
+#else
+	return 1;
+#endif
+}
+
+static U64 VectorTransitions16(const U16* samples, U64 num_samples, U16 mask, TransitionSink& sink)
+{
+#if defined(MBUS_AVX2_AT_RUN_TIME)
+	if (__builtin_cpu_supports("avx2"))
+		return Avx2Transitions16(samples, num_samples, mask, sink);
+#elif defined(MBUS_AVX2_KERNELS)
+	return Avx2Transitions16(samples, num_samples, mask, sink);
+#endif
+#if defined(__SSE2__)
+	return Sse2Transitions16(samples, num_samples, mask, sink);
+#else
+	return 1;
+#endif
+}
+
+bool ExtractTransitions(const U8* samples, U64 num_samples, U32 bytes_per_sample, const std::vector< U32 >& wire_bits, U32 sample_rate, MBusTrace& trace, std::string& error)
+{
+	if ((bytes_per_sample != 1) && (bytes_per_sample != 2)) {
+		error = "samples must be 1 or 2 bytes";
+		return false;
+	}
+	if ((wire_bits.size() < 2) || (wire_bits.size() % 2)) {
+		error = "need a CLK and a DAT for every node, i.e. an even number of wires";
+		return false;
+	}
+	if (num_samples == 0) {
+		error = "no samples";
+		return false;
+	}
+
+	size_t node_count = wire_bits.size() / 2;
+	trace.mSampleRate = sample_rate;
+	trace.mNumSamples = num_samples;
+	trace.mNodeCLKs.assign(node_count, MBusTraceChannel());
+	trace.mNodeDATs.assign(node_count, MBusTraceChannel());
+
+	U32 first = samples[0] | ((bytes_per_sample == 2) ? samples[1] << 8 : 0);
+	U32 mask = 0;
+	TransitionSink sink;
+	for (size_t wire=0; wire < wire_bits.size(); wire++) {
+		U32 bit = wire_bits[wire];
+		MBusTraceChannel& channel = (wire & 1) ? trace.mNodeDATs[wire / 2] : trace.mNodeCLKs[wire / 2];
+		if ((bit >= bytes_per_sample * 8) || (mask & (1 << bit))) {
+			error = "bad or repeated probe channel";
+			return false;
+		}
+		mask |= 1 << bit;
+		sink.mEdges[bit] = &channel.mEdges;
+		channel.mInitialBitState = (first & (1 << bit)) ? BIT_HIGH : BIT_LOW;
+	}
+
+	if (bytes_per_sample == 1) {
+		U64 done = VectorTransitions8(samples, num_samples, (U8) mask, sink);
+		ScalarTransitions< U8 >(samples, done, num_samples, (U8) mask, sink);
+	} else {
+		// Little-endian words, read in place
+		const U16* words = (const U16*) samples;
+		U64 done = VectorTransitions16(words, num_samples, (U16) mask, sink);
+		ScalarTransitions< U16 >(words, done, num_samples, (U16) mask, sink);
+	}
+	return true;
+}
+
+bool ImportRawSamples(const std::string& path, U32 bytes_per_sample, const std::vector< U32 >& wire_bits, U32 sample_rate, MBusTrace& trace, std::string& error)
+{
+	MBusMappedFile file;
+	if (!file.Open(path)) {
+		error = "could not open " + path;
+		return false;
+	}
+	if ((bytes_per_sample == 0) || (file.GetSize() % bytes_per_sample)) {
+		error = "file is not a whole number of samples";
+		return false;
+	}
+	return ExtractTransitions(file.GetData(), file.GetSize() / bytes_per_sample, bytes_per_sample, wire_bits, sample_rate, trace, error);
+}
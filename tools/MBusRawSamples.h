@@ -0,0 +1,21 @@
+#ifndef MBUS_RAW_SAMPLES
+#define MBUS_RAW_SAMPLES
+
+#include "MBusTypes.h"
+
+#include <string>
+#include <vector>
+
+struct MBusTrace;
+
+/* Raw logic dumps: one byte or one little-endian 16-bit word per sample,
+ * bit n holding probe channel n. wire_bits gives the probe channel for each
+ * ring wire in MBusTrace order (mediator CLK, mediator DAT, then each
+ * member's CLK and DAT).
+ */
+bool ImportRawSamples(const std::string& path, U32 bytes_per_sample, const std::vector< U32 >& wire_bits, U32 sample_rate, MBusTrace& trace, std::string& error);
+
+// The same over a buffer already in memory
+bool ExtractTransitions(const U8* samples, U64 num_samples, U32 bytes_per_sample, const std::vector< U32 >& wire_bits, U32 sample_rate, MBusTrace& trace, std::string& error);
+
+#endif //MBUS_RAW_SAMPLES
@@ -0,0 +1,69 @@
+#include "MBusStreamListener.h"
+
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+MBusStreamListener::MBusStreamListener()
+:	mListenSocket( -1 ),
+	mSocket( -1 )
+{
+}
+
+MBusStreamListener::~MBusStreamListener()
+{
+	Close();
+}
+
+bool MBusStreamListener::Listen( const std::string& path )
+{
+	Close();
+
+	struct sockaddr_un address;
+	if (path.size() >= sizeof(address.sun_path))
+		return false;
+
+	mListenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (mListenSocket < 0)
+		return false;
+
+	unlink(path.c_str());
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path.c_str());
+	if ((bind(mListenSocket, (struct sockaddr*) &address, sizeof(address)) != 0) || (listen(mListenSocket, 1) != 0)) {
+		Close();
+		return false;
+	}
+
+	mPath = path;
+	return true;
+}
+
+void MBusStreamListener::Close()
+{
+	if (mSocket >= 0)
+		close(mSocket);
+	if (mListenSocket >= 0)
+		close(mListenSocket);
+	if (!mPath.empty())
+		unlink(mPath.c_str());
+	mSocket = -1;
+	mListenSocket = -1;
+	mPath.clear();
+}
+
+bool MBusStreamListener::Accept()
+{
+	if (mSocket >= 0)
+		close(mSocket);
+	mSocket = accept(mListenSocket, NULL, NULL);
+	return mSocket >= 0;
+}
+
+size_t MBusStreamListener::Read( char* buffer, size_t size )
+{
+	ssize_t length = read(mSocket, buffer, size);
+	return (length > 0) ? (size_t) length : 0;
+}
@@ -0,0 +1,35 @@
+#ifndef MBUS_STREAM_LISTENER
+#define MBUS_STREAM_LISTENER
+
+#include "MBusTypes.h"
+
+#include <string>
+
+// The receiving end of MBusTransactionStreamer: a Unix domain socket that
+// takes one connection at a time, standing in for a monitoring daemon
+class MBusStreamListener
+{
+public:
+	MBusStreamListener();
+	~MBusStreamListener();
+
+	// Replaces any stale socket file at path
+	bool Listen( const std::string& path );
+	void Close();
+
+	// Waits for the next streamer to connect
+	bool Accept();
+	// Bytes as they arrive; 0 once the streamer disconnects
+	size_t Read( char* buffer, size_t size );
+
+protected:
+	std::string mPath;
+	int mListenSocket;
+	int mSocket;
+
+private:
+	MBusStreamListener( const MBusStreamListener& );
+	MBusStreamListener& operator=( const MBusStreamListener& );
+};
+
+#endif //MBUS_STREAM_LISTENER
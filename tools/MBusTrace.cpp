@@ -0,0 +1,107 @@
+#include "MBusTrace.h"
+#include "MBusSimulator.h"
+
+#include <fstream>
+#include <sstream>
+
+static void WriteChannel(std::ostream& out, const char* name, int node, const MBusTraceChannel& channel)
+{
+	out << name << " " << node << " " << (channel.mInitialBitState == BIT_HIGH);
+	U64 previous = 0;
+	for (size_t i=0; i < channel.mEdges.size(); i++) {
+		out << " " << channel.mEdges[i] - previous;
+		previous = channel.mEdges[i];
+	}
+	out << "\n";
+}
+
+bool WriteTrace(const std::string& path, const MBusTrace& trace)
+{
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+	if (!out.is_open())
+		return false;
+
+	out << "mbus-trace 1\n";
+	out << "rate " << trace.mSampleRate << "\n";
+	out << "samples " << trace.mNumSamples << "\n";
+	out << "nodes " << trace.mNodeCLKs.size() << "\n";
+	for (size_t i=0; i < trace.mNodeCLKs.size(); i++) {
+		WriteChannel(out, "clk", i, trace.mNodeCLKs[i]);
+		WriteChannel(out, "dat", i, trace.mNodeDATs[i]);
+	}
+	return !out.fail();
+}
+
+bool ReadTrace(const std::string& path, MBusTrace& trace)
+{
+	std::ifstream in(path.c_str());
+	if (!in.is_open())
+		return false;
+
+	trace.mSampleRate = 0;
+	trace.mNumSamples = 0;
+	trace.mNodeCLKs.clear();
+	trace.mNodeDATs.clear();
+
+	std::string line;
+	if (!std::getline(in, line) || (line.compare(0, 12, "mbus-trace 1") != 0))
+		return false;
+
+	while (std::getline(in, line)) {
+		std::istringstream args(line);
+		std::string key;
+		if (!(args >> key) || (key[0] == '#'))
+			continue;
+
+		if (key == "rate") {
+			if ((args >> trace.mSampleRate).fail())
+				return false;
+		} else if (key == "samples") {
+			if ((args >> trace.mNumSamples).fail())
+				return false;
+		} else if (key == "nodes") {
+			size_t nodes;
+			if ((args >> nodes).fail() || (nodes < 1))
+				return false;
+			trace.mNodeCLKs.resize(nodes);
+			trace.mNodeDATs.resize(nodes);
+		} else if ((key == "clk") || (key == "dat")) {
+			size_t node;
+			int initial;
+			if ((args >> node >> initial).fail() || (node >= trace.mNodeCLKs.size()))
+				return false;
+			MBusTraceChannel& channel = (key == "clk") ? trace.mNodeCLKs[node] : trace.mNodeDATs[node];
+			channel.mInitialBitState = initial ? BIT_HIGH : BIT_LOW;
+			channel.mEdges.clear();
+
+			U64 sample = 0, delta;
+			while (args >> delta) {
+				sample += delta;
+				channel.mEdges.push_back(sample);
+			}
+			if (!args.eof())
+				return false;
+		} else {
+			return false;
+		}
+	}
+	return (trace.mSampleRate != 0) && !trace.mNodeCLKs.empty();
+}
+
+void TraceFromSimulator(MBusSimulator& simulator, U32 sample_rate, MBusTrace& trace)
+{
+	int node_count = simulator.GetNodeCount();
+	trace.mSampleRate = sample_rate;
+	trace.mNumSamples = simulator.GetSampleNumber();
+	trace.mNodeCLKs.resize(node_count);
+	trace.mNodeDATs.resize(node_count);
+
+	for (int i=0; i < node_count; i++) {
+		MBusSimulatedChannel* clk = simulator.GetNodeCLK(i);
+		MBusSimulatedChannel* dat = simulator.GetNodeDAT(i);
+		trace.mNodeCLKs[i].mInitialBitState = clk->GetInitialBitState();
+		trace.mNodeCLKs[i].mEdges = clk->GetEdges();
+		trace.mNodeDATs[i].mInitialBitState = dat->GetInitialBitState();
+		trace.mNodeDATs[i].mEdges = dat->GetEdges();
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef MBUS_TRACE
+#define MBUS_TRACE
+
+#include "MBusTypes.h"
+
+#include <string>
+#include <vector>
+
+class MBusSimulator;
+
+// One wire of a recorded ring: its state at sample 0 and every edge after
+struct MBusTraceChannel
+{
+	BitState mInitialBitState;
+	std::vector< U64 > mEdges;
+};
+
+// A recorded ring, node 0 is the mediator
+struct MBusTrace
+{
+	U32 mSampleRate;
+	U64 mNumSamples;
+	std::vector< MBusTraceChannel > mNodeCLKs;
+	std::vector< MBusTraceChannel > mNodeDATs;
+};
+
+// Text edge traces (.trace), one line per wire with delta-coded edges:
+//
+//   mbus-trace 1
+//   rate <samples/sec>
+//   samples <count>
+//   nodes <count>
+//   clk <node> <initial 0|1> <delta> <delta> ...
+//   dat <node> <initial 0|1> <delta> <delta> ...
+//
+// The first delta is from sample 0, each following one from the edge before
+bool ReadTrace(const std::string& path, MBusTrace& trace);
+bool WriteTrace(const std::string& path, const MBusTrace& trace);
+
+// Copies everything the simulator has generated so far
+void TraceFromSimulator(MBusSimulator& simulator, U32 sample_rate, MBusTrace& trace);
+
+#endif //MBUS_TRACE
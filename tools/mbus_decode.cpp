@@ -0,0 +1,1634 @@
+/*
+ * Headless MBus decoder, built without the AnalyzerSDK (see build_analyzer.py).
+ * It runs the analyzer's decoder core over the simulator core's output, so
+ * decoder changes can be checked and timed without Logic.
+ *
+ *   mbus_decode simulate <scenario> [-n nodes] [-t seconds] [-r rate]
+ *       Play a scenario file and print one line per decoded transaction,
+ *       in the same layout as the scenario's "expect" output.
+ *
+ *   mbus_decode fuzz [-n nodes] [-s seed] [-i iterations] [-f fault,...] [-r rate]
+ *       Round-trip random messages through simulator and decoder and compare
+ *       against the simulator's known answer. A failing case is shrunk and
+ *       printed with the seed that reproduces it.
+ *
+ *   mbus_decode allocs <scenario> [-n nodes] [-t seconds] [-r rate] [-i count]
+ *       Decode a scenario and count operator new calls over count
+ *       transactions once the decoder has warmed up; any at all fails.
+ *       The decoder must not allocate per transaction (e.g. -t 20 -i 10000).
+ *       Then decode it again into the store, address index, statistics,
+ *       efficiency and timeline, as the analyzer does, which may only
+ *       allocate a chunk at a time.
+ *
+ *   mbus_decode record <scenario> <capture> [-n nodes] [-t seconds] [-r rate]
+ *   mbus_decode decode <capture>
+ *   mbus_decode convert <trace> <capture>
+ *       Save a scenario as a capture, decode one, or convert a text trace.
+ *       Captures ending in .mbe are edge files (see MBusEdgeFile.h), which
+ *       are decoded in place from a mapping; anything else is a text trace
+ *       (see MBusTrace.h).
+ *
+ *   mbus_decode split <capture> <seconds> <prefix>
+ *   mbus_decode chunks <state> <chunk>...
+ *       Rolling captures (see MBusChunks.h). split cuts a capture into
+ *       <prefix>000000.mbe, <prefix>000001.mbe, ... of the given length,
+ *       as the monitoring rig writes them. chunks decodes chunk files in order as
+ *       one capture, starting from the decoder state saved in <state> if
+ *       there is one and saving where the last chunk stopped, so the next
+ *       run continues mid-transaction if need be.
+ *
+ *   mbus_decode import <csv|vcd|bin> <capture> [-w wire,...] [-r rate] [-B bytes]
+ *       Convert a Logic CSV export, a VCD or a raw sample dump (.bin/.raw)
+ *       into a capture. -w names the capture signal for each wire: mediator
+ *       CLK, mediator DAT, then each member's CLK and DAT (see MBusImport.h);
+ *       for raw dumps these are probe bit numbers, and -B is 1 or 2 bytes
+ *       per sample (see MBusRawSamples.h). CSV times are rounded to -r
+ *       (default 10 MHz); VCD defaults to one sample per tick.
+ *
+ *   mbus_decode query <capture> [address] [-S store]
+ *       Without an address, list every prefix and functional unit the
+ *       capture talks to. With one (17, 1*, F00000B7, F00000B*; see
+ *       MBusAddressIndex.h), print only the matching transactions, found
+ *       through the address index rather than a scan.
+ *
+ *   mbus_decode stats <capture> [-S store]
+ *       Print message, byte, ack/nak/error, arbitration loss and bus time
+ *       totals per address and per sender (the analyzer's summary export).
+ *
+ *   mbus_decode efficiency <capture> [-S store]
+ *       Print the CLK cycles spent in arbitration, address, data,
+ *       interjection and control per message, goodput and effective payload
+ *       rate, for short, full and no address messages and in all, then the
+ *       same for each transaction (the analyzer's efficiency export).
+ *
+ *   mbus_decode timeline <capture> [-W bin_us] [-L max_bins]
+ *       Print the share of each bin the bus spent idle, arbitrating, and in
+ *       address, data, interjection and control, for the finest bins (10 ms
+ *       by default) and every 4x coarser level, skipping levels with more
+ *       than max_bins bins (the analyzer's utilization export).
+ *
+ *   mbus_decode messages <capture> [records]
+ *       Decode each transaction's register, memory and broadcast messages
+ *       (see MBusMessage.h) and print them as the analyzer's message export
+ *       does, or with a records path, write the raw 40-byte MBusMessage
+ *       records there instead for offline tools to map.
+ *
+ *   mbus_decode json <capture> <output> [-S store]
+ *       Write every transaction as a line of JSON (see MBusJsonWriter.h), as
+ *       the analyzer's JSON Lines export does, and report how fast.
+ *
+ *   mbus_decode pcap <capture> <output> [-S store]
+ *       Write every transaction as a pcap packet (see MBusPcapWriter.h), as
+ *       the analyzer's pcap export does, and report how fast.
+ *
+ *       These (query through pcap) keep transactions in an
+ *       MBusTransactionStore and write from it; -S keeps the store in a
+ *       segment file (see MBusSegmentFile.h) instead of memory, as the
+ *       analyzer's "Transaction Store File" does.
+ *
+ *   mbus_decode listen <socket>
+ *   mbus_decode stream <capture> <socket>
+ *   mbus_decode latency <capture> [-i count] [-p per_second]
+ *       Live streaming (see MBusStreamer.h). listen stands in for the
+ *       monitoring daemon and prints what the analyzer streams to <socket>;
+ *       stream decodes a capture into it the way the analyzer would. latency
+ *       replays the capture's transactions through the streamer to a local
+ *       listener at a fixed rate (default 10000/s) and reports the delay
+ *       from commit to receipt, and any drops.
+ *
+ *   mbus_decode footprint <capture>...
+ *       Compare the memory held by one frame per data byte with compact
+ *       storage (one data block frame plus an MBusTransactionStore record
+ *       per message), and check every stored transaction reads back intact
+ *       and every message with data has a data block naming its record.
+ *
+ *   mbus_decode store <capture> <store> [-i lookups]
+ *       Decode the capture into a store file, frames and all, and report its
+ *       size, the memory it leaves in use and the peak resident size; time
+ *       lookups (default 1000) of transactions and frames by index and by
+ *       time, and check everything reads back as decoded.
+ *
+ *   mbus_decode bench <capture>...
+ *       Time each capture through the generic state machine and through
+ *       the one compiled for its node count (see MBusDecoder.cpp), after
+ *       checking both decode it the same.
+ *
+ *   mbus_decode capi <capture>...
+ *       Decode each capture through the C interface (see MBusCApi.h), as a
+ *       tool loading libmbusdecoder would, check every transaction and
+ *       payload comes back as the decoder committed it, and time reading
+ *       them all against decoding into C++ transactions.
+ *
+ *   mbus_decode propagation <capture>
+ *       Print how long each CLK edge took to get from each node to the next
+ *       (see MBusPropagation.h), as the analyzer's propagation export does,
+ *       and what measuring it costs the decode.
+ *
+ *   mbus_decode rings <capture> <nodes,nodes,...>
+ *   mbus_decode join <capture>... <output>
+ *       Several independent rings on one probe (see MBusRingSet.h). rings
+ *       splits the capture's nodes into rings of the given sizes, mediator
+ *       first in each, decodes them all in one pass, checks each ring
+ *       decodes the same as on its own and that frames came out in order,
+ *       and times one pass against a pass per ring. join puts captures side
+ *       by side as one, each one's nodes after the last's.
+ *
+ *   mbus_decode region <capture> <start_s> <end_s> [-i interval]
+ *       Decode the capture taking a checkpoint (see MBusDecoder.h) every
+ *       interval transactions (default 1000), then decode again only the
+ *       transactions starting between start_s and end_s, from the nearest
+ *       checkpoint before them. Prints those, checks they match the full
+ *       decode, and times both.
+ *
+ *   mbus_decode check [-b baseline] [-m margin] [-u] <capture>...
+ *       Regression gate for the corpus in corpus/: every capture must decode
+ *       exactly to its .expected file, and to its .messages file (the
+ *       messages export) if it has one, and throughput must not fall more
+ *       than margin (default 0.10) below the baseline. -u records a new
+ *       baseline instead.
+ */
+
+#include "MBusChannel.h"
+#include "MBusDecoder.h"
+#include "MBusRingSet.h"
+#include "MBusSimulator.h"
+#include "MBusTransaction.h"
+#include "MBusTransactionStore.h"
+#include "MBusAddressIndex.h"
+#include "MBusStatistics.h"
+#include "MBusEfficiency.h"
+#include "MBusUtilization.h"
+#include "MBusStreamer.h"
+#include "MBusMessage.h"
+#include "MBusJsonWriter.h"
+#include "MBusPcapWriter.h"
+#include "MBusPropagation.h"
+#include "MBusTrace.h"
+#include "MBusEdgeFile.h"
+#include "MBusImport.h"
+#include "MBusRawSamples.h"
+#include "MBusStreamListener.h"
+#include "MBusChunks.h"
+#include "MBusCApi.h"
+#include "MBusCapture.h"
+#include "MBusGates.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Every operator new the tool makes, so allocs can see the decoder's
+// (see CountAllocations). It stays here rather than with the gates, as
+// everything else in tools/ is linked into libmbusdecoder as well.
+static std::atomic< U64 > gAllocations( 0 );
+
+void* operator new( std::size_t size )
+{
+	gAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* memory = std::malloc(size ? size : 1);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete( void* memory ) throw()
+{
+	std::free(memory);
+}
+
+static int Simulate( const std::string& scenario, int node_count, double seconds, U32 sample_rate )
+{
+	MBusTrace trace;
+	SimulateTrace(scenario, node_count, seconds, sample_rate, trace);
+
+	CollectingSink sink;
+	clock_t start = std::clock();
+	DecodeTrace(trace, sink);
+	double elapsed = Seconds(start);
+
+	WriteTransactions(std::cout, sink.mTransactions);
+	std::cerr << sink.mTransactions.size() << " transactions, " << trace.mNumSamples << " samples in "
+		<< elapsed << " s (" << (elapsed > 0 ? trace.mNumSamples / elapsed / 1e6 : 0) << " Msamples/s)" << std::endl;
+	return 0;
+}
+
+static int Record( const std::string& scenario, const std::string& path, int node_count, double seconds, U32 sample_rate )
+{
+	MBusTrace trace;
+	SimulateTrace(scenario, node_count, seconds, sample_rate, trace);
+	if (!SaveCapture(path, trace)) {
+		std::cerr << "Could not write " << path << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+static int Decode( const std::string& path )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+
+	CollectingSink sink;
+	capture.Decode(sink);
+	WriteTransactions(std::cout, sink.mTransactions);
+	return 0;
+}
+
+static void ListAddresses( MBusAddressIndex& index, MBusTransactionStore& store, U8 address_bits )
+{
+	std::vector< U32 > prefixes;
+	index.GetPrefixes(address_bits, prefixes);
+	for (size_t i=0; i < prefixes.size(); i++) {
+		MBusAddressFilter filter;
+		filter.mAddressBits = address_bits;
+		filter.mPrefix = prefixes[i];
+		for (int unit = 0; unit < 16; unit++) {
+			std::vector< U64 > ids;
+			filter.mFunctionalUnit = unit;
+			index.Find(filter, ids);
+			if (ids.empty())
+				continue;
+
+			MBusTransactionRecord record;
+			store.GetRecord(ids[0], record);
+			std::printf((address_bits == 32) ? "%08X  prefix %05X  F.U. %X  %lu\n" : "%02X        prefix %X  F.U. %X  %lu\n",
+				record.mAddress, prefixes[i], unit, (unsigned long) ids.size());
+		}
+	}
+}
+
+static int Query( const std::string& path, const std::string& address, const std::string& store_path )
+{
+	MBusAddressFilter filter;
+	if (!address.empty() && !ParseAddressFilter(address, filter)) {
+		std::cerr << "Bad address " << address << ", expected e.g. 17, 1*, F00000B7 or F00000B*" << std::endl;
+		return 1;
+	}
+
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+
+	StoringSink sink;
+	if (!sink.OpenStore(store_path))
+		return 1;
+	capture.Decode(sink);
+
+	if (address.empty()) {
+		ListAddresses(sink.mIndex, sink.mStore, 8);
+		ListAddresses(sink.mIndex, sink.mStore, 32);
+		return 0;
+	}
+
+	clock_t start = std::clock();
+	std::vector< U64 > ids;
+	sink.mIndex.Find(filter, ids);
+	double elapsed = Seconds(start);
+
+	MBusTransaction transaction;
+	for (size_t i=0; i < ids.size(); i++) {
+		sink.mStore.GetTransaction(ids[i], transaction);
+		WriteTransactionLine(std::cout, transaction);
+		std::cout << "\n";
+	}
+	std::cerr << ids.size() << " of " << sink.mStore.GetCount() << " transactions matched in "
+		<< elapsed * 1e6 << " us" << std::endl;
+	return 0;
+}
+
+static int Stats( const std::string& path, const std::string& store_path )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+
+	StoringSink sink;
+	if (!sink.OpenStore(store_path))
+		return 1;
+	capture.Decode(sink);
+	WriteStatisticsSummary(std::cout, sink.mStatistics, capture.GetSampleRate());
+	return 0;
+}
+
+static int Efficiency( const std::string& path, const std::string& store_path )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+
+	StoringSink sink;
+	if (!sink.OpenStore(store_path))
+		return 1;
+	capture.Decode(sink);
+	WriteEfficiencySummary(std::cout, sink.mEfficiency, capture.GetSampleRate());
+	std::cout << std::endl;
+	WriteEfficiencyHeader(std::cout);
+	double samples_per_cycle = sink.mEfficiency.GetSamplesPerCycle();
+	MBusTransaction transaction;
+	U64 num_transactions = sink.mStore.GetCount();
+	for (U64 i=0; i < num_transactions; i++) {
+		sink.mStore.GetTransaction(i, transaction);
+		WriteEfficiencyLine(std::cout, transaction, samples_per_cycle, capture.GetSampleRate());
+	}
+	return 0;
+}
+
+static int Timeline( const std::string& path, U32 bin_us, U64 max_bins )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+
+	StoringSink sink;
+	sink.mUtilization.Initialize((U64) capture.GetSampleRate() * bin_us / 1000000);
+	sink.mTimeline = true;
+	capture.Decode(sink);
+	WriteUtilizationTimeline(std::cout, sink.mUtilization, capture.GetSampleRate(), max_bins);
+	return 0;
+}
+
+static int Messages( const std::string& path, const std::string& records_path )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+	CollectingSink sink;
+	capture.Decode(sink);
+
+	clock_t start = std::clock();
+	std::vector< MBusMessage > messages;
+	for (size_t i=0; i < sink.mTransactions.size(); i++)
+		DecodeMessages(sink.mTransactions[i], messages);
+	double elapsed = Seconds(start);
+
+	if (records_path.empty()) {
+		WriteMessages(std::cout, messages, capture.GetSampleRate());
+	} else {
+		std::ofstream out(records_path.c_str(), std::ios::out | std::ios::binary);
+		if (!messages.empty())
+			out.write((const char*) &messages[0], messages.size() * sizeof(MBusMessage));
+		if (!out) {
+			std::cerr << "Could not write " << records_path << std::endl;
+			return 1;
+		}
+	}
+
+	std::cerr << messages.size() << " messages from " << sink.mTransactions.size() << " transactions in "
+		<< elapsed * 1e6 << " us" << std::endl;
+	return 0;
+}
+
+static int Json( const std::string& path, const std::string& out_path, const std::string& store_path )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+	StoringSink sink;
+	if (!sink.OpenStore(store_path))
+		return 1;
+	capture.Decode(sink);
+
+	MBusJsonWriter writer;
+	if (!writer.Open(out_path.c_str())) {
+		std::cerr << "Could not write " << out_path << std::endl;
+		return 1;
+	}
+	writer.SetTiming(capture.GetSampleRate(), 0);
+
+	clock_t start = std::clock();
+	MBusTransaction transaction;
+	U64 num_transactions = sink.mStore.GetCount();
+	for (U64 i=0; i < num_transactions; i++) {
+		sink.mStore.GetTransaction(i, transaction);
+		writer.Write(transaction);
+	}
+	U64 bytes = writer.GetBytesWritten();
+	bool ok = writer.Close();
+	double elapsed = Seconds(start);
+
+	std::cerr << num_transactions << " transactions, " << bytes << " bytes in " << elapsed << " s ("
+		<< (elapsed > 0 ? bytes / elapsed / 1e6 : 0) << " MB/s)" << std::endl;
+	if (!ok) {
+		std::cerr << "Could not write " << out_path << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+static int Pcap( const std::string& path, const std::string& out_path, const std::string& store_path )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+	StoringSink sink;
+	if (!sink.OpenStore(store_path))
+		return 1;
+	capture.Decode(sink);
+
+	MBusPcapWriter writer;
+	clock_t start = std::clock();
+	bool ok = writer.Open(out_path.c_str(), capture.GetSampleRate());
+	MBusTransaction transaction;
+	U64 num_transactions = sink.mStore.GetCount();
+	for (U64 i=0; ok && (i < num_transactions); i++) {
+		sink.mStore.GetTransaction(i, transaction);
+		writer.Write(transaction);
+	}
+	ok = writer.Close() && ok;
+	double elapsed = Seconds(start);
+
+	if (!ok) {
+		std::cerr << "Could not write " << out_path << std::endl;
+		return 1;
+	}
+	std::cerr << num_transactions << " packets, " << writer.GetBytesWritten() << " bytes in " << elapsed << " s ("
+		<< (elapsed > 0 ? writer.GetBytesWritten() / elapsed / 1e6 : 0) << " MB/s)" << std::endl;
+	return 0;
+}
+
+static int Listen( const std::string& path )
+{
+	MBusStreamListener listener;
+	if (!listener.Listen(path)) {
+		std::cerr << "Could not listen on " << path << std::endl;
+		return 1;
+	}
+
+	std::vector< char > buffer(1 << 16);
+	while (listener.Accept()) {
+		U64 lines = 0;
+		size_t length;
+		while ((length = listener.Read(&buffer[0], buffer.size())) != 0) {
+			lines += std::count(buffer.begin(), buffer.begin() + length, '\n');
+			std::fwrite(&buffer[0], 1, length, stdout);
+			std::fflush(stdout);
+		}
+		std::cerr << "Streamer disconnected after " << lines << " lines" << std::endl;
+	}
+	return 0;
+}
+
+// Streams transactions as they commit, like MBusAnalyzer
+class StreamingSink : public MBusDecoderSink
+{
+public:
+	StreamingSink( MBusTransactionStreamer& streamer ) : mStreamer( streamer ) {}
+
+	virtual void AddFrame( const MBusFrame& ) {}
+	virtual void CommitResults() {}
+	virtual void CommitTransaction( const MBusTransaction& transaction ) { mStreamer.Push( transaction ); }
+	virtual void ReportProgress( U64 ) {}
+
+	MBusTransactionStreamer& mStreamer;
+};
+
+static int Stream( const std::string& path, const std::string& socket_path )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+
+	MBusTransactionStreamer streamer;
+	streamer.Start(socket_path);
+	StreamingSink sink(streamer);
+	capture.Decode(sink);
+	streamer.Stop();
+
+	std::cerr << streamer.GetSent() << " sent, " << streamer.GetDropped() << " dropped" << std::endl;
+	return 0;
+}
+
+static int Latency( const std::string& path, U32 count, U32 per_second )
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+	CollectingSink collected;
+	capture.Decode(collected);
+	if (collected.mTransactions.empty()) {
+		std::cerr << "No transactions in " << path << std::endl;
+		return 1;
+	}
+
+	char socket_path[64];
+	std::snprintf(socket_path, sizeof(socket_path), "/tmp/mbus_latency.%d", (int) getpid());
+	MBusStreamListener listener;
+	if (!listener.Listen(socket_path)) {
+		std::cerr << "Could not listen on " << socket_path << std::endl;
+		return 1;
+	}
+
+	// Each replayed transaction carries its sequence number as its start
+	// sample, so the listener can match it to the time it was pushed
+	std::vector< Clock::time_point > pushed(count);
+	std::vector< double > latencies;
+	latencies.reserve(count);
+	std::thread consumer([&]() {
+		if (!listener.Accept())
+			return;
+		std::vector< char > buffer(1 << 16);
+		std::string partial;
+		size_t length;
+		while ((length = listener.Read(&buffer[0], buffer.size())) != 0) {
+			Clock::time_point now = Clock::now();
+			partial.append(&buffer[0], length);
+			size_t start = 0, end;
+			while ((end = partial.find('\n', start)) != std::string::npos) {
+				if (partial[start] != '#') {
+					U64 sequence = std::strtoull(partial.c_str() + start, NULL, 10);
+					if (sequence < pushed.size())
+						latencies.push_back(std::chrono::duration< double, std::micro >(now - pushed[sequence]).count());
+				}
+				start = end + 1;
+			}
+			partial.erase(0, start);
+		}
+	});
+
+	MBusTransactionStreamer streamer;
+	streamer.Start(socket_path);
+	while (streamer.GetSent() == 0) {
+		// Wait for the listener so startup isn't counted as latency
+		MBusTransaction hello = collected.mTransactions[0];
+		hello.mStartingSampleInclusive = count;
+		streamer.Push(hello);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	Clock::time_point begin = Clock::now();
+	MBusTransaction transaction;
+	for (U32 i=0; i < count; i++) {
+		if (per_second) {
+			Clock::time_point due = begin + std::chrono::nanoseconds((U64) i * 1000000000 / per_second);
+			while (Clock::now() < due)
+				;
+		}
+		transaction = collected.mTransactions[i % collected.mTransactions.size()];
+		transaction.mStartingSampleInclusive = i;
+		pushed[i] = Clock::now();
+		streamer.Push(transaction);
+	}
+	double elapsed = std::chrono::duration< double >(Clock::now() - begin).count();
+	streamer.Stop();
+	consumer.join();
+
+	std::sort(latencies.begin(), latencies.end());
+	std::printf("%u pushed in %.3f s (%.0f/s), %lu received, %lu dropped\n", count, elapsed, count / elapsed,
+		(unsigned long) latencies.size(), (unsigned long) streamer.GetDropped());
+	if (!latencies.empty()) {
+		std::printf("latency us: p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+			latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100],
+			latencies[latencies.size() * 999 / 1000], latencies.back());
+	}
+	return 0;
+}
+
+// True if the store gave back everything it keeps of a transaction
+static bool SameStored( const MBusTransaction& stored, const MBusTransaction& decoded )
+{
+	return SameDecode(decoded, stored) &&
+		(stored.mStartingSampleInclusive == decoded.mStartingSampleInclusive) &&
+		(stored.mEndingSampleInclusive == decoded.mEndingSampleInclusive) &&
+		(stored.mAddressSample == decoded.mAddressSample) &&
+		(stored.mDataSamples == decoded.mDataSamples) &&
+		(stored.mDataEndingSample == decoded.mDataEndingSample) &&
+		(memcmp(stored.mPhaseSamples, decoded.mPhaseSamples, sizeof(stored.mPhaseSamples)) == 0);
+}
+
+static bool SameFrame( const MBusFrame& a, const MBusFrame& b )
+{
+	return (a.mStartingSampleInclusive == b.mStartingSampleInclusive) &&
+		(a.mEndingSampleInclusive == b.mEndingSampleInclusive) &&
+		(a.mData1 == b.mData1) && (a.mData2 == b.mData2) &&
+		(a.mType == b.mType) && (a.mFlags == b.mFlags);
+}
+
+// Stamps data blocks with the id the store gives their message next, as
+// MBusResultsSink does, and keeps them to check against the store
+class BlockSink : public StoringSink
+{
+public:
+	virtual void AddFrame( const MBusFrame& frame )
+	{
+		if (frame.mType == FrameTypeDataBlock) {
+			mBlocks.push_back( frame );
+			mBlocks.back().mData1 = mStore.GetCount();
+		}
+		StoringSink::AddFrame( frame );
+	}
+
+	std::vector< MBusFrame > mBlocks;
+};
+
+static int Footprint( const std::vector< std::string >& paths )
+{
+	int failures = 0;
+	for (size_t i=0; i < paths.size(); i++) {
+		Capture capture;
+		if (!capture.Open(paths[i])) {
+			std::cerr << "Could not read capture " << paths[i] << std::endl;
+			failures++;
+			continue;
+		}
+
+		CollectingSink collected;
+		capture.Decode(collected);
+		StoringSink sink;
+		capture.Decode(sink);
+
+		// Compact mode keeps every frame but the data bytes, plus one block per message with data
+		BlockSink compact;
+		DecodeOptions options;
+		options.mCompact = true;
+		options.mRingNodes.push_back(capture.GetNodeCount());
+		options.mRingSinks.push_back(&compact);
+		capture.Decode(compact, options);
+		U64 blocks = compact.mBlocks.size();
+
+		U64 payload = 0;
+		U64 with_data = 0;
+		bool intact = collected.mTransactions.size() == sink.mStore.GetCount();
+		MBusTransaction stored;
+		for (size_t j=0; j < collected.mTransactions.size(); j++) {
+			const MBusTransaction& decoded = collected.mTransactions[j];
+			with_data += decoded.mData.empty() ? 0 : 1;
+			payload += decoded.mData.size();
+
+			if (!sink.mStore.GetTransaction(j, stored) || !SameStored(stored, decoded))
+				intact = false;
+		}
+
+		// Every stored message with data has exactly one block naming it. A
+		// message the decoder dropped leaves a block whose id falls on a
+		// record that doesn't cover it, as the bubble text checks.
+		U64 named = 0;
+		U64 orphans = 0;
+		for (size_t j=0; j < compact.mBlocks.size(); j++) {
+			const MBusFrame& block = compact.mBlocks[j];
+			MBusTransactionRecord record;
+			if (!compact.mStore.GetRecord(block.mData1, record) ||
+				(record.mStartingSampleInclusive > (U64) block.mStartingSampleInclusive) ||
+				((U64) block.mEndingSampleInclusive > record.mEndingSampleInclusive)) {
+				orphans++;
+			} else if (record.mNumBytes == block.mData2) {
+				named++;
+			}
+		}
+		bool blocks_intact = named == with_data;
+
+		U64 frame_bytes = sink.mFrames * sizeof(MBusFrame);
+		U64 compact_bytes = (sink.mFrames - sink.mDataFrames + blocks) * sizeof(MBusFrame) + sink.mStore.GetMemoryUsage();
+		U64 frame_data_bytes = sink.mDataFrames * sizeof(MBusFrame);
+		U64 store_bytes = sink.mStore.GetMemoryUsage();
+
+		std::printf("%s: %lu transactions, %lu payload bytes\n", paths[i].c_str(), (unsigned long) sink.mStore.GetCount(), (unsigned long) payload);
+		std::printf("  per-byte frames  %10lu bytes (%lu frames, %lu for data)\n", (unsigned long) frame_bytes, (unsigned long) sink.mFrames, (unsigned long) frame_data_bytes);
+		std::printf("  compact storage  %10lu bytes (%lu in the store)  %.1fx smaller\n", (unsigned long) compact_bytes, (unsigned long) store_bytes,
+			compact_bytes ? (double) frame_bytes / compact_bytes : 0.0);
+		if (orphans)
+			std::printf("  %lu data blocks of messages the decoder dropped\n", (unsigned long) orphans);
+		if (!intact) {
+			std::printf("  FAIL: stored transactions do not read back as decoded\n");
+			failures++;
+		}
+		if (!blocks_intact) {
+			std::printf("  FAIL: %lu of %lu messages with data have a data block naming them\n", (unsigned long) named, (unsigned long) with_data);
+			failures++;
+		}
+	}
+	return failures ? 1 : 0;
+}
+
+// Checks a second decode against what the store holds as it goes, so
+// nothing is kept in memory
+class VerifyingSink : public MBusDecoderSink
+{
+public:
+	VerifyingSink( MBusTransactionStore& store ) : mStore( store ), mTransactions( 0 ), mFrames( 0 ), mMismatches( 0 ) {}
+
+	virtual void AddFrame( const MBusFrame& frame )
+	{
+		MBusFrame stored;
+		if (!mStore.GetFrame( mFrames++, stored ) || !SameFrame( stored, frame ))
+			mMismatches++;
+	}
+	virtual void CommitResults() {}
+	virtual void CommitTransaction( const MBusTransaction& transaction )
+	{
+		if (!mStore.GetTransaction( mTransactions++, mStored ) || !SameStored( mStored, transaction ))
+			mMismatches++;
+	}
+	virtual void ReportProgress( U64 ) {}
+
+	MBusTransactionStore& mStore;
+	MBusTransaction mStored;
+	U64 mTransactions;
+	U64 mFrames;
+	U64 mMismatches;
+};
+
+static U64 RandomBelow( U64 limit )
+{
+	return limit ? (((U64) std::rand() << 31) ^ (U64) std::rand()) % limit : 0;
+}
+
+static int Store( const std::string& path, const std::string& store_path, U32 lookups )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+
+	StoringSink sink;
+	if (!sink.OpenStore(store_path))
+		return 1;
+	clock_t start = std::clock();
+	capture.Decode(sink);
+	double elapsed = Seconds(start);
+
+	MBusTransactionStore& store = sink.mStore;
+	U64 transactions = store.GetCount();
+	U64 frames = store.GetFrameCount();
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	std::printf("%s: %lu transactions, %lu frames in %.2f s\n", path.c_str(), (unsigned long) transactions, (unsigned long) frames, elapsed);
+	std::printf("  store file %lu bytes, %lu bytes of index in memory, peak resident %ld KiB\n",
+		(unsigned long) store.GetFileSize(), (unsigned long) store.GetMemoryUsage(), (long) usage.ru_maxrss);
+
+	// Lookups at random, each checked against its neighbour: the answer is
+	// in progress at (or after) the sample, the one before it is over
+	bool found = true;
+	U64 samples = capture.GetNumSamples();
+	MBusTransaction transaction;
+	MBusTransactionRecord record, before;
+	MBusFrame frame, previous;
+	start = std::clock();
+	for (U32 i=0; i < lookups; i++)
+		store.GetTransaction(RandomBelow(transactions), transaction);
+	double by_id = Seconds(start);
+	start = std::clock();
+	for (U32 i=0; i < lookups; i++)
+		store.GetFrame(RandomBelow(frames), frame);
+	double by_index = Seconds(start);
+	start = std::clock();
+	for (U32 i=0; i < lookups; i++) {
+		U64 sample = RandomBelow(samples);
+		U64 id = store.FindTransaction(sample);
+		if (store.GetRecord(id, record) && (record.mEndingSampleInclusive < sample))
+			found = false;
+		if (id && store.GetRecord(id - 1, before) && (before.mEndingSampleInclusive >= sample))
+			found = false;
+	}
+	double by_time = Seconds(start);
+	start = std::clock();
+	for (U32 i=0; i < lookups; i++) {
+		U64 sample = RandomBelow(samples);
+		U64 index = store.FindFrame(sample);
+		if (store.GetFrame(index, frame) && ((U64) frame.mEndingSampleInclusive < sample))
+			found = false;
+		if (index && store.GetFrame(index - 1, previous) && ((U64) previous.mEndingSampleInclusive >= sample))
+			found = false;
+	}
+	double frame_by_time = Seconds(start);
+	std::printf("  lookups in us: transaction %.2f, frame %.2f, transaction by time %.2f, frame by time %.2f\n",
+		lookups ? by_id * 1e6 / lookups : 0.0, lookups ? by_index * 1e6 / lookups : 0.0,
+		lookups ? by_time * 1e6 / lookups : 0.0, lookups ? frame_by_time * 1e6 / lookups : 0.0);
+
+	VerifyingSink verify(store);
+	capture.Decode(verify);
+	if ((verify.mTransactions != transactions) || (verify.mFrames != frames) || verify.mMismatches) {
+		std::printf("  FAIL: %lu stored transactions and frames do not read back as decoded\n", (unsigned long) verify.mMismatches);
+		return 1;
+	}
+	if (!found) {
+		std::printf("  FAIL: a lookup by time found the wrong transaction or frame\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int Convert( const std::string& in_path, const std::string& out_path )
+{
+	MBusTrace trace;
+	if (!ReadTrace(in_path, trace)) {
+		std::cerr << "Could not read trace " << in_path << std::endl;
+		return 1;
+	}
+	if (!SaveCapture(out_path, trace)) {
+		std::cerr << "Could not write " << out_path << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Every edge of a capture, whichever kind it is
+static void LoadTrace( Capture& capture, MBusTrace& trace )
+{
+	if (!capture.mIsEdgeFile) {
+		trace = capture.mTrace;
+		return;
+	}
+
+	const MBusEdgeFile& file = capture.mEdgeFile;
+	trace.mSampleRate = file.GetSampleRate();
+	trace.mNumSamples = file.GetNumSamples();
+	trace.mNodeCLKs.resize(file.GetNodeCount());
+	trace.mNodeDATs.resize(file.GetNodeCount());
+	for (U32 wire=0; wire < 2 * file.GetNodeCount(); wire++) {
+		MBusTraceChannel& channel = (wire & 1) ? trace.mNodeDATs[wire / 2] : trace.mNodeCLKs[wire / 2];
+		MBusEdgeFileReader reader;
+		reader.SetWire(file, wire);
+		channel.mInitialBitState = reader.GetBitState();
+		channel.mEdges.clear();
+		while (reader.GetSampleOfNextEdge() != ~0ULL) {
+			reader.AdvanceToNextEdge();
+			channel.mEdges.push_back(reader.GetSampleNumber());
+		}
+	}
+}
+
+// Cuts a capture into chunk files of the given length, as the monitoring
+// rig writes them: each starts at its own sample 0, one after the other
+static int Split( const std::string& path, double seconds, const std::string& prefix )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+	MBusTrace trace;
+	LoadTrace(capture, trace);
+
+	U64 length = (U64) (seconds * trace.mSampleRate);
+	if (length == 0) {
+		std::cerr << "Chunks must be at least a sample long" << std::endl;
+		return 1;
+	}
+
+	size_t wires = 2 * trace.mNodeCLKs.size();
+	std::vector< size_t > next( wires, 0 );
+	int chunks = 0;
+	for (U64 start = 0; start < trace.mNumSamples; start += length, chunks++) {
+		U64 end = std::min(start + length, trace.mNumSamples);
+
+		MBusTrace chunk;
+		chunk.mSampleRate = trace.mSampleRate;
+		chunk.mNumSamples = end - start;
+		chunk.mNodeCLKs.resize(trace.mNodeCLKs.size());
+		chunk.mNodeDATs.resize(trace.mNodeDATs.size());
+		for (size_t wire=0; wire < wires; wire++) {
+			const MBusTraceChannel& in = (wire & 1) ? trace.mNodeDATs[wire / 2] : trace.mNodeCLKs[wire / 2];
+			MBusTraceChannel& out = (wire & 1) ? chunk.mNodeDATs[wire / 2] : chunk.mNodeCLKs[wire / 2];
+			// An edge on a chunk's last sample is that chunk's, so the next starts after it
+			bool high = (in.mInitialBitState == BIT_HIGH) != ((next[wire] & 1) != 0);
+			out.mInitialBitState = high ? BIT_HIGH : BIT_LOW;
+			for ( ; (next[wire] < in.mEdges.size()) && (in.mEdges[next[wire]] <= end); next[wire]++)
+				out.mEdges.push_back(in.mEdges[next[wire]] - start);
+		}
+
+		char name[32];
+		std::snprintf(name, sizeof(name), "%06d.mbe", chunks);
+		if (!WriteEdgeFile(prefix + name, chunk)) {
+			std::cerr << "Could not write " << prefix + name << std::endl;
+			return 1;
+		}
+	}
+	std::cerr << chunks << " chunks" << std::endl;
+	return 0;
+}
+
+// Decodes chunk files in order as one capture, carrying the decoder state
+// across each boundary, and leaves the state in state_path for the next run
+static int Chunks( const std::string& state_path, const std::vector< std::string >& paths )
+{
+	MBusChunkState state;
+	FILE* existing = std::fopen(state_path.c_str(), "rb");
+	if (existing != NULL) {
+		std::fclose(existing);
+		if (!ReadChunkState(state_path, state)) {
+			std::cerr << "Could not read chunk state " << state_path << std::endl;
+			return 1;
+		}
+	}
+
+	CollectingSink sink;
+	U64 samples = 0;
+	double elapsed = 0.0;
+	for (size_t i=0; i < paths.size(); i++) {
+		MBusEdgeFile file;
+		if (!file.Open(paths[i])) {
+			std::cerr << "Could not read chunk " << paths[i] << std::endl;
+			return 1;
+		}
+		clock_t start = std::clock();
+		bool fits = DecodeChunk(file, state, sink);
+		elapsed += Seconds(start);
+		if (!fits) {
+			std::cerr << paths[i] << " does not follow on from the chunk before it" << std::endl;
+			return 1;
+		}
+		samples += file.GetNumSamples();
+	}
+
+	if (!WriteChunkState(state_path, state)) {
+		std::cerr << "Could not write " << state_path << std::endl;
+		return 1;
+	}
+
+	size_t carried = 0;
+	for (size_t wire=0; wire < state.mCarry.size(); wire++)
+		carried += state.mCarry[wire].size();
+	WriteTransactions(std::cout, sink.mTransactions);
+	std::cerr << sink.mTransactions.size() << " transactions, " << samples << " samples in "
+		<< elapsed << " s (" << (elapsed > 0 ? samples / elapsed / 1e6 : 0) << " Msamples/s); "
+		<< carried << " edges carried to the next chunk" << std::endl;
+	return 0;
+}
+
+static bool HasExtension( const std::string& path, const char* extension )
+{
+	size_t length = std::strlen(extension);
+	return (path.size() > length) && (path.compare(path.size() - length, length, extension) == 0);
+}
+
+static int Import( const std::string& in_path, const std::string& out_path, const std::vector< std::string >& wires, U32 sample_rate, U32 bytes_per_sample )
+{
+	MBusTrace trace;
+	std::string error;
+	bool vcd = HasExtension(in_path, ".vcd");
+	bool raw = HasExtension(in_path, ".bin") || HasExtension(in_path, ".raw");
+	if (!vcd && (sample_rate == 0))
+		sample_rate = 10000000;
+
+	clock_t start = std::clock();
+	bool ok;
+	if (raw) {
+		// Raw dumps name wires by probe bit; default to every bit in order
+		std::vector< U32 > wire_bits;
+		for (size_t i=0; i < wires.size(); i++)
+			wire_bits.push_back(std::strtoul(wires[i].c_str(), NULL, 0));
+		for (U32 bit=0; wires.empty() && (bit < bytes_per_sample * 8); bit++)
+			wire_bits.push_back(bit);
+		ok = ImportRawSamples(in_path, bytes_per_sample, wire_bits, sample_rate, trace, error);
+	} else if (vcd) {
+		ok = ImportVcd(in_path, wires, sample_rate, trace, error);
+	} else {
+		ok = ImportSaleaeCsv(in_path, wires, sample_rate, trace, error);
+	}
+	double elapsed = Seconds(start);
+	if (!ok) {
+		std::cerr << "Could not import " << in_path << ": " << error << std::endl;
+		return 1;
+	}
+
+	U64 num_edges = 0;
+	for (size_t i=0; i < trace.mNodeCLKs.size(); i++)
+		num_edges += trace.mNodeCLKs[i].mEdges.size() + trace.mNodeDATs[i].mEdges.size();
+	std::cerr << trace.mNodeCLKs.size() << " nodes, " << num_edges << " edges, " << trace.mNumSamples << " samples at "
+		<< trace.mSampleRate << " Hz, parsed in " << elapsed << " s" << std::endl;
+
+	if (!SaveCapture(out_path, trace)) {
+		std::cerr << "Could not write " << out_path << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Samples/sec decoding capture over and over for at least a tenth of a second
+static double TimeDecode( Capture& capture, const DecodeOptions& options )
+{
+	double samples = 0.0;
+	clock_t start = std::clock();
+	do {
+		CollectingSink sink;
+		capture.Decode(sink, options);
+		samples += capture.GetNumSamples();
+	} while (Seconds(start) < 0.1);
+	return samples / Seconds(start);
+}
+
+static int Bench( const std::vector< std::string >& paths )
+{
+	int failures = 0;
+	for (size_t i=0; i < paths.size(); i++) {
+		Capture capture;
+		if (!capture.Open(paths[i])) {
+			std::cerr << "Could not read capture " << paths[i] << std::endl;
+			return 1;
+		}
+
+		CollectingSink generic, specialized;
+		capture.Decode(generic, DecodeOptions(false));
+		capture.Decode(specialized, DecodeOptions(true));
+		bool same = generic.mTransactions.size() == specialized.mTransactions.size();
+		for (size_t j=0; same && (j < generic.mTransactions.size()); j++)
+			same = SameDecode(generic.mTransactions[j], specialized.mTransactions[j]);
+		if (!same) {
+			std::cerr << "FAIL " << paths[i] << ": generic and specialized decodes differ" << std::endl;
+			failures++;
+			continue;
+		}
+
+		// Alternate and keep the best of each, so a noisy moment hits both
+		double generic_rate = 0.0, specialized_rate = 0.0;
+		for (int round = 0; round < 7; round++) {
+			generic_rate = std::max(generic_rate, TimeDecode(capture, DecodeOptions(false)));
+			specialized_rate = std::max(specialized_rate, TimeDecode(capture, DecodeOptions(true)));
+		}
+		std::printf("%-24s %2u nodes  generic %8.1f  specialized %8.1f Msamples/s  (%+.1f%%)\n",
+			paths[i].c_str(), capture.GetNodeCount(), generic_rate / 1e6, specialized_rate / 1e6,
+			(specialized_rate / generic_rate - 1.0) * 100);
+	}
+	return failures ? 1 : 0;
+}
+
+// True if the C interface handed back everything the decoder committed
+static bool SameRecord( const mbus_transaction& record, const MBusTransaction& transaction )
+{
+	size_t length = transaction.mData.size();
+	return (record.start_sample == transaction.mStartingSampleInclusive) &&
+		(record.end_sample == transaction.mEndingSampleInclusive) &&
+		(record.address_sample == transaction.mAddressSample) &&
+		(record.data_end_sample == transaction.mDataEndingSample) &&
+		(record.address == transaction.mAddress) && (record.address_bits == transaction.mAddressBits) &&
+		(record.requesters == transaction.mRequesters) &&
+		(record.arbitration_winner == transaction.mArbitrationWinner) &&
+		(record.priority_winner == transaction.mPriorityWinner) &&
+		(record.transmitter == transaction.mTransmitter) &&
+		((record.cb0 != 0) == transaction.mCB0) && ((record.cb1 != 0) == transaction.mCB1) &&
+		(record.flags == transaction.mFlags) &&
+		(record.data_length == length) &&
+		((length == 0) || ((memcmp(record.data, &transaction.mData[0], length) == 0) &&
+			(memcmp(record.data_samples, &transaction.mDataSamples[0], length * sizeof(U64)) == 0))) &&
+		(memcmp(record.phase_samples, transaction.mPhaseSamples, sizeof(record.phase_samples)) == 0);
+}
+
+// Samples/sec decoding the wires through the C interface and reading every
+// transaction and payload byte back, over and over for a tenth of a second
+static double TimeCApi( mbus_decoder* decoder, const std::vector< mbus_wire >& wires, U64 num_samples, U64& checksum )
+{
+	double samples = 0.0;
+	clock_t start = std::clock();
+	do {
+		mbus_decode_edges(decoder, &wires[0], (uint32_t) wires.size(), num_samples);
+		const mbus_transaction* record;
+		while ((record = mbus_next_transaction(decoder)) != NULL)
+			for (uint64_t i=0; i < record->data_length; i++)
+				checksum += record->data[i];
+		samples += num_samples;
+	} while (Seconds(start) < 0.1);
+	return samples / Seconds(start);
+}
+
+// Decodes each capture through the C interface, as a tool loading the
+// shared library would, checks it hands back what the decoder committed,
+// and times it against decoding into a CollectingSink
+static int CApi( const std::vector< std::string >& paths )
+{
+	int failures = 0;
+	for (size_t i=0; i < paths.size(); i++) {
+		Capture capture;
+		if (!capture.Open(paths[i])) {
+			std::cerr << "Could not read capture " << paths[i] << std::endl;
+			return 1;
+		}
+		MBusTrace trace;
+		LoadTrace(capture, trace);
+
+		// The trace's own edge arrays, read in place
+		std::vector< mbus_wire > wires(2 * trace.mNodeCLKs.size());
+		for (size_t wire=0; wire < wires.size(); wire++) {
+			const MBusTraceChannel& channel = (wire & 1) ? trace.mNodeDATs[wire / 2] : trace.mNodeCLKs[wire / 2];
+			wires[wire].edges = channel.mEdges.empty() ? NULL : reinterpret_cast< const uint64_t* >(&channel.mEdges[0]);
+			wires[wire].edge_count = channel.mEdges.size();
+			wires[wire].initial_level = (channel.mInitialBitState == BIT_HIGH) ? 1 : 0;
+			wires[wire].reserved = 0;
+		}
+
+		mbus_decoder* decoder = mbus_decoder_create((uint32_t) trace.mNodeCLKs.size());
+		if (decoder == NULL) {
+			std::cerr << "FAIL " << paths[i] << ": no decoder for " << trace.mNodeCLKs.size() << " nodes" << std::endl;
+			failures++;
+			continue;
+		}
+		int status = mbus_decode_edges(decoder, &wires[0], (uint32_t) wires.size(), trace.mNumSamples);
+		CollectingSink native;
+		DecodeTrace(trace, native);
+
+		uint64_t count = 0;
+		const mbus_transaction* records = mbus_get_transactions(decoder, &count);
+		bool same = (status == MBUS_OK) && (count == native.mTransactions.size());
+		for (size_t j=0; same && (j < count); j++)
+			same = SameRecord(records[j], native.mTransactions[j]);
+		if (!same) {
+			std::cerr << "FAIL " << paths[i] << ": C interface and decoder differ " << mbus_decoder_error(decoder) << std::endl;
+			mbus_decoder_destroy(decoder);
+			failures++;
+			continue;
+		}
+
+		// Once its buffers have grown, a decoder only allocates to start over
+		U64 allocations = gAllocations.load();
+		mbus_decode_edges(decoder, &wires[0], (uint32_t) wires.size(), trace.mNumSamples);
+		allocations = gAllocations.load() - allocations;
+
+		// Alternate and keep the best of each, so a noisy moment hits both
+		U64 checksum = 0;
+		double capi_rate = 0.0, native_rate = 0.0;
+		for (int round = 0; round < 7; round++) {
+			capi_rate = std::max(capi_rate, TimeCApi(decoder, wires, trace.mNumSamples, checksum));
+			double samples = 0.0;
+			clock_t start = std::clock();
+			do {
+				CollectingSink sink;
+				DecodeTrace(trace, sink);
+				samples += trace.mNumSamples;
+			} while (Seconds(start) < 0.1);
+			native_rate = std::max(native_rate, samples / Seconds(start));
+		}
+		mbus_decoder_destroy(decoder);
+
+		std::printf("%-24s %2u nodes  %7llu transactions  C %8.1f  native %8.1f Msamples/s  (%+.1f%%)  %llu allocations per decode\n",
+			paths[i].c_str(), (unsigned) trace.mNodeCLKs.size(), (unsigned long long) count, capi_rate / 1e6, native_rate / 1e6,
+			(capi_rate / native_rate - 1.0) * 100, (unsigned long long) allocations);
+	}
+	return failures ? 1 : 0;
+}
+
+static int Propagation( const std::string& path )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+
+	MBusPropagationProfile profile;
+	profile.Initialize(capture.GetNodeCount());
+	DecodeOptions profiled;
+	profiled.mPropagation = &profile;
+	CollectingSink sink;
+	capture.Decode(sink, profiled);
+	WritePropagationProfile(std::cout, profile, capture.GetSampleRate());
+
+	// What profiling costs, best of each as in bench
+	double plain_rate = 0.0, profiled_rate = 0.0;
+	for (int round = 0; round < 7; round++) {
+		plain_rate = std::max(plain_rate, TimeDecode(capture, DecodeOptions()));
+		profile.Initialize(capture.GetNodeCount());
+		profiled_rate = std::max(profiled_rate, TimeDecode(capture, profiled));
+	}
+	std::fprintf(stderr, "%u nodes  plain %.1f  profiled %.1f Msamples/s  (%+.1f%%)\n", capture.GetNodeCount(),
+		plain_rate / 1e6, profiled_rate / 1e6, (profiled_rate / plain_rate - 1.0) * 100);
+	return 0;
+}
+
+// Collects one ring's transactions, and counts frames that start before
+// one already handed to any ring's sink
+class RingSink : public CollectingSink
+{
+public:
+	RingSink( S64& latest, U64& out_of_order ) : mLatest( latest ), mOutOfOrder( out_of_order ), mProgress( 0 ) {}
+
+	virtual void AddFrame( const MBusFrame& frame )
+	{
+		if (frame.mStartingSampleInclusive < mLatest)
+			mOutOfOrder++;
+		else
+			mLatest = frame.mStartingSampleInclusive;
+	}
+	virtual void ReportProgress( U64 ) { mProgress++; }
+
+	S64& mLatest;
+	U64& mOutOfOrder;
+	U64 mProgress;
+};
+
+static bool ParseRings( const std::string& list, std::vector< U32 >& nodes )
+{
+	std::istringstream counts(list);
+	std::string count;
+	nodes.clear();
+	while (std::getline(counts, count, ',')) {
+		U32 node_count = (U32) std::strtoul(count.c_str(), NULL, 0);
+		if ((node_count < 2) || (node_count > MBUS_DECODER_MAX_NODES))
+			return false;
+		nodes.push_back(node_count);
+	}
+	return !nodes.empty();
+}
+
+// Seconds to decode every ring, in one pass for all of them if together,
+// else a pass each, averaged over at least a tenth of a second
+static double TimeRings( Capture& capture, const std::vector< U32 >& nodes, bool together )
+{
+	int passes = 0;
+	clock_t start = std::clock();
+	do {
+		std::vector< CollectingSink > sinks(nodes.size());
+		DecodeOptions options;
+		options.mRingNodes = nodes;
+		options.mRingSinks.assign(nodes.size(), NULL);
+		for (size_t i=0; i < nodes.size(); i++) {
+			options.mRingSinks[i] = &sinks[i];
+			if (!together) {
+				capture.Decode(sinks[i], options);
+				options.mRingSinks[i] = NULL;
+			}
+		}
+		if (together)
+			capture.Decode(sinks[0], options);
+		passes++;
+	} while (Seconds(start) < 0.1);
+	return Seconds(start) / passes;
+}
+
+// Decodes a capture as several independent rings, all in one pass and then
+// each on its own, and checks every ring got the same transactions both ways
+static int Rings( const std::string& path, const std::string& list )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+	std::vector< U32 > nodes;
+	U32 node_count = 0;
+	if (ParseRings(list, nodes))
+		for (size_t i=0; i < nodes.size(); i++)
+			node_count += nodes[i];
+	if (node_count != capture.GetNodeCount()) {
+		std::cerr << "Rings must split the capture's " << capture.GetNodeCount() << " nodes, 2 to "
+			<< MBUS_DECODER_MAX_NODES << " each" << std::endl;
+		return 1;
+	}
+
+	S64 latest = 0;
+	U64 out_of_order = 0;
+	std::vector< RingSink > together(nodes.size(), RingSink(latest, out_of_order));
+	DecodeOptions options;
+	options.mRingNodes = nodes;
+	for (size_t i=0; i < nodes.size(); i++)
+		options.mRingSinks.push_back(&together[i]);
+	capture.Decode(together[0], options);
+
+	int failures = 0;
+	for (size_t i=0; i < nodes.size(); i++) {
+		S64 alone_latest = 0;
+		U64 alone_out_of_order = 0;
+		RingSink alone(alone_latest, alone_out_of_order);
+		DecodeOptions alone_options;
+		alone_options.mRingNodes = nodes;
+		alone_options.mRingSinks.assign(nodes.size(), NULL);
+		alone_options.mRingSinks[i] = &alone;
+		capture.Decode(alone, alone_options);
+
+		const std::vector< MBusTransaction >& a = together[i].mTransactions;
+		const std::vector< MBusTransaction >& b = alone.mTransactions;
+		bool same = a.size() == b.size();
+		for (size_t j=0; same && (j < a.size()); j++)
+			same = SameStored(a[j], b[j]);
+		std::printf("ring %u: %u nodes, %u transactions%s\n", (unsigned) i, nodes[i], (unsigned) a.size(),
+			same ? "" : ", differs from decoding the ring alone");
+		if (!same)
+			failures++;
+		// Logic's progress bar hangs on these, with one ring or several
+		if (!together[i].mProgress || !alone.mProgress) {
+			std::printf("ring %u: no progress reported%s\n", (unsigned) i, alone.mProgress ? "" : " on its own");
+			failures++;
+		}
+	}
+	if (out_of_order) {
+		std::printf("%llu frames out of order\n", (unsigned long long) out_of_order);
+		failures++;
+	}
+
+	// Alternate and keep the best of each, so a noisy moment hits both
+	double one_pass = 0.0, ring_by_ring = 0.0;
+	for (int round = 0; round < 7; round++) {
+		double seconds = TimeRings(capture, nodes, true);
+		one_pass = round ? std::min(one_pass, seconds) : seconds;
+		seconds = TimeRings(capture, nodes, false);
+		ring_by_ring = round ? std::min(ring_by_ring, seconds) : seconds;
+	}
+	std::printf("one pass %.1f ms, ring by ring %.1f ms (%.2fx)\n", one_pass * 1e3, ring_by_ring * 1e3, ring_by_ring / one_pass);
+	return failures ? 1 : 0;
+}
+
+// Puts captures side by side as one, each one's nodes after the last's, to
+// make multi-ring captures out of single-ring ones
+static int Join( const std::vector< std::string >& paths, const std::string& out_path )
+{
+	MBusTrace joined;
+	joined.mSampleRate = 0;
+	joined.mNumSamples = 0;
+	for (size_t i=0; i < paths.size(); i++) {
+		Capture capture;
+		if (!capture.Open(paths[i])) {
+			std::cerr << "Could not read capture " << paths[i] << std::endl;
+			return 1;
+		}
+		MBusTrace trace;
+		LoadTrace(capture, trace);
+		if (i && (trace.mSampleRate != joined.mSampleRate)) {
+			std::cerr << paths[i] << " is not at " << joined.mSampleRate << " samples/s" << std::endl;
+			return 1;
+		}
+		joined.mSampleRate = trace.mSampleRate;
+		joined.mNumSamples = std::max(joined.mNumSamples, trace.mNumSamples);
+		joined.mNodeCLKs.insert(joined.mNodeCLKs.end(), trace.mNodeCLKs.begin(), trace.mNodeCLKs.end());
+		joined.mNodeDATs.insert(joined.mNodeDATs.end(), trace.mNodeDATs.begin(), trace.mNodeDATs.end());
+	}
+	if (!SaveCapture(out_path, joined)) {
+		std::cerr << "Could not write " << out_path << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Keeps every transaction and checkpoint of a full decode
+class CheckpointingSink : public CollectingSink
+{
+public:
+	virtual void CommitCheckpoint( const MBusDecoderCheckpoint& checkpoint ) { mCheckpoints.push_back( checkpoint ); }
+
+	std::vector< MBusDecoderCheckpoint > mCheckpoints;
+};
+
+// Keeps the transactions that start in [start, end] and stops the decode
+// at the first one past it
+class RegionSink : public CollectingSink
+{
+public:
+	RegionSink( U64 start, U64 end ) : mStart( start ), mEnd( end ) {}
+
+	virtual void CommitTransaction( const MBusTransaction& transaction )
+	{
+		if (transaction.mStartingSampleInclusive > mEnd)
+			throw MBusEndOfData();
+		if (transaction.mStartingSampleInclusive >= mStart)
+			mTransactions.push_back( transaction );
+	}
+
+	U64 mStart;
+	U64 mEnd;
+};
+
+static int Region( const std::string& path, double start_s, double end_s, U32 interval )
+{
+	Capture capture;
+	if (!capture.Open(path)) {
+		std::cerr << "Could not read capture " << path << std::endl;
+		return 1;
+	}
+	U64 start = (U64) (start_s * capture.GetSampleRate());
+	U64 end = (U64) (end_s * capture.GetSampleRate());
+
+	DecodeOptions options;
+	options.mCheckpointInterval = interval;
+	CheckpointingSink full;
+	clock_t full_start = std::clock();
+	capture.Decode(full, options);
+	double full_elapsed = Seconds(full_start);
+
+	// The last checkpoint before the region; a transaction starting at or
+	// after start begins after it
+	const MBusDecoderCheckpoint* from = NULL;
+	for (size_t i=0; (i < full.mCheckpoints.size()) && (full.mCheckpoints[i].mSample < start); i++)
+		from = &full.mCheckpoints[i];
+
+	RegionSink region( start, end );
+	DecodeOptions resume;
+	resume.mResume = from;
+	clock_t region_start = std::clock();
+	capture.Decode(region, resume);
+	double region_elapsed = Seconds(region_start);
+
+	// Same answer as the full decode gave for those transactions
+	std::vector< MBusTransaction > expected;
+	for (size_t i=0; i < full.mTransactions.size(); i++) {
+		U64 sample = full.mTransactions[i].mStartingSampleInclusive;
+		if ((sample >= start) && (sample <= end))
+			expected.push_back(full.mTransactions[i]);
+	}
+	bool same = expected.size() == region.mTransactions.size();
+	for (size_t i=0; same && (i < expected.size()); i++)
+		same = SameDecode(expected[i], region.mTransactions[i]);
+
+	WriteTransactions(std::cout, region.mTransactions);
+	std::cerr << full.mTransactions.size() << " transactions, " << full.mCheckpoints.size() << " checkpoints ("
+		<< full.mCheckpoints.size() * sizeof(MBusDecoderCheckpoint) << " bytes) in " << full_elapsed << " s; "
+		<< region.mTransactions.size() << " in the region from the checkpoint at "
+		<< (from ? (double) from->mSample / capture.GetSampleRate() : 0.0) << " s in " << region_elapsed << " s" << std::endl;
+	if (!same) {
+		std::cerr << "FAIL: resuming from the checkpoint decoded the region differently" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+static int Usage()
+{
+	std::fprintf(stderr,
+		"usage: mbus_decode simulate <scenario> [-n nodes] [-t seconds] [-r rate]\n"
+		"       mbus_decode fuzz [-n nodes] [-s seed] [-i iterations] [-f fault,...] [-r rate]\n"
+		"       mbus_decode allocs <scenario> [-n nodes] [-t seconds] [-r rate] [-i count]\n"
+		"       mbus_decode record <scenario> <capture> [-n nodes] [-t seconds] [-r rate]\n"
+		"       mbus_decode decode <capture>\n"
+		"       mbus_decode convert <trace> <capture>\n"
+		"       mbus_decode split <capture> <seconds> <prefix>\n"
+		"       mbus_decode chunks <state> <chunk>...\n"
+		"       mbus_decode import <csv|vcd|bin> <capture> [-w wire,...] [-r rate] [-B bytes]\n"
+		"       mbus_decode query <capture> [address] [-S store]\n"
+		"       mbus_decode stats <capture> [-S store]\n"
+		"       mbus_decode efficiency <capture> [-S store]\n"
+		"       mbus_decode timeline <capture> [-W bin_us] [-L max_bins]\n"
+		"       mbus_decode messages <capture> [records]\n"
+		"       mbus_decode json <capture> <output> [-S store]\n"
+		"       mbus_decode pcap <capture> <output> [-S store]\n"
+		"       mbus_decode listen <socket>\n"
+		"       mbus_decode stream <capture> <socket>\n"
+		"       mbus_decode latency <capture> [-i count] [-p per_second]\n"
+		"       mbus_decode footprint <capture>...\n"
+		"       mbus_decode store <capture> <store> [-i lookups]\n"
+		"       mbus_decode bench <capture>...\n"
+		"       mbus_decode capi <capture>...\n"
+		"       mbus_decode propagation <capture>\n"
+		"       mbus_decode rings <capture> <nodes,nodes,...>\n"
+		"       mbus_decode join <capture>... <output>\n"
+		"       mbus_decode region <capture> <start_s> <end_s> [-i interval]\n"
+		"       mbus_decode check [-b baseline] [-m margin] [-u] <capture>...\n");
+	return 2;
+}
+
+int main( int argc, char* argv[] )
+{
+	if (argc < 2)
+		return Usage();
+
+	std::string mode = argv[1];
+	std::vector< std::string > positional;
+	int node_count = 3;
+	double seconds = 1.0;
+	U32 seed = 1;
+	U32 iterations = 1000;
+	U32 fault_mask = 0;
+	U32 sample_rate = 10000000;
+	bool sample_rate_given = false;
+	U32 bytes_per_sample = 1;
+	std::vector< std::string > wires;
+	std::string baseline;
+	double margin = 0.10;
+	bool update = false;
+	U32 bin_us = 10000;
+	U32 per_second = 10000;
+	U64 max_bins = 0;
+	std::string store_path;
+
+	for (int arg = 2; arg < argc; arg++) {
+		std::string flag = argv[arg];
+		if ((flag.size() < 2) || (flag[0] != '-')) {
+			positional.push_back(flag);
+			continue;
+		}
+		if (flag == "-u") {
+			update = true;
+			continue;
+		}
+		if (arg + 1 >= argc)
+			return Usage();
+
+		const char* value = argv[++arg];
+		if (flag == "-n")
+			node_count = std::atoi(value);
+		else if (flag == "-t")
+			seconds = std::atof(value);
+		else if (flag == "-s")
+			seed = std::strtoul(value, NULL, 0);
+		else if (flag == "-i")
+			iterations = std::strtoul(value, NULL, 0);
+		else if (flag == "-r") {
+			sample_rate = std::strtoul(value, NULL, 0);
+			sample_rate_given = true;
+		} else if (flag == "-B") {
+			bytes_per_sample = std::strtoul(value, NULL, 0);
+		} else if (flag == "-w") {
+			std::istringstream list(value);
+			std::string wire;
+			while (std::getline(list, wire, ','))
+				wires.push_back(wire);
+		}
+		else if (flag == "-b")
+			baseline = value;
+		else if (flag == "-m")
+			margin = std::atof(value);
+		else if (flag == "-p")
+			per_second = std::strtoul(value, NULL, 0);
+		else if (flag == "-W")
+			bin_us = std::strtoul(value, NULL, 0);
+		else if (flag == "-L")
+			max_bins = std::strtoull(value, NULL, 0);
+		else if (flag == "-S")
+			store_path = value;
+		else if ((flag != "-f") || !ParseFaults(value, fault_mask))
+			return Usage();
+	}
+	if ((node_count < 1) || (node_count > 32))
+		return Usage();
+
+	if ((mode == "simulate") && (positional.size() == 1))
+		return Simulate(positional[0], node_count, seconds, sample_rate);
+	if ((mode == "fuzz") && positional.empty())
+		return FuzzDecoder(node_count, seed, iterations, fault_mask, sample_rate);
+	if ((mode == "allocs") && (positional.size() == 1))
+		return CountAllocations(positional[0], node_count, seconds, sample_rate, iterations, gAllocations);
+	if ((mode == "record") && (positional.size() == 2))
+		return Record(positional[0], positional[1], node_count, seconds, sample_rate);
+	if ((mode == "decode") && (positional.size() == 1))
+		return Decode(positional[0]);
+	if ((mode == "convert") && (positional.size() == 2))
+		return Convert(positional[0], positional[1]);
+	if ((mode == "split") && (positional.size() == 3))
+		return Split(positional[0], std::atof(positional[1].c_str()), positional[2]);
+	if ((mode == "chunks") && (positional.size() >= 2))
+		return Chunks(positional[0], std::vector< std::string >(positional.begin() + 1, positional.end()));
+	if ((mode == "import") && (positional.size() == 2))
+		return Import(positional[0], positional[1], wires, sample_rate_given ? sample_rate : 0, bytes_per_sample);
+	if ((mode == "query") && ((positional.size() == 1) || (positional.size() == 2)))
+		return Query(positional[0], (positional.size() == 2) ? positional[1] : "", store_path);
+	if ((mode == "stats") && (positional.size() == 1))
+		return Stats(positional[0], store_path);
+	if ((mode == "efficiency") && (positional.size() == 1))
+		return Efficiency(positional[0], store_path);
+	if ((mode == "timeline") && (positional.size() == 1) && (bin_us > 0))
+		return Timeline(positional[0], bin_us, max_bins);
+	if ((mode == "messages") && ((positional.size() == 1) || (positional.size() == 2)))
+		return Messages(positional[0], (positional.size() == 2) ? positional[1] : "");
+	if ((mode == "json") && (positional.size() == 2))
+		return Json(positional[0], positional[1], store_path);
+	if ((mode == "pcap") && (positional.size() == 2))
+		return Pcap(positional[0], positional[1], store_path);
+	if ((mode == "listen") && (positional.size() == 1))
+		return Listen(positional[0]);
+	if ((mode == "stream") && (positional.size() == 2))
+		return Stream(positional[0], positional[1]);
+	if ((mode == "latency") && (positional.size() == 1))
+		return Latency(positional[0], iterations, per_second);
+	if ((mode == "footprint") && !positional.empty())
+		return Footprint(positional);
+	if ((mode == "store") && (positional.size() == 2))
+		return Store(positional[0], positional[1], iterations);
+	if ((mode == "bench") && !positional.empty())
+		return Bench(positional);
+	if ((mode == "capi") && !positional.empty())
+		return CApi(positional);
+	if ((mode == "propagation") && (positional.size() == 1))
+		return Propagation(positional[0]);
+	if ((mode == "rings") && (positional.size() == 2))
+		return Rings(positional[0], positional[1]);
+	if ((mode == "join") && (positional.size() >= 3))
+		return Join(std::vector< std::string >(positional.begin(), positional.end() - 1), positional.back());
+	if ((mode == "region") && (positional.size() == 3) && (iterations > 0))
+		return Region(positional[0], std::atof(positional[1].c_str()), std::atof(positional[2].c_str()), iterations);
+	if ((mode == "check") && !positional.empty())
+		return CheckCorpus(positional, baseline, margin, update);
+	return Usage();
+}